@@ -0,0 +1,55 @@
+/*
+ *
+ * Copyright 2014 Flavio Negrão Torres
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#import <Foundation/Foundation.h>
+
+@class APBlobStore;
+
+/**
+ Value of a binary attribute whose remote file may not have been downloaded yet. Objects faulted in hold it
+ instead of the data, so fetching them doesn't download anything and saving them keeps the reference as it is.
+
+ The file is downloaded by the blob store download queue: -loadInBackground starts it (the incremental store
+ does it when the object is first read), reading the bytes waits for it. If the download fails the data is
+ empty and loadingError tells why, another -load: tries again.
+ */
+@interface APBlobData : NSData
+
+/**
+ Designated Initializer
+ @param reference remote reference returned by -[APBlobStore referenceForRemoteFileURL:].
+ @param blobStore where the file is downloaded to.
+ */
+- (instancetype) initWithReference:(NSData*) reference
+                         blobStore:(APBlobStore*) blobStore;
+
+/// What the cache store keeps for this value.
+@property (nonatomic, strong, readonly) NSData* reference;
+
+/// YES once downloaded, reading the bytes doesn't wait then.
+@property (nonatomic, readonly, getter = isLoaded) BOOL loaded;
+
+/// Why the last download failed, nil if it hasn't.
+@property (nonatomic, strong, readonly) NSError* loadingError;
+
+/// Starts the download unless it is loaded or being loaded already. Returns immediately.
+- (void) loadInBackground;
+
+/// Waits for the download, @returns NO if it has failed.
+- (BOOL) load:(NSError *__autoreleasing*) error;
+
+@end
@@ -0,0 +1,166 @@
+/*
+ *
+ * Copyright 2014 Flavio Negrão Torres
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#import "APBlobData.h"
+
+#import "APBlobStore.h"
+#import "NSLogEmoji.h"
+#import "APCommon.h"
+
+
+@interface APBlobData ()
+
+@property (nonatomic, strong) NSData* reference;
+@property (nonatomic, weak) APBlobStore* blobStore;
+
+// All of them synchronized on self
+@property (nonatomic, strong) NSData* data;
+@property (nonatomic, strong) NSError* loadingError;
+@property (nonatomic, strong) dispatch_group_t loadingGroup;
+
+@end
+
+
+@implementation APBlobData
+
+- (instancetype) initWithReference:(NSData*) reference
+                         blobStore:(APBlobStore*) blobStore {
+
+    self = [super init];
+    if (self) {
+        _reference = [reference copy];
+        _blobStore = blobStore;
+    }
+    return self;
+}
+
+
+#pragma mark - Loading
+
+- (BOOL) isLoaded {
+
+    @synchronized(self) {
+        return (self.data != nil);
+    }
+}
+
+
+- (NSError*) loadingError {
+
+    @synchronized(self) {
+        return _loadingError;
+    }
+}
+
+
+- (void) loadInBackground {
+
+    [self loadingGroupStartingIfNeeded];
+}
+
+
+- (BOOL) load:(NSError *__autoreleasing*) error {
+
+    dispatch_group_t loadingGroup = [self loadingGroupStartingIfNeeded];
+    if (loadingGroup) {
+        dispatch_group_wait(loadingGroup, DISPATCH_TIME_FOREVER);
+    }
+
+    @synchronized(self) {
+        if (!self.data) {
+            if (error) *error = self.loadingError;
+            return NO;
+        }
+        return YES;
+    }
+}
+
+
+// nil if loaded already
+- (dispatch_group_t) loadingGroupStartingIfNeeded {
+
+    APBlobStore* blobStore = self.blobStore;
+    dispatch_group_t loadingGroup;
+
+    @synchronized(self) {
+        if (self.data || self.loadingGroup) {
+            return self.loadingGroup;
+        }
+
+        if (!blobStore) {
+            self.loadingError = [NSError errorWithDomain:NSCocoaErrorDomain code:NSUserCancelledError userInfo:nil];
+            return nil;
+        }
+
+        loadingGroup = dispatch_group_create();
+        self.loadingGroup = loadingGroup;
+        self.loadingError = nil;
+        dispatch_group_enter(loadingGroup);
+    }
+
+    [blobStore dataForReference:self.reference completion:^(NSData* data, NSError* loadingError) {
+        if (!data) {
+            if (AP_DEBUG_ERRORS) { ELog(@"Error loading %@: %@",[[NSString alloc]initWithData:self.reference encoding:NSUTF8StringEncoding],loadingError)}
+        }
+        @synchronized(self) {
+            self.data = data;
+            self.loadingError = (data) ? nil : loadingError ?: [NSError errorWithDomain:NSCocoaErrorDomain code:NSUserCancelledError userInfo:nil];
+            self.loadingGroup = nil;
+        }
+        dispatch_group_leave(loadingGroup);
+    }];
+
+    return loadingGroup;
+}
+
+
+#pragma mark - NSData
+
+- (NSUInteger) length {
+
+    [self load:nil];
+    @synchronized(self) {
+        return [self.data length];
+    }
+}
+
+
+- (const void*) bytes {
+
+    [self load:nil];
+    @synchronized(self) {
+        return [self.data bytes];
+    }
+}
+
+
+// Same reference, same content, no need to load them.
+- (BOOL) isEqual:(id) object {
+
+    if ([object isKindOfClass:[APBlobData class]]) {
+        return [self.reference isEqualToData:[(APBlobData*) object reference]];
+    }
+    return [super isEqual:object];
+}
+
+
+- (id) copyWithZone:(NSZone*) zone {
+
+    return self;
+}
+
+@end
@@ -0,0 +1,123 @@
+/*
+ *
+ * Copyright 2014 Flavio Negrão Torres
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#import <Foundation/Foundation.h>
+
+/**
+ Content-addressed file store for the values of binary attributes, and of transformable attributes whose values are
+ NSData already (the only ones pushed to Parse as files). Other transformable values are kept inline by the cache SQLite.
+
+ Each value is written once to a file named after its SHA-256 digest, the cache SQLite only keeps a small reference
+ to it (see -referenceForData:error:), identical values share the same file. Values are read memory-mapped.
+
+ It also remembers the name of the Parse file holding each digest, so that unchanged values aren't uploaded again.
+
+ Remote files may be kept by reference only (see -referenceForRemoteFileURL:), they are downloaded the first time
+ their data is read or by -prefetchReferences: in the background.
+ */
+@interface APBlobStore : NSObject
+
+/**
+ Designated Initializer
+ @param directoryPath where the blobs are kept, created if needed.
+ */
+- (instancetype) initWithDirectoryPath:(NSString*) directoryPath;
+
+@property (nonatomic, strong, readonly) NSString* directoryPath;
+
+/// Hex SHA-256 of data
++ (NSString*) digestForData:(NSData*) data;
+
+/// YES if value is a reference returned by -referenceForData:error: or -referenceForRemoteFileURL: rather than the value itself.
++ (BOOL) isReference:(id) value;
+
+/// YES if value is a reference returned by -referenceForRemoteFileURL:
++ (BOOL) isRemoteReference:(id) value;
+
+/// The digest a reference points to, nil if it isn't a reference.
++ (NSString*) digestForReference:(NSData*) reference;
+
+/**
+ Writes data to the store unless there's a blob with the same digest already.
+ @returns the reference to be kept in the attribute instead of data, nil if it can't be written.
+ */
+- (NSData*) referenceForData:(NSData*) data error:(NSError *__autoreleasing*) error;
+
+/// Reference to a file that hasn't been downloaded yet, nothing is written.
+- (NSData*) referenceForRemoteFileURL:(NSString*) url;
+
+/**
+ Remote references are downloaded synchronously if they haven't been yet.
+ @returns the memory-mapped data the reference points to, nil if the blob is missing or can't be downloaded.
+ */
+- (NSData*) dataForReference:(NSData*) reference error:(NSError *__autoreleasing*) error;
+
+/// YES if reading reference doesn't require a download.
+- (BOOL) hasDataForReference:(NSData*) reference;
+
+/**
+ Same as -dataForReference:error: but run by the download queue, ahead of the prefetches. Returns immediately,
+ completion is called on a background thread, with no data nor error if the blobs have been removed meanwhile.
+ */
+- (void) dataForReference:(NSData*) reference
+               completion:(void (^)(NSData* data, NSError* error)) completion;
+
+/**
+ Downloads remote references in the background, at most maxConcurrentDownloads at a time,
+ and only while the remote files downloaded take less than prefetchSizeLimit bytes. Returns immediately.
+ */
+- (void) prefetchReferences:(NSArray*) references;
+
+/// Default is 2
+@property (nonatomic, assign) NSUInteger maxConcurrentDownloads;
+
+/// Default is 50MB, 0 disables prefetching, files are then downloaded when read only.
+@property (nonatomic, assign) unsigned long long prefetchSizeLimit;
+
+/// Number of bytes of remote files downloaded so far.
+@property (nonatomic, readonly) unsigned long long downloadedSize;
+
+/// Parse file name holding the digest or nil if it has never been uploaded or downloaded.
+- (NSString*) remoteFileNameForDigest:(NSString*) digest;
+
+/// Same as -remoteFileNameForDigest: for either kind of reference.
+- (NSString*) remoteFileNameForReference:(NSData*) reference;
+- (void) setRemoteFileName:(NSString*) fileName forDigest:(NSString*) digest;
+
+/// Remote file names are kept in memory until saved.
+- (BOOL) saveRemoteFileNames:(NSError *__autoreleasing*) error;
+
+- (BOOL) removeAllBlobs:(NSError *__autoreleasing*) error;
+
+/**
+ Starts a garbage collection, to be called before the references in use are marked.
+ References handed out since the previous collection began, or while this one runs, may not have been saved yet:
+ the sweep keeps their blobs.
+ */
+- (void) beginCollection;
+
+/**
+ Sweep phase of the garbage collection started by -beginCollection, the caller marks the references still in use.
+ Blobs and downloaded files neither in references nor pinned are removed.
+ */
+- (BOOL) removeBlobsNotInReferences:(NSSet*) references
+                              error:(NSError *__autoreleasing*) error;
+
+/// Ends the collection without sweeping, -removeBlobsNotInReferences:error: ends it as well.
+- (void) endCollection;
+
+@end
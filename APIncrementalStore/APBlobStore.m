@@ -0,0 +1,536 @@
+/*
+ *
+ * Copyright 2014 Flavio Negrão Torres
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#import "APBlobStore.h"
+#import "APBlobData.h"
+
+#import <CommonCrypto/CommonDigest.h>
+
+#import "NSLogEmoji.h"
+#import "APCommon.h"
+
+// References are "apblob:sha256:<64 hex characters>" or "apblob:url:<remote file url>" for files not downloaded yet
+static NSString* const APBlobReferencePrefix = @"apblob:sha256:";
+static NSString* const APBlobRemoteReferencePrefix = @"apblob:url:";
+static NSUInteger const APBlobDigestLength = CC_SHA256_DIGEST_LENGTH * 2;
+
+static NSString* const APBlobRemoteFileNamesFileName = @"RemoteFileNames.plist";
+static NSString* const APBlobRemoteFilesDirectoryName = @"Remote";
+
+static NSUInteger const APBlobDefaultMaxConcurrentDownloads = 2;
+static unsigned long long const APBlobDefaultPrefetchSizeLimit = 50 * 1024 * 1024;
+
+
+@interface APBlobStore ()
+
+@property (nonatomic, strong) NSString* directoryPath;
+
+// {digest: Parse file name}, synchronized on itself
+@property (nonatomic, strong) NSMutableDictionary* remoteFileNamesByDigest;
+@property (nonatomic, assign) BOOL hasUnsavedRemoteFileNames;
+
+@property (nonatomic, strong) NSOperationQueue* prefetchQueue;
+
+// Synchronized on self
+@property (nonatomic, assign) unsigned long long downloadedSize;
+
+/*
+ File names (digests or remote file names) of the references handed out since the last collection began,
+ and the ones the collection running must keep (see -beginCollection). Both synchronized on handedOutFileNames.
+ */
+@property (nonatomic, strong) NSMutableSet* handedOutFileNames;
+@property (nonatomic, strong) NSMutableSet* pinnedFileNames;
+
+@end
+
+
+@implementation APBlobStore
+
+- (instancetype) initWithDirectoryPath:(NSString*) directoryPath {
+
+    self = [super init];
+    if (self) {
+        _directoryPath = directoryPath;
+        [[NSFileManager defaultManager] createDirectoryAtPath:directoryPath withIntermediateDirectories:YES attributes:nil error:nil];
+
+        NSDictionary* savedRemoteFileNames = [NSDictionary dictionaryWithContentsOfFile:[self remoteFileNamesPath]];
+        _remoteFileNamesByDigest = savedRemoteFileNames ? [savedRemoteFileNames mutableCopy] : [NSMutableDictionary dictionary];
+        
+        _maxConcurrentDownloads = APBlobDefaultMaxConcurrentDownloads;
+        _prefetchSizeLimit = APBlobDefaultPrefetchSizeLimit;
+        _downloadedSize = [self sizeOfDirectoryAtPath:[self remoteFilesDirectoryPath]];
+        _handedOutFileNames = [NSMutableSet set];
+    }
+    return self;
+}
+
+
+#pragma mark - References
+
++ (NSString*) digestForData:(NSData*) data {
+
+    unsigned char digest[CC_SHA256_DIGEST_LENGTH];
+    CC_SHA256([data bytes], (CC_LONG)[data length], digest);
+
+    NSMutableString* hexDigest = [NSMutableString stringWithCapacity:APBlobDigestLength];
+    for (NSUInteger i = 0; i < CC_SHA256_DIGEST_LENGTH; i++) {
+        [hexDigest appendFormat:@"%02x", digest[i]];
+    }
+    return hexDigest;
+}
+
+
++ (BOOL) isReference:(id) value {
+
+    return ([self digestForReference:value] != nil || [self isRemoteReference:value]);
+}
+
+
++ (BOOL) isRemoteReference:(id) value {
+
+    return ([self remoteFileURLForReference:value] != nil);
+}
+
+
++ (NSString*) remoteFileURLForReference:(NSData*) reference {
+
+    // Quick check before decoding, binary values are rarely that short. Blob data would be loaded just to check it.
+    if (![reference isKindOfClass:[NSData class]] || [reference isKindOfClass:[APBlobData class]] ||
+        [reference length] <= [APBlobRemoteReferencePrefix length] ||
+        memcmp([reference bytes], [APBlobRemoteReferencePrefix UTF8String], [APBlobRemoteReferencePrefix length]) != 0) {
+        return nil;
+    }
+
+    NSString* referenceString = [[NSString alloc]initWithData:reference encoding:NSUTF8StringEncoding];
+    return [referenceString substringFromIndex:[APBlobRemoteReferencePrefix length]];
+}
+
+
++ (NSString*) digestForReference:(NSData*) reference {
+
+    if (![reference isKindOfClass:[NSData class]] || [reference isKindOfClass:[APBlobData class]] ||
+        [reference length] != [APBlobReferencePrefix length] + APBlobDigestLength) {
+        return nil;
+    }
+
+    NSString* referenceString = [[NSString alloc]initWithData:reference encoding:NSUTF8StringEncoding];
+    if (![referenceString hasPrefix:APBlobReferencePrefix]) {
+        return nil;
+    }
+    return [referenceString substringFromIndex:[APBlobReferencePrefix length]];
+}
+
+
+#pragma mark - Reading and Writing
+
+- (NSData*) referenceForData:(NSData*) data error:(NSError *__autoreleasing*) error {
+
+    NSString* digest = [[self class] digestForData:data];
+    NSString* path = [self pathForDigest:digest];
+
+    // Before checking it exists, a sweep running can't remove it afterwards.
+    [self pinFileName:digest];
+
+    // Identical values are written only once
+    if (![[NSFileManager defaultManager] fileExistsAtPath:path]) {
+        [[NSFileManager defaultManager] createDirectoryAtPath:[path stringByDeletingLastPathComponent] withIntermediateDirectories:YES attributes:nil error:nil];
+
+        NSError* writingError = nil;
+        if (![data writeToFile:path options:NSDataWritingAtomic error:&writingError]) {
+            if (AP_DEBUG_ERRORS) { ELog(@"Error writing blob %@: %@",digest,writingError)}
+            if (error) *error = writingError;
+            return nil;
+        }
+    }
+
+    return [[APBlobReferencePrefix stringByAppendingString:digest] dataUsingEncoding:NSUTF8StringEncoding];
+}
+
+
+- (NSData*) referenceForRemoteFileURL:(NSString*) url {
+
+    [self pinFileName:[[self pathForRemoteFileURL:url] lastPathComponent]];
+    return [[APBlobRemoteReferencePrefix stringByAppendingString:url] dataUsingEncoding:NSUTF8StringEncoding];
+}
+
+
+// The reference handed out may not be saved before the next sweep, see -beginCollection.
+- (void) pinFileName:(NSString*) fileName {
+
+    @synchronized(self.handedOutFileNames) {
+        [self.handedOutFileNames addObject:fileName];
+        [self.pinnedFileNames addObject:fileName];
+    }
+}
+
+
+- (NSData*) dataForReference:(NSData*) reference error:(NSError *__autoreleasing*) error {
+
+    NSString* url = [[self class] remoteFileURLForReference:reference];
+    if (url) {
+        return [self dataForRemoteFileURL:url error:error];
+    }
+
+    NSString* digest = [[self class] digestForReference:reference];
+    if (!digest) {
+        return nil;
+    }
+
+    NSError* readingError = nil;
+    NSData* data = [NSData dataWithContentsOfFile:[self pathForDigest:digest] options:NSDataReadingMappedAlways error:&readingError];
+    if (!data) {
+        if (AP_DEBUG_ERRORS) { ELog(@"Error reading blob %@: %@",digest,readingError)}
+        if (error) *error = readingError;
+    }
+    return data;
+}
+
+
+- (BOOL) hasDataForReference:(NSData*) reference {
+
+    NSString* url = [[self class] remoteFileURLForReference:reference];
+    if (url) {
+        return [[NSFileManager defaultManager] fileExistsAtPath:[self pathForRemoteFileURL:url]];
+    }
+
+    NSString* digest = [[self class] digestForReference:reference];
+    return (digest && [[NSFileManager defaultManager] fileExistsAtPath:[self pathForDigest:digest]]);
+}
+
+
+- (NSData*) dataForRemoteFileURL:(NSString*) url error:(NSError *__autoreleasing*) error {
+
+    NSString* path = [self pathForRemoteFileURL:url];
+
+    if (![[NSFileManager defaultManager] fileExistsAtPath:path]) {
+        if (AP_DEBUG_INFO) { DLog(@"Downloading %@",url)}
+
+        NSError* downloadError = nil;
+        NSData* data = [NSData dataWithContentsOfURL:[NSURL URLWithString:url] options:0 error:&downloadError];
+        if (!data) {
+            if (AP_DEBUG_ERRORS) { ELog(@"Error downloading %@: %@",url,downloadError)}
+            if (error) *error = downloadError;
+            return nil;
+        }
+
+        [[NSFileManager defaultManager] createDirectoryAtPath:[path stringByDeletingLastPathComponent] withIntermediateDirectories:YES attributes:nil error:nil];
+        if (![data writeToFile:path options:NSDataWritingAtomic error:&downloadError]) {
+            if (AP_DEBUG_ERRORS) { ELog(@"Error writing %@: %@",url,downloadError)}
+            if (error) *error = downloadError;
+            return nil;
+        }
+
+        @synchronized(self) {
+            self.downloadedSize += [data length];
+        }
+        [self setRemoteFileName:[url lastPathComponent] forDigest:[[self class] digestForData:data]];
+    }
+
+    NSError* readingError = nil;
+    NSData* data = [NSData dataWithContentsOfFile:path options:NSDataReadingMappedAlways error:&readingError];
+    if (!data) {
+        if (AP_DEBUG_ERRORS) { ELog(@"Error reading %@: %@",url,readingError)}
+        if (error) *error = readingError;
+    }
+    return data;
+}
+
+
+- (void) dataForReference:(NSData*) reference
+               completion:(void (^)(NSData* data, NSError* error)) completion {
+
+    __block NSData* data = nil;
+    __block NSError* readingError = nil;
+    NSBlockOperation* operation = [NSBlockOperation blockOperationWithBlock:^{
+        NSError* localError = nil;
+        data = [self dataForReference:reference error:&localError];
+        readingError = localError;
+    }];
+    
+    // Called as well when cancelled by -removeAllBlobs:
+    operation.completionBlock = ^{
+        completion(data, readingError);
+    };
+    operation.queuePriority = NSOperationQueuePriorityHigh;
+    [self.prefetchQueue addOperation:operation];
+}
+
+
+#pragma mark - Prefetching
+
+- (void) prefetchReferences:(NSArray*) references {
+
+    if (self.prefetchSizeLimit == 0) {
+        return;
+    }
+
+    for (NSData* reference in references) {
+        if (![[self class] isRemoteReference:reference] || [self hasDataForReference:reference]) {
+            continue;
+        }
+
+        __weak typeof(self) weakSelf = self;
+        [self.prefetchQueue addOperationWithBlock:^{
+            typeof(self) strongSelf = weakSelf;
+            if (strongSelf && strongSelf.downloadedSize < strongSelf.prefetchSizeLimit) {
+                [strongSelf dataForReference:reference error:nil];
+            }
+        }];
+    }
+}
+
+
+- (NSOperationQueue*) prefetchQueue {
+
+    @synchronized(self) {
+        if (!_prefetchQueue) {
+            _prefetchQueue = [[NSOperationQueue alloc]init];
+            _prefetchQueue.name = @"com.apetis.apincrementalstore.blobstore.prefetch";
+            _prefetchQueue.maxConcurrentOperationCount = self.maxConcurrentDownloads;
+        }
+        return _prefetchQueue;
+    }
+}
+
+
+- (void) setMaxConcurrentDownloads:(NSUInteger) maxConcurrentDownloads {
+
+    _maxConcurrentDownloads = MAX(maxConcurrentDownloads, 1);
+    _prefetchQueue.maxConcurrentOperationCount = _maxConcurrentDownloads;
+}
+
+
+- (BOOL) removeAllBlobs:(NSError *__autoreleasing*) error {
+
+    [_prefetchQueue cancelAllOperations];
+    @synchronized(self) {
+        self.downloadedSize = 0;
+    }
+
+    @synchronized(self.remoteFileNamesByDigest) {
+        [self.remoteFileNamesByDigest removeAllObjects];
+        self.hasUnsavedRemoteFileNames = NO;
+    }
+
+    NSFileManager* fileManager = [NSFileManager defaultManager];
+    if ([fileManager fileExistsAtPath:self.directoryPath]) {
+        if (![fileManager removeItemAtPath:self.directoryPath error:error]) {
+            return NO;
+        }
+    }
+    return [fileManager createDirectoryAtPath:self.directoryPath withIntermediateDirectories:YES attributes:nil error:error];
+}
+
+
+#pragma mark - Garbage Collection
+
+- (void) beginCollection {
+
+    @synchronized(self.handedOutFileNames) {
+        self.pinnedFileNames = self.handedOutFileNames;
+        self.handedOutFileNames = [NSMutableSet set];
+    }
+}
+
+
+- (BOOL) removeBlobsNotInReferences:(NSSet*) references
+                              error:(NSError *__autoreleasing*) error {
+
+    BOOL success = [self sweepBlobsNotInReferences:references error:error];
+    [self endCollection];
+    return success;
+}
+
+
+- (void) endCollection {
+
+    @synchronized(self.handedOutFileNames) {
+        self.pinnedFileNames = nil;
+    }
+}
+
+
+- (BOOL) sweepBlobsNotInReferences:(NSSet*) references
+                             error:(NSError *__autoreleasing*) error {
+
+    NSMutableSet* referencedDigests = [NSMutableSet setWithCapacity:[references count]];
+    NSMutableSet* referencedRemoteFileNames = [NSMutableSet set];
+    for (NSData* reference in references) {
+        NSString* url = [[self class] remoteFileURLForReference:reference];
+        if (url) {
+            [referencedRemoteFileNames addObject:[[self pathForRemoteFileURL:url] lastPathComponent]];
+        } else {
+            NSString* digest = [[self class] digestForReference:reference];
+            if (digest) [referencedDigests addObject:digest];
+        }
+    }
+
+    NSFileManager* fileManager = [NSFileManager defaultManager];
+    NSMutableArray* removedDigests = [NSMutableArray array];
+    unsigned long long removedRemoteSize = 0;
+
+    NSError* removingError = nil;
+    NSArray* directoryNames = [fileManager contentsOfDirectoryAtPath:self.directoryPath error:&removingError];
+    if (!directoryNames) {
+        if (error) *error = removingError;
+        return NO;
+    }
+
+    for (NSString* directoryName in directoryNames) {
+        NSString* directoryPath = [self.directoryPath stringByAppendingPathComponent:directoryName];
+        BOOL isRemoteFilesDirectory = [directoryName isEqualToString:APBlobRemoteFilesDirectoryName];
+        if (!isRemoteFilesDirectory && [directoryName length] != 2) {
+            continue;
+        }
+
+        for (NSString* fileName in [fileManager contentsOfDirectoryAtPath:directoryPath error:nil]) {
+            if ((isRemoteFilesDirectory) ? [referencedRemoteFileNames containsObject:fileName] : [referencedDigests containsObject:fileName]) {
+                continue;
+            }
+
+            NSString* path = [directoryPath stringByAppendingPathComponent:fileName];
+            NSDictionary* attributes = [fileManager attributesOfItemAtPath:path error:nil];
+
+            // Checked and removed while holding the pins, references can be handed out meanwhile.
+            @synchronized(self.handedOutFileNames) {
+                if ([self.pinnedFileNames containsObject:fileName]) {
+                    continue;
+                }
+                if (![fileManager removeItemAtPath:path error:&removingError]) {
+                    if (AP_DEBUG_ERRORS) { ELog(@"Error removing blob %@: %@",fileName,removingError)}
+                    if (error) *error = removingError;
+                    return NO;
+                }
+            }
+            if (isRemoteFilesDirectory) {
+                removedRemoteSize += [attributes fileSize];
+            } else {
+                [removedDigests addObject:fileName];
+            }
+        }
+    }
+
+    @synchronized(self) {
+        self.downloadedSize -= MIN(removedRemoteSize, self.downloadedSize);
+    }
+
+    @synchronized(self.remoteFileNamesByDigest) {
+        for (NSString* digest in removedDigests) {
+            if (self.remoteFileNamesByDigest[digest]) {
+                [self.remoteFileNamesByDigest removeObjectForKey:digest];
+                self.hasUnsavedRemoteFileNames = YES;
+            }
+        }
+    }
+
+    if (AP_DEBUG_INFO) { DLog(@"%lu blobs and %llu bytes of remote files removed",(unsigned long)[removedDigests count],removedRemoteSize)}
+    return [self saveRemoteFileNames:error];
+}
+
+
+#pragma mark - Remote File Names
+
+- (NSString*) remoteFileNameForDigest:(NSString*) digest {
+
+    if (!digest) {
+        return nil;
+    }
+
+    @synchronized(self.remoteFileNamesByDigest) {
+        return self.remoteFileNamesByDigest[digest];
+    }
+}
+
+
+- (NSString*) remoteFileNameForReference:(NSData*) reference {
+
+    NSString* url = [[self class] remoteFileURLForReference:reference];
+    return (url) ? [url lastPathComponent] : [self remoteFileNameForDigest:[[self class] digestForReference:reference]];
+}
+
+
+- (void) setRemoteFileName:(NSString*) fileName forDigest:(NSString*) digest {
+
+    if (!fileName || !digest) {
+        return;
+    }
+
+    @synchronized(self.remoteFileNamesByDigest) {
+        if (![self.remoteFileNamesByDigest[digest] isEqualToString:fileName]) {
+            self.remoteFileNamesByDigest[digest] = fileName;
+            self.hasUnsavedRemoteFileNames = YES;
+        }
+    }
+}
+
+
+- (BOOL) saveRemoteFileNames:(NSError *__autoreleasing*) error {
+
+    NSDictionary* remoteFileNames;
+    @synchronized(self.remoteFileNamesByDigest) {
+        if (!self.hasUnsavedRemoteFileNames) {
+            return YES;
+        }
+        remoteFileNames = [self.remoteFileNamesByDigest copy];
+        self.hasUnsavedRemoteFileNames = NO;
+    }
+
+    NSData* data = [NSPropertyListSerialization dataWithPropertyList:remoteFileNames format:NSPropertyListBinaryFormat_v1_0 options:0 error:error];
+    return (data && [data writeToFile:[self remoteFileNamesPath] options:NSDataWritingAtomic error:error]);
+}
+
+
+#pragma mark - Support Methods
+
+// Spread over 256 directories, ie: <directoryPath>/ab/abcdef...
+- (NSString*) pathForDigest:(NSString*) digest {
+
+    return [[self.directoryPath stringByAppendingPathComponent:[digest substringToIndex:2]] stringByAppendingPathComponent:digest];
+}
+
+
+// Named after the digest of their URL, their content digest is only known once downloaded.
+- (NSString*) pathForRemoteFileURL:(NSString*) url {
+
+    NSString* urlDigest = [[self class] digestForData:[url dataUsingEncoding:NSUTF8StringEncoding]];
+    return [[self remoteFilesDirectoryPath] stringByAppendingPathComponent:urlDigest];
+}
+
+
+- (NSString*) remoteFilesDirectoryPath {
+
+    return [self.directoryPath stringByAppendingPathComponent:APBlobRemoteFilesDirectoryName];
+}
+
+
+- (unsigned long long) sizeOfDirectoryAtPath:(NSString*) path {
+
+    unsigned long long size = 0;
+    NSDirectoryEnumerator* enumerator = [[NSFileManager defaultManager] enumeratorAtPath:path];
+    for (__unused NSString* fileName in enumerator) {
+        size += [[enumerator fileAttributes] fileSize];
+    }
+    return size;
+}
+
+
+- (NSString*) remoteFileNamesPath {
+
+    return [self.directoryPath stringByAppendingPathComponent:APBlobRemoteFileNamesFileName];
+}
+
+@end
@@ -24,6 +24,9 @@ extern NSString* const APObjectUIDAttributeName;
 /// Cached objects will have this attribute to enable conflict identification when merging objects from the webservice provider.
 extern NSString* const APObjectLastModifiedAttributeName;
 
+/// Identifier the BaaS provider gave to the object (ie: Parse objectId), set once the object has been synced. Lets the sync build pointers to it without querying for it.
+extern NSString* const APObjectRemoteIDAttributeName;
+
 /// Cached objects set with YES for this attribute will be merged with the BaaS provider objects.
 extern NSString* const APObjectIsDirtyAttributeName;
 
@@ -57,6 +60,9 @@ extern NSString* const APObjectEntityNameAttributeName;
 /// Whether or not an object is created remotely.
 extern NSString* const APObjectIsCreatedRemotelyAttributeName;
 
+/// Cache only. Members of the object PFRelations as of the last sync {relationshipName: {relatedObjectUID: relatedEntityName}}, so that pushes only send what has changed.
+extern NSString* const APObjectRelationMembersAttributeName;
+
 /// If an NSEnitityDescription has this key set to NO on its userInfo propriety then it will be included in the representation of a cached managed object that is passed to APIncrementalStore
 extern NSString* const APIncrementalStorePrivateAttributeKey;
 
@@ -81,6 +87,47 @@ extern NSString* const APIncrementalStorePrivateAttributeKey;
 extern NSString* const APCoreDataACLAttributeName;
 
 
+#pragma mark - Outbox
+
+/**
+ Cache only entity, the disk cache appends one entry to it (APObjectUIDAttributeName and APObjectEntityNameAttributeName)
+ for each object inserted, updated or deleted. The sync operation pushes the objects in sequence order and removes
+ the entries once Parse has acknowledged them, instead of looking for dirty objects in every table.
+ */
+extern NSString* const APOutboxEntityName;
+
+/// Integer 64 attribute of APOutboxEntityName, increases with each entry.
+extern NSString* const APOutboxSequenceAttributeName;
+
+
+#pragma mark - Sync State
+
+/**
+ Cache only entity where the sync operation keeps its state, one object per user (or envID):
+ the date of the latest object synced for each entity, the Parse time of the latest pull, the envID and whether the outbox has been seeded.
+ It's saved in the same transaction as the objects merged from Parse, so it never gets ahead of the cache.
+ */
+extern NSString* const APSyncStateEntityName;
+
+/// String attribute of APSyncStateEntityName, the user objectId or envID the state belongs to.
+extern NSString* const APSyncStateKeyAttributeName;
+
+/// Transformable attribute of APSyncStateEntityName, dictionary of entity names to the date of the latest object synced.
+extern NSString* const APSyncStateCursorsAttributeName;
+
+/// Transformable attribute of APSyncStateEntityName, dictionary of entity names to the objectUID of the latest object synced. Objects sharing its date are told apart by it.
+extern NSString* const APSyncStateCursorObjectUIDsAttributeName;
+
+/// Date attribute of APSyncStateEntityName.
+extern NSString* const APSyncStateServerTimeAttributeName;
+
+/// String attribute of APSyncStateEntityName.
+extern NSString* const APSyncStateEnvIDAttributeName;
+
+/// Boolean attribute of APSyncStateEntityName, YES once the objects made dirty before there was an outbox have been pushed.
+extern NSString* const APSyncStateOutboxSeededAttributeName;
+
+
 #pragma mark - Logs
 
 /// Set it to YES to see at the console a message every time that a method from an instance is called
@@ -26,7 +26,24 @@ NSString* const APObjectEntityNameAttributeName = @"apObjectEntityName";
 NSString* const APIncrementalStorePrivateAttributeKey = @"kAPIncrementalStorePrivateAttribute";
 
 NSString* const APObjectLastModifiedAttributeName = @"apObjectLastModified";
+NSString* const APObjectRemoteIDAttributeName = @"apObjectRemoteID";
 NSString* const APObjectIsDirtyAttributeName = @"apObjectIsDirty";
 NSString* const APObjectIsCreatedRemotelyAttributeName = @"apObjectIsCreatedRemotely";
+NSString* const APObjectRelationMembersAttributeName = @"apObjectRelationMembers";
 
-NSString* const APCoreDataACLAttributeName = @"__ACL";
\ No newline at end of file
+NSString* const APCoreDataACLAttributeName = @"__ACL";
+
+#pragma mark - Outbox
+
+NSString* const APOutboxEntityName = @"APOutboxEntry";
+NSString* const APOutboxSequenceAttributeName = @"apSequence";
+
+#pragma mark - Sync State
+
+NSString* const APSyncStateEntityName = @"APSyncState";
+NSString* const APSyncStateKeyAttributeName = @"apSyncStateKey";
+NSString* const APSyncStateCursorsAttributeName = @"apSyncStateCursors";
+NSString* const APSyncStateCursorObjectUIDsAttributeName = @"apSyncStateCursorObjectUIDs";
+NSString* const APSyncStateServerTimeAttributeName = @"apSyncStateServerTime";
+NSString* const APSyncStateEnvIDAttributeName = @"apSyncStateEnvID";
+NSString* const APSyncStateOutboxSeededAttributeName = @"apSyncStateOutboxSeeded";
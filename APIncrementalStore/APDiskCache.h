@@ -23,6 +23,9 @@
 
 @import CoreData;
 
+@class APDiskCacheWriter;
+@class APBlobStore;
+
 
 @interface APDiskCache : NSObject
 
@@ -37,6 +40,17 @@
  translateToObjectUIDBlock:(NSString* (^)(NSManagedObjectID*)) translateBlock
         localStoreFileName:(NSString*) localStoreFileName;
 
+/**
+ Same as initWithManagedModel:translateToObjectUIDBlock:localStoreFileName:, a store created with one of previousModels is migrated
+ to model before being opened. The cache models are built at runtime and aren't found in any bundle, Core Data can't infer
+ these migrations by itself. A store that isn't compatible with any of them is still opened with automatic migration.
+ @param previousModels cache models of the previous versions
+ */
+- (id)initWithManagedModel:(NSManagedObjectModel*) model
+     previousManagedModels:(NSArray*) previousModels
+ translateToObjectUIDBlock:(NSString* (^)(NSManagedObjectID*)) translateBlock
+        localStoreFileName:(NSString*) localStoreFileName;
+
 
 @property (nonatomic, readonly) NSString* localStoreFileName;
 
@@ -49,7 +63,7 @@
  "APObjectEntityNameAttributeName": entityName,
  "AttributeName1": propertyValue1,
  "AttributeName2": propertyValue2,
- "AttributeData1": NSData,
+ "AttributeData1": NSData (APBlobData for remote files, downloaded when read),
  "RelationshipToOneName": objectUID,
  "RelationshipToMany":
  [
@@ -73,14 +87,48 @@
                          requestContext:(NSManagedObjectContext*) requestContext
                                   error:(NSError *__autoreleasing*)error;
 
+/**
+ Same as fetchObjectRepresentations:requestContext:error: but only the identity of the objects is retrieved:
+ [
+ {
+ "APObjectUIDAttributeName": objectUID,
+ "APObjectEntityNameAttributeName": entityName
+ },
+ ...
+ ]
+ */
+- (NSArray*) fetchObjectIdentities:(NSFetchRequest *)fetchRequest
+                    requestContext:(NSManagedObjectContext*) requestContext
+                             error:(NSError *__autoreleasing*)error;
+
 - (NSUInteger) countObjectRepresentations:(NSFetchRequest *)fetchRequest
                            requestContext:(NSManagedObjectContext*) requestContext
                                     error:(NSError *__autoreleasing*)error;
 
+/**
+ Retrieve only the objects related to objectUID through relationship, without loading the object itself.
+ Format is the same used for To-Many relationships in representations, for To-One relationships as well:
+ {
+ "EntityName1": [objectUID, objectUID, ...],
+ "EntityName2": [objectUID, ...]
+ }
+ @returns the related objects (empty if none) or nil if the object can't be found or an error occurs.
+ */
+- (NSDictionary*) fetchRelatedObjectUIDsForRelationship:(NSRelationshipDescription*) relationship
+                                              objectUID:(NSString*) objectUID
+                                             entityName:(NSString*) entityName
+                                         requestContext:(NSManagedObjectContext*) requestContext
+                                                  error:(NSError *__autoreleasing*)error;
+
 - (NSDictionary*) fetchObjectRepresentationForObjectUID:(NSString*) objectUID
                                          requestContext:(NSManagedObjectContext*) requestContext
                                              entityName:(NSString*) entityName;
 
+/**
+ NSDictionaryResultType fetch run by the cache SQLite, including propertiesToFetch with NSExpressionDescription aggregates,
+ propertiesToGroupBy and havingPredicate. Without propertiesToFetch only the user model attributes are returned.
+ Relationship values and other object IDs (ie: expressionForEvaluatedObject) are returned as {"EntityName": objectUID} or NSNull.
+ */
 - (NSArray*) fetchDictionaryRepresentations:(NSFetchRequest *)fetchRequest
                               requestContext:(NSManagedObjectContext*) requestContext
                                        error:(NSError *__autoreleasing*)error;
@@ -97,8 +145,37 @@
 // entityName:(NSString*) entityName
                               error:(NSError *__autoreleasing *)error;
 
+/**
+ Applies all the changes of a save and commits them to the cache store at once, either all of them are written or none.
+ insertObjectRepresentations:, updateObjectRepresentations: and deleteObjectRepresentations: are shortcuts to this method.
+ */
+- (BOOL) saveInsertedObjectRepresentations:(NSArray*) insertedObjects
+              updatedObjectRepresentations:(NSArray*) updatedObjects
+              deletedObjectRepresentations:(NSArray*) deletedObjects
+                                     error:(NSError *__autoreleasing *)error;
+
 - (void) ap_willRemoveFromPersistentStoreCoordinator;
 
+/**
+ Saves are written to SQLite behind the callers back, saves within writeCoalescingInterval (seconds, default 0.05)
+ of each other share the same transaction. Call -flush: when the changes must be durable (ie: before syncing).
+ */
+@property (nonatomic, assign) NSTimeInterval writeCoalescingInterval;
+@property (nonatomic, strong, readonly) APDiskCacheWriter* writer;
+
+/// Writes any pending change and waits for it, @returns NO if any write since the last flush has failed.
+- (BOOL) flush:(NSError *__autoreleasing *)error;
+
+/// Values of binary attributes (and transformable ones already NSData), the cache SQLite only keeps their references. Shared with the sync operation.
+@property (nonatomic, strong, readonly) APBlobStore* blobStore;
+
+/**
+ Mark and sweep of the blob store: the references found in the cache store are kept, the other blobs are removed.
+ Blobs of saves in flight are pinned by the blob store, the store is read by a context of its own.
+ Must not run while a sync operation writes to the cache store, it marks only what is saved.
+ */
+- (BOOL) removeUnreferencedBlobs:(NSError *__autoreleasing *)error;
+
 /**
  Permanent objectIDs are only allocated when the objects are syncronized with the remote webservice. Before that
  we must allocate a temporary objectID to allow for unique identification of objects between the APIncrementalStore
@@ -109,6 +186,20 @@
 
 - (void) resetCache;
 
+/**
+ Objects looked up by objectUID are kept in an in-memory index, so that repeated lookups (relationships, updates,
+ deletes) don't need to go to the store. These are the number of lookups served and not served by the index.
+ */
+@property (nonatomic, readonly) NSUInteger objectIDIndexHits;
+@property (nonatomic, readonly) NSUInteger objectIDIndexMisses;
+
+/**
+ Predicates are translated to the cache model once per structure (the same predicate with different constants),
+ these are the number of translations served and not served by the template cache.
+ */
+@property (nonatomic, readonly) NSUInteger predicateTemplateHits;
+@property (nonatomic, readonly) NSUInteger predicateTemplateMisses;
+
 - (NSString *)pathToLocalStore;
 
 @end
\ No newline at end of file
@@ -17,16 +17,28 @@
 
 #import "APDiskCache.h"
 
+#import "APDiskCacheWriter.h"
+#import "APBlobStore.h"
+#import "APBlobData.h"
 #import "NSArray+Enumerable.h"
 #import "NSLogEmoji.h"
 #import "APCommon.h"
 #import "APError.h"
 
 
+static NSString* const APPredicateConstantVariablePrefix = @"APPredicateConstant";
+static NSTimeInterval const APDefaultWriteCoalescingInterval = 0.05;
+static NSString* const APBlobStoreDirectorySuffix = @"-Blobs";
+static NSUInteger const APPredicateTemplatesCountLimit = 256;
+static NSUInteger const APBlobMarkBatchSize = 500;
+static NSString* const APMigratingStoreSuffix = @"-migrating";
+
+
 @interface APDiskCache()
 
 @property (nonatomic, strong) NSPersistentStoreCoordinator* psc;
 @property (nonatomic, weak) NSManagedObjectModel* model;
+@property (nonatomic, strong) NSArray* previousModels;
 @property (nonatomic, strong) NSString* localStoreFileName;
 @property (nonatomic, assign) BOOL shouldResetCacheFile;
 @property (nonatomic, copy) NSString* (^translateManagedObjectIDToObjectUIDBlock) (NSManagedObjectID*);
@@ -34,12 +46,44 @@
 // Context used for saving in BG
 @property (nonatomic, strong) NSManagedObjectContext* savingToPSCContext;
 
+// Writes savingToPSCContext changes to SQLite, see -saveAndReset:mainContext:
+@property (nonatomic, strong) APDiskCacheWriter* writer;
+
+@property (nonatomic, strong) APBlobStore* blobStore;
+
+// Last sequence given to an outbox entry, see -lastOutboxSequence
+@property (nonatomic, strong) NSNumber* outboxSequence;
+
 // Context used for interacting with APincrementalStore
 @property (nonatomic, strong) NSManagedObjectContext* mainContext;
 
 /// Observes messages sent by NSManagedObjectContext Save
 @property (nonatomic, strong) id contextObserver;
 
+/*
+ In-memory index of cache objectIDs by objectUID, one dictionary per root entity:
+ {
+    RootEntityName1: {objectUID: objectID, objectUID: objectID, ...},
+    RootEntityName2: {objectUID: objectID, ...}
+ }
+ objectUIDsByObjectID is its inverse and is used to evict deleted objects.
+ All access is synchronized on objectIDsByObjectUIDByEntityName.
+ */
+@property (nonatomic, strong) NSMutableDictionary* objectIDsByObjectUIDByEntityName;
+@property (nonatomic, strong) NSMutableDictionary* objectUIDsByObjectID;
+@property (nonatomic, assign) NSUInteger objectIDIndexHits;
+@property (nonatomic, assign) NSUInteger objectIDIndexMisses;
+
+/*
+ Built once, see -newControlPropertiesPredicate.
+ Translated predicate templates by predicate structure, see -cachePredicateFromPredicate:requestContext:forEntityName:
+ Predicates are translated from any requesting context, the counters are synchronized on predicateTemplatesByStructure.
+ */
+@property (nonatomic, strong) NSPredicate* controlPropertiesPredicate;
+@property (nonatomic, strong) NSCache* predicateTemplatesByStructure;
+@property (nonatomic, assign) NSUInteger predicateTemplateHits;
+@property (nonatomic, assign) NSUInteger predicateTemplateMisses;
+
 
 @end
 
@@ -61,6 +105,18 @@
 
 
 - (id)initWithManagedModel:(NSManagedObjectModel*) model
+ translateToObjectUIDBlock:(NSString* (^)(NSManagedObjectID*)) translateBlock
+        localStoreFileName:(NSString*) localStoreFileName {
+    
+    return [self initWithManagedModel:model
+                previousManagedModels:nil
+            translateToObjectUIDBlock:translateBlock
+                   localStoreFileName:localStoreFileName];
+}
+
+
+- (id)initWithManagedModel:(NSManagedObjectModel*) model
+     previousManagedModels:(NSArray*) previousModels
  translateToObjectUIDBlock:(NSString* (^)(NSManagedObjectID*)) translateBlock
         localStoreFileName:(NSString*) localStoreFileName {
     
@@ -73,6 +129,14 @@
             _localStoreFileName = localStoreFileName;
             _translateManagedObjectIDToObjectUIDBlock = translateBlock;
             _model = model;
+            _previousModels = previousModels ?: @[];
+            _objectIDsByObjectUIDByEntityName = [NSMutableDictionary dictionary];
+            _objectUIDsByObjectID = [NSMutableDictionary dictionary];
+            _controlPropertiesPredicate = [self newControlPropertiesPredicate];
+            _predicateTemplatesByStructure = [[NSCache alloc]init];
+            _predicateTemplatesByStructure.countLimit = APPredicateTemplatesCountLimit;
+            _writeCoalescingInterval = APDefaultWriteCoalescingInterval;
+            _blobStore = [[APBlobStore alloc]initWithDirectoryPath:[[self pathToLocalStore] stringByAppendingString:APBlobStoreDirectorySuffix]];
             
             [self configPersistentStoreCoordinator];
             [self configManagedContexts];
@@ -95,9 +159,13 @@
      [[NSNotificationCenter defaultCenter] removeObserver:self.contextObserver];
     
     [self deleteCacheStore];
+    [self resetObjectIDIndex];
+    [self.blobStore removeAllBlobs:nil];
     
     _mainContext = nil;
+    _outboxSequence = nil;
     _savingToPSCContext = nil;
+    _writer = nil;
     _psc = nil;
     
     [self configPersistentStoreCoordinator];
@@ -128,11 +196,17 @@
 - (void) ap_willRemoveFromPersistentStoreCoordinator {
     
     if (AP_DEBUG_METHODS) { MLog() }
+    NSError* flushError = nil;
+    if (![self flush:&flushError]) {
+        if (AP_DEBUG_ERRORS) {ELog(@"Error writing the cache before removing it: %@",flushError)}
+    }
     [[NSNotificationCenter defaultCenter] removeObserver:self.contextObserver];
     _contextObserver = nil;
     _mainContext = nil;
     _savingToPSCContext = nil;
+    _writer = nil;
     [self removeAllPersistentStores];
+    [self resetObjectIDIndex];
     
 }
 
@@ -151,6 +225,15 @@
 }
 
 
+#pragma mark - Getters and Setters
+
+- (void) setWriteCoalescingInterval:(NSTimeInterval) writeCoalescingInterval {
+    
+    _writeCoalescingInterval = writeCoalescingInterval;
+    self.writer.coalescingInterval = writeCoalescingInterval;
+}
+
+
 #pragma mark - Config
 
 // Local Cache
@@ -166,6 +249,10 @@
     NSURL *storeURL = [NSURL fileURLWithPath:[self pathToLocalStore]];
     
     NSError *error = nil;
+    if (![self migrateStoreAtURL:storeURL error:&error]) {
+        [NSException raise:APIncrementalStoreExceptionLocalCacheStore format:@"Error migrating sqlite persistent store: %@", error];
+    }
+    
     [self.psc addPersistentStoreWithType:NSSQLiteStoreType configuration:nil URL:storeURL options:options error:&error];
     
     if (error) {
@@ -174,6 +261,93 @@
 }
 
 
+/*
+ Automatic migration looks for the model the store was created with in the bundles, the cache models are built at runtime.
+ Stores created with one of previousModels are migrated here with an inferred mapping model, into a new file that replaces the store.
+ */
+- (BOOL) migrateStoreAtURL:(NSURL*) storeURL error:(NSError *__autoreleasing*) error {
+    
+    if (AP_DEBUG_METHODS) { MLog()}
+    
+    NSFileManager* fileManager = [NSFileManager defaultManager];
+    if (![fileManager fileExistsAtPath:[storeURL path]]) {
+        return YES;
+    }
+    
+    NSError* localError = nil;
+    NSDictionary* metadata = [NSPersistentStoreCoordinator metadataForPersistentStoreOfType:NSSQLiteStoreType URL:storeURL error:&localError];
+    if (!metadata) {
+        if (error) *error = localError;
+        return NO;
+    }
+    
+    if ([self.model isConfiguration:nil compatibleWithStoreMetadata:metadata]) {
+        return YES;
+    }
+    
+    NSManagedObjectModel* sourceModel = nil;
+    for (NSManagedObjectModel* previousModel in self.previousModels) {
+        if ([previousModel isConfiguration:nil compatibleWithStoreMetadata:metadata]) {
+            sourceModel = previousModel;
+            break;
+        }
+    }
+    
+    if (!sourceModel) {
+        if (AP_DEBUG_ERRORS) {ELog(@"Cache store created with an unknown model, trying automatic migration")}
+        return YES;
+    }
+    
+    if (AP_DEBUG_INFO) {DLog(@"Migrating cache store from a previous version")}
+    
+    NSMappingModel* mappingModel = [NSMappingModel inferredMappingModelForSourceModel:sourceModel destinationModel:self.model error:&localError];
+    if (!mappingModel) {
+        if (error) *error = localError;
+        return NO;
+    }
+    
+    // A single file, without -wal and -shm to be moved along
+    NSURL* migratedStoreURL = [NSURL fileURLWithPath:[[storeURL path] stringByAppendingString:APMigratingStoreSuffix]];
+    NSDictionary* migratedStoreOptions = @{NSSQLitePragmasOption: @{@"journal_mode": @"DELETE"}};
+    
+    if ([fileManager fileExistsAtPath:[migratedStoreURL path]] && ![fileManager removeItemAtURL:migratedStoreURL error:&localError]) {
+        if (error) *error = localError;
+        return NO;
+    }
+    
+    NSMigrationManager* migrationManager = [[NSMigrationManager alloc]initWithSourceModel:sourceModel destinationModel:self.model];
+    if (![migrationManager migrateStoreFromURL:storeURL
+                                          type:NSSQLiteStoreType
+                                       options:nil
+                              withMappingModel:mappingModel
+                              toDestinationURL:migratedStoreURL
+                               destinationType:NSSQLiteStoreType
+                            destinationOptions:migratedStoreOptions
+                                         error:&localError]) {
+        [fileManager removeItemAtURL:migratedStoreURL error:nil];
+        if (error) *error = localError;
+        return NO;
+    }
+    
+    // The previous store journal must not be applied to the migrated one
+    for (NSString* journalSuffix in @[@"-wal",@"-shm"]) {
+        NSString* journalPath = [[storeURL path] stringByAppendingString:journalSuffix];
+        if ([fileManager fileExistsAtPath:journalPath] && ![fileManager removeItemAtPath:journalPath error:&localError]) {
+            if (error) *error = localError;
+            return NO;
+        }
+    }
+    
+    if (![fileManager replaceItemAtURL:storeURL withItemAtURL:migratedStoreURL backupItemName:nil options:0 resultingItemURL:nil error:&localError]) {
+        if (error) *error = localError;
+        return NO;
+    }
+    
+    if (AP_DEBUG_INFO) {DLog(@"Cache store migrated successfully")}
+    return YES;
+}
+
+
 - (void) configManagedContexts {
     
     if (AP_DEBUG_METHODS) { MLog()}
@@ -181,6 +355,7 @@
     self.savingToPSCContext = [[NSManagedObjectContext alloc]initWithConcurrencyType:NSPrivateQueueConcurrencyType];
     self.savingToPSCContext.persistentStoreCoordinator = self.psc;
     [self.savingToPSCContext setMergePolicy:NSMergeByPropertyStoreTrumpMergePolicy];
+    self.writer = [[APDiskCacheWriter alloc]initWithContext:self.savingToPSCContext coalescingInterval:self.writeCoalescingInterval];
 
     self.mainContext = [[NSManagedObjectContext alloc]initWithConcurrencyType:NSPrivateQueueConcurrencyType];
     self.mainContext.parentContext = self.savingToPSCContext;
@@ -204,6 +379,8 @@
                                 
                                 if ([savingContextStoreURL isEqual:myContextStoreURL]) {
                                     
+                                    [self evictDeletedObjectsFromObjectIDIndex:note.userInfo[NSDeletedObjectsKey]];
+                                    
                                     if (savingContext != self.mainContext) {
                                         
                                         if (savingContext != self.savingToPSCContext) {
@@ -246,12 +423,56 @@
         return nil;
     }
     
-    __block NSMutableArray* representations = [[NSMutableArray alloc]initWithCapacity:[cachedManagedObjects count]];
+    NSError* representationError = nil;
+    NSArray* representations = [self representationsFromManagedObjects:cachedManagedObjects error:&representationError];
+    if (!representations) {
+        if (error) *error = representationError;
+        return nil;
+    }
+    return representations;
+}
+
+
+- (NSArray*) fetchObjectIdentities:(NSFetchRequest *)fetchRequest
+                    requestContext:(NSManagedObjectContext*) requestContext
+                             error:(NSError *__autoreleasing*)error {
+    
+    if (AP_DEBUG_METHODS) { MLog()}
+    
+    __block NSError* localError = nil;
+    NSFetchRequest* cacheFetchRequest = [self cacheFetchRequestFromFetchRequest:fetchRequest requestContext:requestContext];
     
-    [cachedManagedObjects enumerateObjectsUsingBlock:^(NSManagedObject* cacheObject, NSUInteger idx, BOOL *stop) {
-        [representations addObject:[self representationFromManagedObject:cacheObject]];
+    // Only the objectUID and the objectID (for the entity name) of each row, limit and offset are applied by SQLite.
+    NSExpressionDescription* objectIDDescription = [[NSExpressionDescription alloc]init];
+    objectIDDescription.name = @"objectID";
+    objectIDDescription.expression = [NSExpression expressionForEvaluatedObject];
+    objectIDDescription.expressionResultType = NSObjectIDAttributeType;
+    
+    cacheFetchRequest.resultType = NSDictionaryResultType;
+    cacheFetchRequest.propertiesToFetch = @[APObjectUIDAttributeName,objectIDDescription];
+    cacheFetchRequest.relationshipKeyPathsForPrefetching = nil;
+    cacheFetchRequest.fetchBatchSize = 0;
+    
+    __block NSArray* results;
+    [self.mainContext performBlockAndWait:^{
+        NSError* fetchingError = nil;
+        results = [self.mainContext executeFetchRequest:cacheFetchRequest error:&fetchingError];
+        if (fetchingError) {
+            localError = fetchingError;
+        }
     }];
-    return representations;
+    
+    if (localError) {
+        if (error) *error = localError;
+        return nil;
+    }
+    
+    NSMutableArray* identities = [[NSMutableArray alloc]initWithCapacity:[results count]];
+    for (NSDictionary* result in results) {
+        [identities addObject:@{APObjectUIDAttributeName: result[APObjectUIDAttributeName],
+                                APObjectEntityNameAttributeName: [result[@"objectID"] entity].name}];
+    }
+    return identities;
 }
 
 
@@ -292,12 +513,26 @@
     
     NSFetchRequest* cacheFetchRequest = [self cacheFetchRequestFromFetchRequest:fetchRequest requestContext:requestContext];
     
+    // Properties are resolved by name against the cache model, cache control attributes are never returned.
+    NSEntityDescription* cacheEntity = self.model.entitiesByName[fetchRequest.entityName];
+    cacheFetchRequest.propertiesToGroupBy = nil;
+    cacheFetchRequest.propertiesToFetch = nil;
+    cacheFetchRequest.entity = cacheEntity;
+    cacheFetchRequest.propertiesToFetch = ([fetchRequest.propertiesToFetch count] > 0) ? [self cachePropertiesFromProperties:fetchRequest.propertiesToFetch] : [[fetchRequest.entity attributesByName] allKeys];
+    cacheFetchRequest.propertiesToGroupBy = [self cachePropertiesFromProperties:fetchRequest.propertiesToGroupBy];
+    
     __block NSArray* objects;
     [self.mainContext performBlockAndWait:^{
         NSError* fetchingError = nil;
-        objects = [self.mainContext executeFetchRequest:cacheFetchRequest error:&fetchingError];
+        NSArray* results = [self.mainContext executeFetchRequest:cacheFetchRequest error:&fetchingError];
         if (fetchingError) {
             localError = fetchingError;
+            return;
+        }
+        
+        objects = [self dictionaryRepresentationsFromResults:results error:&fetchingError];
+        if (!objects) {
+            localError = fetchingError;
         }
     }];
     
@@ -310,282 +545,719 @@
 }
 
 
-- (NSDictionary*) representationFromManagedObject: (NSManagedObject*) cacheObject {
-    if (AP_DEBUG_METHODS) { MLog()}
-    
-    
-    NSMutableDictionary* representation = [[NSMutableDictionary alloc]init];
-    representation[APObjectEntityNameAttributeName] = cacheObject.entity.name;
-    NSDictionary* properties = [cacheObject.entity propertiesByName];
-    
-    NSManagedObjectContext* moc = cacheObject.managedObjectContext;
-    NSAssert(moc, @"NSManagedObjectContext can't be nil");
-    [moc performBlockAndWait:^{
-    
-        [properties enumerateKeysAndObjectsUsingBlock:^(NSString* propertyName, NSPropertyDescription* propertyDescription, BOOL *stop) {
-            [cacheObject willAccessValueForKey:propertyName];
-            if ([propertyDescription isKindOfClass:[NSAttributeDescription class]]) {
-                
-                // Attribute
-                if ([[propertyDescription.userInfo valueForKey:APIncrementalStorePrivateAttributeKey] boolValue] != YES ) {
-                    representation[propertyName] = [cacheObject primitiveValueForKey:propertyName] ?: [NSNull null];
-                }
-                
-            } else if ([propertyDescription isKindOfClass:[NSRelationshipDescription class]]) {
-                NSRelationshipDescription* relationshipDescription = (NSRelationshipDescription*) propertyDescription;
-                
-                if (!relationshipDescription.isToMany) {
-                    
-                    // To-One
-                    
-                    NSManagedObject* relatedObject = [cacheObject primitiveValueForKey:propertyName];
-                    [relatedObject willAccessValueForKey:propertyName];
-                    
-                    if ([relatedObject valueForKey:APObjectUIDAttributeName] &&
-                        [[relatedObject valueForKey:APObjectStatusAttributeName] isEqualToNumber:@(APObjectStatusPopulated)]) {
-                        
-                            representation[propertyName] = @{relatedObject.entity.name:[relatedObject valueForKey:APObjectUIDAttributeName]};
-                        
-                    } else {
-                        representation[propertyName] =  [NSNull null];
-                    }
-                    
-                    [relatedObject didAccessValueForKey:propertyName];
-                    
-                } else {
-                    
-                    // To-Many
-                    
-                    NSSet* relatedObjects = [cacheObject primitiveValueForKey:propertyName];
-                    __block NSMutableDictionary* relatedObjectsRepresentation = [NSMutableDictionary dictionary];
-                    
-                    [relatedObjects enumerateObjectsUsingBlock:^(NSManagedObject* relatedObject, BOOL *stop) {
-                        [relatedObject willAccessValueForKey:propertyName];
-                        
-                        if ([relatedObject valueForKey:APObjectUIDAttributeName] &&
-                            [[relatedObject valueForKey:APObjectStatusAttributeName] isEqualToNumber:@(APObjectStatusPopulated)]) {
-                            
-                            NSMutableArray* relatedObjectsUID = [[relatedObjectsRepresentation valueForKey:relatedObject.entity.name]mutableCopy] ?: [NSMutableArray arrayWithCapacity:1];
-                            [relatedObjectsUID addObject:[relatedObject valueForKey:APObjectUIDAttributeName]];
-                            [relatedObjectsRepresentation setValue:relatedObjectsUID forKey:relatedObject.entity.name];
-                        }
-                        
-                        [relatedObject didAccessValueForKey:propertyName];
-                    }];
-                    representation[propertyName] = relatedObjectsRepresentation; //?: [NSNull null];
-                }
-            }
-            [cacheObject didAccessValueForKey:propertyName];
-        }];
-    }];
-    
-    return representation;
-}
-
-
-#pragma mark - Translate Predicates
-
-// Translates a user submitted fetchRequest to a "translated" request for local cache queries.
-- (NSFetchRequest*) cacheFetchRequestFromFetchRequest:(NSFetchRequest*) fetchRequest requestContext:(NSManagedObjectContext*) requestContext {
+// Property descriptions from the user model are replaced by their names, expression descriptions are kept as they are.
+- (NSArray*) cachePropertiesFromProperties:(NSArray*) properties {
     
-    if (AP_DEBUG_METHODS) { MLog()}
-    
-    NSFetchRequest* cacheFetchRequest = [fetchRequest copy];
-   
-    NSMutableArray* predicates = [NSMutableArray array];
-    
-    NSPredicate* translatedPredicate = [self cachePredicateFromPredicate:fetchRequest.predicate requestContext:requestContext forEntityName:fetchRequest.entityName];
-    if (translatedPredicate) [predicates addObject:translatedPredicate];
-    
-    [predicates addObject:[self controlPropertiesPredicate]];
-    [cacheFetchRequest setPredicate:[NSCompoundPredicate andPredicateWithSubpredicates:predicates]];
+    if (!properties) {
+        return nil;
+    }
     
-    return cacheFetchRequest;
+    NSMutableArray* cacheProperties = [NSMutableArray arrayWithCapacity:[properties count]];
+    for (id property in properties) {
+        if ([property isKindOfClass:[NSPropertyDescription class]] && ![property isKindOfClass:[NSExpressionDescription class]]) {
+            [cacheProperties addObject:[(NSPropertyDescription*) property name]];
+        } else {
+            [cacheProperties addObject:property];
+        }
+    }
+    return cacheProperties;
 }
 
 
-- (NSPredicate*) controlPropertiesPredicate {
+/*
+ Cache objectIDs (relationships, evaluated objects) are replaced by {"EntityName": objectUID}, with one query per entity.
+ Must be called from mainContext queue.
+ */
+- (NSArray*) dictionaryRepresentationsFromResults:(NSArray*) results
+                                            error:(NSError *__autoreleasing*)error {
+    
+    NSMutableDictionary* objectIDsByEntityName = [NSMutableDictionary dictionary];
+    BOOL hasBlobReferences = NO;
+    for (NSDictionary* result in results) {
+        for (id value in [result allValues]) {
+            if ([APBlobStore isReference:value]) {
+                hasBlobReferences = YES;
+                
+            } else if ([value isKindOfClass:[NSManagedObjectID class]]) {
+                NSManagedObjectID* objectID = value;
+                NSMutableArray* objectIDs = objectIDsByEntityName[objectID.entity.name];
+                if (!objectIDs) {
+                    objectIDs = [NSMutableArray array];
+                    objectIDsByEntityName[objectID.entity.name] = objectIDs;
+                }
+                [objectIDs addObject:objectID];
+            }
+        }
+    }
     
-    // see -[APDiskCache setModel:] for a comprehensive explanation
-    NSPredicate* lastModifiedDateIsNil = [NSPredicate predicateWithFormat:@"%K == nil",APObjectLastModifiedAttributeName];
-    NSPredicate* isNotCreatedRemotely = [NSPredicate predicateWithFormat:@"%K == NO",APObjectIsCreatedRemotelyAttributeName];
-    NSPredicate* wasCreatedLocally = [NSCompoundPredicate andPredicateWithSubpredicates:@[lastModifiedDateIsNil,isNotCreatedRemotely]];
+    if ([objectIDsByEntityName count] == 0 && !hasBlobReferences) {
+        return results;
+    }
     
-    NSPredicate* hasLastModifiedDate = [NSPredicate predicateWithFormat:@"%K != nil",APObjectLastModifiedAttributeName];
-    NSPredicate* hasLastModifiedDateOrWasCreatedLocally = [NSCompoundPredicate orPredicateWithSubpredicates:@[hasLastModifiedDate,wasCreatedLocally]];
-   
-    NSPredicate* onlyPopulatedObjectsObjects = [NSPredicate predicateWithFormat:@"%K == %@",APObjectStatusAttributeName,@(APObjectStatusPopulated)];
+    NSMutableDictionary* objectUIDsByObjectID = [NSMutableDictionary dictionary];
+    for (NSString* entityName in objectIDsByEntityName) {
+        NSError* fetchingError = nil;
+        NSDictionary* entityObjectUIDsByObjectID = [self populatedObjectUIDsForObjectIDs:objectIDsByEntityName[entityName]
+                                                                                  entity:self.model.entitiesByName[entityName]
+                                                                               inContext:self.mainContext
+                                                                                   error:&fetchingError];
+        if (!entityObjectUIDsByObjectID) {
+            if (error) *error = fetchingError;
+            return nil;
+        }
+        [objectUIDsByObjectID addEntriesFromDictionary:entityObjectUIDsByObjectID];
+    }
     
-    return [NSCompoundPredicate andPredicateWithSubpredicates:@[onlyPopulatedObjectsObjects,hasLastModifiedDateOrWasCreatedLocally]];
+    NSMutableArray* representations = [NSMutableArray arrayWithCapacity:[results count]];
+    for (NSDictionary* result in results) {
+        NSMutableDictionary* representation = [result mutableCopy];
+        [result enumerateKeysAndObjectsUsingBlock:^(id key, id value, BOOL *stop) {
+            if ([value isKindOfClass:[NSManagedObjectID class]]) {
+                NSString* objectUID = objectUIDsByObjectID[value];
+                representation[key] = objectUID ? @{[[(NSManagedObjectID*) value entity] name]: objectUID} : [NSNull null];
+                
+            } else if ([APBlobStore isReference:value]) {
+                representation[key] = [self dataForBlobReference:value];
+            }
+        }];
+        [representations addObject:representation];
+    }
+    return representations;
 }
 
 
-- (NSDictionary*) fetchObjectRepresentationForObjectUID:(NSString*) objectUID
+- (NSDictionary*) fetchRelatedObjectUIDsForRelationship:(NSRelationshipDescription*) relationship
+                                              objectUID:(NSString*) objectUID
+                                             entityName:(NSString*) entityName
                                          requestContext:(NSManagedObjectContext*) requestContext
-                                             entityName:(NSString*) entityName {
-    
-    if (AP_DEBUG_METHODS) { MLog()}
+                                                  error:(NSError *__autoreleasing*)error {
     
-    NSDictionary* managedObjectRep;
-    
-    NSFetchRequest *fetchRequest = [[NSFetchRequest alloc] initWithEntityName:entityName];
-    
-    // Object matching the objectUID and is populated
-    NSPredicate* objectUIDPredicate = [NSPredicate predicateWithFormat:@"%K == %@", APObjectUIDAttributeName, objectUID];
-    NSPredicate* populatedObjectsPredicate = [NSPredicate predicateWithFormat:@"%K == %@",APObjectStatusAttributeName,@(APObjectStatusPopulated)];
+    if (AP_DEBUG_METHODS) { MLog(@" - Relationship: %@",relationship.name)}
     
-    fetchRequest.predicate = [NSCompoundPredicate andPredicateWithSubpredicates:@[objectUIDPredicate,populatedObjectsPredicate]];
+    NSEntityDescription* entity = self.model.entitiesByName[entityName];
+    NSRelationshipDescription* cacheRelationship = entity.relationshipsByName[relationship.name];
+    NSRelationshipDescription* inverseRelationship = cacheRelationship.inverseRelationship;
     
-    __block NSArray *results;
-    __block NSError* localError;
+    NSPredicate* ownerPredicate = [NSCompoundPredicate andPredicateWithSubpredicates:@[[NSPredicate predicateWithFormat:@"%K == %@", APObjectUIDAttributeName, objectUID],
+                                                                                      [self controlPropertiesPredicate]]];
+    __block NSError* localError = nil;
+    __block NSMutableDictionary* relatedObjectUIDsByEntityName = nil;
     
-    [self.mainContext performBlockAndWait:^{
-        NSError *fetchingError = nil;
-        results = [self.mainContext executeFetchRequest:fetchRequest error:&fetchingError];
-        if (fetchingError) {
-            localError = fetchingError;
-        }
-    }];
-   
-    if (localError || [results count] > 1) {
-        // TODO handle error
-        [NSException raise:APIncrementalStoreExceptionInconsistency format:@"It was supposed to fetch only one object based on the objectUID: %@",objectUID];
+    if (!cacheRelationship.isToMany) {
         
-    } else if ([results count] == 1) {
-        managedObjectRep = [self representationFromManagedObject:[results lastObject]];
+        /*
+         To-One: the related objectID is a foreign key at the owner (no join, attributes aren't loaded),
+         then its UID if it is populated.
+         */
+        NSFetchRequest* fetchRequest = [[NSFetchRequest alloc] initWithEntityName:entityName];
+        fetchRequest.predicate = ownerPredicate;
+        fetchRequest.resultType = NSDictionaryResultType;
+        fetchRequest.propertiesToFetch = @[APObjectUIDAttributeName,relationship.name];
+        
+        [self.mainContext performBlockAndWait:^{
+            NSError* fetchingError = nil;
+            NSArray* results = [self.mainContext executeFetchRequest:fetchRequest error:&fetchingError];
+            if (fetchingError || [results count] == 0) {
+                localError = fetchingError;
+                return;
+            }
+            
+            NSManagedObjectID* relatedObjectID = [results lastObject][relationship.name];
+            NSDictionary* objectUIDsByObjectID = [self populatedObjectUIDsForObjectIDs:relatedObjectID ? @[relatedObjectID] : @[]
+                                                                                entity:cacheRelationship.destinationEntity
+                                                                             inContext:self.mainContext
+                                                                                 error:&fetchingError];
+            if (!objectUIDsByObjectID) {
+                localError = fetchingError;
+                return;
+            }
+            
+            relatedObjectUIDsByEntityName = [NSMutableDictionary dictionary];
+            if (objectUIDsByObjectID[relatedObjectID]) {
+                relatedObjectUIDsByEntityName[relatedObjectID.entity.name] = @[objectUIDsByObjectID[relatedObjectID]];
+            }
+        }];
+        
+    } else if (inverseRelationship) {
+        
+        /*
+         To-Many: the owner only needs to exist, the related objects are fetched from the destination
+         entity through the inverse relationship, only their UIDs and objectIDs.
+         */
+        NSFetchRequest* ownerFetchRequest = [[NSFetchRequest alloc] initWithEntityName:entityName];
+        ownerFetchRequest.predicate = ownerPredicate;
+        
+        NSString* inverseFormat = inverseRelationship.isToMany ? @"ANY %K.%K == %@" : @"%K.%K == %@";
+        NSPredicate* relatedPredicate = [NSCompoundPredicate andPredicateWithSubpredicates:@[[NSPredicate predicateWithFormat:inverseFormat, inverseRelationship.name, APObjectUIDAttributeName, objectUID],
+                                                                                            [NSPredicate predicateWithFormat:@"%K == %@",APObjectStatusAttributeName,@(APObjectStatusPopulated)],
+                                                                                            [NSPredicate predicateWithFormat:@"%K != nil",APObjectUIDAttributeName]]];
+        NSExpressionDescription* objectIDDescription = [[NSExpressionDescription alloc]init];
+        objectIDDescription.name = @"objectID";
+        objectIDDescription.expression = [NSExpression expressionForEvaluatedObject];
+        objectIDDescription.expressionResultType = NSObjectIDAttributeType;
+        
+        NSFetchRequest* relatedFetchRequest = [[NSFetchRequest alloc] initWithEntityName:cacheRelationship.destinationEntity.name];
+        relatedFetchRequest.predicate = relatedPredicate;
+        relatedFetchRequest.resultType = NSDictionaryResultType;
+        relatedFetchRequest.propertiesToFetch = @[APObjectUIDAttributeName,objectIDDescription];
+        
+        [self.mainContext performBlockAndWait:^{
+            NSError* fetchingError = nil;
+            NSUInteger numberOfOwners = [self.mainContext countForFetchRequest:ownerFetchRequest error:&fetchingError];
+            if (fetchingError || numberOfOwners == 0) {
+                localError = fetchingError;
+                return;
+            }
+            
+            NSArray* results = [self.mainContext executeFetchRequest:relatedFetchRequest error:&fetchingError];
+            if (fetchingError) {
+                localError = fetchingError;
+                return;
+            }
+            
+            relatedObjectUIDsByEntityName = [NSMutableDictionary dictionary];
+            for (NSDictionary* result in results) {
+                NSString* relatedEntityName = [result[@"objectID"] entity].name;
+                NSMutableArray* relatedObjectUIDs = relatedObjectUIDsByEntityName[relatedEntityName];
+                if (!relatedObjectUIDs) {
+                    relatedObjectUIDs = [NSMutableArray array];
+                    relatedObjectUIDsByEntityName[relatedEntityName] = relatedObjectUIDs;
+                }
+                [relatedObjectUIDs addObject:result[APObjectUIDAttributeName]];
+            }
+        }];
+        
+    } else {
+        
+        // No inverse relationship to query from, the owner has to be loaded.
+        NSFetchRequest* fetchRequest = [[NSFetchRequest alloc] initWithEntityName:entityName];
+        fetchRequest.predicate = [NSPredicate predicateWithFormat:@"%K == %@", APObjectUIDAttributeName, objectUID];
+        NSDictionary* representation = [[self fetchObjectRepresentations:fetchRequest requestContext:requestContext error:&localError] lastObject];
+        if (representation) {
+            relatedObjectUIDsByEntityName = [representation[relationship.name] mutableCopy];
+        }
     }
     
-    return managedObjectRep;
+    if (localError) {
+        if (error) *error = localError;
+        return nil;
+    }
+    return relatedObjectUIDsByEntityName;
 }
 
 
-// Translates a user submitted predicate to a "translated" one used on local cache queries.
-- (NSPredicate*) cachePredicateFromPredicate:(NSPredicate *)predicate
-                              requestContext:(NSManagedObjectContext*) requestContext
-                               forEntityName:(NSString*) entityName {
+/*
+ Representations are built for the whole set of objects at once. Related objects UIDs are read with one projected
+ query per relationship (and entity), instead of firing a fault for each related object.
+ */
+- (NSArray*) representationsFromManagedObjects:(NSArray*) cacheObjects
+                                         error:(NSError *__autoreleasing*)error {
     
-    if (AP_DEBUG_METHODS) { MLog()}
+    if (AP_DEBUG_METHODS) { MLog(@" - Number of objects: %lu",(unsigned long)[cacheObjects count])}
     
-    if (!predicate) {
-        return nil;
+    if ([cacheObjects count] == 0) {
+        return @[];
     }
     
-    NSPredicate *adjustedPredicate = [predicate copy];
+    __block NSError* localError = nil;
+    __block NSMutableArray* representations = [[NSMutableArray alloc]initWithCapacity:[cacheObjects count]];
     
-    if ([adjustedPredicate isKindOfClass:[NSCompoundPredicate class]]) {
-        NSCompoundPredicate *compoundPredicate = (NSCompoundPredicate*)predicate;
-        NSArray *subpredicates = [compoundPredicate subpredicates];
-        NSMutableArray *newSubpredicates = [NSMutableArray arrayWithCapacity:[subpredicates count]];
+    NSManagedObjectContext* moc = [[cacheObjects firstObject] managedObjectContext];
+    NSAssert(moc, @"NSManagedObjectContext can't be nil");
+    [moc performBlockAndWait:^{
         
-        for (NSPredicate *subpredicate in subpredicates) {
-            [newSubpredicates addObject:[self cachePredicateFromPredicate:subpredicate requestContext:requestContext  forEntityName:entityName]];
+        // {EntityName: [objects]}
+        NSMutableDictionary* cacheObjectsByEntityName = [NSMutableDictionary dictionary];
+        for (NSManagedObject* cacheObject in cacheObjects) {
+            NSMutableArray* entityCacheObjects = cacheObjectsByEntityName[cacheObject.entity.name];
+            if (!entityCacheObjects) {
+                entityCacheObjects = [NSMutableArray array];
+                cacheObjectsByEntityName[cacheObject.entity.name] = entityCacheObjects;
+            }
+            [entityCacheObjects addObject:cacheObject];
         }
-        adjustedPredicate = [[NSCompoundPredicate alloc] initWithType:compoundPredicate.compoundPredicateType subpredicates:newSubpredicates];
-        
-    } else {
-        
-        NSComparisonPredicate *comparisonPredicate = (NSComparisonPredicate *)adjustedPredicate;
-        NSExpression *rightExpression = comparisonPredicate.rightExpression;
-        NSExpression *leftExpression = comparisonPredicate.leftExpression;
         
-        if (comparisonPredicate.leftExpression.expressionType == NSConstantValueExpressionType) {
-            id leftConstValue = [self cacheTranslatedConstantValueFromConstantValue:comparisonPredicate.leftExpression.constantValue requestContext:requestContext];
-            leftExpression = [NSExpression expressionForConstantValue:leftConstValue];
-        }
+        // {EntityName: {RelationshipName: {ownerObjectID: {RelatedEntityName: [objectUID, ...]}}}}
+        NSMutableDictionary* relatedObjectUIDsByEntityName = [NSMutableDictionary dictionaryWithCapacity:[cacheObjectsByEntityName count]];
         
-        if (comparisonPredicate.rightExpression.expressionType == NSConstantValueExpressionType) {
-            id rightConstValue = [self cacheTranslatedConstantValueFromConstantValue:comparisonPredicate.rightExpression.constantValue requestContext:requestContext];
-            rightExpression = [NSExpression expressionForConstantValue:rightConstValue];
+        for (NSString* entityName in cacheObjectsByEntityName) {
+            NSArray* entityCacheObjects = cacheObjectsByEntityName[entityName];
+            NSDictionary* relationships = [self.model.entitiesByName[entityName] relationshipsByName];
+            NSMutableDictionary* relatedObjectUIDsByRelationshipName = [NSMutableDictionary dictionaryWithCapacity:[relationships count]];
+            
+            for (NSString* relationshipName in relationships) {
+                NSRelationshipDescription* relationship = relationships[relationshipName];
+                NSDictionary* relatedObjectUIDsByOwner = (relationship.isToMany) ?
+                [self relatedObjectUIDsForToManyRelationship:relationship ownerObjects:entityCacheObjects error:&localError] :
+                [self relatedObjectUIDsForToOneRelationship:relationship ownerObjects:entityCacheObjects error:&localError];
+                
+                if (!relatedObjectUIDsByOwner) {
+                    return;
+                }
+                relatedObjectUIDsByRelationshipName[relationshipName] = relatedObjectUIDsByOwner;
+            }
+            relatedObjectUIDsByEntityName[entityName] = relatedObjectUIDsByRelationshipName;
         }
         
-        adjustedPredicate = [NSComparisonPredicate predicateWithLeftExpression:leftExpression
-                                                               rightExpression:rightExpression
-                                                                      modifier:comparisonPredicate.comparisonPredicateModifier
-                                                                          type:comparisonPredicate.predicateOperatorType
-                                                                       options:comparisonPredicate.options];
-    }
-    return adjustedPredicate;
-}
-
+        // Single pass
+        for (NSManagedObject* cacheObject in cacheObjects) {
+            NSMutableDictionary* representation = [[NSMutableDictionary alloc]init];
+            representation[APObjectEntityNameAttributeName] = cacheObject.entity.name;
+            
+            [[cacheObject.entity attributesByName] enumerateKeysAndObjectsUsingBlock:^(NSString* attributeName, NSAttributeDescription* attributeDescription, BOOL *stop) {
+                if ([[attributeDescription.userInfo valueForKey:APIncrementalStorePrivateAttributeKey] boolValue] != YES ) {
+                    [cacheObject willAccessValueForKey:attributeName];
+                    id value = [cacheObject primitiveValueForKey:attributeName];
+                    [cacheObject didAccessValueForKey:attributeName];
+                    
+                    if ([APBlobStore isReference:value]) {
+                        value = [self dataForBlobReference:value];
+                    }
+                    representation[attributeName] = value ?: [NSNull null];
+                }
+            }];
+            
+            NSDictionary* relatedObjectUIDsByRelationshipName = relatedObjectUIDsByEntityName[cacheObject.entity.name];
+            [[cacheObject.entity relationshipsByName] enumerateKeysAndObjectsUsingBlock:^(NSString* relationshipName, NSRelationshipDescription* relationship, BOOL *stop) {
+                NSDictionary* relatedObjectUIDs = relatedObjectUIDsByRelationshipName[relationshipName][cacheObject.objectID];
+                
+                if (relationship.isToMany) {
+                    representation[relationshipName] = relatedObjectUIDs ?: @{};
+                    
+                } else {
+                    // {RelatedEntityName: objectUID}
+                    NSString* relatedEntityName = [[relatedObjectUIDs allKeys] lastObject];
+                    representation[relationshipName] = relatedEntityName ? @{relatedEntityName: [relatedObjectUIDs[relatedEntityName] lastObject]} : [NSNull null];
+                }
+            }];
+            
+            [representations addObject:representation];
+        }
+    }];
+    
+    if (localError) {
+        if (error) *error = localError;
+        return nil;
+    }
+    return representations;
+}
 
-- (id) cacheTranslatedConstantValueFromConstantValue:(id) constantValue requestContext:(NSManagedObjectContext*) requestContext {
+
+/*
+ @returns {ownerObjectID: {RelatedEntityName: [objectUID, ...]}}, only for owners with populated related objects.
+ Must be called from the owner objects context queue.
+ */
+- (NSDictionary*) relatedObjectUIDsForToManyRelationship:(NSRelationshipDescription*) relationship
+                                            ownerObjects:(NSArray*) ownerObjects
+                                                   error:(NSError *__autoreleasing*)error {
+    
+    NSManagedObjectContext* moc = [[ownerObjects firstObject] managedObjectContext];
+    NSArray* ownerObjectIDs = [ownerObjects valueForKey:@"objectID"];
+    NSRelationshipDescription* inverseRelationship = relationship.inverseRelationship;
+    NSMutableDictionary* relatedObjectUIDsByOwner = [NSMutableDictionary dictionary];
+    
+    void (^addRelatedObjectUID)(NSManagedObjectID*, NSString*, NSString*) = ^(NSManagedObjectID* ownerObjectID, NSString* relatedEntityName, NSString* relatedObjectUID) {
+        NSMutableDictionary* relatedObjectUIDsByEntityName = relatedObjectUIDsByOwner[ownerObjectID];
+        if (!relatedObjectUIDsByEntityName) {
+            relatedObjectUIDsByEntityName = [NSMutableDictionary dictionary];
+            relatedObjectUIDsByOwner[ownerObjectID] = relatedObjectUIDsByEntityName;
+        }
+        NSMutableArray* relatedObjectUIDs = relatedObjectUIDsByEntityName[relatedEntityName];
+        if (!relatedObjectUIDs) {
+            relatedObjectUIDs = [NSMutableArray array];
+            relatedObjectUIDsByEntityName[relatedEntityName] = relatedObjectUIDs;
+        }
+        [relatedObjectUIDs addObject:relatedObjectUID];
+    };
+    
+    NSError* fetchingError = nil;
     
-    id cacheTransletedConstantValue;
+    if (inverseRelationship && !inverseRelationship.isToMany) {
+        
+        // The owner is a foreign key at the related objects, one projected query for all owners.
+        NSExpressionDescription* objectIDDescription = [[NSExpressionDescription alloc]init];
+        objectIDDescription.name = @"objectID";
+        objectIDDescription.expression = [NSExpression expressionForEvaluatedObject];
+        objectIDDescription.expressionResultType = NSObjectIDAttributeType;
+        
+        NSFetchRequest* fetchRequest = [[NSFetchRequest alloc] initWithEntityName:relationship.destinationEntity.name];
+        fetchRequest.predicate = [NSCompoundPredicate andPredicateWithSubpredicates:@[[NSPredicate predicateWithFormat:@"%K IN %@",inverseRelationship.name,ownerObjectIDs],
+                                                                                      [NSPredicate predicateWithFormat:@"%K == %@",APObjectStatusAttributeName,@(APObjectStatusPopulated)],
+                                                                                      [NSPredicate predicateWithFormat:@"%K != nil",APObjectUIDAttributeName]]];
+        fetchRequest.resultType = NSDictionaryResultType;
+        fetchRequest.propertiesToFetch = @[APObjectUIDAttributeName,inverseRelationship.name,objectIDDescription];
+        
+        NSArray* results = [moc executeFetchRequest:fetchRequest error:&fetchingError];
+        for (NSDictionary* result in results) {
+            addRelatedObjectUID(result[inverseRelationship.name],[result[@"objectID"] entity].name,result[APObjectUIDAttributeName]);
+        }
+        
+    } else {
+        
+        // Many-to-many, the join table can't be projected. All related objects are prefetched in one query instead.
+        NSFetchRequest* fetchRequest = [[NSFetchRequest alloc] initWithEntityName:relationship.entity.name];
+        fetchRequest.predicate = [NSPredicate predicateWithFormat:@"self IN %@",ownerObjectIDs];
+        fetchRequest.relationshipKeyPathsForPrefetching = @[relationship.name];
+        
+        NSArray* results = [moc executeFetchRequest:fetchRequest error:&fetchingError];
+        for (NSManagedObject* ownerObject in results) {
+            for (NSManagedObject* relatedObject in [ownerObject primitiveValueForKey:relationship.name]) {
+                NSString* relatedObjectUID = [relatedObject primitiveValueForKey:APObjectUIDAttributeName];
+                if (relatedObjectUID && [[relatedObject primitiveValueForKey:APObjectStatusAttributeName] isEqualToNumber:@(APObjectStatusPopulated)]) {
+                    addRelatedObjectUID(ownerObject.objectID,relatedObject.entity.name,relatedObjectUID);
+                }
+            }
+        }
+    }
+    
+    if (fetchingError) {
+        if (error) *error = fetchingError;
+        return nil;
+    }
+    return relatedObjectUIDsByOwner;
+}
+
+
+/*
+ The related objectIDs are already known by the owners (faults aren't fired), the related objects
+ UIDs are read with one projected query.
+ @returns {ownerObjectID: {RelatedEntityName: [objectUID]}}, only for owners with a populated related object.
+ Must be called from the owner objects context queue.
+ */
+- (NSDictionary*) relatedObjectUIDsForToOneRelationship:(NSRelationshipDescription*) relationship
+                                           ownerObjects:(NSArray*) ownerObjects
+                                                  error:(NSError *__autoreleasing*)error {
+    
+    NSMutableDictionary* ownerObjectIDsByRelatedObjectID = [NSMutableDictionary dictionary];
+    for (NSManagedObject* ownerObject in ownerObjects) {
+        NSManagedObjectID* relatedObjectID = [[ownerObject primitiveValueForKey:relationship.name] objectID];
+        if (relatedObjectID) {
+            NSMutableArray* ownerObjectIDs = ownerObjectIDsByRelatedObjectID[relatedObjectID] ?: [NSMutableArray array];
+            [ownerObjectIDs addObject:ownerObject.objectID];
+            ownerObjectIDsByRelatedObjectID[relatedObjectID] = ownerObjectIDs;
+        }
+    }
+    
+    NSError* fetchingError = nil;
+    NSDictionary* objectUIDsByObjectID = [self populatedObjectUIDsForObjectIDs:[ownerObjectIDsByRelatedObjectID allKeys]
+                                                                        entity:relationship.destinationEntity
+                                                                     inContext:[[ownerObjects firstObject] managedObjectContext]
+                                                                         error:&fetchingError];
+    if (!objectUIDsByObjectID) {
+        if (error) *error = fetchingError;
+        return nil;
+    }
+    
+    NSMutableDictionary* relatedObjectUIDsByOwner = [NSMutableDictionary dictionaryWithCapacity:[ownerObjects count]];
+    [objectUIDsByObjectID enumerateKeysAndObjectsUsingBlock:^(NSManagedObjectID* relatedObjectID, NSString* relatedObjectUID, BOOL *stop) {
+        for (NSManagedObjectID* ownerObjectID in ownerObjectIDsByRelatedObjectID[relatedObjectID]) {
+            relatedObjectUIDsByOwner[ownerObjectID] = @{relatedObjectID.entity.name: @[relatedObjectUID]};
+        }
+    }];
+    return relatedObjectUIDsByOwner;
+}
+
+
+/*
+ @returns {objectID: objectUID} for the objects that are populated.
+ Must be called from the context queue.
+ */
+- (NSDictionary*) populatedObjectUIDsForObjectIDs:(NSArray*) objectIDs
+                                           entity:(NSEntityDescription*) entity
+                                        inContext:(NSManagedObjectContext*) context
+                                            error:(NSError *__autoreleasing*)error {
+    
+    if ([objectIDs count] == 0) {
+        return @{};
+    }
+    
+    NSExpressionDescription* objectIDDescription = [[NSExpressionDescription alloc]init];
+    objectIDDescription.name = @"objectID";
+    objectIDDescription.expression = [NSExpression expressionForEvaluatedObject];
+    objectIDDescription.expressionResultType = NSObjectIDAttributeType;
+    
+    NSFetchRequest* fetchRequest = [[NSFetchRequest alloc] initWithEntityName:entity.name];
+    fetchRequest.predicate = [NSCompoundPredicate andPredicateWithSubpredicates:@[[NSPredicate predicateWithFormat:@"self IN %@",objectIDs],
+                                                                                  [NSPredicate predicateWithFormat:@"%K == %@",APObjectStatusAttributeName,@(APObjectStatusPopulated)],
+                                                                                  [NSPredicate predicateWithFormat:@"%K != nil",APObjectUIDAttributeName]]];
+    fetchRequest.resultType = NSDictionaryResultType;
+    fetchRequest.propertiesToFetch = @[APObjectUIDAttributeName,objectIDDescription];
+    
+    NSError* fetchingError = nil;
+    NSArray* results = [context executeFetchRequest:fetchRequest error:&fetchingError];
+    if (fetchingError) {
+        if (error) *error = fetchingError;
+        return nil;
+    }
+    
+    NSMutableDictionary* objectUIDsByObjectID = [NSMutableDictionary dictionaryWithCapacity:[results count]];
+    for (NSDictionary* result in results) {
+        objectUIDsByObjectID[result[@"objectID"]] = result[APObjectUIDAttributeName];
+    }
+    return objectUIDsByObjectID;
+}
+
+
+#pragma mark - Translate Predicates
+
+// Translates a user submitted fetchRequest to a "translated" request for local cache queries.
+- (NSFetchRequest*) cacheFetchRequestFromFetchRequest:(NSFetchRequest*) fetchRequest requestContext:(NSManagedObjectContext*) requestContext {
+    
+    if (AP_DEBUG_METHODS) { MLog()}
+    
+    NSFetchRequest* cacheFetchRequest = [fetchRequest copy];
+    [cacheFetchRequest setPredicate:[self cachePredicateFromPredicate:fetchRequest.predicate requestContext:requestContext forEntityName:fetchRequest.entityName]];
+    
+    return cacheFetchRequest;
+}
+
+
+// see -[APDiskCache setModel:] for a comprehensive explanation
+- (NSPredicate*) newControlPropertiesPredicate {
+    
+    NSPredicate* lastModifiedDateIsNil = [NSPredicate predicateWithFormat:@"%K == nil",APObjectLastModifiedAttributeName];
+    NSPredicate* isNotCreatedRemotely = [NSPredicate predicateWithFormat:@"%K == NO",APObjectIsCreatedRemotelyAttributeName];
+    NSPredicate* wasCreatedLocally = [NSCompoundPredicate andPredicateWithSubpredicates:@[lastModifiedDateIsNil,isNotCreatedRemotely]];
+    
+    NSPredicate* hasLastModifiedDate = [NSPredicate predicateWithFormat:@"%K != nil",APObjectLastModifiedAttributeName];
+    NSPredicate* hasLastModifiedDateOrWasCreatedLocally = [NSCompoundPredicate orPredicateWithSubpredicates:@[hasLastModifiedDate,wasCreatedLocally]];
+   
+    NSPredicate* onlyPopulatedObjectsObjects = [NSPredicate predicateWithFormat:@"%K == %@",APObjectStatusAttributeName,@(APObjectStatusPopulated)];
+    
+    return [NSCompoundPredicate andPredicateWithSubpredicates:@[onlyPopulatedObjectsObjects,hasLastModifiedDateOrWasCreatedLocally]];
+}
+
+
+- (NSDictionary*) fetchObjectRepresentationForObjectUID:(NSString*) objectUID
+                                         requestContext:(NSManagedObjectContext*) requestContext
+                                             entityName:(NSString*) entityName {
+    
+    if (AP_DEBUG_METHODS) { MLog()}
+    
+    NSDictionary* managedObjectRep;
+    
+    NSFetchRequest *fetchRequest = [[NSFetchRequest alloc] initWithEntityName:entityName];
+    
+    // Object matching the objectUID and is populated
+    NSPredicate* objectUIDPredicate = [NSPredicate predicateWithFormat:@"%K == %@", APObjectUIDAttributeName, objectUID];
+    NSPredicate* populatedObjectsPredicate = [NSPredicate predicateWithFormat:@"%K == %@",APObjectStatusAttributeName,@(APObjectStatusPopulated)];
+    
+    fetchRequest.predicate = [NSCompoundPredicate andPredicateWithSubpredicates:@[objectUIDPredicate,populatedObjectsPredicate]];
+    
+    __block NSArray *results;
+    __block NSError* localError;
+    
+    [self.mainContext performBlockAndWait:^{
+        NSError *fetchingError = nil;
+        results = [self.mainContext executeFetchRequest:fetchRequest error:&fetchingError];
+        if (fetchingError) {
+            localError = fetchingError;
+        }
+    }];
+   
+    if (localError || [results count] > 1) {
+        // TODO handle error
+        [NSException raise:APIncrementalStoreExceptionInconsistency format:@"It was supposed to fetch only one object based on the objectUID: %@",objectUID];
+        
+    } else if ([results count] == 1) {
+        NSError* representationError = nil;
+        managedObjectRep = [[self representationsFromManagedObjects:results error:&representationError] lastObject];
+        if (representationError) {
+            if (AP_DEBUG_ERRORS) {ELog(@"Error creating representation for objectUID %@: %@",objectUID,representationError)}
+        }
+    }
+    
+    return managedObjectRep;
+}
+
+
+/*
+ Translates a user submitted predicate to a "translated" one used on local cache queries, including the control properties predicate.
+ 
+ Predicates with the same structure (ie: the same predicate format but for the constants) are translated only once,
+ their constants are replaced by $APPredicateConstantN variables and the resulting template is kept in predicateTemplatesByStructure.
+ Each fetch only translates its constants and substitutes them in the template.
+ */
+- (NSPredicate*) cachePredicateFromPredicate:(NSPredicate *)predicate
+                              requestContext:(NSManagedObjectContext*) requestContext
+                               forEntityName:(NSString*) entityName {
+    
+    if (AP_DEBUG_METHODS) { MLog()}
+    
+    if (!predicate) {
+        return self.controlPropertiesPredicate;
+    }
+    
+    NSMutableString* structure = [NSMutableString string];
+    NSMutableArray* constants = [NSMutableArray array];
+    [self appendStructureOfPredicate:predicate toString:structure constants:constants];
+    
+    NSPredicate* predicateTemplate = [self.predicateTemplatesByStructure objectForKey:structure];
+    BOOL isTemplateCached = (predicateTemplate != nil);
+    
+    if (!predicateTemplate) {
+        NSUInteger variableIndex = 0;
+        NSPredicate* templatePredicate = [self templateFromPredicate:predicate variableIndex:&variableIndex];
+        predicateTemplate = [NSCompoundPredicate andPredicateWithSubpredicates:@[templatePredicate,self.controlPropertiesPredicate]];
+        [self.predicateTemplatesByStructure setObject:predicateTemplate forKey:structure];
+    }
+    
+    @synchronized(self.predicateTemplatesByStructure) {
+        if (isTemplateCached) {
+            self.predicateTemplateHits++;
+        } else {
+            self.predicateTemplateMisses++;
+        }
+    }
+    
+    if ([constants count] == 0) {
+        return predicateTemplate;
+    }
+    
+    NSMutableDictionary* variables = [NSMutableDictionary dictionaryWithCapacity:[constants count]];
+    [constants enumerateObjectsUsingBlock:^(id constantValue, NSUInteger idx, BOOL *stop) {
+        id translatedConstantValue = [self cacheTranslatedConstantValueFromConstantValue:constantValue requestContext:requestContext];
+        variables[[self variableNameForConstantAtIndex:idx]] = translatedConstantValue ?: [NSNull null];
+    }];
+    
+    return [predicateTemplate predicateWithSubstitutionVariables:variables];
+}
+
+
+// Constants become variables of the template, except nil which may be part of the structure (ie: "name == nil")
+- (BOOL) isParameterizableExpression:(NSExpression*) expression {
+    
+    return (expression.expressionType == NSConstantValueExpressionType &&
+            expression.constantValue != nil &&
+            expression.constantValue != [NSNull null]);
+}
+
+
+- (NSString*) variableNameForConstantAtIndex:(NSUInteger) idx {
+    
+    return [APPredicateConstantVariablePrefix stringByAppendingFormat:@"%lu",(unsigned long)idx];
+}
+
+
+// The constants are collected in the same order -templateFromPredicate:variableIndex: numbers the variables.
+- (void) appendStructureOfPredicate:(NSPredicate*) predicate
+                           toString:(NSMutableString*) structure
+                          constants:(NSMutableArray*) constants {
+    
+    if ([predicate isKindOfClass:[NSCompoundPredicate class]]) {
+        NSCompoundPredicate* compoundPredicate = (NSCompoundPredicate*) predicate;
+        [structure appendFormat:@"(%lu",(unsigned long)compoundPredicate.compoundPredicateType];
+        
+        for (NSPredicate* subpredicate in compoundPredicate.subpredicates) {
+            [structure appendString:@" "];
+            [self appendStructureOfPredicate:subpredicate toString:structure constants:constants];
+        }
+        [structure appendString:@")"];
+        
+    } else if ([predicate isKindOfClass:[NSComparisonPredicate class]]) {
+        NSComparisonPredicate* comparisonPredicate = (NSComparisonPredicate*) predicate;
+        [structure appendFormat:@"[%lu %lu %lu ",(unsigned long)comparisonPredicate.predicateOperatorType,
+         (unsigned long)comparisonPredicate.comparisonPredicateModifier,(unsigned long)comparisonPredicate.options];
+        
+        for (NSExpression* expression in @[comparisonPredicate.leftExpression,comparisonPredicate.rightExpression]) {
+            if ([self isParameterizableExpression:expression]) {
+                [structure appendString:@"$ "];
+                [constants addObject:expression.constantValue];
+            } else {
+                [structure appendFormat:@"%@ ",expression];
+            }
+        }
+        [structure appendString:@"]"];
+        
+    } else {
+        [structure appendString:predicate.predicateFormat];
+    }
+}
+
+
+- (NSPredicate*) templateFromPredicate:(NSPredicate*) predicate
+                         variableIndex:(NSUInteger*) variableIndex {
+    
+    if ([predicate isKindOfClass:[NSCompoundPredicate class]]) {
+        NSCompoundPredicate *compoundPredicate = (NSCompoundPredicate*)predicate;
+        NSMutableArray *newSubpredicates = [NSMutableArray arrayWithCapacity:[compoundPredicate.subpredicates count]];
+        
+        for (NSPredicate *subpredicate in compoundPredicate.subpredicates) {
+            [newSubpredicates addObject:[self templateFromPredicate:subpredicate variableIndex:variableIndex]];
+        }
+        return [[NSCompoundPredicate alloc] initWithType:compoundPredicate.compoundPredicateType subpredicates:newSubpredicates];
+        
+    } else if ([predicate isKindOfClass:[NSComparisonPredicate class]]) {
+        NSComparisonPredicate *comparisonPredicate = (NSComparisonPredicate *)predicate;
+        NSExpression *leftExpression = comparisonPredicate.leftExpression;
+        NSExpression *rightExpression = comparisonPredicate.rightExpression;
+        
+        if ([self isParameterizableExpression:leftExpression]) {
+            leftExpression = [NSExpression expressionForVariable:[self variableNameForConstantAtIndex:(*variableIndex)++]];
+        }
+        
+        if ([self isParameterizableExpression:rightExpression]) {
+            rightExpression = [NSExpression expressionForVariable:[self variableNameForConstantAtIndex:(*variableIndex)++]];
+        }
+        
+        return [NSComparisonPredicate predicateWithLeftExpression:leftExpression
+                                                  rightExpression:rightExpression
+                                                         modifier:comparisonPredicate.comparisonPredicateModifier
+                                                             type:comparisonPredicate.predicateOperatorType
+                                                          options:comparisonPredicate.options];
+    }
+    return predicate;
+}
+
+
+- (id) cacheTranslatedConstantValueFromConstantValue:(id) constantValue requestContext:(NSManagedObjectContext*) requestContext {
     
     if ([constantValue isKindOfClass:[NSManagedObject class]]) {
         NSManagedObjectID* objectID = [(NSManagedObject *)constantValue objectID];
-        cacheTransletedConstantValue = [self cachedManagedObjectIDFromObjectID:objectID];
+        return [self cachedManagedObjectIDFromObjectID:objectID];
         
     } else if ([constantValue isKindOfClass:[NSManagedObjectID class]]) {
-        NSManagedObjectID* objectID = (NSManagedObjectID *)constantValue;
-        cacheTransletedConstantValue = [self cachedManagedObjectIDFromObjectID:objectID];
+        return [self cachedManagedObjectIDFromObjectID:constantValue];
         
-    //} else if ([constantValue isKindOfClass:[NSMutableSet class]]) {
-    } else if ([constantValue isKindOfClass:[NSSet class]]) {
-        NSSet* mutableSet = constantValue;
+    } else if ([constantValue isKindOfClass:[NSSet class]] || [constantValue isKindOfClass:[NSArray class]]) {
         
-        __block NSMutableSet* cacheTranslatedSet;
-        __block NSInteger capacity = 0;
-        
-        [requestContext performBlockAndWait:^{
-            capacity = [mutableSet count];
-            cacheTranslatedSet = [[NSMutableSet alloc]initWithCapacity:capacity];
-            
-            [mutableSet enumerateObjectsUsingBlock:^(id obj, BOOL *stop) {
-                NSManagedObjectID* objectID;
-                
+        // Sets may be relationship faults and arrays may have managed objects, both must be read in their context.
+        BOOL needsRequestContext = [constantValue isKindOfClass:[NSSet class]];
+        if (!needsRequestContext) {
+            for (id obj in constantValue) {
                 if ([obj isKindOfClass:[NSManagedObject class]]) {
-                    objectID = [(NSManagedObject *)obj objectID];
-                    
-                } else if ([obj isKindOfClass:[NSManagedObjectID class]]) {
-                    objectID = (NSManagedObjectID *)obj;
-                    
-                } else {
-                    NSLog(@"Error - Predicate constant %@ not supported by APIncrementalStore yet",constantValue);
+                    needsRequestContext = YES;
+                    break;
                 }
-                [cacheTranslatedSet addObject:[self cachedManagedObjectIDFromObjectID:objectID]];
-            }];
-        }];
-        cacheTransletedConstantValue = cacheTranslatedSet;
-        
-    } else if ([constantValue isKindOfClass:[NSArray class]]) {
-        NSArray* array = constantValue;
-        
-        __block NSMutableArray* cacheTranslatedSet;
-        __block NSInteger capacity = 0;
+            }
+        }
         
-        [requestContext performBlockAndWait:^{
-            capacity = [array count];
-            cacheTranslatedSet = [[NSMutableArray alloc]initWithCapacity:capacity];
+        __block id cacheTranslatedCollection;
+        void (^translateBlock)(void) = ^{
+            cacheTranslatedCollection = [constantValue isKindOfClass:[NSSet class]] ? [NSMutableSet setWithCapacity:[constantValue count]] : [NSMutableArray arrayWithCapacity:[constantValue count]];
             
-            [array enumerateObjectsUsingBlock:^(id obj, NSUInteger idx, BOOL *stop) {
-                NSManagedObjectID* objectID;
-                
-                if ([obj isKindOfClass:[NSManagedObject class]]) {
-                    objectID = [(NSManagedObject *)obj objectID];
-                    
-                } else if ([obj isKindOfClass:[NSManagedObjectID class]]) {
-                    objectID = (NSManagedObjectID *)obj;
+            for (id obj in constantValue) {
+                if ([obj isKindOfClass:[NSManagedObject class]] || [obj isKindOfClass:[NSManagedObjectID class]]) {
+                    id cacheObjectID = [self cacheTranslatedConstantValueFromConstantValue:obj requestContext:requestContext];
+                    if (cacheObjectID) [cacheTranslatedCollection addObject:cacheObjectID];
                     
                 } else {
-                    NSLog(@"Error - Predicate constant %@ not supported by APIncrementalStore yet",constantValue);
+                    // Strings, numbers, etc (ie: objectUIDs) are used as they are
+                    [cacheTranslatedCollection addObject:obj];
                 }
-                [cacheTranslatedSet addObject:[self cachedManagedObjectIDFromObjectID:objectID]];
-            }];
-        }];
-        cacheTransletedConstantValue = cacheTranslatedSet;
-        
-    } else /*if ([constantValue isKindOfClass:[NSString class]] ||
-               [constantValue isKindOfClass:[NSNumber class]] ||
-               [constantValue isKindOfClass:[NSDate class]] ||
-                constantValue == nil)*/ {
-        cacheTransletedConstantValue = constantValue;
+            }
+        };
         
-   /* } else {
-        NSLog(@"Error - Predicate constant %@ not supported by APIncrementalStore yet",constantValue);*/
+        if (needsRequestContext && requestContext) {
+            [requestContext performBlockAndWait:translateBlock];
+        } else {
+            translateBlock();
+        }
+        return cacheTranslatedCollection;
     }
     
-    return cacheTransletedConstantValue;
+    // Strings, numbers, dates, etc.
+    return constantValue;
 }
 
 
@@ -602,6 +1274,11 @@
     
     if (AP_DEBUG_METHODS) { MLog()}
     
+    NSManagedObjectID* indexedObjectID = [self indexedObjectIDForObjectUID:objectUID entityName:entityName];
+    if (indexedObjectID) {
+        return indexedObjectID;
+    }
+    
     NSFetchRequest *fetchRequest = [[NSFetchRequest alloc] initWithEntityName:entityName];
     //NSEntityDescription *desc = [NSEntityDescription entityForName:entityName inManagedObjectContext:self.localContext];
     
@@ -645,10 +1322,172 @@
         // result count == 1
         cacheObject = [results lastObject];
     }
+    
+    if (cacheObject) {
+        [self indexObjectID:[cacheObject objectID] forObjectUID:objectUID];
+    }
     return cacheObject ? [cacheObject objectID] : nil;
 }
 
 
+#pragma mark - ObjectID Index
+
+- (NSString*) rootEntityNameForEntity:(NSEntityDescription*) entity {
+    
+    while (entity.superentity) {
+        entity = entity.superentity;
+    }
+    return entity.name;
+}
+
+
+- (NSManagedObjectID*) indexedObjectIDForObjectUID:(NSString*) objectUID
+                                        entityName:(NSString*) entityName {
+    
+    if (!objectUID) {
+        return nil;
+    }
+    
+    NSEntityDescription* entity = self.model.entitiesByName[entityName];
+    NSString* rootEntityName = [self rootEntityNameForEntity:entity];
+    
+    @synchronized(self.objectIDsByObjectUIDByEntityName) {
+        NSManagedObjectID* objectID = self.objectIDsByObjectUIDByEntityName[rootEntityName][objectUID];
+        
+        // ObjectUIDs are unique, an object from a sibling entity means there's no such object for this entity.
+        if (objectID && ![objectID.entity isKindOfEntity:entity]) {
+            objectID = nil;
+        }
+        
+        if (objectID) {
+            self.objectIDIndexHits++;
+        } else {
+            self.objectIDIndexMisses++;
+        }
+        return objectID;
+    }
+}
+
+
+- (void) indexObjectID:(NSManagedObjectID*) objectID
+          forObjectUID:(NSString*) objectUID {
+    
+    if (!objectUID || [objectID isTemporaryID]) {
+        return;
+    }
+    
+    NSString* rootEntityName = [self rootEntityNameForEntity:objectID.entity];
+    
+    @synchronized(self.objectIDsByObjectUIDByEntityName) {
+        NSMutableDictionary* objectIDsByObjectUID = self.objectIDsByObjectUIDByEntityName[rootEntityName];
+        if (!objectIDsByObjectUID) {
+            objectIDsByObjectUID = [NSMutableDictionary dictionary];
+            self.objectIDsByObjectUIDByEntityName[rootEntityName] = objectIDsByObjectUID;
+        }
+        objectIDsByObjectUID[objectUID] = objectID;
+        self.objectUIDsByObjectID[objectID] = objectUID;
+    }
+}
+
+
+/*
+ Objects are deleted by the sync operation, which uses its own persistent store coordinator,
+ therefore their objectIDs need to be mapped to ours before looking them up.
+ */
+- (void) evictDeletedObjectsFromObjectIDIndex:(NSSet*) deletedObjects {
+    
+    if ([deletedObjects count] == 0) {
+        return;
+    }
+    
+    @synchronized(self.objectIDsByObjectUIDByEntityName) {
+        for (NSManagedObject* deletedObject in deletedObjects) {
+            NSManagedObjectID* objectID = [self.psc managedObjectIDForURIRepresentation:[deletedObject.objectID URIRepresentation]];
+            NSString* objectUID = objectID ? self.objectUIDsByObjectID[objectID] : nil;
+            
+            if (objectUID) {
+                [self.objectIDsByObjectUIDByEntityName[[self rootEntityNameForEntity:objectID.entity]] removeObjectForKey:objectUID];
+                [self.objectUIDsByObjectID removeObjectForKey:objectID];
+            }
+        }
+    }
+}
+
+
+- (void) resetObjectIDIndex {
+    
+    @synchronized(self.objectIDsByObjectUIDByEntityName) {
+        [self.objectIDsByObjectUIDByEntityName removeAllObjects];
+        [self.objectUIDsByObjectID removeAllObjects];
+    }
+}
+
+
+- (void) warmUpObjectIDIndexForObjectUIDs:(NSArray*) objectUIDs
+                               entityName:(NSString*) entityName {
+    
+    if (AP_DEBUG_METHODS) { MLog(@" - Entity: %@ - Number of objectUIDs: %lu",entityName,(unsigned long)[objectUIDs count])}
+    
+    NSEntityDescription* entity = self.model.entitiesByName[entityName];
+    NSString* rootEntityName = [self rootEntityNameForEntity:entity];
+    
+    NSMutableArray* objectUIDsToFetch = [NSMutableArray arrayWithCapacity:[objectUIDs count]];
+    @synchronized(self.objectIDsByObjectUIDByEntityName) {
+        NSDictionary* objectIDsByObjectUID = self.objectIDsByObjectUIDByEntityName[rootEntityName];
+        for (NSString* objectUID in objectUIDs) {
+            if (!objectIDsByObjectUID[objectUID]) [objectUIDsToFetch addObject:objectUID];
+        }
+    }
+    
+    if ([objectUIDsToFetch count] == 0) {
+        return;
+    }
+    
+    NSExpressionDescription* objectIDDescription = [[NSExpressionDescription alloc]init];
+    objectIDDescription.name = @"objectID";
+    objectIDDescription.expression = [NSExpression expressionForEvaluatedObject];
+    objectIDDescription.expressionResultType = NSObjectIDAttributeType;
+    
+    NSFetchRequest* fetchRequest = [[NSFetchRequest alloc] initWithEntityName:entityName];
+    fetchRequest.predicate = [NSPredicate predicateWithFormat:@"%K IN %@", APObjectUIDAttributeName, objectUIDsToFetch];
+    fetchRequest.resultType = NSDictionaryResultType;
+    fetchRequest.propertiesToFetch = @[APObjectUIDAttributeName,objectIDDescription];
+    
+    __block NSArray* results;
+    [self.mainContext performBlockAndWait:^{
+        NSError* fetchError = nil;
+        results = [self.mainContext executeFetchRequest:fetchRequest error:&fetchError];
+        if (fetchError) {
+            if (AP_DEBUG_ERRORS) {ELog(@"Error warming up objectID index: %@",fetchError)}
+        }
+    }];
+    
+    for (NSDictionary* result in results) {
+        [self indexObjectID:result[@"objectID"] forObjectUID:result[APObjectUIDAttributeName]];
+    }
+}
+
+
+- (void) warmUpObjectIDIndexForRepresentations:(NSArray*) representations {
+    
+    NSMutableDictionary* objectUIDsByEntityName = [NSMutableDictionary dictionary];
+    
+    for (NSDictionary* representation in representations) {
+        NSString* entityName = representation[APObjectEntityNameAttributeName];
+        NSString* objectUID = representation[APObjectUIDAttributeName];
+        if (entityName && objectUID) {
+            NSMutableArray* objectUIDs = objectUIDsByEntityName[entityName] ?: [NSMutableArray array];
+            [objectUIDs addObject:objectUID];
+            objectUIDsByEntityName[entityName] = objectUIDs;
+        }
+    }
+    
+    [objectUIDsByEntityName enumerateKeysAndObjectsUsingBlock:^(NSString* entityName, NSArray* objectUIDs, BOOL *stop) {
+        [self warmUpObjectIDIndexForObjectUIDs:objectUIDs entityName:entityName];
+    }];
+}
+
+
 #pragma mark - Inserting/Creating/Updating
 
 - (BOOL)insertObjectRepresentations:(NSArray*) representations
@@ -656,38 +1495,160 @@
     
     if (AP_DEBUG_METHODS) { MLog()}
     
-    __block BOOL success = YES;
+    return [self saveInsertedObjectRepresentations:representations updatedObjectRepresentations:nil deletedObjectRepresentations:nil error:error];
+}
+
+
+- (BOOL)updateObjectRepresentations:(NSArray*) updateObjects
+// entityName:(NSString*) entityName
+                              error:(NSError *__autoreleasing *) error {
     
-    // Update local context with received representations
-    [representations enumerateObjectsUsingBlock:^(NSDictionary* representation, NSUInteger idx, BOOL *stop) {
-        NSString* objectUID = [representation valueForKey:APObjectUIDAttributeName];
-        if (!objectUID) {
-            [NSException raise:APIncrementalStoreExceptionInconsistency format:@"Representation must have objectUID set"];
+    if (AP_DEBUG_METHODS) {MLog()}
+    
+    return [self saveInsertedObjectRepresentations:nil updatedObjectRepresentations:updateObjects deletedObjectRepresentations:nil error:error];
+}
+
+
+- (BOOL)deleteObjectRepresentations:(NSArray*) deleteObjects
+                              error:(NSError *__autoreleasing *)error {
+    
+    if (AP_DEBUG_METHODS) {MLog()}
+    
+    return [self saveInsertedObjectRepresentations:nil updatedObjectRepresentations:nil deletedObjectRepresentations:deleteObjects error:error];
+}
+
+
+- (BOOL) saveInsertedObjectRepresentations:(NSArray*) insertedObjects
+              updatedObjectRepresentations:(NSArray*) updatedObjects
+              deletedObjectRepresentations:(NSArray*) deletedObjects
+                                     error:(NSError *__autoreleasing *)error {
+    
+    if (AP_DEBUG_METHODS) { MLog(@" - Inserted: %lu - Updated: %lu - Deleted: %lu",(unsigned long)[insertedObjects count],(unsigned long)[updatedObjects count],(unsigned long)[deletedObjects count])}
+    
+    // All objects are resolved upfront with one query per entity
+    NSMutableArray* allObjects = [NSMutableArray arrayWithCapacity:[insertedObjects count] + [updatedObjects count] + [deletedObjects count]];
+    if (insertedObjects) [allObjects addObjectsFromArray:insertedObjects];
+    if (updatedObjects) [allObjects addObjectsFromArray:updatedObjects];
+    if (deletedObjects) [allObjects addObjectsFromArray:deletedObjects];
+    [self warmUpObjectIDIndexForRepresentations:allObjects];
+    
+    [self applyInsertedObjectRepresentations:insertedObjects];
+    [self applyUpdatedObjectRepresentations:updatedObjects];
+    [self applyDeletedObjectRepresentations:deletedObjects];
+    [self appendOutboxEntriesForRepresentations:allObjects];
+    
+    NSError* saveError = nil;
+    if (![self saveAndReset:NO mainContext:&saveError]) {
+        
+        // Nothing is written if any of the changes can't be, objects inserted meanwhile are no longer valid.
+        [self.mainContext performBlockAndWait:^{
+            [self.mainContext rollback];
+        }];
+        [self resetObjectIDIndex];
+        if (error) *error = saveError;
+        return NO;
+    }
+    return YES;
+}
+
+
+#pragma mark - Outbox
+
+// One entry per object changed, written in the same transaction as the changes (see APOutboxEntityName).
+- (void) appendOutboxEntriesForRepresentations:(NSArray*) representations {
+    
+    NSEntityDescription* outboxEntity = self.model.entitiesByName[APOutboxEntityName];
+    if (!outboxEntity || [representations count] == 0) {
+        return;
+    }
+    
+    [self.mainContext performBlockAndWait:^{
+        int64_t sequence = [self lastOutboxSequence];
+        
+        for (NSDictionary* representation in representations) {
+            NSManagedObject* entry = [[NSManagedObject alloc]initWithEntity:outboxEntity insertIntoManagedObjectContext:self.mainContext];
+            [entry setValue:@(++sequence) forKey:APOutboxSequenceAttributeName];
+            [entry setValue:representation[APObjectUIDAttributeName] forKey:APObjectUIDAttributeName];
+            [entry setValue:representation[APObjectEntityNameAttributeName] forKey:APObjectEntityNameAttributeName];
         }
-        NSString* entityName = representation[APObjectEntityNameAttributeName];
-        NSManagedObjectID* managedObjectID = [self fetchManagedObjectIDForObjectUID:objectUID entityName:entityName createIfNeeded:NO];
+        self.outboxSequence = @(sequence);
+    }];
+}
+
+
+/*
+ Read from the store once, kept in memory afterwards. The sync operation removes entries
+ but never adds them, so the sequence only has to be unique while there are entries left.
+ Must be called from within mainContext queue.
+ */
+- (int64_t) lastOutboxSequence {
+    
+    if (!self.outboxSequence) {
+        NSFetchRequest* request = [NSFetchRequest fetchRequestWithEntityName:APOutboxEntityName];
+        request.sortDescriptors = @[[NSSortDescriptor sortDescriptorWithKey:APOutboxSequenceAttributeName ascending:NO]];
+        request.fetchLimit = 1;
         
-        __block NSManagedObject* managedObject;
-        if (managedObjectID) {
+        NSError* fetchingError = nil;
+        NSManagedObject* lastEntry = [[self.mainContext executeFetchRequest:request error:&fetchingError] lastObject];
+        if (fetchingError) {
+            if (AP_DEBUG_ERRORS) {ELog(@"Error reading the outbox sequence: %@",fetchingError)}
+        }
+        self.outboxSequence = [lastEntry valueForKey:APOutboxSequenceAttributeName] ?: @0;
+    }
+    return [self.outboxSequence longLongValue];
+}
+
+
+- (void) applyInsertedObjectRepresentations:(NSArray*) representations {
+    
+    if ([representations count] == 0) {
+        return;
+    }
+    
+    NSMutableArray* managedObjects = [NSMutableArray arrayWithCapacity:[representations count]];
+    NSMutableArray* newManagedObjects = [NSMutableArray array];
+    
+    [self.mainContext performBlockAndWait:^{
+        
+        for (NSDictionary* representation in representations) {
+            NSString* objectUID = [representation valueForKey:APObjectUIDAttributeName];
+            if (!objectUID) {
+                [NSException raise:APIncrementalStoreExceptionInconsistency format:@"Representation must have objectUID set"];
+            }
+            NSString* entityName = representation[APObjectEntityNameAttributeName];
             
-            [self.mainContext performBlockAndWait:^{
+            // The index has been warmed up, no need to go to the store again for objects that don't exist yet.
+            NSManagedObjectID* managedObjectID = [self indexedObjectIDForObjectUID:objectUID entityName:entityName];
+            
+            NSManagedObject* managedObject;
+            if (managedObjectID) {
                 // Object was inserted previously, most likely due to an insertion of an object that contained a relationship reference to this one.
                 managedObject = [self.mainContext objectWithID:managedObjectID];
-            }];
-            
-        } else {
-            [self.mainContext performBlockAndWait:^{
+                
+            } else {
                 managedObject = [NSEntityDescription insertNewObjectForEntityForName:entityName inManagedObjectContext:self.mainContext];
-                NSError* permanentIdError = nil;
-                [self.mainContext obtainPermanentIDsForObjects:@[managedObject] error:&permanentIdError];
-                // Sanity check
-                if (permanentIdError) {
-                    [NSException raise:APIncrementalStoreExceptionInconsistency format:@"Could not obtain permanent IDs for objects %@ with error %@", managedObject, permanentIdError];
-                }
-            }];
+                [newManagedObjects addObject:managedObject];
+            }
+            [managedObjects addObject:managedObject];
         }
         
-        [self populateManagedObject:managedObject withRepresentation:representation];
+        if ([newManagedObjects count] > 0) {
+            NSError* permanentIdError = nil;
+            [self.mainContext obtainPermanentIDsForObjects:newManagedObjects error:&permanentIdError];
+            // Sanity check
+            if (permanentIdError) {
+                [NSException raise:APIncrementalStoreExceptionInconsistency format:@"Could not obtain permanent IDs for objects %@ with error %@", newManagedObjects, permanentIdError];
+            }
+        }
+    }];
+    
+    // Indexed before populating, so that objects of the same batch referencing each other are found.
+    [managedObjects enumerateObjectsUsingBlock:^(NSManagedObject* managedObject, NSUInteger idx, BOOL *stop) {
+        [self indexObjectID:managedObject.objectID forObjectUID:[representations[idx] valueForKey:APObjectUIDAttributeName]];
+    }];
+    
+    [managedObjects enumerateObjectsUsingBlock:^(NSManagedObject* managedObject, NSUInteger idx, BOOL *stop) {
+        [self populateManagedObject:managedObject withRepresentation:representations[idx]];
         
         [self.mainContext performBlockAndWait:^{
             [managedObject setValue:@YES forKey:APObjectIsDirtyAttributeName];
@@ -695,27 +1656,13 @@
             [managedObject setValue:@(APObjectStatusPopulated) forKey:APObjectStatusAttributeName];
         }];
     }];
-    
-    NSError* saveError = nil;
-    if (![self saveAndReset:NO mainContext:&saveError]) {
-        success = NO;
-        *error = saveError;
-    }
-    
-    return success;
 }
 
 
-- (BOOL)updateObjectRepresentations:(NSArray*) updateObjects
-// entityName:(NSString*) entityName
-                              error:(NSError *__autoreleasing *) error {
-    
-    if (AP_DEBUG_METHODS) {MLog()}
-    
-    __block BOOL success = YES;
+- (void) applyUpdatedObjectRepresentations:(NSArray*) representations {
     
     // Update local context with received representations
-    [updateObjects enumerateObjectsUsingBlock:^(NSDictionary* representation, NSUInteger idx, BOOL *stop) {
+    [representations enumerateObjectsUsingBlock:^(NSDictionary* representation, NSUInteger idx, BOOL *stop) {
         NSString* objectUID = [representation valueForKey:APObjectUIDAttributeName];
         NSString* entityName = representation[APObjectEntityNameAttributeName];
         NSManagedObjectID* managedObjectID = [self fetchManagedObjectIDForObjectUID:objectUID entityName:entityName createIfNeeded:NO];
@@ -727,47 +1674,23 @@
         }];
         
         [self populateManagedObject:managedObject withRepresentation:representation];
-        
     }];
-    
-    NSError* saveError = nil;
-    if (![self saveAndReset:NO mainContext:&saveError]) {
-        success = NO;
-        *error = saveError;
-    }
-    
-    return success;
 }
 
 
-- (BOOL)deleteObjectRepresentations:(NSArray*) deleteObjects
-                              error:(NSError *__autoreleasing *)error {
-    
-    if (AP_DEBUG_METHODS) {MLog()}
-    
-    __block BOOL success = YES;
+- (void) applyDeletedObjectRepresentations:(NSArray*) representations {
     
-    // Update local context with received representations
-    [deleteObjects enumerateObjectsUsingBlock:^(NSDictionary* representation, NSUInteger idx, BOOL *stop) {
+    [representations enumerateObjectsUsingBlock:^(NSDictionary* representation, NSUInteger idx, BOOL *stop) {
         NSString* objectUID = [representation valueForKey:APObjectUIDAttributeName];
         NSString* entityName = representation[APObjectEntityNameAttributeName];
         NSManagedObjectID* managedObjectID = [self fetchManagedObjectIDForObjectUID:objectUID entityName:entityName createIfNeeded:NO];
         
-        __block NSManagedObject* managedObject;
         [self.mainContext performBlockAndWait:^{
-            managedObject = [self.mainContext objectWithID:managedObjectID];
+            NSManagedObject* managedObject = [self.mainContext objectWithID:managedObjectID];
             [managedObject setValue:@(APObjectStatusDeleted) forKey:APObjectStatusAttributeName];
             [managedObject setValue:@YES forKey:APObjectIsDirtyAttributeName];
         }];
     }];
-    
-    NSError* saveError = nil;
-    if (![self saveAndReset:NO mainContext:&saveError]) {
-        success = NO;
-        *error = saveError;
-    }
-    
-    return success;
 }
 
 
@@ -792,7 +1715,7 @@
                 } else {
                     
                     if (representation[propertyName]) {
-                        [managedObject setPrimitiveValue:representation[propertyName] forKey:propertyName];
+                        [managedObject setPrimitiveValue:[self cacheValueForAttribute:(NSAttributeDescription*) propertyDescription value:representation[propertyName]] forKey:propertyName];
                     }
                 }
                 
@@ -808,6 +1731,9 @@
                         
                         [relatedRepresentations enumerateKeysAndObjectsUsingBlock:^(NSString* entityName, NSArray* relatedObjectUIDs, BOOL *stop) {
                             
+                            // One query for all related objects not yet indexed instead of one per object.
+                            [self warmUpObjectIDIndexForObjectUIDs:relatedObjectUIDs entityName:entityName];
+                            
                             [relatedObjectUIDs enumerateObjectsUsingBlock:^(NSString* objectUID, NSUInteger idx, BOOL *stop) {
                                 NSManagedObjectID* relatedManagedObjectID = [self fetchManagedObjectIDForObjectUID:objectUID entityName:entityName createIfNeeded:YES];
                                 
@@ -847,6 +1773,34 @@
 }
 
 
+/*
+ Binary values are kept in the blob store, the attribute only keeps their reference. So are transformable values
+ already transformed to NSData by the model classes (the way they are sent to Parse), others are kept inline.
+ */
+- (id) cacheValueForAttribute:(NSAttributeDescription*) attribute
+                        value:(id) value {
+    
+    // Not read since it was fetched (or its download has failed), it goes back as it was.
+    if ([value isKindOfClass:[APBlobData class]]) {
+        return [(APBlobData*) value reference];
+    }
+    
+    if (![attribute.name isEqualToString:APCoreDataACLAttributeName] &&
+        (attribute.attributeType == NSBinaryDataAttributeType || attribute.attributeType == NSTransformableAttributeType) &&
+        [value isKindOfClass:[NSData class]] && ![APBlobStore isReference:value]) {
+        
+        NSError* blobError = nil;
+        NSData* reference = [self.blobStore referenceForData:value error:&blobError];
+        if (reference) {
+            return reference;
+        }
+        // Kept inline if it can't be written to the blob store
+        if (AP_DEBUG_ERRORS) {ELog(@"Error writing %@ to the blob store: %@",attribute.name,blobError)}
+    }
+    return value;
+}
+
+
 - (BOOL) saveAndReset: (BOOL) reset
           mainContext: (NSError *__autoreleasing *)error {
     
@@ -865,22 +1819,149 @@
             
         } else {
              if (reset) [self.mainContext reset];
-            [self.savingToPSCContext performBlock:^{
-                
-                if (![self.savingToPSCContext save:&localError]) {
-                    if (AP_DEBUG_ERRORS) { ELog(@"Error saving changes: %@",localError)}
-                    success = NO;
-                    if (error) *error = localError;
-                } else {
-                     if (reset) [self.savingToPSCContext reset];
-                }
-            }];
         }
     }];
+    
+    if (!success) {
+        return NO;
+    }
+    
+    // Written behind, back-to-back saves end up in the same SQLite transaction
+    [self.writer scheduleWrite];
+    
+    if (reset) {
+        if (![self.writer flush:&localError]) {
+            if (error) *error = localError;
+            return NO;
+        }
+        [self.savingToPSCContext performBlockAndWait:^{
+            [self.savingToPSCContext reset];
+        }];
+    }
     return success;
 }
 
 
+- (BOOL) flush:(NSError *__autoreleasing *)error {
+    
+    if (AP_DEBUG_METHODS) { MLog() }
+    
+    return (self.writer) ? [self.writer flush:error] : YES;
+}
+
+
+#pragma mark - Blobs
+
+/*
+ Remote files are downloaded when read (see APBlobData), not while fetching the objects holding them.
+ Blobs already in the store are read memory-mapped.
+ */
+- (id) dataForBlobReference:(NSData*) reference {
+    
+    if ([APBlobStore isRemoteReference:reference]) {
+        return [[APBlobData alloc]initWithReference:reference blobStore:self.blobStore];
+    }
+    
+    NSError* readingError = nil;
+    NSData* data = [self.blobStore dataForReference:reference error:&readingError];
+    if (!data) {
+        if (AP_DEBUG_ERRORS) {ELog(@"Missing blob %@: %@",[APBlobStore digestForReference:reference],readingError)}
+    }
+    return data ?: [NSNull null];
+}
+
+
+- (BOOL) removeUnreferencedBlobs:(NSError *__autoreleasing *)error {
+    
+    if (AP_DEBUG_METHODS) { MLog() }
+    
+    // Removed from its coordinator
+    if (!self.mainContext) {
+        return YES;
+    }
+    
+    /*
+     Nothing is saved meanwhile: references saved before are in the store once flushed,
+     the ones not saved yet or handed out from now on are pinned by the blob store.
+     */
+    __block NSError* markingError = nil;
+    __block BOOL flushed = NO;
+    [self.mainContext performBlockAndWait:^{
+        [self.blobStore beginCollection];
+        flushed = [self flush:&markingError];
+    }];
+    
+    NSMutableSet* references = (flushed) ? [self referencesInStore:&markingError] : nil;
+    
+    if (!references) {
+        if (AP_DEBUG_ERRORS) {ELog(@"Error marking the blobs in use: %@",markingError)}
+        [self.blobStore endCollection];
+        if (error) *error = markingError;
+        return NO;
+    }
+    
+    NSError* sweepingError = nil;
+    if (![self.blobStore removeBlobsNotInReferences:references error:&sweepingError]) {
+        if (error) *error = sweepingError;
+        return NO;
+    }
+    return YES;
+}
+
+
+// Mark phase, read from the store by a context of its own APBlobMarkBatchSize objects at a time.
+- (NSMutableSet*) referencesInStore:(NSError *__autoreleasing *)error {
+    
+    NSManagedObjectContext* markContext = [[NSManagedObjectContext alloc]initWithConcurrencyType:NSPrivateQueueConcurrencyType];
+    markContext.persistentStoreCoordinator = self.psc;
+    
+    __block NSMutableSet* references = [NSMutableSet set];
+    __block NSError* localError = nil;
+    
+    [markContext performBlockAndWait:^{
+        for (NSEntityDescription* entity in self.model.entities) {
+            NSMutableArray* blobAttributes = [NSMutableArray array];
+            for (NSAttributeDescription* attribute in [entity.attributesByName allValues]) {
+                if (attribute.attributeType == NSBinaryDataAttributeType || attribute.attributeType == NSTransformableAttributeType) {
+                    [blobAttributes addObject:attribute];
+                }
+            }
+            if ([blobAttributes count] == 0) {
+                continue;
+            }
+            
+            NSFetchRequest* fr = [NSFetchRequest fetchRequestWithEntityName:entity.name];
+            fr.includesSubentities = NO;
+            fr.resultType = NSDictionaryResultType;
+            fr.propertiesToFetch = blobAttributes;
+            fr.fetchBatchSize = APBlobMarkBatchSize;
+            
+            NSError* fetchingError = nil;
+            NSArray* results = [markContext executeFetchRequest:fr error:&fetchingError];
+            if (!results) {
+                localError = fetchingError;
+                references = nil;
+                return;
+            }
+            
+            for (NSUInteger location = 0; location < [results count]; location += APBlobMarkBatchSize) {
+                @autoreleasepool {
+                    NSArray* batch = [results subarrayWithRange:NSMakeRange(location, MIN(APBlobMarkBatchSize, [results count] - location))];
+                    for (NSDictionary* result in batch) {
+                        for (id value in [result allValues]) {
+                            if ([APBlobStore isReference:value]) [references addObject:value];
+                        }
+                    }
+                }
+            }
+        }
+    }];
+    
+    if (!references && error) *error = localError;
+    return references;
+}
+
+
 #pragma mark - Utils
 
 - (NSString *)documentsDirectory {
@@ -0,0 +1,59 @@
+/*
+ *
+ * Copyright 2014 Flavio Negrão Torres
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#import <Foundation/Foundation.h>
+#import <CoreData/CoreData.h>
+
+/**
+ Writes the changes saved into a context connected to the cache persistent store coordinator (APDiskCache savingToPSCContext)
+ behind the callers back. Writes requested within coalescingInterval of each other are written to SQLite in a single transaction.
+
+ Call -flush: whenever the changes need to be durable, ie: before another persistent store coordinator reads the cache store.
+ */
+@interface APDiskCacheWriter : NSObject
+
+/**
+ Designated Initializer
+ @param context private queue context whose persistent store coordinator points to the cache store.
+ @param coalescingInterval how long (in seconds) a write waits for others to join it, 0 writes as soon as the context queue is free.
+ */
+- (instancetype) initWithContext:(NSManagedObjectContext*) context
+              coalescingInterval:(NSTimeInterval) coalescingInterval;
+
+@property (nonatomic, strong, readonly) NSManagedObjectContext* context;
+@property (nonatomic, assign) NSTimeInterval coalescingInterval;
+
+/// The context has changes to be written, returns immediately.
+- (void) scheduleWrite;
+
+/**
+ Barrier, writes whatever is pending and waits until it is durable.
+ A failed write stays pending and is tried again by the next write or flush.
+ @returns NO if the pending writes could not be written.
+ */
+- (BOOL) flush:(NSError *__autoreleasing*) error;
+
+/// Number of writes requested and not yet written.
+@property (nonatomic, readonly) NSUInteger queueDepth;
+
+/// Number of SQLite transactions, each one may have any number of writes requested.
+@property (nonatomic, readonly) NSUInteger numberOfTransactions;
+
+/// Time (in seconds) between the oldest write requested and it being durable, for the last transaction.
+@property (nonatomic, readonly) NSTimeInterval lastDurabilityLatency;
+
+@end
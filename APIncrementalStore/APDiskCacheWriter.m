@@ -0,0 +1,148 @@
+/*
+ *
+ * Copyright 2014 Flavio Negrão Torres
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#import "APDiskCacheWriter.h"
+
+#import "NSLogEmoji.h"
+#import "APCommon.h"
+
+
+@interface APDiskCacheWriter ()
+
+@property (nonatomic, strong) NSManagedObjectContext* context;
+
+// All of them synchronized on self
+@property (nonatomic, assign) NSUInteger queueDepth;
+@property (nonatomic, assign) BOOL writeScheduled;
+@property (nonatomic, strong) NSDate* oldestPendingWriteDate;
+
+// Only accessed from the context queue
+@property (nonatomic, strong) NSError* writeError;
+@property (nonatomic, assign) NSUInteger numberOfTransactions;
+@property (nonatomic, assign) NSTimeInterval lastDurabilityLatency;
+
+@end
+
+
+@implementation APDiskCacheWriter
+
+- (instancetype) initWithContext:(NSManagedObjectContext*) context
+              coalescingInterval:(NSTimeInterval) coalescingInterval {
+
+    self = [super init];
+    if (self) {
+        _context = context;
+        _coalescingInterval = coalescingInterval;
+    }
+    return self;
+}
+
+
+#pragma mark - Writing
+
+- (void) scheduleWrite {
+
+    @synchronized(self) {
+        self.queueDepth++;
+        if (!self.oldestPendingWriteDate) {
+            self.oldestPendingWriteDate = [NSDate date];
+        }
+
+        // Joins the write already scheduled
+        if (self.writeScheduled) {
+            return;
+        }
+        self.writeScheduled = YES;
+    }
+
+    __weak typeof(self) weakSelf = self;
+    void (^writeBlock)(void) = ^{
+        [weakSelf.context performBlock:^{
+            [weakSelf write];
+        }];
+    };
+
+    if (self.coalescingInterval > 0) {
+        dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(self.coalescingInterval * NSEC_PER_SEC)), dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), writeBlock);
+    } else {
+        writeBlock();
+    }
+}
+
+
+- (BOOL) flush:(NSError *__autoreleasing*) error {
+
+    if (AP_DEBUG_METHODS) { MLog(@" - Queue depth: %lu",(unsigned long)self.queueDepth)}
+
+    // The context queue is serial, writes already enqueued are done by the time this block runs.
+    __block NSError* flushError = nil;
+    [self.context performBlockAndWait:^{
+        [self write];
+        flushError = self.writeError;
+        self.writeError = nil;
+    }];
+
+    if (flushError) {
+        if (error) *error = flushError;
+        return NO;
+    }
+    return YES;
+}
+
+
+// Must be called from the context queue
+- (void) write {
+
+    NSUInteger numberOfWrites;
+    NSDate* oldestPendingWriteDate;
+
+    @synchronized(self) {
+        numberOfWrites = self.queueDepth;
+        oldestPendingWriteDate = self.oldestPendingWriteDate;
+        self.queueDepth = 0;
+        self.oldestPendingWriteDate = nil;
+        self.writeScheduled = NO;
+    }
+
+    // Already written by a flush
+    if (numberOfWrites == 0) {
+        return;
+    }
+
+    NSError* saveError = nil;
+    if (![self.context save:&saveError]) {
+        if (AP_DEBUG_ERRORS) { ELog(@"Error saving changes: %@",saveError)}
+        self.writeError = saveError;
+
+        // The changes are still in the context, the next write or flush tries them again.
+        @synchronized(self) {
+            self.queueDepth += numberOfWrites;
+            if (!self.oldestPendingWriteDate || [oldestPendingWriteDate compare:self.oldestPendingWriteDate] == NSOrderedAscending) {
+                self.oldestPendingWriteDate = oldestPendingWriteDate;
+            }
+        }
+
+    } else {
+        // Whatever has failed before is durable now
+        self.writeError = nil;
+        self.numberOfTransactions++;
+        self.lastDurabilityLatency = -[oldestPendingWriteDate timeIntervalSinceNow];
+        if (AP_DEBUG_INFO) { DLog(@"%lu writes in one transaction, latency: %.3fs",(unsigned long)numberOfWrites,self.lastDurabilityLatency)}
+    }
+}
+
+@end
@@ -16,6 +16,8 @@
 
 @import CoreData;
 
+#import "APRowCache.h"
+
 
 #pragma mark - Notifications
 
@@ -45,14 +47,26 @@ extern NSString *const APNotificationCacheWillStartSync __attribute__((deprecate
 
 
 /** 
- APIncrementalStore will post this message once it synced a single object. Also the NSNotification 
- userInfo will be keyed with APNotificationCacheNumberOfLocalObjectsKey and
- APNotificationCacheNumberOfRemoteObjectsKey showing the number of objects that were synced.
+ APIncrementalStore will post this message as objects get synced. Progress of all entities and both directions is
+ gathered together and delivered once APOptionSyncProgressIntervalKey seconds have passed since the previous delivery
+ or APOptionSyncProgressObjectCountKey objects have been synced, whichever comes first, and once more when the sync ends.
+ Each delivery posts one message per entity and direction with objects synced since the previous one. Also the NSNotification 
+ userInfo will be keyed with APNotificationNumberOfLocalObjectsSyncedKey or APNotificationNumberOfRemoteObjectsSyncedKey
+ showing the number of objects that were synced since the previous delivery and APNotificationObjectEntityNameKey.
+ Set APOptionPerObjectSyncNotificationsKey to have it posted once per object instead.
  */
 extern NSString *const APNotificationStoreDidSyncObject;
 extern NSString *const APNotificationCacheDidSyncObject __attribute__((deprecated("use APNotificationStoreDidSyncObject. First deprecated in 0.4")));
 
 
+/**
+ With APOptionSyncChangeFeedKey set APIncrementalStore will post this message after each page of remote objects
+ or batch of local objects is saved to the disk cache. APNotificationSyncedObjectsKey will contain the objects of
+ that page, in the same format as APNotificationStoreDidFinishSync. Use it to refresh objects while the sync goes on.
+ */
+extern NSString *const APNotificationStoreDidMergeChanges;
+
+
 /// APIncrementalStore will post this message once it finishes the disk cache sync process.
 extern NSString *const APNotificationStoreDidFinishSync;
 extern NSString *const APNotificationCacheDidFinishSync __attribute__((deprecated("use APNotificationStoreDidSyncObject. First deprecated in 0.4")));
@@ -62,7 +76,7 @@ extern NSString *const APNotificationCacheDidFinishSync __attribute__((deprecate
  APIncrementalStore will include this key when the APNotificationCacheWillStartSync 
  is sent showing how many cached objects will be synced.
  When object counting is not fully supported by the webservice the value will be -1.
- It will be also be included in APNotificationStoreDidSyncObject with value set to 1.
+ It will be also be included in APNotificationStoreDidSyncObject with the number of objects synced.
  */
 extern NSString *const APNotificationNumberOfLocalObjectsSyncedKey;
 extern NSString *const APNotificationCacheNumberOfLocalObjectsKey __attribute__((deprecated("use APNotificationNumberOfLocalObjectsSyncedKey. First deprecated in 0.4")));
@@ -71,7 +85,7 @@ extern NSString *const APNotificationCacheNumberOfLocalObjectsKey __attribute__(
  APIncrementalStore will include this key when the APNotificationCacheWillStartSync 
  is sent showing how many remote objects will be merged locally.
  When object counting is not fully supported by the webservice the value will be -1.
- It will be also be included in APNotificationStoreDidSyncObject with value set to 1.
+ It will be also be included in APNotificationStoreDidSyncObject with the number of objects synced.
  */
 extern NSString *const APNotificationNumberOfRemoteObjectsSyncedKey;
 extern NSString *const APNotificationCacheNumberOfRemoteObjectsKey __attribute__((deprecated("use APNotificationNumberOfRemoteObjectsSyncedKey. First deprecated in 0.4")));
@@ -132,6 +146,45 @@ extern NSString* const APOptionSyncOnSaveKey;
 /// The name of the disk cache store file.
 extern NSString* const APOptionCacheFileNameKey;
 
+/// Number of local objects pushed to the webservice per request (NSNumber). Default is 50.
+extern NSString* const APOptionPushBatchSizeKey;
+
+/// Maximum number of entities pulled from the webservice at the same time (NSNumber). Default is 4.
+extern NSString* const APOptionPullConcurrencyKey;
+
+/// Number of remote objects requested per page when pulling remote changes (NSNumber). Default is 1000, the maximum allowed by Parse.
+extern NSString* const APOptionPullPageSizeKey;
+
+/// Approximate maximum number of bytes the row cache keeps in memory for faulted objects (NSNumber). Default is 4MB, 0 disables it.
+extern NSString* const APOptionRowCacheCostLimitKey;
+
+/// Which rows are evicted once the row cache is full (NSNumber with an APRowCacheEvictionPolicy). Default is APRowCacheEvictionPolicyLeastRecentlyUsed.
+extern NSString* const APOptionRowCacheEvictionPolicyKey;
+
+/// Saves within this interval (NSNumber, seconds) of each other are written to the cache SQLite in a single transaction. Default is 0.05.
+extern NSString* const APOptionCacheWriteCoalescingIntervalKey;
+
+/**
+ Set it to YES (NSNumber) and files are downloaded when first read or in the background after the sync instead of during it. Default is NO.
+ Until then binary attributes hold an APBlobData, reading its bytes waits for the download, -[APBlobData loadInBackground] doesn't.
+ */
+extern NSString* const APOptionDeferFileDownloadsKey;
+
+/// Number of bytes (NSNumber) of deferred files downloaded in the background, 0 only downloads them when read. Default is 50MB.
+extern NSString* const APOptionFilePrefetchSizeLimitKey;
+
+/// Seconds (NSNumber) between deliveries of APNotificationStoreDidSyncObject, for all entities and directions together. Default is 0.5.
+extern NSString* const APOptionSyncProgressIntervalKey;
+
+/// Number of objects synced (NSNumber) that triggers APNotificationStoreDidSyncObject before APOptionSyncProgressIntervalKey. Default is 500.
+extern NSString* const APOptionSyncProgressObjectCountKey;
+
+/// Set it to YES (NSNumber) to have APNotificationStoreDidSyncObject posted once per object synced, as in earlier versions. Default is NO.
+extern NSString* const APOptionPerObjectSyncNotificationsKey;
+
+/// Set it to YES (NSNumber) to have APNotificationStoreDidMergeChanges posted for each page synced, APNotificationStoreDidFinishSync won't include APNotificationSyncedObjectsKey. Default is NO.
+extern NSString* const APOptionSyncChangeFeedKey;
+
 /// Whether or not an existing sqlite file should be removed and a new one created before the persistent store starts using it
 extern NSString* const APOptionCacheFileResetKey __attribute__((deprecated("First deprecated in 0.42")));
 
@@ -16,6 +16,9 @@
  */
 
 #import "APDiskCache.h"
+#import "APRowCache.h"
+#import "APBlobStore.h"
+#import "APBlobData.h"
 #import "APParseSyncOperation.h"
 
 #import "NSArray+Enumerable.h"
@@ -43,6 +46,7 @@ NSString* const APNotificationRequestStoreFullSync = @"com.apetis.apincrementals
 NSString* const APNotificationStoreWillStartSync = @"com.apetis.apincrementalstore.willstartsync";
 NSString* const APNotificationStoreDidSyncObject = @"com.apetis.apincrementalstore.didSyncObject";
 NSString* const APNotificationStoreDidFinishSync = @"com.apetis.apincrementalstore.didfinishsinc";
+NSString* const APNotificationStoreDidMergeChanges = @"com.apetis.apincrementalstore.didmergechanges";
 
 
 NSString* const APNotificationNumberOfLocalObjectsSyncedKey = @"com.apetis.apincrementalstore.diskcache.numberoflocalobjectssynced.key";
@@ -80,12 +84,28 @@ NSString* const APOptionCacheFileResetKey = @"com.apetis.apincrementalstore.opti
 
 NSString* const APOptionMergePolicyKey = @"com.apetis.apincrementalstore.option.mergepolicy.key";
 NSString* const APOptionSyncOnSaveKey = @"com.apetis.apincrementalstore.option.synconsave.key";
+NSString* const APOptionPushBatchSizeKey = @"com.apetis.apincrementalstore.option.pushbatchsize.key";
+NSString* const APOptionPullConcurrencyKey = @"com.apetis.apincrementalstore.option.pullconcurrency.key";
+NSString* const APOptionPullPageSizeKey = @"com.apetis.apincrementalstore.option.pullpagesize.key";
+NSString* const APOptionRowCacheCostLimitKey = @"com.apetis.apincrementalstore.option.rowcachecostlimit.key";
+NSString* const APOptionRowCacheEvictionPolicyKey = @"com.apetis.apincrementalstore.option.rowcacheevictionpolicy.key";
+NSString* const APOptionCacheWriteCoalescingIntervalKey = @"com.apetis.apincrementalstore.option.cachewritecoalescinginterval.key";
+NSString* const APOptionDeferFileDownloadsKey = @"com.apetis.apincrementalstore.option.deferfiledownloads.key";
+NSString* const APOptionFilePrefetchSizeLimitKey = @"com.apetis.apincrementalstore.option.fileprefetchsizelimit.key";
+NSString* const APOptionSyncProgressIntervalKey = @"com.apetis.apincrementalstore.option.syncprogressinterval.key";
+NSString* const APOptionSyncProgressObjectCountKey = @"com.apetis.apincrementalstore.option.syncprogressobjectcount.key";
+NSString* const APOptionPerObjectSyncNotificationsKey = @"com.apetis.apincrementalstore.option.perobjectsyncnotifications.key";
+NSString* const APOptionSyncChangeFeedKey = @"com.apetis.apincrementalstore.option.syncchangefeed.key";
 NSString* const APOptionMergePolicyServerWins = @"com.apetis.apincrementalstore.option.mergepolicy.serverwins";
 NSString* const APOptionMergePolicyClientWins = @"com.apetis.apincrementalstore.option.mergepolicy.clientwins";
 
 
 #pragma mark - Local Constants
 static NSString* const APDefaultLocalCacheFileName = @"APIncrementalStoreDiskCache.sqlite";
+static NSUInteger const APDefaultRowCacheCostLimit = 4 * 1024 * 1024;
+
+// Faults returned by a fetch are loaded together in batches of this size when fetchBatchSize isn't set.
+static NSUInteger const APDefaultFaultBatchSize = 100;
 
 // mapBetweenManagedObjectIDsAndObjectUIDByEntityName Keys
 static NSString* const APManagedObjectIDKey = @"APManagedObjectIDKey";
@@ -98,12 +118,36 @@ static NSString* const APReferenceCountKey = @"APReferenceCountKey";
 @property (nonatomic,strong) APDiskCache* diskCache;
 @property (nonatomic,strong) NSString* diskCacheFileName;
 
+/*
+ Values handed to Core Data when faulting objects, so that faults don't need to go to the disk cache every time.
+ Only objects registered by some context are kept (see -setRowCacheValues:forObjectUID:entityName:version:),
+ saves and sync merges invalidate them.
+ */
+@property (nonatomic,strong) APRowCache* rowCache;
+
+/*
+ Fetches return faults only, the objects of a fetch are split in batches of fetchBatchSize and the first one
+ of a batch to be fired loads the values of the whole batch into rowCache.
+ {objectUID: batch}, every objectUID of a batch points to the same {objectUID: entityName} dictionary.
+ */
+@property (nonatomic,strong) NSMutableDictionary* faultBatchesByObjectUID;
+
 @property (nonatomic,strong) NSManagedObjectModel* model;
 @property (nonatomic,strong) NSManagedObjectModel* modelPlusCacheProperties;
 
 //@property (nonatomic,weak) APWebServiceSyncOperation* syncOperation;
 @property (nonatomic,assign) APMergePolicy mergePolicy;
 @property (nonatomic,assign) BOOL syncOnSave;
+@property (nonatomic,strong) NSNumber* pushBatchSize;
+@property (nonatomic,strong) NSNumber* pullConcurrency;
+@property (nonatomic,strong) NSNumber* pullPageSize;
+@property (nonatomic,strong) NSNumber* cacheWriteCoalescingInterval;
+@property (nonatomic,assign) BOOL deferFileDownloads;
+@property (nonatomic,strong) NSNumber* filePrefetchSizeLimit;
+@property (nonatomic,strong) NSNumber* syncProgressInterval;
+@property (nonatomic,strong) NSNumber* syncProgressObjectCount;
+@property (nonatomic,assign) BOOL perObjectSyncNotifications;
+@property (nonatomic,assign) BOOL syncChangeFeed;
 @property (nonatomic,assign) id authenticatedUser;
 @property (atomic,assign, getter = isSyncing) BOOL syncing;
 @property (nonatomic,strong) NSOperationQueue* syncQueue;
@@ -143,6 +187,8 @@ static NSString* const APReferenceCountKey = @"APReferenceCountKey";
  }
  */
 @property (nonatomic, strong) NSMutableDictionary *mapBetweenManagedObjectIDsAndObjectUIDByEntityName;
+// Contexts register, unregister and fault objects from their own queues, all access to the map above goes through it.
+@property (nonatomic, strong) NSObject *registeredObjectsLock;
 
 @end
 
@@ -172,6 +218,23 @@ static NSString* const APReferenceCountKey = @"APReferenceCountKey";
         }
         _mergePolicy = [[options valueForKey:APOptionMergePolicyKey] integerValue];
         _syncOnSave = [options valueForKey:APOptionSyncOnSaveKey] ? [[options valueForKey:APOptionSyncOnSaveKey]boolValue] : YES;
+        _pushBatchSize = [options valueForKey:APOptionPushBatchSizeKey];
+        _pullConcurrency = [options valueForKey:APOptionPullConcurrencyKey];
+        _pullPageSize = [options valueForKey:APOptionPullPageSizeKey];
+        _cacheWriteCoalescingInterval = [options valueForKey:APOptionCacheWriteCoalescingIntervalKey];
+        _deferFileDownloads = [[options valueForKey:APOptionDeferFileDownloadsKey] boolValue];
+        _filePrefetchSizeLimit = [options valueForKey:APOptionFilePrefetchSizeLimitKey];
+        _syncProgressInterval = [options valueForKey:APOptionSyncProgressIntervalKey];
+        _syncProgressObjectCount = [options valueForKey:APOptionSyncProgressObjectCountKey];
+        _perObjectSyncNotifications = [[options valueForKey:APOptionPerObjectSyncNotificationsKey] boolValue];
+        _syncChangeFeed = [[options valueForKey:APOptionSyncChangeFeedKey] boolValue];
+        
+        NSNumber* rowCacheCostLimit = [options valueForKey:APOptionRowCacheCostLimitKey];
+        _rowCache = [[APRowCache alloc]initWithCostLimit:rowCacheCostLimit ? [rowCacheCostLimit unsignedIntegerValue] : APDefaultRowCacheCostLimit
+                                          evictionPolicy:[[options valueForKey:APOptionRowCacheEvictionPolicyKey] unsignedIntegerValue]];
+        _faultBatchesByObjectUID = [NSMutableDictionary dictionary];
+        _mapBetweenManagedObjectIDsAndObjectUIDByEntityName = [NSMutableDictionary dictionary];
+        _registeredObjectsLock = [[NSObject alloc]init];
         
         _model = psc.managedObjectModel;
         _modelPlusCacheProperties = [self cacheModelFromUserModel:psc.managedObjectModel];
@@ -261,22 +324,16 @@ static NSString* const APReferenceCountKey = @"APReferenceCountKey";
         };
         
         _diskCache = [[APDiskCache alloc]initWithManagedModel:self.modelPlusCacheProperties
+                                        previousManagedModels:@[[self cacheModelFromUserModel:self.model previousVersion:YES]]
                                     translateToObjectUIDBlock:translateBlock
                                            localStoreFileName:self.diskCacheFileName];
+        if (self.cacheWriteCoalescingInterval) _diskCache.writeCoalescingInterval = [self.cacheWriteCoalescingInterval doubleValue];
+        if (self.filePrefetchSizeLimit) _diskCache.blobStore.prefetchSizeLimit = [self.filePrefetchSizeLimit unsignedLongLongValue];
     }
     return _diskCache;
 }
 
 
-- (NSMutableDictionary*) mapBetweenManagedObjectIDsAndObjectUIDByEntityName {
-    
-    if (!_mapBetweenManagedObjectIDsAndObjectUIDByEntityName) {
-        _mapBetweenManagedObjectIDsAndObjectUIDByEntityName = [NSMutableDictionary dictionary];
-    }
-    return _mapBetweenManagedObjectIDsAndObjectUIDByEntityName;
-}
-
-
 #pragma mark - NSIncrementalStore Subclass Methods
 
 - (BOOL)loadMetadata:(NSError *__autoreleasing *)error {
@@ -312,6 +369,27 @@ static NSString* const APReferenceCountKey = @"APReferenceCountKey";
     NSString* objectUID = [self referenceObjectForObjectID:objectID];
     //if (AP_DEBUG_INFO) {DLog(@"New values for entity: %@ with id %@", objectID.entity.name, objectUID)}
     
+    NSDictionary* cachedValues = [self.rowCache valuesForObjectUID:objectUID];
+    if (cachedValues) {
+        [self loadBlobDataInBackground:cachedValues];
+        return [[NSIncrementalStoreNode alloc] initWithObjectID:objectID withValues:cachedValues version:1];
+    }
+    
+    // First fault of a fetch batch to be fired, the whole batch is loaded at once
+    NSDictionary* faultBatch = [self takeFaultBatchForObjectUID:objectUID];
+    if ([faultBatch count] > 1) {
+        [self loadFaultBatch:faultBatch withContext:context];
+        
+        cachedValues = [self.rowCache valuesForObjectUID:objectUID];
+        if (cachedValues) {
+            [self loadBlobDataInBackground:cachedValues];
+            return [[NSIncrementalStoreNode alloc] initWithObjectID:objectID withValues:cachedValues version:1];
+        }
+    }
+    
+    // Must be taken before reading, if the object changes meanwhile what we read won't be cached.
+    NSUInteger rowVersion = [self.rowCache versionForObjectUID:objectUID];
+    
     NSDictionary *objectFromCache = [self.diskCache fetchObjectRepresentationForObjectUID:objectUID requestContext:context entityName:objectID.entity.name];
     
     if (!objectFromCache) {
@@ -320,11 +398,38 @@ static NSString* const APReferenceCountKey = @"APReferenceCountKey";
         return nil;
     }
     
-    // Create dictionary of keys and values for incremental store node
+    NSDictionary* dictionaryRepresentationOfCacheObject = [self nodeValuesForEntity:objectID.entity fromRepresentation:objectFromCache];
+    
+    [self setRowCacheValues:dictionaryRepresentationOfCacheObject forObjectUID:objectUID entityName:objectID.entity.name version:rowVersion];
+    
+    [self loadBlobDataInBackground:dictionaryRepresentationOfCacheObject];
+    NSIncrementalStoreNode *node = [[NSIncrementalStoreNode alloc] initWithObjectID:objectID withValues:dictionaryRepresentationOfCacheObject version:1];
+    return node;
+}
+
+
+/*
+ Remote files of the object being read start downloading off the calling thread, the objects fetched or
+ loaded along with it don't download anything until they are read as well.
+ */
+- (void) loadBlobDataInBackground:(NSDictionary*) nodeValues {
+    
+    for (id value in [nodeValues allValues]) {
+        if ([value isKindOfClass:[APBlobData class]]) {
+            [(APBlobData*) value loadInBackground];
+        }
+    }
+}
+
+
+// Dictionary of keys and values for incremental store node: attributes and to-one relationships
+- (NSDictionary*) nodeValuesForEntity:(NSEntityDescription*) entity
+                   fromRepresentation:(NSDictionary*) objectFromCache {
+    
     NSMutableDictionary *dictionaryRepresentationOfCacheObject = [NSMutableDictionary dictionary];
     
     // Attributes
-    NSArray* entityAttributes = [[[objectID entity] attributesByName] allKeys];
+    NSArray* entityAttributes = [[entity attributesByName] allKeys];
     [[objectFromCache dictionaryWithValuesForKeys:entityAttributes] enumerateKeysAndObjectsUsingBlock:^(id attributeName, id attributeValue, BOOL *stop) {
         if (attributeValue != [NSNull null]) {
             dictionaryRepresentationOfCacheObject[attributeName] = attributeValue;
@@ -332,26 +437,25 @@ static NSString* const APReferenceCountKey = @"APReferenceCountKey";
     }];
     
     // To-One relationships
-    NSArray* entityRelationships = [[[objectID entity] relationshipsByName] allKeys];
+    NSArray* entityRelationships = [[entity relationshipsByName] allKeys];
     [[objectFromCache dictionaryWithValuesForKeys:entityRelationships] enumerateKeysAndObjectsUsingBlock:^(id relationshipName, id relationshipValue, BOOL *stop) {
         
-        if (![[[objectID entity]relationshipsByName][relationshipName] isToMany]) {
+        if (![[entity relationshipsByName][relationshipName] isToMany]) {
             
             if (relationshipValue == [NSNull null] || relationshipValue == nil) {
                 dictionaryRepresentationOfCacheObject[relationshipName] = [NSNull null];
                 
             } else {
-                //NSRelationshipDescription* relationship = [[objectID entity] relationshipsByName][relationshipName];
                 NSString* relatedObjectID = [[relationshipValue allValues]lastObject];
                 NSString* relatedObjectEntityName = [[relationshipValue allKeys]lastObject];
-                NSEntityDescription* relatedObjectEntityDescription = [NSEntityDescription entityForName:relatedObjectEntityName inManagedObjectContext:context];
+                NSEntityDescription* relatedObjectEntityDescription = self.model.entitiesByName[relatedObjectEntityName];
                 NSManagedObjectID *relationshipObjectID = [self managedObjectIDForEntity:relatedObjectEntityDescription withObjectUID:relatedObjectID];
                 dictionaryRepresentationOfCacheObject[relationshipName] = relationshipObjectID;
             }
         }
     }];
-    NSIncrementalStoreNode *node = [[NSIncrementalStoreNode alloc] initWithObjectID:objectID withValues:dictionaryRepresentationOfCacheObject version:1];
-    return node;
+    
+    return dictionaryRepresentationOfCacheObject;
 }
 
 
@@ -377,66 +481,34 @@ static NSString* const APReferenceCountKey = @"APReferenceCountKey";
     
     //if (AP_DEBUG_INFO) {DLog(@"New values for relationship: %@ for entity: %@ with id %@", relationship, objectID.entity.name, objectUID)}
     
-    NSFetchRequest *fr = [[NSFetchRequest alloc] initWithEntityName:objectID.entity.name];
-    fr.predicate = [NSPredicate predicateWithFormat:@"%K == %@", APObjectUIDAttributeName, objectUID];
-    
     NSError *fetchError = nil;
-    NSArray *results = [self.diskCache fetchObjectRepresentations:fr requestContext:context error:&fetchError];
-    
-    if (fetchError || [results count] > 1) {
-        // TODO handle error
-    }
-    
-    NSDictionary* objectFromCache = [results lastObject];
-    
-    if (!objectFromCache) {
-        // [NSException raise:APIncrementalStoreExceptionIncompatibleRequest format:@"Cache object with managed objectUUID %@ not found.", objectUUID];
+    NSDictionary* relatedObjectUIDsByEntityName = [self.diskCache fetchRelatedObjectUIDsForRelationship:relationship
+                                                                                               objectUID:objectUID
+                                                                                              entityName:objectID.entity.name
+                                                                                          requestContext:context
+                                                                                                   error:&fetchError];
+    if (!relatedObjectUIDsByEntityName) {
         // object has been deleted ?
+        if (error) *error = fetchError;
         return nil;
     }
     
-    if ([relationship isToMany]) {
-        
-        // to-many: pull related object set from cache
-        // value should be the cache object reference for the related object, if the relationship value is not nil
-        
-        __block NSMutableArray *arrayToReturn = [NSMutableArray array];
-        
-        NSDictionary *relatedObjectCacheReferenceDict = objectFromCache[[relationship name]];
-        if ([relatedObjectCacheReferenceDict count] > 0) {
-            
-            [relatedObjectCacheReferenceDict enumerateKeysAndObjectsUsingBlock:^(NSString* entityName, NSArray* cacheManagedObjectReferences, BOOL *stop) {
-                NSEntityDescription* destinationEntity = [NSEntityDescription entityForName:entityName inManagedObjectContext:context];
-                [cacheManagedObjectReferences enumerateObjectsUsingBlock:^(NSString* cacheManagedObjectReference, NSUInteger idx, BOOL *stop) {
-                    NSManagedObjectID *managedObjectID = [self managedObjectIDForEntity:destinationEntity withObjectUID:cacheManagedObjectReference];
-                    [arrayToReturn addObject:managedObjectID];
-                }];
-            }];
+    // value should be the cache object reference for the related object, if the relationship value is not nil
+    
+    NSMutableArray *relatedManagedObjectIDs = [NSMutableArray array];
+    
+    [relatedObjectUIDsByEntityName enumerateKeysAndObjectsUsingBlock:^(NSString* entityName, NSArray* relatedObjectUIDs, BOOL *stop) {
+        NSEntityDescription* destinationEntity = self.model.entitiesByName[entityName];
+        for (NSString* relatedObjectUID in relatedObjectUIDs) {
+            [relatedManagedObjectIDs addObject:[self managedObjectIDForEntity:destinationEntity withObjectUID:relatedObjectUID]];
         }
-        
-        return arrayToReturn;
+    }];
+    
+    if ([relationship isToMany]) {
+        return relatedManagedObjectIDs;
         
     } else {
-        
-        // to-one: pull related object from cache
-        // value should be the cache object reference for the related object, if the relationship value is not nil
-        
-        NSDictionary *relatedObjectCacheReferenceDict = objectFromCache[[relationship name]];
-        
-        if (!relatedObjectCacheReferenceDict) {
-            return nil; //[NSNull null];
-            
-        } else {
-            
-            NSString *entityName = [[relatedObjectCacheReferenceDict allValues]lastObject];
-            NSString *relatedObjectUID = [[relatedObjectCacheReferenceDict allKeys]lastObject];
-            NSEntityDescription* destinationEntity = [NSEntityDescription entityForName:entityName inManagedObjectContext:context];
-            
-            // Use primary key id to create in-memory context managed object ID equivalent
-            NSManagedObjectID *managedObjectID = [self managedObjectIDForEntity:destinationEntity withObjectUID:relatedObjectUID];
-            
-            return managedObjectID;
-        }
+        return [relatedManagedObjectIDs lastObject] ?: [NSNull null];
     }
 }
 
@@ -535,8 +607,9 @@ static NSString* const APReferenceCountKey = @"APReferenceCountKey";
     
     if (AP_DEBUG_METHODS) { MLog() }
     
+    // Identities only (limit and offset applied by the disk cache), values are loaded when the faults fire.
     NSError *localCacheError = nil;
-    NSArray *cacheRepresentations = [self.diskCache fetchObjectRepresentations:fetchRequest requestContext:context error:&localCacheError];
+    NSArray *cacheIdentities = [self.diskCache fetchObjectIdentities:fetchRequest requestContext:context error:&localCacheError];
     
     if (localCacheError != nil) {
         if (error != NULL) {
@@ -545,30 +618,141 @@ static NSString* const APReferenceCountKey = @"APReferenceCountKey";
         return nil;
     }
     
-    __block NSMutableArray *results = [NSMutableArray array];
+    NSUInteger batchSize = ([fetchRequest fetchBatchSize] > 0) ? [fetchRequest fetchBatchSize] : APDefaultFaultBatchSize;
+    
+    __block NSMutableArray *results = [NSMutableArray arrayWithCapacity:[cacheIdentities count]];
+    __block NSMutableDictionary* objectsToRefreshByObjectUID = [NSMutableDictionary dictionary];
+    __block NSMutableArray* faultBatches = [NSMutableArray array];
+    __block NSMutableDictionary* faultBatch;
     
-    [cacheRepresentations enumerateObjectsUsingBlock:^(id cacheManagedObjectRep, NSUInteger idx, BOOL *stop) {
-        NSString *objectUID = [cacheManagedObjectRep valueForKey:APObjectUIDAttributeName];
-        NSString* entityName = [cacheManagedObjectRep valueForKey:APObjectEntityNameAttributeName];
-        NSEntityDescription* entityDescription = [NSEntityDescription entityForName:entityName inManagedObjectContext:context];
-        NSManagedObjectID* managedObjectID = [self managedObjectIDForEntity:entityDescription withObjectUID:objectUID];
+    [context performBlockAndWait:^{
         
-        __block NSManagedObject* managedObject;
-        [context performBlockAndWait:^{
+        for (NSDictionary* cacheIdentity in cacheIdentities) {
+            NSString *objectUID = cacheIdentity[APObjectUIDAttributeName];
+            NSString* entityName = cacheIdentity[APObjectEntityNameAttributeName];
+            NSEntityDescription* entityDescription = self.model.entitiesByName[entityName];
+            NSManagedObjectID* managedObjectID = [self managedObjectIDForEntity:entityDescription withObjectUID:objectUID];
+            
             // Allows us to always return object, faulted or not
-            managedObject = [context objectWithID:managedObjectID];
-        }];
+            NSManagedObject* managedObject = [context objectWithID:managedObjectID];
+            
+            if (![managedObject isFault]) {
+                if ([fetchRequest shouldRefreshRefetchedObjects]) {
+                    objectsToRefreshByObjectUID[objectUID] = managedObject;
+                }
+                
+            } else {
+                if (!faultBatch || [faultBatch count] == batchSize) {
+                    faultBatch = [NSMutableDictionary dictionaryWithCapacity:batchSize];
+                    [faultBatches addObject:faultBatch];
+                }
+                faultBatch[objectUID] = entityName;
+            }
+            [results addObject:managedObject];
+        }
+    }];
+    
+    // Batches are only worth it if fired faults can keep their values
+    if (self.rowCache.costLimit > 0) {
+        @synchronized(self.faultBatchesByObjectUID) {
+            for (NSMutableDictionary* batch in faultBatches) {
+                for (NSString* objectUID in batch) {
+                    self.faultBatchesByObjectUID[objectUID] = batch;
+                }
+            }
+        }
+    }
+    
+    if ([objectsToRefreshByObjectUID count] > 0) {
+        NSFetchRequest* refreshRequest = [NSFetchRequest fetchRequestWithEntityName:fetchRequest.entityName];
+        refreshRequest.predicate = [NSPredicate predicateWithFormat:@"%K IN %@",APObjectUIDAttributeName,[objectsToRefreshByObjectUID allKeys]];
+        NSArray* cacheRepresentations = [self.diskCache fetchObjectRepresentations:refreshRequest requestContext:context error:&localCacheError];
+        
+        if (localCacheError != nil) {
+            if (error != NULL) {
+                *error = localCacheError;
+            }
+            return nil;
+        }
         
-        if (![managedObject isFault] && [fetchRequest shouldRefreshRefetchedObjects]) {
+        for (NSDictionary* cacheManagedObjectRep in cacheRepresentations) {
+            NSManagedObject* managedObject = objectsToRefreshByObjectUID[cacheManagedObjectRep[APObjectUIDAttributeName]];
             [self populateManagedObject:managedObject withRepresentation:cacheManagedObjectRep callingContext:context];
         }
-        [results addObject:managedObject];
-    }];
+    }
     
     return results;
 }
 
 
+#pragma mark - Fault Batches
+
+// Returns the batch objectUID belongs to, its objectUIDs aren't pending anymore.
+- (NSDictionary*) takeFaultBatchForObjectUID:(NSString*) objectUID {
+    
+    @synchronized(self.faultBatchesByObjectUID) {
+        NSDictionary* faultBatch = [self.faultBatchesByObjectUID[objectUID] copy];
+        [self.faultBatchesByObjectUID removeObjectsForKeys:[faultBatch allKeys]];
+        return faultBatch;
+    }
+}
+
+
+// Object no longer registered, its values would not be cached anyway.
+- (void) removeObjectUIDFromFaultBatch:(NSString*) objectUID {
+    
+    @synchronized(self.faultBatchesByObjectUID) {
+        [self.faultBatchesByObjectUID[objectUID] removeObjectForKey:objectUID];
+        [self.faultBatchesByObjectUID removeObjectForKey:objectUID];
+    }
+}
+
+
+// One disk cache query per entity, values of the objects still registered are kept in rowCache.
+- (void) loadFaultBatch:(NSDictionary*) faultBatch
+            withContext:(NSManagedObjectContext*) context {
+    
+    if (AP_DEBUG_METHODS) { MLog(@" - Loading %lu faults",(unsigned long)[faultBatch count])}
+    
+    NSMutableDictionary* rowVersionsByObjectUID = [NSMutableDictionary dictionaryWithCapacity:[faultBatch count]];
+    NSMutableDictionary* objectUIDsByEntityName = [NSMutableDictionary dictionary];
+    
+    [faultBatch enumerateKeysAndObjectsUsingBlock:^(NSString* objectUID, NSString* entityName, BOOL *stop) {
+        rowVersionsByObjectUID[objectUID] = @([self.rowCache versionForObjectUID:objectUID]);
+        
+        NSMutableArray* objectUIDs = objectUIDsByEntityName[entityName];
+        if (!objectUIDs) {
+            objectUIDs = [NSMutableArray array];
+            objectUIDsByEntityName[entityName] = objectUIDs;
+        }
+        [objectUIDs addObject:objectUID];
+    }];
+    
+    [objectUIDsByEntityName enumerateKeysAndObjectsUsingBlock:^(NSString* entityName, NSArray* objectUIDs, BOOL *stop) {
+        NSFetchRequest* batchRequest = [NSFetchRequest fetchRequestWithEntityName:entityName];
+        batchRequest.includesSubentities = NO;
+        batchRequest.predicate = [NSPredicate predicateWithFormat:@"%K IN %@",APObjectUIDAttributeName,objectUIDs];
+        
+        NSError* fetchingError = nil;
+        NSArray* cacheRepresentations = [self.diskCache fetchObjectRepresentations:batchRequest requestContext:context error:&fetchingError];
+        if (fetchingError) {
+            // Faults will be loaded one by one
+            if (AP_DEBUG_ERRORS) {ELog(@"Error loading fault batch for entity %@: %@",entityName,fetchingError)}
+            return;
+        }
+        
+        NSEntityDescription* entity = self.model.entitiesByName[entityName];
+        for (NSDictionary* cacheManagedObjectRep in cacheRepresentations) {
+            NSString* objectUID = cacheManagedObjectRep[APObjectUIDAttributeName];
+            [self setRowCacheValues:[self nodeValuesForEntity:entity fromRepresentation:cacheManagedObjectRep]
+                       forObjectUID:objectUID
+                         entityName:entityName
+                            version:[rowVersionsByObjectUID[objectUID] unsignedIntegerValue]];
+        }
+    }];
+}
+
+
 // Returns NSArray<NSManagedObjectID>
 - (id) AP_fetchManagedObjectIDs:(NSFetchRequest *)fetchRequest
                     withContext:(NSManagedObjectContext *)context
@@ -576,23 +760,26 @@ static NSString* const APReferenceCountKey = @"APReferenceCountKey";
     
     if (AP_DEBUG_METHODS) { MLog() }
     
-    NSFetchRequest *fetchCopy = [fetchRequest copy];
-    
-    [fetchCopy setResultType:NSManagedObjectResultType];
+    // objectUIDs are translated straight to objectIDs, no representation or managed object is created.
+    NSError *localCacheError = nil;
+    NSArray *cacheIdentities = [self.diskCache fetchObjectIdentities:fetchRequest requestContext:context error:&localCacheError];
     
-    if ([fetchRequest fetchBatchSize] > 0) {
-        [fetchCopy setFetchBatchSize:[fetchRequest fetchBatchSize]];
+    if (localCacheError != nil) {
+        if (error != NULL) {
+            *error = localCacheError;
+        }
+        return nil;
     }
     
-    NSArray *objects = [self AP_fetchManagedObjects:fetchCopy withContext:context error:error];
+    NSDictionary* entitiesByName = self.model.entitiesByName;
+    NSMutableArray* objectIDs = [NSMutableArray arrayWithCapacity:[cacheIdentities count]];
     
-    if (error != NULL && *error != nil) {
-        return nil;
+    for (NSDictionary* cacheIdentity in cacheIdentities) {
+        NSEntityDescription* entityDescription = entitiesByName[cacheIdentity[APObjectEntityNameAttributeName]];
+        [objectIDs addObject:[self managedObjectIDForEntity:entityDescription withObjectUID:cacheIdentity[APObjectUIDAttributeName]]];
     }
     
-    return [objects map:^(id item) {
-        return [item objectID];
-    }];
+    return objectIDs;
 }
 
 
@@ -629,7 +816,50 @@ static NSString* const APReferenceCountKey = @"APReferenceCountKey";
         return nil;
     }
     
-    return objects;
+    // Relationship values come as {entityName: objectUID}
+    NSSet* objectIDKeys = [self objectIDKeysForDictionaryFetchRequest:fetchRequest];
+    if ([objectIDKeys count] == 0) {
+        return objects;
+    }
+    
+    NSDictionary* entitiesByName = self.model.entitiesByName;
+    return [objects map:^id(NSDictionary* object) {
+        NSMutableDictionary* translatedObject = nil;
+        for (NSString* key in objectIDKeys) {
+            id value = object[key];
+            if ([value isKindOfClass:[NSDictionary class]]) {
+                if (!translatedObject) translatedObject = [object mutableCopy];
+                NSString* entityName = [[value allKeys] lastObject];
+                translatedObject[key] = [self managedObjectIDForEntity:entitiesByName[entityName] withObjectUID:value[entityName]];
+            }
+        }
+        return translatedObject ?: object;
+    }];
+}
+
+
+/*
+ Keys of a dictionary fetch whose values are objects: relationships and expressions of NSObjectIDAttributeType.
+ Other dictionaries (ie: transformable attributes) are returned as they are.
+ */
+- (NSSet*) objectIDKeysForDictionaryFetchRequest:(NSFetchRequest*) fetchRequest {
+    
+    NSMutableSet* objectIDKeys = [NSMutableSet set];
+    NSDictionary* propertiesByName = fetchRequest.entity.propertiesByName;
+    
+    NSArray* properties = [(fetchRequest.propertiesToFetch ?: @[]) arrayByAddingObjectsFromArray:fetchRequest.propertiesToGroupBy ?: @[]];
+    for (id property in properties) {
+        id propertyDescription = ([property isKindOfClass:[NSString class]]) ? propertiesByName[property] : property;
+        
+        if ([propertyDescription isKindOfClass:[NSRelationshipDescription class]]) {
+            [objectIDKeys addObject:[propertyDescription name]];
+            
+        } else if ([propertyDescription isKindOfClass:[NSExpressionDescription class]] &&
+                   [propertyDescription expressionResultType] == NSObjectIDAttributeType) {
+            [objectIDKeys addObject:[propertyDescription name]];
+        }
+    }
+    return objectIDKeys;
 }
 
 
@@ -656,45 +886,24 @@ static NSString* const APReferenceCountKey = @"APReferenceCountKey";
     NSSet *updatedObjects = [saveRequest updatedObjects];
     NSSet *deletedObjects = [saveRequest deletedObjects];
     
-    __block NSError* localError;
-    
-    if ([insertedObjects count] > 0) {
-        NSDictionary* insertedObjectRepresentations = [self representationsFromManagedObjects:[insertedObjects allObjects]];
-        
-        [insertedObjectRepresentations enumerateKeysAndObjectsUsingBlock:^(NSString* entityName, NSArray* representations, BOOL *stop) {
-            
-            if (![self.diskCache insertObjectRepresentations:representations error:&localError]) {
-                *stop = YES;
-                *error = localError;
-            }
-        }];
-        if (localError) return nil;
+    // Invalidated once written, faults reading them meanwhile won't be cached.
+    NSMutableSet* savedObjectUIDs = [NSMutableSet setWithCapacity:[updatedObjects count] + [deletedObjects count]];
+    for (NSManagedObject* managedObject in [updatedObjects setByAddingObjectsFromSet:deletedObjects]) {
+        NSString* objectUID = [self referenceObjectForObjectID:managedObject.objectID];
+        if (objectUID) [savedObjectUIDs addObject:objectUID];
     }
     
-    if ([updatedObjects count] > 0) {
-        NSDictionary* updatedObjectRepresentations = [self representationsFromManagedObjects:[updatedObjects allObjects]];
-        
-        [updatedObjectRepresentations enumerateKeysAndObjectsUsingBlock:^(NSString* entityName, NSArray* representations, BOOL *stop) {
-            
-            if (![self.diskCache updateObjectRepresentations:representations error:&localError]){
-                *stop = YES;
-                *error = localError;
-            }
-        }];
-        if (localError) return nil;
-    }
+    // All changes go to the disk cache in a single transaction
+    NSError* localError = nil;
+    BOOL success = [self.diskCache saveInsertedObjectRepresentations:[self flattenedRepresentationsFromManagedObjects:[insertedObjects allObjects]]
+                                        updatedObjectRepresentations:[self flattenedRepresentationsFromManagedObjects:[updatedObjects allObjects]]
+                                        deletedObjectRepresentations:[self flattenedRepresentationsFromManagedObjects:[deletedObjects allObjects]]
+                                                               error:&localError];
+    [self.rowCache invalidateObjectUIDs:savedObjectUIDs];
     
-    if ([deletedObjects count] > 0) {
-        NSDictionary* deletedObjectRepresentations = [self representationsFromManagedObjects:[deletedObjects allObjects]];
-        
-        [deletedObjectRepresentations enumerateKeysAndObjectsUsingBlock:^(NSString* entityName, NSArray* representations, BOOL *stop) {
-            
-            if (![self.diskCache deleteObjectRepresentations:representations error:&localError]) {
-                *stop = YES;
-                *error = localError;
-            }
-        }];
-        if (localError) return nil;
+    if (!success) {
+        if (error) *error = localError;
+        return nil;
     }
     
     if (self.syncOnSave) [self syncLocalCacheAllRemoteObjects:NO];
@@ -706,9 +915,7 @@ static NSString* const APReferenceCountKey = @"APReferenceCountKey";
 #pragma mark - NSIncrementalStore Subclass Optional Methods
 
 // Both managedObjectContextDidRegisterObjectsWithIDs: and managedObjectContextDidUnregisterObjectsWithIDs:
-// could be enhanced to implement what Apple call row cache.
-// However as we are relying on CoreData to provide us with the caching engine we don't need to investing time
-// here.
+// keep the reference counts that drive the lifetime of the row cache entries (see rowCache).
 
 /*
  Once the incremental store registers a new managedObjectID we cache it and
@@ -720,28 +927,30 @@ static NSString* const APReferenceCountKey = @"APReferenceCountKey";
     
     // [super managedObjectContextDidRegisterObjectsWithIDs:objectIDs];
     
-    for (NSManagedObjectID *objectID in objectIDs) {
-        id objectUID = [self referenceObjectForObjectID:objectID];
-        
-        if (!objectUID) {
-            if (AP_DEBUG_ERRORS) { ELog(@"ObjectID: %@ does not have objectUID??", objectID)}
-            continue;
-        }
-        
-        NSMutableDictionary *objectIDsAndRefereceCountByObjectUID = self.mapBetweenManagedObjectIDsAndObjectUIDByEntityName[objectID.entity.name]?:[NSMutableDictionary dictionary];
-        
-        NSDictionary* objectUIDDictEntry = objectIDsAndRefereceCountByObjectUID[objectUID];
-        
-        if (!objectUIDDictEntry) {
-            objectUIDDictEntry = @{APManagedObjectIDKey:objectID, APReferenceCountKey:@1};
+    @synchronized(self.registeredObjectsLock) {
+        for (NSManagedObjectID *objectID in objectIDs) {
+            id objectUID = [self referenceObjectForObjectID:objectID];
+            
+            if (!objectUID) {
+                if (AP_DEBUG_ERRORS) { ELog(@"ObjectID: %@ does not have objectUID??", objectID)}
+                continue;
+            }
             
-        } else {
-            NSNumber* referenceCount = objectUIDDictEntry[APReferenceCountKey];
-            objectUIDDictEntry = @{APManagedObjectIDKey:objectID, APReferenceCountKey:@([referenceCount integerValue] + 1)};
+            NSMutableDictionary *objectIDsAndRefereceCountByObjectUID = self.mapBetweenManagedObjectIDsAndObjectUIDByEntityName[objectID.entity.name]?:[NSMutableDictionary dictionary];
+            
+            NSDictionary* objectUIDDictEntry = objectIDsAndRefereceCountByObjectUID[objectUID];
+            
+            if (!objectUIDDictEntry) {
+                objectUIDDictEntry = @{APManagedObjectIDKey:objectID, APReferenceCountKey:@1};
+                
+            } else {
+                NSNumber* referenceCount = objectUIDDictEntry[APReferenceCountKey];
+                objectUIDDictEntry = @{APManagedObjectIDKey:objectID, APReferenceCountKey:@([referenceCount integerValue] + 1)};
+            }
+            
+            objectIDsAndRefereceCountByObjectUID[objectUID] = objectUIDDictEntry;
+            self.mapBetweenManagedObjectIDsAndObjectUIDByEntityName[objectID.entity.name] = objectIDsAndRefereceCountByObjectUID;
         }
-        
-        objectIDsAndRefereceCountByObjectUID[objectUID] = objectUIDDictEntry;
-        self.mapBetweenManagedObjectIDsAndObjectUIDByEntityName[objectID.entity.name] = objectIDsAndRefereceCountByObjectUID;
     }
 }
 
@@ -754,50 +963,68 @@ static NSString* const APReferenceCountKey = @"APReferenceCountKey";
     
     if (AP_DEBUG_METHODS) {MLog()}
     
-    for (NSManagedObjectID *objectID in objectIDs) {
-        id objectUID = [self referenceObjectForObjectID:objectID];
-        
-        if (!objectUID) {
-            if (AP_DEBUG_ERRORS) { ELog(@"ObjectID: %@ does not have objectUID??", objectID)}
-            continue;
-        }
-        
-        NSMutableDictionary *objectIDsAndRefereceCountByObjectUID = self.mapBetweenManagedObjectIDsAndObjectUIDByEntityName[objectID.entity.name];
-        
-        if (!objectIDsAndRefereceCountByObjectUID) {
-            if (AP_DEBUG_ERRORS) { ELog(@"Entity: %@ isn't registred in self.mapBetweenObjectIDsAndObjectUIDByEntityName ??", objectID.entity.name)}
-            continue;
-            
-        } else {
-            
-             // Entry: {objectID: refereceCount}
-             // get existing entry and increment referece count by 1
-            
-            NSMutableDictionary* objectUIDDictEntry = [objectIDsAndRefereceCountByObjectUID[objectUID]mutableCopy];
+    @synchronized(self.registeredObjectsLock) {
+        for (NSManagedObjectID *objectID in objectIDs) {
+            id objectUID = [self referenceObjectForObjectID:objectID];
             
-            if (!objectUIDDictEntry) {
-                if (AP_DEBUG_ERRORS) {ELog(@"Warning - Trying to unregister a not previously registered objectUID: %@ ", objectUID)}
+            if (!objectUID) {
+                if (AP_DEBUG_ERRORS) { ELog(@"ObjectID: %@ does not have objectUID??", objectID)}
                 continue;
             }
             
-            NSNumber* referenceCount = objectUIDDictEntry[APReferenceCountKey];
+            NSMutableDictionary *objectIDsAndRefereceCountByObjectUID = self.mapBetweenManagedObjectIDsAndObjectUIDByEntityName[objectID.entity.name];
             
-            if ([referenceCount integerValue] == 1) {
+            if (!objectIDsAndRefereceCountByObjectUID) {
+                if (AP_DEBUG_ERRORS) { ELog(@"Entity: %@ isn't registred in self.mapBetweenObjectIDsAndObjectUIDByEntityName ??", objectID.entity.name)}
+                continue;
                 
-                 // No context holds reference for this managedObjectID anymore,
-                 // we can remove it from objectIDsAndRefereceCountByObjectUUID
+            } else {
                 
-                [objectIDsAndRefereceCountByObjectUID removeObjectForKey:objectUID];
+                 // Entry: {objectID: refereceCount}
+                 // get existing entry and increment referece count by 1
                 
-            } else {
-                objectUIDDictEntry[APReferenceCountKey] = @([referenceCount integerValue] - 1);
-                objectIDsAndRefereceCountByObjectUID[objectUID] = objectUIDDictEntry;
+                NSMutableDictionary* objectUIDDictEntry = [objectIDsAndRefereceCountByObjectUID[objectUID]mutableCopy];
+                
+                if (!objectUIDDictEntry) {
+                    if (AP_DEBUG_ERRORS) {ELog(@"Warning - Trying to unregister a not previously registered objectUID: %@ ", objectUID)}
+                    continue;
+                }
+                
+                NSNumber* referenceCount = objectUIDDictEntry[APReferenceCountKey];
+                
+                if ([referenceCount integerValue] == 1) {
+                    
+                     // No context holds reference for this managedObjectID anymore,
+                     // we can remove it from objectIDsAndRefereceCountByObjectUUID
+                    
+                    [objectIDsAndRefereceCountByObjectUID removeObjectForKey:objectUID];
+                    [self.rowCache removeObjectUIDs:@[objectUID]];
+                    [self removeObjectUIDFromFaultBatch:objectUID];
+                    
+                } else {
+                    objectUIDDictEntry[APReferenceCountKey] = @([referenceCount integerValue] - 1);
+                    objectIDsAndRefereceCountByObjectUID[objectUID] = objectUIDDictEntry;
+                }
             }
         }
     }
 }
 
 
+// Rows live as long as some context has the object registered
+- (void) setRowCacheValues:(NSDictionary*) values
+              forObjectUID:(NSString*) objectUID
+                entityName:(NSString*) entityName
+                   version:(NSUInteger) version {
+    
+    @synchronized(self.registeredObjectsLock) {
+        if (self.mapBetweenManagedObjectIDsAndObjectUIDByEntityName[entityName][objectUID]) {
+            [self.rowCache setValues:values forObjectUID:objectUID version:version];
+        }
+    }
+}
+
+
 #pragma mark - Notification Handlers
 
 - (void) didReceiveSyncNotifcation: (NSNotification*) note {
@@ -818,12 +1045,17 @@ static NSString* const APReferenceCountKey = @"APReferenceCountKey";
     
     if (AP_DEBUG_METHODS) { MLog()}
     [self.diskCache resetCache];
+    [self.rowCache invalidateAllObjects];
     [[NSNotificationCenter defaultCenter]postNotificationName:APNotificationStoreDidFinishCacheReset object:self];
 }
 
 - (void) didReceiveAppDidEnterBackground: (NSNotification*) note {
     if (AP_DEBUG_METHODS) { MLog()}
     [self.syncQueue cancelAllOperations];
+    NSError* flushError = nil;
+    if (![self.diskCache flush:&flushError]) {
+        if (AP_DEBUG_ERRORS) {ELog(@"Error writing the cache before going to background: %@",flushError)}
+    }
 }
 
 
@@ -835,6 +1067,15 @@ static NSString* const APReferenceCountKey = @"APReferenceCountKey";
     
     if ([self.syncQueue operationCount] == 0) {
         
+        // The sync operation reads the cache store through its own coordinator, pending writes must be there.
+        NSError* flushError = nil;
+        if (![self.diskCache flush:&flushError]) {
+            if (AP_DEBUG_ERRORS) {ELog(@"Error writing the cache before syncing: %@",flushError)}
+            // Syncing without them would push stale objects and pull over unsaved changes.
+            [[NSNotificationCenter defaultCenter]postNotificationName:APNotificationStoreDidFinishSync object:self userInfo:@{APNotificationSyncErrorKey: flushError}];
+            return;
+        }
+        
         NSPersistentStoreCoordinator* syncPSC = [[NSPersistentStoreCoordinator alloc]initWithManagedObjectModel:self.modelPlusCacheProperties];
         
         NSString *currSysVer = [[UIDevice currentDevice] systemVersion];
@@ -842,6 +1083,7 @@ static NSString* const APReferenceCountKey = @"APReferenceCountKey";
             [syncPSC setValue:@"Sync Operation PSC" forKey:@"name"];
         }
         
+        // Stores of previous versions have been migrated by the disk cache when it opened them (see -diskCache).
         NSDictionary *options = @{ NSMigratePersistentStoresAutomaticallyOption: @YES,
                                    /*NSSQLitePragmasOption:@{@"journal_mode":@"DELETE"},*/
                                    NSInferMappingModelAutomaticallyOption: @YES};
@@ -865,30 +1107,75 @@ static NSString* const APReferenceCountKey = @"APReferenceCountKey";
         NSString* username = [self.authenticatedUser valueForKey:@"username"];
         [syncOperation setEnvID:[NSString stringWithFormat:@"%@-%@",self.diskCache.localStoreFileName,username]];
         syncOperation.fullSync = allRemoteObjects;
+        if (self.pushBatchSize) syncOperation.pushBatchSize = [self.pushBatchSize unsignedIntegerValue];
+        if (self.pullConcurrency) syncOperation.pullConcurrency = [self.pullConcurrency unsignedIntegerValue];
+        if (self.pullPageSize) syncOperation.pullPageSize = [self.pullPageSize unsignedIntegerValue];
+        if (self.syncProgressInterval) syncOperation.progressInterval = [self.syncProgressInterval doubleValue];
+        if (self.syncProgressObjectCount) syncOperation.progressObjectCount = [self.syncProgressObjectCount unsignedIntegerValue];
+        [(APParseSyncOperation*) syncOperation setBlobStore:self.diskCache.blobStore];
+        [(APParseSyncOperation*) syncOperation setDeferFileDownloads:self.deferFileDownloads];
         
         __weak  typeof(self) weakSelf = self;
         
-        [syncOperation setPerObjectCompletionBlock:^(BOOL isRemote, NSString* entityName) {
+        BOOL perObjectSyncNotifications = self.perObjectSyncNotifications;
+        
+        [syncOperation setProgressBlock:^(NSDictionary* remoteObjectsSyncedByEntityName, NSDictionary* localObjectsSyncedByEntityName) {
             
             if (![NSThread isMainThread]) {
                 [NSException raise:APIncrementalStoreExceptionInconsistency format:@"It should be called in the main thread"];
             
             } else if (weakSelf ) {
-                NSString* userInfoKey = (isRemote) ? APNotificationNumberOfRemoteObjectsSyncedKey: APNotificationNumberOfLocalObjectsSyncedKey;
-                NSDictionary* userInfo = @{userInfoKey: @1, APNotificationObjectEntityNameKey:entityName};
-                [[NSNotificationCenter defaultCenter]postNotificationName:APNotificationStoreDidSyncObject object:weakSelf userInfo:userInfo];
+                
+                // One notification per entity and direction, or per object when asked for the old behaviour
+                void (^postNotifications)(NSDictionary*, NSString*) = ^(NSDictionary* objectsSyncedByEntityName, NSString* userInfoKey) {
+                    [objectsSyncedByEntityName enumerateKeysAndObjectsUsingBlock:^(NSString* entityName, NSNumber* numberOfObjects, BOOL *stop) {
+                        NSUInteger numberOfNotifications = (perObjectSyncNotifications) ? [numberOfObjects unsignedIntegerValue] : 1;
+                        NSDictionary* userInfo = @{userInfoKey: (perObjectSyncNotifications) ? @1 : numberOfObjects, APNotificationObjectEntityNameKey:entityName};
+                        for (NSUInteger idx = 0; idx < numberOfNotifications; idx++) {
+                            [[NSNotificationCenter defaultCenter]postNotificationName:APNotificationStoreDidSyncObject object:weakSelf userInfo:userInfo];
+                        }
+                    }];
+                };
+                postNotifications(remoteObjectsSyncedByEntityName,APNotificationNumberOfRemoteObjectsSyncedKey);
+                postNotifications(localObjectsSyncedByEntityName,APNotificationNumberOfLocalObjectsSyncedKey);
             }
         }];
         
         
+        BOOL syncChangeFeed = self.syncChangeFeed;
+        
+        if (syncChangeFeed) {
+            [syncOperation setMergedChangesBlock:^(NSDictionary* objectUIDsNestedByEntityName) {
+                
+                if (![NSThread isMainThread]) {
+                    [NSException raise:APIncrementalStoreExceptionInconsistency format:@"It should be called in the main thread"];
+                } else if (weakSelf ) {
+                    [weakSelf invalidateRowCacheForObjectUIDsNestedByEntityName:objectUIDsNestedByEntityName];
+                    NSDictionary* userInfo = @{APNotificationSyncedObjectsKey: [weakSelf translateObjectUIDsToManagedObjectIDs:objectUIDsNestedByEntityName]};
+                    [[NSNotificationCenter defaultCenter]postNotificationName:APNotificationStoreDidMergeChanges object:weakSelf userInfo:userInfo];
+                }
+            }];
+        }
+        
         [syncOperation setSyncCompletionBlock:^(NSDictionary* mergedObjectsUIDsNestedByEntityName, NSError* operationError) {
             
             if (![NSThread isMainThread]) {
                 [NSException raise:APIncrementalStoreExceptionInconsistency format:@"It should be called in the main thread"];
             } else if (weakSelf ) {
                 
+                /*
+                 Merged objects are no longer what the row cache has. Pages may have been merged before an error,
+                 in that case we can't tell which objects have changed.
+                 */
+                if (operationError || !mergedObjectsUIDsNestedByEntityName) {
+                    [weakSelf.rowCache invalidateAllObjects];
+                } else if (!syncChangeFeed) {
+                    [weakSelf invalidateRowCacheForObjectUIDsNestedByEntityName:mergedObjectsUIDsNestedByEntityName];
+                }
+                
+                // With the change feed objects have been sent page by page already
                 NSMutableDictionary* syncResults = [NSMutableDictionary dictionaryWithCapacity:2];
-                if (mergedObjectsUIDsNestedByEntityName) {
+                if (mergedObjectsUIDsNestedByEntityName && !syncChangeFeed) {
                     syncResults[APNotificationSyncedObjectsKey] = [weakSelf translateObjectUIDsToManagedObjectIDs:mergedObjectsUIDsNestedByEntityName];
                 }
                 if (operationError) {
@@ -898,6 +1185,15 @@ static NSString* const APReferenceCountKey = @"APReferenceCountKey";
                 [[NSNotificationCenter defaultCenter]postNotificationName:APNotificationStoreDidFinishSync object:weakSelf userInfo:[syncResults copy]];
                 
                 weakSelf.syncing = NO;
+                
+                // Files replaced or deleted by the sync, queued so that the next sync waits for it.
+                APDiskCache* diskCache = weakSelf.diskCache;
+                [weakSelf.syncQueue addOperationWithBlock:^{
+                    NSError* blobsError = nil;
+                    if (![diskCache removeUnreferencedBlobs:&blobsError]) {
+                        if (AP_DEBUG_ERRORS) {ELog(@"Error removing unreferenced blobs: %@",blobsError)}
+                    }
+                }];
             }
         }];
         
@@ -908,6 +1204,16 @@ static NSString* const APReferenceCountKey = @"APReferenceCountKey";
     }
 }
 
+- (void) invalidateRowCacheForObjectUIDsNestedByEntityName:(NSDictionary*) objectUIDsNestedByEntityName {
+    
+    [objectUIDsNestedByEntityName enumerateKeysAndObjectsUsingBlock:^(NSString* entityName, NSDictionary* objectUIDsByStatus, BOOL *stop) {
+        [objectUIDsByStatus enumerateKeysAndObjectsUsingBlock:^(NSString* status, NSArray* objectUIDs, BOOL *stop) {
+            [self.rowCache invalidateObjectUIDs:objectUIDs];
+        }];
+    }];
+}
+
+
 /*
  objectUIDsNestedByEntityName has the following format:
  
@@ -973,18 +1279,14 @@ static NSString* const APReferenceCountKey = @"APReferenceCountKey";
     NSManagedObjectID *managedObjectID = nil;
     
     // Check if we have it created already
-    NSMutableDictionary *objectIDsAndRefCountByObjectUID = self.mapBetweenManagedObjectIDsAndObjectUIDByEntityName[entityDescription.name];
+    NSDictionary* objectUIDEntry;
+    @synchronized(self.registeredObjectsLock) {
+        objectUIDEntry = self.mapBetweenManagedObjectIDsAndObjectUIDByEntityName[entityDescription.name][objectUID];
+    }
     
-    if (objectIDsAndRefCountByObjectUID) {
-        NSDictionary* objectUIDEntry = objectIDsAndRefCountByObjectUID[objectUID];
-        
-        if (!objectUIDEntry) {
-            managedObjectID = [self newObjectIDForEntity:entityDescription referenceObject:objectUID];
-            
-        } else {
-            managedObjectID = objectUIDEntry[APManagedObjectIDKey];
-            NSAssert([managedObjectID isKindOfClass:[NSManagedObjectID class]],@"returned object should be of NSManagedObjectId kind");
-        }
+    if (objectUIDEntry) {
+        managedObjectID = objectUIDEntry[APManagedObjectIDKey];
+        NSAssert([managedObjectID isKindOfClass:[NSManagedObjectID class]],@"returned object should be of NSManagedObjectId kind");
         
     } else {
         /*
@@ -1019,6 +1321,16 @@ static NSString* const APReferenceCountKey = @"APReferenceCountKey";
 }
 
 
+- (NSArray*) flattenedRepresentationsFromManagedObjects: (NSArray*) managedObjects {
+    
+    NSMutableArray* representations = [NSMutableArray arrayWithCapacity:[managedObjects count]];
+    for (NSArray* entityRepresentations in [[self representationsFromManagedObjects:managedObjects] allValues]) {
+        [representations addObjectsFromArray:entityRepresentations];
+    }
+    return representations;
+}
+
+
 - (NSDictionary*) representationFromManagedObject: (NSManagedObject*) managedObject {
     
     if (AP_DEBUG_METHODS) { MLog() }
@@ -1157,6 +1469,16 @@ static NSString* const APReferenceCountKey = @"APReferenceCountKey";
     
     if (AP_DEBUG_METHODS) { MLog()}
     
+    return [self cacheModelFromUserModel:model previousVersion:NO];
+}
+
+
+/*
+ previousVersion builds the cache model of the stores created up to 0.4.2: without the remote ID and relation members
+ attributes, the outbox and the sync state entities. APDiskCache migrates these stores when it opens them.
+ */
+- (NSManagedObjectModel*) cacheModelFromUserModel:(NSManagedObjectModel*) model previousVersion:(BOOL) previousVersion {
+    
     NSManagedObjectModel *cacheModel = [model copy];
     
     /*
@@ -1205,6 +1527,15 @@ static NSString* const APReferenceCountKey = @"APReferenceCountKey";
         [lastModifiedProperty setUserInfo:@{APIncrementalStorePrivateAttributeKey:@YES}];
         [additionalProperties addObject:lastModifiedProperty];
         
+        if (!previousVersion) {
+            NSAttributeDescription *remoteIDProperty = [[NSAttributeDescription alloc] init];
+            [remoteIDProperty setName:APObjectRemoteIDAttributeName];
+            [remoteIDProperty setAttributeType:NSStringAttributeType];
+            [remoteIDProperty setIndexed:NO];
+            [remoteIDProperty setUserInfo:@{APIncrementalStorePrivateAttributeKey:@YES}];
+            [additionalProperties addObject:remoteIDProperty];
+        }
+        
         NSAttributeDescription *statusProperty = [[NSAttributeDescription alloc] init];
         [statusProperty setName:APObjectStatusAttributeName];
         [statusProperty setAttributeType:NSInteger16AttributeType];
@@ -1232,10 +1563,95 @@ static NSString* const APReferenceCountKey = @"APReferenceCountKey";
         [createdRemotelyProperty setUserInfo:@{APIncrementalStorePrivateAttributeKey:@YES}];
         [additionalProperties addObject:createdRemotelyProperty];
         
+        if (!previousVersion) {
+            NSAttributeDescription *relationMembersProperty = [[NSAttributeDescription alloc] init];
+            [relationMembersProperty setName:APObjectRelationMembersAttributeName];
+            [relationMembersProperty setAttributeType:NSTransformableAttributeType];
+            [relationMembersProperty setIndexed:NO];
+            [relationMembersProperty setUserInfo:@{APIncrementalStorePrivateAttributeKey:@YES}];
+            [additionalProperties addObject:relationMembersProperty];
+        }
+        
         [entity setProperties:[entity.properties arrayByAddingObjectsFromArray:additionalProperties]];
     }
+    
+    if (!previousVersion) {
+        [cacheModel setEntities:[cacheModel.entities arrayByAddingObjectsFromArray:@[[self outboxEntity],[self syncStateEntity]]]];
+    }
     return cacheModel;
 }
 
 
+// See APOutboxEntityName
+- (NSEntityDescription*) outboxEntity {
+    
+    NSEntityDescription* outboxEntity = [[NSEntityDescription alloc]init];
+    [outboxEntity setName:APOutboxEntityName];
+    
+    NSAttributeDescription *sequenceProperty = [[NSAttributeDescription alloc] init];
+    [sequenceProperty setName:APOutboxSequenceAttributeName];
+    [sequenceProperty setAttributeType:NSInteger64AttributeType];
+    [sequenceProperty setIndexed:YES];
+    [sequenceProperty setOptional:NO];
+    
+    NSAttributeDescription *uidProperty = [[NSAttributeDescription alloc] init];
+    [uidProperty setName:APObjectUIDAttributeName];
+    [uidProperty setAttributeType:NSStringAttributeType];
+    [uidProperty setIndexed:NO];
+    [uidProperty setOptional:NO];
+    
+    NSAttributeDescription *entityNameProperty = [[NSAttributeDescription alloc] init];
+    [entityNameProperty setName:APObjectEntityNameAttributeName];
+    [entityNameProperty setAttributeType:NSStringAttributeType];
+    [entityNameProperty setIndexed:NO];
+    [entityNameProperty setOptional:NO];
+    
+    [outboxEntity setProperties:@[sequenceProperty,uidProperty,entityNameProperty]];
+    return outboxEntity;
+}
+
+
+// See APSyncStateEntityName
+- (NSEntityDescription*) syncStateEntity {
+    
+    NSEntityDescription* syncStateEntity = [[NSEntityDescription alloc]init];
+    [syncStateEntity setName:APSyncStateEntityName];
+    
+    NSAttributeDescription *keyProperty = [[NSAttributeDescription alloc] init];
+    [keyProperty setName:APSyncStateKeyAttributeName];
+    [keyProperty setAttributeType:NSStringAttributeType];
+    [keyProperty setIndexed:YES];
+    [keyProperty setOptional:NO];
+    
+    NSAttributeDescription *cursorsProperty = [[NSAttributeDescription alloc] init];
+    [cursorsProperty setName:APSyncStateCursorsAttributeName];
+    [cursorsProperty setAttributeType:NSTransformableAttributeType];
+    [cursorsProperty setOptional:YES];
+    
+    NSAttributeDescription *cursorObjectUIDsProperty = [[NSAttributeDescription alloc] init];
+    [cursorObjectUIDsProperty setName:APSyncStateCursorObjectUIDsAttributeName];
+    [cursorObjectUIDsProperty setAttributeType:NSTransformableAttributeType];
+    [cursorObjectUIDsProperty setOptional:YES];
+    
+    NSAttributeDescription *serverTimeProperty = [[NSAttributeDescription alloc] init];
+    [serverTimeProperty setName:APSyncStateServerTimeAttributeName];
+    [serverTimeProperty setAttributeType:NSDateAttributeType];
+    [serverTimeProperty setOptional:YES];
+    
+    NSAttributeDescription *envIDProperty = [[NSAttributeDescription alloc] init];
+    [envIDProperty setName:APSyncStateEnvIDAttributeName];
+    [envIDProperty setAttributeType:NSStringAttributeType];
+    [envIDProperty setOptional:YES];
+    
+    NSAttributeDescription *outboxSeededProperty = [[NSAttributeDescription alloc] init];
+    [outboxSeededProperty setName:APSyncStateOutboxSeededAttributeName];
+    [outboxSeededProperty setAttributeType:NSBooleanAttributeType];
+    [outboxSeededProperty setDefaultValue:@NO];
+    [outboxSeededProperty setOptional:YES];
+    
+    [syncStateEntity setProperties:@[keyProperty,cursorsProperty,cursorObjectUIDsProperty,serverTimeProperty,envIDProperty,outboxSeededProperty]];
+    return syncStateEntity;
+}
+
+
 @end
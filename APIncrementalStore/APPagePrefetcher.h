@@ -0,0 +1,53 @@
+/*
+ *
+ * Copyright 2014 Flavio Negrão Torres
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#import <Foundation/Foundation.h>
+
+/**
+ Fetches pages ahead of the consumer in a background queue, keeping at most `depth` pages
+ waiting to be consumed. Pages are delivered in the same order they were fetched.
+ */
+@interface APPagePrefetcher : NSObject
+
+/**
+ Designated Initializer
+ @param depth maximum number of pages fetched ahead of the consumer, minimum is 1.
+ @param fetchBlock called serially from a background queue to fetch the next page. It returns nil
+        and sets the error if the page could not be fetched. When it sets isLastPage to YES no more pages are requested.
+ */
+- (instancetype) initWithDepth:(NSUInteger) depth
+                    fetchBlock:(id (^)(BOOL* isLastPage, NSError*__autoreleasing* error)) fetchBlock;
+
+/// Starts fetching pages in background.
+- (void) start;
+
+/**
+ Blocks until the next page is available.
+ @returns the next page or nil when there are no more pages or an error has occurred.
+ */
+- (id) nextPage:(NSError*__autoreleasing*) error;
+
+/// Stops fetching, pages already fetched are discarded.
+- (void) cancel;
+
+/// Total seconds the background fetch has waited for the consumer to make room for a page.
+@property (nonatomic, readonly) NSTimeInterval fetchStallTime;
+
+/// Total seconds the consumer has waited for the background fetch to deliver a page.
+@property (nonatomic, readonly) NSTimeInterval consumerStallTime;
+
+@end
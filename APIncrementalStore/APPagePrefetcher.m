@@ -0,0 +1,130 @@
+/*
+ *
+ * Copyright 2014 Flavio Negrão Torres
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#import "APPagePrefetcher.h"
+
+
+@interface APPagePrefetcher ()
+
+@property (nonatomic, assign) NSUInteger depth;
+@property (nonatomic, copy) id (^fetchBlock)(BOOL* isLastPage, NSError*__autoreleasing* error);
+
+@property (nonatomic, strong) NSCondition* condition;
+@property (nonatomic, strong) NSMutableArray* pages;
+@property (nonatomic, strong) NSError* fetchError;
+@property (nonatomic, assign, getter=isFinished) BOOL finished;
+@property (nonatomic, assign, getter=isCancelled) BOOL cancelled;
+
+@property (nonatomic, assign) NSTimeInterval fetchStallTime;
+@property (nonatomic, assign) NSTimeInterval consumerStallTime;
+
+@end
+
+
+@implementation APPagePrefetcher
+
+- (instancetype) initWithDepth:(NSUInteger) depth
+                    fetchBlock:(id (^)(BOOL* isLastPage, NSError*__autoreleasing* error)) fetchBlock {
+    
+    self = [super init];
+    if (self) {
+        _depth = MAX(depth, 1);
+        _fetchBlock = [fetchBlock copy];
+        _condition = [[NSCondition alloc]init];
+        _pages = [NSMutableArray arrayWithCapacity:_depth];
+    }
+    return self;
+}
+
+
+- (void) start {
+    
+    dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+        
+        BOOL isLastPage = NO;
+        
+        while (!isLastPage) {
+            
+            @autoreleasepool {
+                
+                [self.condition lock];
+                NSDate* waitStart = [NSDate date];
+                while ([self.pages count] >= self.depth && !self.isCancelled) {
+                    [self.condition wait];
+                }
+                self.fetchStallTime += [[NSDate date] timeIntervalSinceDate:waitStart];
+                BOOL cancelled = self.isCancelled;
+                [self.condition unlock];
+                
+                if (cancelled) {
+                    break;
+                }
+                
+                NSError* error = nil;
+                id page = self.fetchBlock(&isLastPage,&error);
+                
+                [self.condition lock];
+                if (!page) {
+                    self.fetchError = error;
+                    isLastPage = YES;
+                } else {
+                    [self.pages addObject:page];
+                }
+                self.finished = isLastPage;
+                [self.condition broadcast];
+                [self.condition unlock];
+            }
+        }
+    });
+}
+
+
+- (id) nextPage:(NSError*__autoreleasing*) error {
+    
+    id page = nil;
+    
+    [self.condition lock];
+    NSDate* waitStart = [NSDate date];
+    while ([self.pages count] == 0 && !self.isFinished && !self.isCancelled) {
+        [self.condition wait];
+    }
+    self.consumerStallTime += [[NSDate date] timeIntervalSinceDate:waitStart];
+    
+    if ([self.pages count] > 0) {
+        page = [self.pages firstObject];
+        [self.pages removeObjectAtIndex:0];
+        [self.condition broadcast];
+        
+    } else if (self.fetchError) {
+        if (error) *error = self.fetchError;
+    }
+    [self.condition unlock];
+    
+    return page;
+}
+
+
+- (void) cancel {
+    
+    [self.condition lock];
+    self.cancelled = YES;
+    [self.pages removeAllObjects];
+    [self.condition broadcast];
+    [self.condition unlock];
+}
+
+@end
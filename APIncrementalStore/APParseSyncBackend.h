@@ -0,0 +1,68 @@
+/*
+ *
+ * Copyright 2014 Flavio Negrão Torres
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#import <Foundation/Foundation.h>
+
+@class PFQuery;
+
+
+/**
+ The round trips APParseSyncOperation makes to the webservice while pushing and pulling objects.
+ Everything else (files, relations, push notifications) still goes straight to the Parse SDK.
+ */
+@protocol APParseSyncBackend <NSObject>
+
+/// Current webservice time, used as the upper bound of a sync.
+- (NSDate*) serverTime:(NSError*__autoreleasing*) error;
+
+- (NSArray*) findObjectsForQuery:(PFQuery*) query
+                           error:(NSError*__autoreleasing*) error;
+
+/**
+ Saves all objects in as few requests as the webservice allows.
+ @returns NO if any of the objects could not be saved; some of them may have been saved nevertheless.
+ */
+- (BOOL) saveObjects:(NSArray*) parseObjects
+               error:(NSError*__autoreleasing*) error;
+
+@end
+
+
+/// Default backend, talks to Parse via the Parse SDK.
+@interface APParseSDKSyncBackend : NSObject <APParseSyncBackend>
+
+@end
+
+
+/**
+ Offline stand-in for Parse, useful to measure the sync throughput without the network.
+ Saves are acknowledged after simulatedLatency seconds (one round trip per call, whatever the
+ number of objects) and objects get a local objectId. Queries always return an empty result,
+ therefore it only makes sense for objects created locally.
+ */
+@interface APLocalSyncBackend : NSObject <APParseSyncBackend>
+
+/// Seconds spent on each call to simulate a network round trip. Default is 0.
+@property (nonatomic, assign) NSTimeInterval simulatedLatency;
+
+/// Saves of objects whose APObjectUIDAttributeName is included here will fail.
+@property (nonatomic, copy) NSSet* failingObjectUIDs;
+
+@property (nonatomic, readonly) NSUInteger numberOfRequests;
+@property (nonatomic, readonly) NSUInteger numberOfSavedObjects;
+
+@end
@@ -0,0 +1,134 @@
+/*
+ *
+ * Copyright 2014 Flavio Negrão Torres
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#import "APParseSyncBackend.h"
+
+#import <Parse/Parse.h>
+#import "NSLogEmoji.h"
+#import "APCommon.h"
+#import "APError.h"
+
+
+@implementation APParseSDKSyncBackend
+
+- (NSDate*) serverTime:(NSError*__autoreleasing*) error {
+
+    NSError* localError = nil;
+    NSDate* parseServerTime = [PFCloud callFunction:@"getTime" withParameters:@{} error:&localError];
+
+    if (localError) {
+        if ([localError.domain isEqualToString:@"Parse"] && localError.code == kPFScriptError) {
+
+            if ([localError.userInfo[@"error"] isEqualToString:@"function not found"]) {
+                NSString* msg = @"You likely don't have Parse Cloud Code configured properly, add a method named \"getTime\" in order to enable APIncrementalStore to retrieve Parse time. Check https://github.com/flavionegrao/APIncrementalStore to see how to set it up correctly.";
+                [NSException raise:APIncrementalStoreExceptionInconsistency format:@"%@",msg];
+
+            } else {
+                if (error) *error = localError;
+                return nil;
+            }
+
+        } else {
+            if (error) *error = localError;
+            return nil;
+        }
+    }
+
+    return parseServerTime;
+}
+
+
+- (NSArray*) findObjectsForQuery:(PFQuery*) query
+                           error:(NSError*__autoreleasing*) error {
+
+    return [query findObjects:error];
+}
+
+
+- (BOOL) saveObjects:(NSArray*) parseObjects
+               error:(NSError*__autoreleasing*) error {
+
+    if ([parseObjects count] == 1) {
+        return [[parseObjects lastObject] save:error];
+    }
+    return [PFObject saveAll:parseObjects error:error];
+}
+
+@end
+
+
+@interface APLocalSyncBackend ()
+
+@property (nonatomic, assign) NSUInteger numberOfRequests;
+@property (nonatomic, assign) NSUInteger numberOfSavedObjects;
+
+@end
+
+
+@implementation APLocalSyncBackend
+
+- (NSDate*) serverTime:(NSError*__autoreleasing*) error {
+
+    [self simulateRoundTrip];
+    return [NSDate date];
+}
+
+
+- (NSArray*) findObjectsForQuery:(PFQuery*) query
+                           error:(NSError*__autoreleasing*) error {
+
+    [self simulateRoundTrip];
+    return @[];
+}
+
+
+- (BOOL) saveObjects:(NSArray*) parseObjects
+               error:(NSError*__autoreleasing*) error {
+
+    [self simulateRoundTrip];
+
+    for (PFObject* parseObject in parseObjects) {
+        NSString* objectUID = parseObject[APObjectUIDAttributeName];
+        if (objectUID && [self.failingObjectUIDs containsObject:objectUID]) {
+            if (error) *error = [NSError errorWithDomain:APIncrementalStoreErrorDomain code:APIncrementalStoreErrorCodeMergingLocalObjects userInfo:@{APObjectUIDAttributeName:objectUID}];
+            return NO;
+        }
+    }
+
+    @synchronized(self) {
+        for (PFObject* parseObject in parseObjects) {
+            if (!parseObject.objectId) {
+                parseObject.objectId = [[NSUUID UUID] UUIDString];
+            }
+        }
+        self.numberOfSavedObjects += [parseObjects count];
+    }
+    return YES;
+}
+
+
+- (void) simulateRoundTrip {
+
+    @synchronized(self) {
+        self.numberOfRequests++;
+    }
+    if (self.simulatedLatency > 0) {
+        [NSThread sleepForTimeInterval:self.simulatedLatency];
+    }
+}
+
+@end
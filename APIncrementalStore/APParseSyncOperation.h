@@ -16,12 +16,17 @@
  */
 
 #import "APWebServiceSyncOperation.h"
+#import "APParseSyncBackend.h"
 
 
 @class PFUser;
+@class APBlobStore;
 
 extern NSString* const APParseRelationshipTypeUserInfoKey;
 
+/// Optional entity user info key, number of objects requested per page when pulling that entity. Overrides pullPageSize, maximum is 1000.
+extern NSString* const APParseQueryPageSizeUserInfoKey;
+
 typedef NS_ENUM(NSUInteger, APParseRelationshipType) {
     APParseRelationshipTypeNonExistent = 0,
     APParseRelationshipTypeArray = 1,
@@ -45,4 +50,13 @@ typedef NS_ENUM(NSUInteger, APParseRelationshipType) {
 
 @property (nonatomic, strong, readonly) PFUser* authenticatedUser;
 
+/// Where objects are pushed to and pulled from. Default is an APParseSDKSyncBackend, use APLocalSyncBackend to measure the sync offline.
+@property (nonatomic, strong) id<APParseSyncBackend> backend;
+
+/// Blob store of the cache (see APDiskCache), pulled files are written to it and values already at Parse aren't uploaded again.
+@property (nonatomic, strong) APBlobStore* blobStore;
+
+/// Set it to YES and pulled files are kept by reference only, downloaded when first read or prefetched after the sync. Requires blobStore. Default is NO.
+@property (nonatomic, assign) BOOL deferFileDownloads;
+
 @end
@@ -23,8 +23,11 @@
 #import <Parse/Parse.h>
 #import "APError.h"
 #import "APCommon.h"
+#import "APPagePrefetcher.h"
+#import "APBlobStore.h"
 
 NSString* const APParseRelationshipTypeUserInfoKey = @"APParseRelationshipType";
+NSString* const APParseQueryPageSizeUserInfoKey = @"APParseQueryPageSize";
 
 /* Debugging */
 BOOL AP_DEBUG_METHODS = NO;
@@ -32,19 +35,24 @@ BOOL AP_DEBUG_ERRORS = NO;
 BOOL AP_DEBUG_INFO = NO;
 
 /*
- NSUserDefaults entry to track the earliest object date synced from Parse.
+ Sync state entry to track the earliest object date synced from Parse.
  We use this Dictionary to keep a "pointer" to a reference date per entity for the last updated object synced from Parse
- There will be one dictionary per logged user.
+ There will be one dictionary per logged user (or envID). 0.4.2 kept it in NSUserDefaults under the same key,
+ it is imported by -loadSyncState.
  @see -[APParseConnector latestObjectSyncedKey]
  */
 static NSString* const APLatestObjectSyncedKey = @"com.apetis.apincrementalstore.parseconnector.request.latestobjectsynced.key";
 
 /*
- It specifies the maximum number of objects that a single Parse query should return when executed.
- If there are more objects than this limit it will be fetched in batches.
+ Maximum number of objects Parse returns for a single query.
  Parse specifies that 100 is the default but it can be increased to maximum 1000.
  */
-static NSUInteger const APParseQueryFetchLimit = 100;
+static NSUInteger const APParseQueryMaxFetchLimit = 1000;
+
+
+// Number of PFRelation queries of a page running at the same time, see -relatedObjectsOfParseObjects:forEntity:error:
+static NSUInteger const APParseRelationQueryConcurrency = 4;
+
 
 
 
@@ -87,15 +95,37 @@ static NSUInteger const APParseQueryFetchLimit = 100;
 @interface APParseSyncOperation()
 
 @property (strong,nonatomic) NSMutableDictionary* latestObjectSyncedDates;
+@property (strong,nonatomic) NSMutableDictionary* latestObjectSyncedObjectUIDs;
 @property (strong,nonatomic) NSString* latestObjectSyncedKey;
 
+// Parse time the latest complete pull has fetched every entity up to, kept with the dates (see -stageSyncState)
+@property (strong,nonatomic) NSDate* lastServerTime;
+
 @property (nonatomic, strong) NSMutableDictionary* mergedObjectsUIDsNestedByEntityName;
+
+// Same objectUIDs as mergedObjectsUIDsNestedByEntityName regardless of status, entity name -> NSMutableSet
+@property (nonatomic, strong) NSMutableDictionary* mergedObjectUIDsByEntityName;
 @property (nonatomic, strong) NSPersistentStoreCoordinator* psc;
 @property (nonatomic, strong) NSManagedObjectContext* context;
 @property (nonatomic, assign, getter=isPushNotificationEnable) BOOL pushNotificationEnable;
 
 @property (nonatomic, strong) id contextDidSaveNotificationObserver;
 
+/*
+ Parse objects of the batch being pushed keyed by objectUID, so that objects related
+ to each other within the same batch share a single Parse object.
+ */
+@property (nonatomic, strong) NSMutableDictionary* pendingParseObjectsByObjectUID;
+
+// Remote file references pulled while deferFileDownloads is set, prefetched once the sync is done. Synchronized on itself.
+@property (nonatomic, strong) NSMutableArray* deferredFileReferences;
+
+/*
+ Members pushed {objectUID: {relationshipName: {relatedObjectUID: relatedEntityName}}}, kept until their object is saved
+ at Parse and only then recorded in APObjectRelationMembersAttributeName, saved along with the rest of the batch.
+ */
+@property (nonatomic, strong) NSMutableDictionary* pendingRelationMembersByObjectUID;
+
 @end
 
 
@@ -129,6 +159,7 @@ static NSUInteger const APParseQueryFetchLimit = 100;
         }
         
         _pushNotificationEnable = pushNotification;
+        _deferredFileReferences = [NSMutableArray array];
         
         if (!psc) {
             [NSException raise:APIncrementalStoreExceptionInconsistency format:@"can't init, psc is nil"];
@@ -137,6 +168,8 @@ static NSUInteger const APParseQueryFetchLimit = 100;
         }
         
         _mergedObjectsUIDsNestedByEntityName = [NSMutableDictionary dictionary];
+        _mergedObjectUIDsByEntityName = [NSMutableDictionary dictionary];
+        _backend = [[APParseSDKSyncBackend alloc]init];
     }
     return self;
 }
@@ -185,6 +218,7 @@ static NSUInteger const APParseQueryFetchLimit = 100;
             
             // Error syncing local objects
             
+            [self flushProgress];
             if (self.syncCompletionBlock) {
                 [[NSOperationQueue mainQueue] addOperationWithBlock:^{
                     self.syncCompletionBlock(self.mergedObjectsUIDsNestedByEntityName,localMergeError);
@@ -200,6 +234,7 @@ static NSUInteger const APParseQueryFetchLimit = 100;
             
             // Error syncing remote objects
             
+            [self flushProgress];
             if (self.syncCompletionBlock) {
                 
                 [[NSOperationQueue mainQueue] addOperationWithBlock:^{
@@ -216,6 +251,7 @@ static NSUInteger const APParseQueryFetchLimit = 100;
             
             // Error saving context
             
+            [self flushProgress];
             if (self.syncCompletionBlock) {
                 
                 [[NSOperationQueue mainQueue] addOperationWithBlock:^{
@@ -226,10 +262,24 @@ static NSUInteger const APParseQueryFetchLimit = 100;
         }
     }
     
+    if (![self isCancelled]) {
+        NSError* blobError = nil;
+        if (![self.blobStore saveRemoteFileNames:&blobError]) {
+            // Files are uploaded again next time, not worth failing the sync
+            if (AP_DEBUG_ERRORS) {ELog(@"Error saving remote file names: %@",blobError)}
+        }
+        
+        @synchronized(self.deferredFileReferences) {
+            [self.blobStore prefetchReferences:self.deferredFileReferences];
+            [self.deferredFileReferences removeAllObjects];
+        }
+    }
+    
     if (![self isCancelled]) {
         
         // All good, notifying error == nil
         
+        [self flushProgress];
         if (self.syncCompletionBlock) {
             
             [[NSOperationQueue mainQueue] addOperationWithBlock:^{
@@ -255,199 +305,429 @@ static NSUInteger const APParseQueryFetchLimit = 100;
     }
     
     __block NSUInteger numberOfDirtyObjectsSynced = 0;
+    NSUInteger batchSize = MAX(self.pushBatchSize, 1);
+    BOOL hasOutbox = (self.psc.managedObjectModel.entitiesByName[APOutboxEntityName] != nil);
     
     [self.context performBlockAndWait:^{
         
-        NSArray* dirtyManagedObjects = [self managedObjectsMarkedAsDirtyInContext:self.context];
+        /*
+         Objects made dirty before there was an outbox (or by a model without it) are found
+         scanning every entity, only once for stores that have an outbox.
+         */
+        if (!hasOutbox || ![self isOutboxSeeded]) {
+            
+            NSArray* dirtyManagedObjects = [self managedObjectsMarkedAsDirtyInContext:self.context];
+            
+            NSLog(@"Local changes - Total objects to be synced: %lu", (unsigned long)[dirtyManagedObjects count]);
+            
+            for (NSUInteger location = 0; location < [dirtyManagedObjects count] && success; location += batchSize) {
+                
+                @autoreleasepool {
+                    NSRange batchRange = NSMakeRange(location, MIN(batchSize, [dirtyManagedObjects count] - location));
+                    success = [self pushBatchOfManagedObjects:[dirtyManagedObjects subarrayWithRange:batchRange]
+                                                outboxEntries:nil
+                                        numberOfObjectsSynced:&numberOfDirtyObjectsSynced
+                                                        error:&localError];
+                }
+            }
+            
+            if (success && hasOutbox) {
+                [self setOutboxSeeded];
+                NSError* saveError = nil;
+                if (![self.context save:&saveError]) {
+                    localError = saveError;
+                    success = NO;
+                }
+            }
+        }
         
-        NSLog(@"Local changes - Total objects to be synced: %lu", (unsigned long)[dirtyManagedObjects count]);
+        if (!hasOutbox) {
+            return;
+        }
+        
+        // Streamed from the outbox, batchSize entries at a time
+        int64_t lastSequence = 0;
         
-        [dirtyManagedObjects enumerateObjectsUsingBlock:^(NSManagedObject* managedObject, NSUInteger idx, BOOL *stop) {
+        while (success) {
             
-            // Debug
-            //NSDate* start = [NSDate date];
+            @autoreleasepool {
+                NSError* fetchingError = nil;
+                NSArray* outboxEntries = [self outboxEntriesAfterSequence:lastSequence limit:batchSize error:&fetchingError];
+                if (!outboxEntries) {
+                    localError = fetchingError;
+                    success = NO;
+                    break;
+                }
+                if ([outboxEntries count] == 0) {
+                    break;
+                }
+                lastSequence = [[[outboxEntries lastObject] valueForKey:APOutboxSequenceAttributeName] longLongValue];
+                
+                NSArray* dirtyManagedObjects = [self dirtyManagedObjectsForOutboxEntries:outboxEntries error:&fetchingError];
+                if (!dirtyManagedObjects) {
+                    localError = fetchingError;
+                    success = NO;
+                    break;
+                }
+                
+                success = [self pushBatchOfManagedObjects:dirtyManagedObjects
+                                            outboxEntries:outboxEntries
+                                    numberOfObjectsSynced:&numberOfDirtyObjectsSynced
+                                                    error:&localError];
+            }
+        }
+    }];
+    
+    if (success)  {
+        DLog(@"Local changes - All changes are in Sync");
+        
+        if (numberOfDirtyObjectsSynced > 0 && self.isPushNotificationEnable) {
+            PFQuery * pushQuery = [PFInstallation query];
+            [pushQuery whereKey:@"deviceType" equalTo:@"ios"];
+            [pushQuery whereKey:@"installationId" notEqualTo:[PFInstallation currentInstallation].installationId];
+            if (![PFPush sendPushDataToQuery:pushQuery withData:@{@"content-available":@"1"} error:&localError]) {
+                ELog(@"Error sending push notification");
+                success = NO;
+            }
+        }
+    }
+    
+    if (error) *error = localError;
+    return success;
+}
+
+
+/*
+ Pushes a batch and commits whatever Parse has acknowledged, even if the batch failed half way through.
+ One context save per batch, outbox entries of the objects no longer dirty are removed in the same save.
+ Must be called from within the context queue.
+ */
+- (BOOL) pushBatchOfManagedObjects:(NSArray*) managedObjects
+                     outboxEntries:(NSArray*) outboxEntries
+             numberOfObjectsSynced:(NSUInteger*) numberOfObjectsSynced
+                             error:(NSError*__autoreleasing*) error {
+    
+    if ([self isCancelled]) {
+        if (error) *error = [NSError errorWithDomain:APIncrementalStoreErrorDomain code:APIncrementalStoreErrorSyncOperationWasCancelled userInfo:nil];
+        return NO;
+    }
+    
+    NSError* batchError = nil;
+    NSArray* syncedEntityNames = ([managedObjects count] > 0) ? [self pushManagedObjects:managedObjects error:&batchError] : @[];
+    
+    if ([outboxEntries count] > 0) {
+        NSMutableDictionary* managedObjectsByObjectUID = [NSMutableDictionary dictionaryWithCapacity:[managedObjects count]];
+        for (NSManagedObject* managedObject in managedObjects) {
+            managedObjectsByObjectUID[[managedObject valueForKey:APObjectUIDAttributeName]] = managedObject;
+        }
+        
+        for (NSManagedObject* outboxEntry in outboxEntries) {
+            NSManagedObject* managedObject = managedObjectsByObjectUID[[outboxEntry valueForKey:APObjectUIDAttributeName]];
+            if (!managedObject || [managedObject isDeleted] || [[managedObject valueForKey:APObjectIsDirtyAttributeName] isEqualToNumber:@NO]) {
+                [self.context deleteObject:outboxEntry];
+            }
+        }
+    }
+    
+    NSError* saveError = nil;
+    if ([self.context hasChanges] && ![self.context save:&saveError]) {
+        if (error) *error = saveError;
+        return NO;
+    }
+    
+    *numberOfObjectsSynced += [syncedEntityNames count];
+    
+    NSCountedSet* syncedEntityNamesCount = [[NSCountedSet alloc]initWithArray:syncedEntityNames];
+    for (NSString* entityName in syncedEntityNamesCount) {
+        [self reportSyncedObjects:[syncedEntityNamesCount countForObject:entityName] entityName:entityName isRemote:NO];
+    }
+    
+    if (batchError) {
+        if (error) *error = batchError;
+        return NO;
+    }
+    return YES;
+}
+
+
+/*
+ Pushes a batch of dirty objects. All Parse objects that need to be saved are collected first and
+ sent in a single request, the local objects are only changed once Parse has acknowledged them.
+ Must be called from within the context queue; it doesn't save the context.
+ 
+ @returns the entity names of the local objects that are in sync now.
+ */
+- (NSArray*) pushManagedObjects:(NSArray*) managedObjects
+                          error:(NSError*__autoreleasing*) error {
+    
+    if (AP_DEBUG_METHODS) {MLog(@"Batch count: %lu",(unsigned long)[managedObjects count])}
+    
+    NSMutableArray* syncedEntityNames = [NSMutableArray arrayWithCapacity:[managedObjects count]];
+    NSMutableArray* parseObjectsToSave = [NSMutableArray arrayWithCapacity:[managedObjects count]];
+    NSMutableArray* managedObjectsToSave = [NSMutableArray arrayWithCapacity:[managedObjects count]];
+    NSMutableArray* acknowledgeBlocks = [NSMutableArray arrayWithCapacity:[managedObjects count]];
+    
+    NSError* localError = nil;
+    NSManagedObject* failedManagedObject = nil;
+    
+    // Existing Parse objects for the whole batch, one query per entity.
+    NSDictionary* remoteParseObjects = [self parseObjectsForManagedObjects:managedObjects error:&localError];
+    if (localError) {
+        if (error) *error = localError;
+        return syncedEntityNames;
+    }
+    
+    // Related objects that are pushed in this same batch must reuse the same Parse object.
+    self.pendingParseObjectsByObjectUID = [remoteParseObjects mutableCopy];
+    
+    for (NSManagedObject* managedObject in managedObjects) {
+        if ([[managedObject valueForKey:APObjectIsCreatedRemotelyAttributeName] isEqualToNumber:@NO] &&
+            ![[managedObject valueForKey:APObjectStatusAttributeName] isEqualToNumber:@(APObjectStatusDeleted)]) {
+            self.pendingParseObjectsByObjectUID[[managedObject valueForKey:APObjectUIDAttributeName]] = [self placeholderParseObjectForManagedObject:managedObject];
+        }
+    }
+    
+    for (NSManagedObject* managedObject in managedObjects) {
+        
+        NSString* objectUID = [managedObject valueForKey:APObjectUIDAttributeName];
+        NSString* entityName = managedObject.entity.name;
+        
+        // Sanity check
+        if (!objectUID) {
+            [NSException raise:APIncrementalStoreExceptionInconsistency format:@"Managed object without objectUID associated??"];
+        }
+        
+        if ([[managedObject valueForKey:APObjectIsCreatedRemotelyAttributeName] isEqualToNumber:@NO]) {
             
-            NSError* blockError = nil;
+            // New object created localy
             
-            if ([self isCancelled]) {
-                localError = [NSError errorWithDomain:APIncrementalStoreErrorDomain code:APIncrementalStoreErrorSyncOperationWasCancelled userInfo:nil];
-                success = NO;
-                *stop = YES;
+            if ([[managedObject valueForKey:APObjectStatusAttributeName] isEqualToNumber:@(APObjectStatusDeleted)]) {
+                
+                // Object was deleted before even synced with Parse, just delete it.
+                [self.context deleteObject:managedObject];
+                [syncedEntityNames addObject:entityName];
                 
             } else {
                 
-                NSString* objectUID = [managedObject valueForKey:APObjectUIDAttributeName];
+                PFObject* parseObject = self.pendingParseObjectsByObjectUID[objectUID];
                 
-                // Sanity check
-                if (!objectUID) {
-                    [NSException raise:APIncrementalStoreExceptionInconsistency format:@"Managed object without objectUID associated??"];
+                if (![self populateParseObject:parseObject withManagedObject:managedObject error:&localError]) {
+                    failedManagedObject = managedObject;
+                    break;
                 }
                 
-                if ([[managedObject valueForKey:APObjectIsCreatedRemotelyAttributeName] isEqualToNumber:@NO]) {
+                [parseObjectsToSave addObject:parseObject];
+                [managedObjectsToSave addObject:managedObject];
+                [acknowledgeBlocks addObject:^{
+                    /* Parse sets the objectId and updatedAt for a new object only after we save it. */
+                    [managedObject setValue:@NO forKey:APObjectIsDirtyAttributeName];
+                    [managedObject setValue:parseObject.updatedAt forKey:APObjectLastModifiedAttributeName];
+                    [managedObject setValue:parseObject.objectId forKey:APObjectRemoteIDAttributeName];
+                    [managedObject setValue:@YES forKey:APObjectIsCreatedRemotelyAttributeName];
+                }];
+            }
+            
+        } else {
+            
+            PFObject* parseObject = self.pendingParseObjectsByObjectUID[objectUID];
+            
+            if (!parseObject) {
+                if (AP_DEBUG_ERRORS) {ELog(@"Error - There's no existing object using the objectUID: %@",objectUID)}
+                localError = [NSError errorWithDomain:APIncrementalStoreErrorDomain code:APIncrementalStoreErrorSyncOperationObjectUIDNotFound userInfo:@{APObjectUIDAttributeName:objectUID}];
+                failedManagedObject = managedObject;
+                break;
+            }
+            
+            NSDate* localObjectUpdatedAt = [managedObject valueForKey:APObjectLastModifiedAttributeName];
+            
+            /*
+             If the object has not been updated since last time we read it from Parse
+             we are safe to updated it. If the object APObjectIsDeleted is set to YES
+             then we save it back to the server to let the others known that it should be
+             deleted and finally we remove it from our disk cache.
+             */
+            
+            if ([parseObject.updatedAt isEqualToDate:localObjectUpdatedAt] || localObjectUpdatedAt == nil) {
+                
+                if (![self populateParseObject:parseObject withManagedObject:managedObject error:&localError]) {
+                    failedManagedObject = managedObject;
+                    break;
+                }
+                
+                [parseObjectsToSave addObject:parseObject];
+                [managedObjectsToSave addObject:managedObject];
+                [acknowledgeBlocks addObject:^{
+                    [managedObject setValue:@NO forKey:APObjectIsDirtyAttributeName];
+                    [managedObject setValue:parseObject.updatedAt forKey:APObjectLastModifiedAttributeName];
+                    [managedObject setValue:parseObject.objectId forKey:APObjectRemoteIDAttributeName];
+                }];
+                
+            } else {
+                
+                // Conflict detected
+                
+                if (AP_DEBUG_INFO) { ALog(@"Conflict detected - ParseObject %@ - LocalObject: %@ - \n%@ \n%@ ",parseObject.updatedAt,localObjectUpdatedAt,parseObject,managedObject)}
+                
+                if (self.mergePolicy == APMergePolicyClientWins) {
                     
-                    // New object created localy
+                    if (AP_DEBUG_INFO) {DLog(@"APMergePolicyClientWins")}
                     
-                    if ([[managedObject valueForKey:APObjectStatusAttributeName] isEqualToNumber:@(APObjectStatusDeleted)]) {
-                        
-                        // Object was deleted before even synced with Parse, just delete it.
-                        [self.context deleteObject:managedObject];
-                        
-                    } else {
-                        
-                        [self insertOnParseManagedObject:managedObject error:&blockError];
-                        if (blockError) {
-                            success = NO;
-                            localError = blockError;
-                            *stop = YES;
-                        } else {
-                            [managedObject setValue:@NO forKey:APObjectIsDirtyAttributeName];
-                        }
+                    if (![self populateParseObject:parseObject withManagedObject:managedObject error:&localError]) {
+                        failedManagedObject = managedObject;
+                        break;
                     }
                     
-                } else {
-                    
-                    PFObject* parseObject = [self parseObjectFromEntity:managedObject.entity objectUID:objectUID error:&blockError];
-                    if (blockError) {
-                        success = NO;
-                        localError = blockError;
-                        *stop = YES;
-                    } else {
-                        
-                        if (!parseObject) {
-                            
-                            // Object doesn't exist at Parse anymore
+                    [parseObjectsToSave addObject:parseObject];
+                    [managedObjectsToSave addObject:managedObject];
+                    [acknowledgeBlocks addObject:^{
+                        if ([[managedObject valueForKey:APObjectStatusAttributeName] isEqualToNumber:@(APObjectStatusDeleted)]) {
                             [self.context deleteObject:managedObject];
-                            
                         } else {
-                            NSDate* localObjectUpdatedAt = [managedObject valueForKey:APObjectLastModifiedAttributeName];
-                            
-                            /*
-                             If the object has not been updated since last time we read it from Parse
-                             we are safe to updated it. If the object APObjectIsDeleted is set to YES
-                             then we save it back to the server to let the others known that it should be
-                             deleted and finally we remove it from our disk cache.
-                             */
-                            
-                            if ([parseObject.updatedAt isEqualToDate:localObjectUpdatedAt] || localObjectUpdatedAt == nil) {
-                                [self populateParseObject:parseObject withManagedObject:managedObject error:&blockError];
-                                
-                                if (blockError) {
-                                    success = NO;
-                                    localError = blockError;
-                                    *stop = YES;
-                                    
-                                } else {
-                                    
-                                    if (![parseObject save:&blockError]) {
-                                        success = NO;
-                                        localError = blockError;
-                                        *stop = YES;
-                                        
-                                    } else {
-                                        [managedObject setValue:@NO forKey:APObjectIsDirtyAttributeName];
-                                        [managedObject setValue:parseObject.updatedAt forKey:APObjectLastModifiedAttributeName];
-                                    }
-                                }
-                                
-                            } else {
-                                
-                                // Conflict detected
-                                
-                                if (AP_DEBUG_INFO) { ALog(@"Conflict detected - ParseObject %@ - LocalObject: %@ - \n%@ \n%@ ",parseObject.updatedAt,localObjectUpdatedAt,parseObject,managedObject)}
-                                
-                                if (self.mergePolicy == APMergePolicyClientWins) {
-                                    
-                                    if (AP_DEBUG_INFO) {DLog(@"APMergePolicyClientWins")}
-                                    
-                                    [self populateParseObject:parseObject withManagedObject:managedObject error:&blockError];
-                                    if (blockError) {
-                                        success = NO;
-                                        localError = blockError;
-                                        *stop = YES;
-                                        
-                                    } else {
-                                        if (![parseObject save:&blockError]) {
-                                            success = NO;
-                                            localError = blockError;
-                                            *stop = YES;
-                                        } else {
-                                            if ([[managedObject valueForKey:APObjectStatusAttributeName] isEqualToNumber:@(APObjectStatusDeleted)]) {
-                                                [self.context deleteObject:managedObject];
-                                            } else {
-                                                [managedObject setValue:@NO forKey:APObjectIsDirtyAttributeName];
-                                                [managedObject setValue:parseObject.updatedAt forKey:APObjectLastModifiedAttributeName];
-                                            }
-                                        }
-                                    }
-                                    
-                                } else if (self.mergePolicy == APMergePolicyServerWins) {
-                                    if (AP_DEBUG_INFO) { DLog(@"APMergePolicyServerWins")}
-                                    NSDictionary* serializeParseObject = [self serializeParseObject:parseObject forEntity:managedObject.entity error:&blockError];
-                                    
-                                    if (blockError) {
-                                        success = NO;
-                                        localError = blockError;
-                                        *stop = YES;
-                                        
-                                    } else {
-                                        [self populateManagedObject:managedObject withSerializedParseObject:serializeParseObject onInsertedRelatedObject:nil];
-                                        [managedObject setValue:@NO forKey:APObjectIsDirtyAttributeName];
-                                        [managedObject setValue:parseObject.updatedAt forKey:APObjectLastModifiedAttributeName];
-                                        
-                                        // TODO: Added it to self.mergedObjectsUIDsNestedByEntityName
-                                    }
-                                    
-                                } else {
-                                    [NSException raise:APIncrementalStoreExceptionInconsistency format:@"Unkown Merge Policy"];
-                                    if (AP_DEBUG_INFO) { ALog(@"Unkown Merge Policy")}
-                                }
-                            }
+                            [managedObject setValue:@NO forKey:APObjectIsDirtyAttributeName];
+                            [managedObject setValue:parseObject.updatedAt forKey:APObjectLastModifiedAttributeName];
+                            [managedObject setValue:parseObject.objectId forKey:APObjectRemoteIDAttributeName];
                         }
+                    }];
+                    
+                } else if (self.mergePolicy == APMergePolicyServerWins) {
+                    
+                    if (AP_DEBUG_INFO) { DLog(@"APMergePolicyServerWins")}
+                    
+                    NSDictionary* serializeParseObject = [self serializeParseObject:parseObject forEntity:managedObject.entity error:&localError];
+                    if (localError) {
+                        failedManagedObject = managedObject;
+                        break;
                     }
-                }
-
-                if (![self.context save:&blockError]){
-                    if (blockError) {
-                        localError = blockError;
-                    }
-                    *stop = YES;
-                    success = NO;
-                }
-                
-                if (!blockError) {
                     
-                    //Debug
-                   // NSDate* end = [NSDate date];
-                    //NSLog(@"Local changes - entity %@ synced with Parse in %f seconds", managedObject.entity.name, [end timeIntervalSinceDate:start]);
+                    [self populateManagedObject:managedObject withSerializedParseObject:serializeParseObject resolvedManagedObjects:nil onInsertedRelatedObject:nil];
+                    [managedObject setValue:@NO forKey:APObjectIsDirtyAttributeName];
+                    [managedObject setValue:parseObject.updatedAt forKey:APObjectLastModifiedAttributeName];
+                    [managedObject setValue:parseObject.objectId forKey:APObjectRemoteIDAttributeName];
+                    [syncedEntityNames addObject:entityName];
                     
-                    [[NSOperationQueue mainQueue]addOperationWithBlock:^{
-                        if (self.perObjectCompletionBlock) self.perObjectCompletionBlock(NO,managedObject.entity.name);
-                    }];
+                    // TODO: Added it to self.mergedObjectsUIDsNestedByEntityName
+                    
+                } else {
+                    [NSException raise:APIncrementalStoreExceptionInconsistency format:@"Unkown Merge Policy"];
+                    if (AP_DEBUG_INFO) { ALog(@"Unkown Merge Policy")}
                 }
             }
-            numberOfDirtyObjectsSynced++;
-        }];
+        }
+    }
+    
+    // Save what has been prepared so far, even if an object further in the batch failed.
+    
+    if ([parseObjectsToSave count] > 0) {
         
-    }];
+        NSError* batchSaveError = nil;
+        if ([self.backend saveObjects:parseObjectsToSave error:&batchSaveError]) {
+            
+            for (NSUInteger idx = 0; idx < [parseObjectsToSave count]; idx++) {
+                ((void(^)(void))acknowledgeBlocks[idx])();
+                [self acknowledgeRelationMembersOfManagedObject:managedObjectsToSave[idx]];
+                [syncedEntityNames addObject:[managedObjectsToSave[idx] entity].name];
+            }
+            
+        } else {
+            
+            /*
+             Parse doesn't tell which objects of a batch failed, try them one by one
+             so that everything else gets acknowledged and the error points to the culprit.
+             */
+            if (AP_DEBUG_ERRORS) {ELog(@"Error saving batch of %lu objects, retrying one by one: %@",(unsigned long)[parseObjectsToSave count],batchSaveError)}
+            
+            for (NSUInteger idx = 0; idx < [parseObjectsToSave count]; idx++) {
+                NSError* objectSaveError = nil;
+                if ([self.backend saveObjects:@[parseObjectsToSave[idx]] error:&objectSaveError]) {
+                    ((void(^)(void))acknowledgeBlocks[idx])();
+                    [self acknowledgeRelationMembersOfManagedObject:managedObjectsToSave[idx]];
+                    [syncedEntityNames addObject:[managedObjectsToSave[idx] entity].name];
+                    
+                } else {
+                    if (!localError) {
+                        localError = objectSaveError;
+                        failedManagedObject = managedObjectsToSave[idx];
+                    }
+                    break;
+                }
+            }
+        }
+    }
     
-   
+    self.pendingParseObjectsByObjectUID = nil;
+    self.pendingRelationMembersByObjectUID = nil;
     
-    if (success)  {
-        DLog(@"Local changes - All changes are in Sync");
+    if (localError) {
+        if (error) *error = [self errorFromError:localError forManagedObject:failedManagedObject];
+    }
+    return syncedEntityNames;
+}
+
+
+/*
+ Fetches the Parse objects equivalent to the managed objects that have been created
+ remotely already, using one query per entity.
+ @returns Parse objects keyed by objectUID
+ */
+- (NSDictionary*) parseObjectsForManagedObjects:(NSArray*) managedObjects
+                                          error:(NSError*__autoreleasing*) error {
+    
+    NSMutableDictionary* objectUIDsByEntityName = [NSMutableDictionary dictionary];
+    NSMutableDictionary* entitiesByName = [NSMutableDictionary dictionary];
+    
+    for (NSManagedObject* managedObject in managedObjects) {
+        if ([[managedObject valueForKey:APObjectIsCreatedRemotelyAttributeName] isEqualToNumber:@YES]) {
+            NSString* entityName = managedObject.entity.name;
+            NSMutableArray* objectUIDs = objectUIDsByEntityName[entityName] ?: [NSMutableArray array];
+            [objectUIDs addObject:[managedObject valueForKey:APObjectUIDAttributeName]];
+            objectUIDsByEntityName[entityName] = objectUIDs;
+            entitiesByName[entityName] = managedObject.entity;
+        }
+    }
+    
+    NSMutableDictionary* parseObjectsByObjectUID = [NSMutableDictionary dictionary];
+    
+    for (NSString* entityName in objectUIDsByEntityName) {
+        NSError* localError = nil;
+        NSArray* results = [self parseObjectsFromEntity:entitiesByName[entityName] objectUIDs:objectUIDsByEntityName[entityName] error:&localError];
         
-        if (numberOfDirtyObjectsSynced > 0 && self.isPushNotificationEnable) {
-            PFQuery * pushQuery = [PFInstallation query];
-            [pushQuery whereKey:@"deviceType" equalTo:@"ios"];
-            [pushQuery whereKey:@"installationId" notEqualTo:[PFInstallation currentInstallation].installationId];
-            if (![PFPush sendPushDataToQuery:pushQuery withData:@{@"content-available":@"1"} error:&localError]) {
-                ELog(@"Error sending push notification");
-                success = NO;
+        if (localError) {
+            if (error) *error = localError;
+            return nil;
+        }
+        
+        for (PFObject* parseObject in results) {
+            NSString* objectUID = parseObject[APObjectUIDAttributeName];
+            
+            if (parseObjectsByObjectUID[objectUID]) {
+                if (AP_DEBUG_ERRORS) {ELog(@"Error - WTF?? more than one object with the objectUID: %@",objectUID)}
+                if (error) *error = [NSError errorWithDomain:APIncrementalStoreErrorDomain code:APIncrementalStoreErrorSyncOperationDuplicatedObjectUID userInfo:@{APObjectUIDAttributeName:objectUID}];
+                return nil;
             }
+            parseObjectsByObjectUID[objectUID] = parseObject;
         }
     }
     
-    if (error) *error = localError;
-    return success;
+    return parseObjectsByObjectUID;
+}
+
+
+/*
+ Adds the objectUID and entity name of the managed object that caused the error,
+ keeping the original domain and code.
+ */
+- (NSError*) errorFromError:(NSError*) error forManagedObject:(NSManagedObject*) managedObject {
+    
+    if (!managedObject) {
+        return error;
+    }
+    
+    NSMutableDictionary* userInfo = [error.userInfo mutableCopy] ?: [NSMutableDictionary dictionary];
+    userInfo[APObjectUIDAttributeName] = [managedObject valueForKey:APObjectUIDAttributeName];
+    userInfo[APObjectEntityNameAttributeName] = managedObject.entity.name;
+    if (!userInfo[NSUnderlyingErrorKey]) userInfo[NSUnderlyingErrorKey] = error;
+    
+    return [NSError errorWithDomain:error.domain code:error.code userInfo:userInfo];
 }
 
 
@@ -471,22 +751,185 @@ static NSUInteger const APParseQueryFetchLimit = 100;
      Such situation may happen if a object in class B gets updated after we have synced class A and
      before we ask for the objects in class B. Quite unlikely but possible.
      */
-    NSDate* parseServerTime = [self getParseServerTime:&localError];
+    NSDate* parseServerTime = [self.backend serverTime:&localError];
     if (localError) {
         if (error) *error = localError;
         return NO;
     }
     
-    [self.context performBlockAndWait:^{
+    [self loadSyncState];
+    
+    /*
+     Each entity is pulled by its own worker, at most pullConcurrency of them at the same time.
+     The first error stops the remaining workers.
+     */
+    NSOperationQueue* pullQueue = [[NSOperationQueue alloc]init];
+    pullQueue.maxConcurrentOperationCount = MAX(self.pullConcurrency, 1);
+    pullQueue.name = @"APParseSyncOperation Pull Queue";
+    
+    NSManagedObjectModel* model = self.psc.managedObjectModel;
+    NSArray* sortedEntities = [[model entities]sortedArrayUsingDescriptors:@[[NSSortDescriptor sortDescriptorWithKey:@"name" ascending:YES]]];
+    
+    for (NSEntityDescription* entityDescription in sortedEntities) {
         
-        NSManagedObjectModel* model = self.context.persistentStoreCoordinator.managedObjectModel;
-        NSArray* sortedEntities = [[model entities]sortedArrayUsingDescriptors:@[[NSSortDescriptor sortDescriptorWithKey:@"name" ascending:YES]]];
+        if ([self isCacheOnlyEntity:entityDescription]) {
+            continue;
+        }
         
-        for (NSEntityDescription* entityDescription in sortedEntities) {
+        [pullQueue addOperationWithBlock:^{
             
-            if (!success) {
-                break;
+            @synchronized(pullQueue) {
+                if (!success) return;
+            }
+            
+            NSError* entityError = nil;
+            if (![self mergeRemoteObjectsForEntity:entityDescription maxUpdatedDate:parseServerTime error:&entityError]) {
+                @synchronized(pullQueue) {
+                    if (success) {
+                        success = NO;
+                        localError = entityError;
+                    }
+                }
+                [pullQueue cancelAllOperations];
+            }
+        }];
+    }
+    
+    [pullQueue waitUntilAllOperationsAreFinished];
+    
+    if (success && [self isCancelled]) {
+        localError = [NSError errorWithDomain:APIncrementalStoreErrorDomain code:APIncrementalStoreErrorSyncOperationWasCancelled userInfo:nil];
+        success = NO;
+    }
+    
+    /*
+     Pages save the entities dates as they go, the server time the pull started from is only
+     recorded once every entity has been pulled up to it.
+     */
+    if (success) {
+        [self.context performBlockAndWait:^{
+            @synchronized(self) {
+                self.lastServerTime = parseServerTime;
+            }
+            [self stageSyncState];
+            NSError* saveError = nil;
+            if ([self.context hasChanges] && ![self.context save:&saveError]) {
+                if (AP_DEBUG_ERRORS) {ELog(@"Error saving the sync state: %@",saveError)}
+                localError = saveError;
+                success = NO;
+            }
+        }];
+    }
+    
+    if (localError && error) *error = localError;
+    
+    if (success)  NSLog(@"Remote changes - All changes are in Sync");
+    return success;
+}
+
+
+/*
+ Fetches and applies all remote changes of one entity using a private child context of self.context.
+ Network round trips (queries, relations and files) run concurrently with the other workers, changes
+ to the contexts are applied one worker at a time so that a child context never pushes stale values
+ of objects shared between entities (like placeholders of related objects) into self.context.
+ */
+- (BOOL) mergeRemoteObjectsForEntity:(NSEntityDescription*) entityDescription
+                      maxUpdatedDate:(NSDate*) maxUpdatedDate
+                               error:(NSError*__autoreleasing*) error {
+    
+    if (AP_DEBUG_METHODS) {MLog(@"Entity: %@",entityDescription.name)}
+    
+    __block BOOL success = YES;
+    __block NSError* localError = nil;
+    
+    NSManagedObjectContext* workerContext = [[NSManagedObjectContext alloc]initWithConcurrencyType:NSPrivateQueueConcurrencyType];
+    workerContext.parentContext = self.context;
+    
+    NSDate* lastSync;
+    NSString* lastSyncObjectUID;
+    if (!self.fullSync) {
+        /* Fetch only what has been updated since we last sync */
+        lastSync = [self latestObjectSyncedDateForEntityName:entityDescription.name];
+        lastSyncObjectUID = [self latestObjectSyncedObjectUIDForEntityName:entityDescription.name];
+    } else {
+        lastSync = nil;
+        lastSyncObjectUID = nil;
+    }
+    
+    /*
+     Pages are delimited by the (updatedAt, objectUID) of the last object of the previous page
+     instead of an offset, Parse doesn't need to skip over what has been read already and objects
+     updated while we are paging can't make us skip or repeat others.
+     The last sync is resumed the same way, objects sharing the date of the last one synced are not skipped.
+     */
+    NSUInteger pageSize = [self pageSizeForEntity:entityDescription];
+    __block NSDate* cursorUpdatedDate = (lastSyncObjectUID) ? lastSync : nil;
+    __block NSString* cursorObjectUID = lastSyncObjectUID;
+    
+    /*
+     The next pages are fetched and serialized (network) while the current one is applied (Core Data).
+     Each page is an array with the Parse objects and their serialized representations.
+     */
+    APPagePrefetcher* prefetcher = [[APPagePrefetcher alloc]initWithDepth:self.pullPrefetchDepth fetchBlock:^id(BOOL *isLastPage, NSError *__autoreleasing *fetchError) {
+        
+        if ([self isCancelled]) {
+            if (fetchError) *fetchError = [NSError errorWithDomain:APIncrementalStoreErrorDomain code:APIncrementalStoreErrorSyncOperationWasCancelled userInfo:nil];
+            return nil;
+        }
+        
+        PFQuery* syncQuery = [self syncQueryForEntity:entityDescription
+                                       minUpdatedDate:lastSync
+                                       maxUpdatedDate:maxUpdatedDate
+                                    cursorUpdatedDate:cursorUpdatedDate
+                                      cursorObjectUID:cursorObjectUID
+                                             pageSize:pageSize];
+        
+        NSError* pageError = nil;
+        NSArray* batchOfObjects = [self.backend findObjectsForQuery:syncQuery error:&pageError];
+        
+        if (pageError) {
+            if (fetchError) *fetchError = pageError;
+            return nil;
+        }
+        
+        if ([batchOfObjects count] > 0) {
+            NSLog(@"Remote changes: syncing batch of entities %@ (count %lu - after %@) with Parse",entityDescription.name,(unsigned long)[batchOfObjects count],cursorUpdatedDate ?: lastSync);
+        }
+        
+        if ([batchOfObjects count] == pageSize) {
+            PFObject* lastParseObject = [batchOfObjects lastObject];
+            cursorUpdatedDate = lastParseObject.updatedAt;
+            cursorObjectUID = lastParseObject[APObjectUIDAttributeName];
+        } else {
+            *isLastPage = YES;
+        }
+        
+        // Round trips for relations and files, outside of any context.
+        NSArray* relatedObjects = [self relatedObjectsOfParseObjects:batchOfObjects forEntity:entityDescription error:&pageError];
+        if (!relatedObjects) {
+            if (fetchError) *fetchError = pageError;
+            return nil;
+        }
+        
+        NSMutableArray* serializedParseObjects = [NSMutableArray arrayWithCapacity:[batchOfObjects count]];
+        for (NSUInteger idx = 0; idx < [batchOfObjects count]; idx++) {
+            NSDictionary* serializedParseObject = [self serializeParseObject:batchOfObjects[idx] forEntity:entityDescription relatedObjectsByKey:relatedObjects[idx] error:&pageError];
+            if (pageError) {
+                if (fetchError) *fetchError = pageError;
+                return nil;
             }
+            [serializedParseObjects addObject:serializedParseObject];
+        }
+        
+        return @[batchOfObjects,serializedParseObjects];
+    }];
+    
+    [prefetcher start];
+    
+    while (success) {
+        
+        @autoreleasepool {
             
             if ([self isCancelled]) {
                 localError = [NSError errorWithDomain:APIncrementalStoreErrorDomain code:APIncrementalStoreErrorSyncOperationWasCancelled userInfo:nil];
@@ -494,55 +937,50 @@ static NSUInteger const APParseQueryFetchLimit = 100;
                 break;
             }
             
-            NSDate* lastSync;
-            if (!self.fullSync) {
-                /* Fetch only what has been updated since we last sync */
-                lastSync = self.latestObjectSyncedDates[entityDescription.name];
-            } else {
-                lastSync = nil;
+            NSArray* page = [prefetcher nextPage:&localError];
+            if (!page) {
+                success = (localError == nil);
+                break;
             }
             
-            NSUInteger skip = 0;
-            BOOL thereAreObjectsToBeFetched = YES;
+            NSArray* batchOfObjects = page[0];
+            NSArray* serializedParseObjects = page[1];
             
-            while (thereAreObjectsToBeFetched && success && [self isCancelled] == NO) {
-                
-                @autoreleasepool {
-                    
-                    PFQuery* syncQuery = [self syncQueryForEntity:entityDescription minUpdatedDate:lastSync maxUpdatedDate:parseServerTime offset:skip];
-                    NSMutableArray* batchOfObjects = [[syncQuery findObjects:&localError] mutableCopy];
+            /*
+             The whole page is committed in a single save, together with the entity sync date
+             (see -saveWorkerContext:error:). A crash never loses nor replays more than one page.
+             */
+            @synchronized(self.context) {
+                [workerContext performBlockAndWait:^{
                     
-                    if ([batchOfObjects count] > 0) {
-                        NSLog(@"Remote changes: syncing batch of entities %@ (count %lu - offset %@) with Parse",entityDescription.name,(unsigned long)[batchOfObjects count],@(skip));
-                    }
+                    NSDate* pageLatestUpdatedDate = nil;
+                    NSString* pageLatestObjectUID = nil;
+                    NSUInteger numberOfMergedObjects = 0;
                     
-                    if (localError) {
+                    // Objects of this page and their related objects, fetched or created once for the whole page.
+                    NSSet* insertedObjectUIDs = nil;
+                    NSDictionary* resolvedManagedObjects = [self managedObjectsForSerializedParseObjects:serializedParseObjects
+                                                                                               inContext:workerContext
+                                                                                      insertedObjectUIDs:&insertedObjectUIDs
+                                                                                                   error:&localError];
+                    if (!resolvedManagedObjects) {
                         success = NO;
-                        break;
                     }
                     
-                    if ([batchOfObjects count] == APParseQueryFetchLimit) {
-                        skip += APParseQueryFetchLimit;
-                    } else {
-                        thereAreObjectsToBeFetched = NO;
-                    }
-                    
-                    while ([batchOfObjects count] > 0 && success && [self isCancelled] == NO) {
+                    for (NSUInteger idx = 0; idx < [batchOfObjects count] && success && [self isCancelled] == NO; idx++) {
                         
                         @autoreleasepool {
                             
-                            PFObject* parseObject = [batchOfObjects firstObject];
-                            [batchOfObjects removeObjectAtIndex:0];
+                            PFObject* parseObject = batchOfObjects[idx];
+                            NSDictionary* serializedParseObject = serializedParseObjects[idx];
+                            NSString* objectUID = [parseObject valueForKey:APObjectUIDAttributeName];
+                            pageLatestUpdatedDate = parseObject.updatedAt;
+                            pageLatestObjectUID = objectUID;
                             
-                            NSManagedObject* managedObject = [self managedObjectForObjectUID:[parseObject valueForKey:APObjectUIDAttributeName] entity:entityDescription inContext:self.context createIfNecessary:NO error:&localError];
-                            if (localError) {
-                                success = NO;
-                                break;
-                            }
+                            NSManagedObject* managedObject = [self managedObjectForObjectUID:objectUID entity:entityDescription inResolvedManagedObjects:resolvedManagedObjects];
                             
                             if ([[managedObject valueForKey:APObjectLastModifiedAttributeName] isEqualToDate:parseObject.updatedAt]){
                                 //Object was inserted/updated during - mergeManagedContext:onSyncObject:onSyncObject:error: and remains the same
-                                [self setLatestObjectSyncedDate:parseObject.updatedAt forEntityName:entityDescription.name];
                                 continue;
                             }
                             
@@ -550,73 +988,53 @@ static NSUInteger const APParseQueryFetchLimit = 100;
                             
                             if (!managedObject) {
                                 
-                                // Disk cache managed object doesn't exist - create it localy if it isn't marked as deleted
+                                // Disk cache managed object doesn't exist and it is marked as deleted, nothing to do.
                                 
-                                if (!parseObjectIsDeleted) {
-                                    managedObject = [NSEntityDescription insertNewObjectForEntityForName:entityDescription.name inManagedObjectContext:self.context];
-                                    [managedObject setValue:@YES forKeyPath:APObjectIsCreatedRemotelyAttributeName];
-                                    
-                                    if (![self.context obtainPermanentIDsForObjects:@[managedObject] error:&localError]) {
-                                        if (localError) {
-                                            success = NO;
-                                            break;
-                                        }
-                                    }
-                                    
-                                    NSDictionary* serializeParseObject = [self serializeParseObject:parseObject forEntity:managedObject.entity error:&localError];
-                                    if (localError) {
-                                        success = NO;
-                                        break;
-                                    }
-                                    
-                                    [self populateManagedObject:managedObject withSerializedParseObject:serializeParseObject onInsertedRelatedObject:nil];
-                                }
+                            } else if ([insertedObjectUIDs containsObject:objectUID]) {
                                 
-                                } else {
-                                    
-                                    // Existing local object
-                                    
-                                    if (parseObjectIsDeleted) {
-                                        [self.context deleteObject:managedObject];
-                                        
-                                        //objectStatus = NSDeletedObjectsKey;
-                                        
-                                    } else {
-                                        NSDictionary* serializeParseObject = [self serializeParseObject:parseObject forEntity:managedObject.entity error:&localError];
-                                        if (localError) {
-                                            success = NO;
-                                            break;
-                                        }
-                                        [self populateManagedObject:managedObject withSerializedParseObject:serializeParseObject onInsertedRelatedObject:nil];
-                                    }
-                                }
+                                // Disk cache managed object has just been created for this page
+                                
+                                [self populateManagedObject:managedObject withSerializedParseObject:serializedParseObject resolvedManagedObjects:resolvedManagedObjects onInsertedRelatedObject:nil];
                                 
-                                // Include an entry into the return NSDictionary for the corresponding object status
+                            } else {
                                 
-                                if (![self isCancelled]) {
+                                // Existing local object
+                                
+                                if (parseObjectIsDeleted) {
+                                    [workerContext deleteObject:managedObject];
                                     
-                                    if (![self.context save:&localError]){
-                                        success = NO;
-                                        break;
-                                        
-                                    } else {
-                                        [self setLatestObjectSyncedDate:parseObject.updatedAt forEntityName:entityDescription.name];
-                                        [[NSOperationQueue mainQueue]addOperationWithBlock:^{
-                                            if (self.perObjectCompletionBlock) self.perObjectCompletionBlock(YES,entityDescription.name);
-                                        }];
-                                    }
+                                } else {
+                                    [self populateManagedObject:managedObject withSerializedParseObject:serializedParseObject resolvedManagedObjects:resolvedManagedObjects onInsertedRelatedObject:nil];
                                 }
-                                parseObject = nil;
-                            } //@autoreleasepool
+                            }
+                            numberOfMergedObjects++;
+                        } //@autoreleasepool
+                    }
+                    
+                    if (success && ![self isCancelled] && pageLatestUpdatedDate) {
+                        
+                        [self setLatestObjectSyncedDate:pageLatestUpdatedDate objectUID:pageLatestObjectUID forEntityName:entityDescription.name];
+                        
+                        if (![self saveWorkerContext:workerContext error:&localError]){
+                            success = NO;
+                            
+                        } else {
+                            [self reportSyncedObjects:numberOfMergedObjects entityName:entityDescription.name isRemote:YES];
                         }
                     }
-                }//@autoreleasepool
+                    
+                    // Don't keep anything around that may become stale while other workers are applying their changes.
+                    [workerContext reset];
+                }];
             }
-    }];
+        }//@autoreleasepool
+    }
     
-    if (localError) *error = localError;
+    [prefetcher cancel];
     
-    if (success)  NSLog(@"Remote changes - All changes are in Sync");
+    if (AP_DEBUG_INFO) {DLog(@"Remote changes - %@ stalls: fetching waited %.3fs for applying, applying waited %.3fs for fetching",entityDescription.name,prefetcher.fetchStallTime,prefetcher.consumerStallTime)}
+    
+    if (localError && error) *error = localError;
     return success;
 }
 
@@ -624,7 +1042,9 @@ static NSUInteger const APParseQueryFetchLimit = 100;
 - (PFQuery*) syncQueryForEntity:(NSEntityDescription*) entityDescription
                  minUpdatedDate:(NSDate*) minUpdatedDate
                  maxUpdatedDate:(NSDate*) maxUpdatedDate
-                         offset:(NSUInteger) offset {
+              cursorUpdatedDate:(NSDate*) cursorUpdatedDate
+                cursorObjectUID:(NSString*) cursorObjectUID
+                       pageSize:(NSUInteger) pageSize {
     
     /*
      This covers the case when the model has entity inheritance.
@@ -632,15 +1052,32 @@ static NSUInteger const APParseQueryFetchLimit = 100;
      */
     NSEntityDescription* rootEntity = [self rootEntityFromEntity:entityDescription];
     
-    PFQuery *query = [PFQuery queryWithClassName:rootEntity.name];
+    PFQuery *query;
+    
+    if (cursorUpdatedDate && cursorObjectUID) {
+        
+        // (updatedAt > cursorUpdatedDate) OR (updatedAt == cursorUpdatedDate AND objectUID > cursorObjectUID)
+        PFQuery* laterObjectsQuery = [PFQuery queryWithClassName:rootEntity.name];
+        [laterObjectsQuery whereKey:@"updatedAt" greaterThan:cursorUpdatedDate];
+        
+        PFQuery* sameDateObjectsQuery = [PFQuery queryWithClassName:rootEntity.name];
+        [sameDateObjectsQuery whereKey:@"updatedAt" equalTo:cursorUpdatedDate];
+        [sameDateObjectsQuery whereKey:APObjectUIDAttributeName greaterThan:cursorObjectUID];
+        
+        query = [PFQuery orQueryWithSubqueries:@[laterObjectsQuery,sameDateObjectsQuery]];
+        
+    } else {
+        query = [PFQuery queryWithClassName:rootEntity.name];
+        if (minUpdatedDate) [query whereKey:@"updatedAt" greaterThan:minUpdatedDate];
+    }
+    
     [query setCachePolicy:kPFCachePolicyNetworkOnly];
     [query orderByAscending:@"updatedAt"];
+    [query addAscendingOrder:APObjectUIDAttributeName];
     [query whereKey:APObjectEntityNameAttributeName equalTo:entityDescription.name];
-    [query setLimit:APParseQueryFetchLimit];
-    [query setSkip:offset];
+    [query setLimit:pageSize];
     
     if (maxUpdatedDate) [query whereKey:@"updatedAt" lessThan:maxUpdatedDate];
-    if (minUpdatedDate) [query whereKey:@"updatedAt" greaterThan:minUpdatedDate];
     
     /* Fetch related objects when the relation is flagged as a Array via core data model metadata or it's a to-one */
     [entityDescription.relationshipsByName enumerateKeysAndObjectsUsingBlock:^(NSString* relationName, NSRelationshipDescription* relationDescription, BOOL *stop) {
@@ -655,6 +1092,22 @@ static NSUInteger const APParseQueryFetchLimit = 100;
     return query;
 }
 
+/*
+ Entity model user info APParseQueryPageSizeUserInfoKey takes precedence over pullPageSize,
+ both limited to what Parse allows.
+ */
+- (NSUInteger) pageSizeForEntity:(NSEntityDescription*) entityDescription {
+    
+    NSUInteger pageSize = self.pullPageSize;
+    NSString* entityPageSize = entityDescription.userInfo[APParseQueryPageSizeUserInfoKey];
+    
+    if ([entityPageSize integerValue] > 0) {
+        pageSize = [entityPageSize integerValue];
+    }
+    return MAX(MIN(pageSize, APParseQueryMaxFetchLimit), 1);
+}
+
+
 /*
  As stated by a Parse technician: We currently limit count operations to 160 api requests within a
  one minute period for each application. We may have to adjust this in the future
@@ -710,46 +1163,238 @@ static NSUInteger const APParseQueryFetchLimit = 100;
     //    return numberOfObjects;
 }
 
- 
-#pragma mark - Track Last Object Sync Date Methods
+ 
+#pragma mark - Track Last Object Sync Date Methods
+
+- (void) setEnvID:(NSString *)envID {
+    [super setEnvID:envID];
+    self.latestObjectSyncedKey = nil;
+    @synchronized(self) {
+        self.latestObjectSyncedDates = nil;
+        self.latestObjectSyncedObjectUIDs = nil;
+    }
+}
+
+- (NSString*) latestObjectSyncedKey {
+    
+    if (!_latestObjectSyncedKey) {
+        _latestObjectSyncedKey = [NSString stringWithFormat:@"%@.%@",APLatestObjectSyncedKey,self.envID ?:self.authenticatedUser.objectId];
+    }
+    return _latestObjectSyncedKey;
+}
+
+
+/*
+ Entities are pulled concurrently, all access to latestObjectSyncedDates goes through the methods below.
+ Dates set here are only persisted by -stageSyncState.
+ */
+- (void) setLatestObjectSyncedDate: (NSDate*) date objectUID:(NSString*) objectUID forEntityName: (NSString*) entityName {
+    
+    if (AP_DEBUG_METHODS) {MLog(@"Date: %@ objectUID: %@",date,objectUID)}
+    
+    @synchronized(self) {
+        NSDate* latestDate = self.latestObjectSyncedDates[entityName];
+        NSString* latestObjectUID = self.latestObjectSyncedObjectUIDs[entityName];
+        
+        // Same order the objects are pulled in: (updatedAt, objectUID)
+        NSComparisonResult order = (latestDate) ? [date compare:latestDate] : NSOrderedDescending;
+        if (order == NSOrderedSame) {
+            order = (latestObjectUID) ? [objectUID compare:latestObjectUID options:NSLiteralSearch] : NSOrderedDescending;
+        }
+        
+        if (order == NSOrderedDescending) {
+            self.latestObjectSyncedDates[entityName] = date;
+            if (objectUID) {
+                self.latestObjectSyncedObjectUIDs[entityName] = objectUID;
+            } else {
+                [self.latestObjectSyncedObjectUIDs removeObjectForKey:entityName];
+            }
+        }
+    }
+}
+
+
+- (NSDate*) latestObjectSyncedDateForEntityName:(NSString*) entityName {
+    
+    @synchronized(self) {
+        return self.latestObjectSyncedDates[entityName];
+    }
+}
+
+
+// nil for dates synced by earlier versions, that only kept the date
+- (NSString*) latestObjectSyncedObjectUIDForEntityName:(NSString*) entityName {
+    
+    @synchronized(self) {
+        return self.latestObjectSyncedObjectUIDs[entityName];
+    }
+}
+
 
-- (void) setEnvID:(NSString *)envID {
-    [super setEnvID:envID];
-    self.latestObjectSyncedKey = nil;
+/*
+ Read once per operation, before the entities start being pulled (see APSyncStateEntityName).
+ Stores synced by 0.4.2 have their dates in NSUserDefaults, they are used until the sync state has its own dates saved.
+ */
+- (void) loadSyncState {
+    
+    @synchronized(self) {
+        if (_latestObjectSyncedDates) {
+            return;
+        }
+    }
+    
+    NSString* syncStateKey = self.latestObjectSyncedKey;
+    __block NSDictionary* storedDates = nil;
+    __block NSDictionary* storedObjectUIDs = nil;
+    __block NSDate* storedServerTime = nil;
+    __block BOOL hasSyncedDates = NO;
+    
+    if (self.psc.managedObjectModel.entitiesByName[APSyncStateEntityName]) {
+        [self.context performBlockAndWait:^{
+            NSError* fetchingError = nil;
+            NSManagedObject* syncState = [self syncStateObjectForKey:syncStateKey create:NO error:&fetchingError];
+            if (fetchingError) {
+                if (AP_DEBUG_ERRORS) {ELog(@"Error reading the sync state: %@",fetchingError)}
+            }
+            if (syncState) {
+                storedDates = [syncState valueForKey:APSyncStateCursorsAttributeName];
+                storedObjectUIDs = [syncState valueForKey:APSyncStateCursorObjectUIDsAttributeName];
+                storedServerTime = [syncState valueForKey:APSyncStateServerTimeAttributeName];
+                hasSyncedDates = (storedDates != nil);
+            }
+        }];
+    }
+    
+    NSMutableDictionary* dates = [storedDates mutableCopy] ?: [NSMutableDictionary dictionary];
+    
+    if (!hasSyncedDates) {
+        NSDictionary* legacyDates = [[NSUserDefaults standardUserDefaults] objectForKey:syncStateKey];
+        [legacyDates enumerateKeysAndObjectsUsingBlock:^(NSString* entityName, NSDate* date, BOOL *stop) {
+            if (!dates[entityName] || [[dates[entityName] laterDate:date] isEqualToDate:date]) {
+                dates[entityName] = date;
+            }
+        }];
+    }
+    
+    @synchronized(self) {
+        if (!_latestObjectSyncedDates) {
+            _latestObjectSyncedDates = dates;
+            _latestObjectSyncedObjectUIDs = [storedObjectUIDs mutableCopy] ?: [NSMutableDictionary dictionary];
+            _lastServerTime = storedServerTime;
+        }
+    }
 }
 
-- (NSString*) latestObjectSyncedKey {
+
+/*
+ The entities dates, the server time the pull started from and the environment are written to the cache store
+ in the same transaction as the objects they describe. Must be called from within self.context queue right before saving it.
+ */
+- (void) stageSyncState {
     
-    if (!_latestObjectSyncedKey) {
-        _latestObjectSyncedKey = [NSString stringWithFormat:@"%@.%@",APLatestObjectSyncedKey,self.envID ?:self.authenticatedUser.objectId];
+    if (!self.psc.managedObjectModel.entitiesByName[APSyncStateEntityName]) {
+        return;
     }
-    return _latestObjectSyncedKey;
+    
+    NSError* fetchingError = nil;
+    NSManagedObject* syncState = [self syncStateObjectForKey:self.latestObjectSyncedKey create:YES error:&fetchingError];
+    if (!syncState) {
+        if (AP_DEBUG_ERRORS) {ELog(@"Error reading the sync state: %@",fetchingError)}
+        return;
+    }
+    
+    @synchronized(self) {
+        [syncState setValue:[self.latestObjectSyncedDates copy] forKey:APSyncStateCursorsAttributeName];
+        [syncState setValue:[self.latestObjectSyncedObjectUIDs copy] forKey:APSyncStateCursorObjectUIDsAttributeName];
+        [syncState setValue:self.lastServerTime forKey:APSyncStateServerTimeAttributeName];
+    }
+    [syncState setValue:self.envID forKey:APSyncStateEnvIDAttributeName];
 }
 
 
-- (void) setLatestObjectSyncedDate: (NSDate*) date forEntityName: (NSString*) entityName {
+// Must be called from within self.context queue.
+- (NSManagedObject*) syncStateObjectForKey:(NSString*) syncStateKey
+                                    create:(BOOL) create
+                                     error:(NSError *__autoreleasing*) error {
     
-    if (AP_DEBUG_METHODS) {MLog(@"Date: %@",date)}
+    NSFetchRequest* request = [NSFetchRequest fetchRequestWithEntityName:APSyncStateEntityName];
+    request.predicate = [NSPredicate predicateWithFormat:@"%K == %@",APSyncStateKeyAttributeName,syncStateKey];
+    request.fetchLimit = 1;
+    
+    NSError* fetchingError = nil;
+    NSArray* results = [self.context executeFetchRequest:request error:&fetchingError];
+    if (!results) {
+        if (error) *error = fetchingError;
+        return nil;
+    }
     
-    if ([[self.latestObjectSyncedDates[entityName] laterDate:date] isEqualToDate:date] || self.latestObjectSyncedDates[entityName] == nil) {
-        self.latestObjectSyncedDates[entityName] = date;
+    NSManagedObject* syncState = [results lastObject];
+    if (!syncState && create) {
+        syncState = [NSEntityDescription insertNewObjectForEntityForName:APSyncStateEntityName inManagedObjectContext:self.context];
+        [syncState setValue:syncStateKey forKey:APSyncStateKeyAttributeName];
     }
-    [[NSUserDefaults standardUserDefaults]setObject:self.latestObjectSyncedDates forKey:self.latestObjectSyncedKey];
+    return syncState;
+}
+
+
+#pragma mark - Last Synced Relation Members
+
+// nil if the members aren't known
+- (NSDictionary*) lastSyncedMembersOfRelationship:(NSString*) relationshipName
+                                    managedObject:(NSManagedObject*) managedObject {
+    
+    return [managedObject valueForKey:APObjectRelationMembersAttributeName][relationshipName];
+}
+
+
+// Saved by the context along with the object, so they are never ahead nor behind it.
+- (void) setLastSyncedMembers:(NSDictionary*) members
+               ofRelationship:(NSString*) relationshipName
+                managedObject:(NSManagedObject*) managedObject {
+    
+    NSMutableDictionary* membersByRelationshipName = [[managedObject valueForKey:APObjectRelationMembersAttributeName] mutableCopy] ?: [NSMutableDictionary dictionary];
+    membersByRelationshipName[relationshipName] = members;
+    [managedObject setValue:[membersByRelationshipName copy] forKey:APObjectRelationMembersAttributeName];
 }
 
 
-- (NSMutableDictionary*) latestObjectSyncedDates {
+- (void) setPendingMembers:(NSDictionary*) members
+            ofRelationship:(NSString*) relationshipName
+                 objectUID:(NSString*) objectUID {
+    
+    if (!self.pendingRelationMembersByObjectUID) {
+        self.pendingRelationMembersByObjectUID = [NSMutableDictionary dictionary];
+    }
     
-    if (!_latestObjectSyncedDates) {
-        _latestObjectSyncedDates = [[[NSUserDefaults standardUserDefaults] objectForKey:self.latestObjectSyncedKey]mutableCopy] ?: [NSMutableDictionary dictionary];
+    NSMutableDictionary* pendingMembers = self.pendingRelationMembersByObjectUID[objectUID];
+    if (!pendingMembers) {
+        pendingMembers = [NSMutableDictionary dictionary];
+        self.pendingRelationMembersByObjectUID[objectUID] = pendingMembers;
     }
-    return _latestObjectSyncedDates;
+    pendingMembers[relationshipName] = members;
+}
+
+
+// The object has been saved at Parse, its relations now have the members pushed.
+- (void) acknowledgeRelationMembersOfManagedObject:(NSManagedObject*) managedObject {
+    
+    NSString* objectUID = [managedObject valueForKey:APObjectUIDAttributeName];
+    [self.pendingRelationMembersByObjectUID[objectUID] enumerateKeysAndObjectsUsingBlock:^(NSString* relationshipName, NSDictionary* members, BOOL *stop) {
+        [self setLastSyncedMembers:members ofRelationship:relationshipName managedObject:managedObject];
+    }];
+    [self.pendingRelationMembersByObjectUID removeObjectForKey:objectUID];
 }
 
+
 #pragma mark - Populating Objects
 
+/*
+ Related objects are looked up in resolvedManagedObjects first (see -managedObjectsForSerializedParseObjects:inContext:insertedObjectUIDs:error:),
+ and only then fetched or created one by one.
+ */
 - (void) populateManagedObject:(NSManagedObject*) managedObject
      withSerializedParseObject:(NSDictionary*) parseObjectDictRepresentation
+        resolvedManagedObjects:(NSDictionary*) resolvedManagedObjects
        onInsertedRelatedObject:(void(^)(NSManagedObject* insertedObject)) block {
     
     if (AP_DEBUG_METHODS) { MLog()}
@@ -768,7 +1413,7 @@ static NSUInteger const APParseQueryFetchLimit = 100;
             } else {
                 
                 if ([propertyDesctiption isKindOfClass:[NSAttributeDescription class]]) {
-                    managedObjectValue = [parseObjectValue copy];
+                    managedObjectValue = [self cacheValueForAttribute:(NSAttributeDescription*) propertyDesctiption value:[parseObjectValue copy]];
                     
                 } else {
                     
@@ -778,19 +1423,25 @@ static NSUInteger const APParseQueryFetchLimit = 100;
                         
                         NSArray *relatedParseObjets = (NSArray*) parseObjectValue;
                         NSMutableSet* relatedManagedObjects = [[NSMutableSet alloc]initWithCapacity:[relatedParseObjets count]];
+                        NSMutableDictionary* members = [NSMutableDictionary dictionaryWithCapacity:[relatedParseObjets count]];
                         
                         for (NSDictionary* dictParseObject in relatedParseObjets) {
                             NSString* relatedObjectUID = [dictParseObject valueForKey:APObjectUIDAttributeName];
                             NSString* relatedObjectEntityName = [dictParseObject valueForKey:APObjectEntityNameAttributeName];
+                            members[relatedObjectUID] = relatedObjectEntityName;
                             NSEntityDescription* relatedObjectEntity = [NSEntityDescription entityForName:relatedObjectEntityName inManagedObjectContext:managedObject.managedObjectContext];
                             if (!relatedObjectEntity) {
                                 [NSException raise:APIncrementalStoreExceptionInconsistency format:@"Entity %@ (Parse) isn't present in the Managed Object Model",relatedObjectEntityName];
                             }
                             
-                            NSManagedObject* relatedManagedObject = [self managedObjectForObjectUID:relatedObjectUID entity:relatedObjectEntity inContext:managedObject.managedObjectContext createIfNecessary:NO error:&localError];
-                            if (localError) {
-                                if (AP_DEBUG_ERRORS) {ELog(@"Populating object with parse object %@",parseObjectDictRepresentation)}
-                                *stop = YES;
+                            NSManagedObject* relatedManagedObject = [self managedObjectForObjectUID:relatedObjectUID entity:relatedObjectEntity inResolvedManagedObjects:resolvedManagedObjects];
+                            
+                            if (!relatedManagedObject) {
+                                relatedManagedObject = [self managedObjectForObjectUID:relatedObjectUID entity:relatedObjectEntity inContext:managedObject.managedObjectContext createIfNecessary:NO error:&localError];
+                                if (localError) {
+                                    if (AP_DEBUG_ERRORS) {ELog(@"Populating object with parse object %@",parseObjectDictRepresentation)}
+                                    *stop = YES;
+                                }
                             }
                             
                             if (!relatedManagedObject) {
@@ -808,6 +1459,11 @@ static NSUInteger const APParseQueryFetchLimit = 100;
                         }
                         managedObjectValue = relatedManagedObjects;
                         
+                        // Committed with the page, what Parse has from now on
+                        if ([relationshipDescription isRelationAtParse]) {
+                            [self setLastSyncedMembers:members ofRelationship:propertyName managedObject:managedObject];
+                        }
+                        
                     } else {
                         
                         // To-One relationship
@@ -816,11 +1472,14 @@ static NSUInteger const APParseQueryFetchLimit = 100;
                         NSString* relatedObjectEntityName = [parseObjectValue valueForKey:APObjectEntityNameAttributeName];
                         NSEntityDescription* relatedObjectEntity = [NSEntityDescription entityForName:relatedObjectEntityName inManagedObjectContext:managedObject.managedObjectContext];
                         
-                        NSManagedObject* relatedManagedObject;
-                        relatedManagedObject = [self managedObjectForObjectUID:relatedObjectUID entity:relatedObjectEntity inContext:managedObject.managedObjectContext createIfNecessary:NO error:&localError];
-                        if (localError) {
-                            if (AP_DEBUG_ERRORS) {ELog(@"Populating object with parse object %@",parseObjectDictRepresentation)}
-                            *stop = YES;
+                        NSManagedObject* relatedManagedObject = [self managedObjectForObjectUID:relatedObjectUID entity:relatedObjectEntity inResolvedManagedObjects:resolvedManagedObjects];
+                        
+                        if (!relatedManagedObject) {
+                            relatedManagedObject = [self managedObjectForObjectUID:relatedObjectUID entity:relatedObjectEntity inContext:managedObject.managedObjectContext createIfNecessary:NO error:&localError];
+                            if (localError) {
+                                if (AP_DEBUG_ERRORS) {ELog(@"Populating object with parse object %@",parseObjectDictRepresentation)}
+                                *stop = YES;
+                            }
                         }
                         
                         if (!relatedManagedObject) {
@@ -848,6 +1507,25 @@ static NSUInteger const APParseQueryFetchLimit = 100;
 }
 
 
+// Same as -[APDiskCache cacheValueForAttribute:value:], the sync context shares the cache store.
+- (id) cacheValueForAttribute:(NSAttributeDescription*) attribute
+                        value:(id) value {
+    
+    if (self.blobStore && ![attribute.name isEqualToString:APCoreDataACLAttributeName] &&
+        (attribute.attributeType == NSBinaryDataAttributeType || attribute.attributeType == NSTransformableAttributeType) &&
+        [value isKindOfClass:[NSData class]] && ![APBlobStore isReference:value]) {
+        
+        NSError* blobError = nil;
+        NSData* reference = [self.blobStore referenceForData:value error:&blobError];
+        if (reference) {
+            return reference;
+        }
+        if (AP_DEBUG_ERRORS) {ELog(@"Error writing %@ to the blob store: %@",attribute.name,blobError)}
+    }
+    return value;
+}
+
+
 - (BOOL) populateParseObject:(PFObject*) parseObject
            withManagedObject:(NSManagedObject*) managedObject
                        error:(NSError *__autoreleasing*)error {
@@ -860,6 +1538,8 @@ static NSUInteger const APParseQueryFetchLimit = 100;
     [mutableProperties removeObjectForKey:APObjectLastModifiedAttributeName];
     [mutableProperties removeObjectForKey:APObjectIsDirtyAttributeName];
     [mutableProperties removeObjectForKey:APObjectIsCreatedRemotelyAttributeName];
+    [mutableProperties removeObjectForKey:APObjectRemoteIDAttributeName];
+    [mutableProperties removeObjectForKey:APObjectRelationMembersAttributeName];
     
     // Track the original entity from Core Data model, we use it when entity inheritance is being used.
     parseObject[APObjectEntityNameAttributeName] = managedObject.entity.name;
@@ -904,15 +1584,28 @@ static NSUInteger const APParseQueryFetchLimit = 100;
                         
                         // Binary
                         
-                        PFFile* file = [PFFile fileWithData:propertyValue];
-                        NSError* localError = nil;
+                        BOOL isReference = [APBlobStore isReference:propertyValue];
+                        PFFile* currentFile = parseObject[propertyName];
                         
-                        if (![file save:&localError]) {
-                            if (AP_DEBUG_ERRORS) {ELog(@"Error saving file to Parse: %@",localError)}
-                            if (error) *error = localError;
-                            *stop = YES;
+                        if (isReference && [currentFile isKindOfClass:[PFFile class]] &&
+                            [currentFile.name isEqualToString:[self.blobStore remoteFileNameForReference:propertyValue]]) {
+                            
+                            // Parse has this value already, no need to upload (or download) it again
+                            
+                        } else {
+                            NSError* localError = nil;
+                            NSData* data = (isReference) ? [self.blobStore dataForReference:propertyValue error:&localError] : propertyValue;
+                            PFFile* file = (data) ? [PFFile fileWithData:data] : nil;
+                            
+                            if (!file || ![file save:&localError]) {
+                                if (AP_DEBUG_ERRORS) {ELog(@"Error saving file to Parse: %@",localError)}
+                                if (error) *error = localError;
+                                *stop = YES;
+                            } else {
+                                [self.blobStore setRemoteFileName:file.name forDigest:[APBlobStore digestForData:data]];
+                                [parseObject setValue:file forKey:propertyName];
+                            }
                         }
-                        [parseObject setValue:file forKey:propertyName];
                         
                     } else {
                         [parseObject setValue:propertyValue forKey:propertyName];
@@ -948,37 +1641,79 @@ static NSUInteger const APParseQueryFetchLimit = 100;
                     } else if ([relationshipDescription isRelationAtParse]) {
                         
                         /*
-                         Would be nice if there was a method to easily empty a relationship or check
-                         what objects are in the relation without querying Parse.
-                         The only way I was able to make it work was to query all objects and
-                         remove them one by one... awesome!
+                         Only the members added or removed since the last sync are sent, see APObjectRelationMembersAttributeName.
+                         Objects not created at Parse yet have no members there.
                          */
                         
                         PFRelation* relation = [parseObject relationForKey:propertyName];
+                        NSString* objectUID = [managedObject valueForKey:APObjectUIDAttributeName];
+                        NSDictionary* lastSyncedMembers = (parseObject.objectId) ? [self lastSyncedMembersOfRelationship:propertyName managedObject:managedObject] : @{};
                         
-                        if (parseObject.objectId) {
+                        if (!lastSyncedMembers) {
+                            
+                            /*
+                             Members unknown (ie: synced by an earlier version), would be nice if there was a method to
+                             easily empty a relationship. The only way I was able to make it work was to query all objects and
+                             remove them one by one... awesome!
+                             */
                             NSError* localError = nil;
                             NSArray* currentObjectsInParseRelation = [[relation query]findObjects:&localError];
-                            if (localError) { *error = localError; return;}
+                            if (localError) { if (error) *error = localError; *stop = YES; return;}
                             [currentObjectsInParseRelation enumerateObjectsUsingBlock:^(PFObject* currentRelatedParseObject, NSUInteger idx, BOOL *stop) {
                                 [relation removeObject:currentRelatedParseObject];
                             }];
+                            lastSyncedMembers = @{};
                         }
                         
-                        /*
-                         Now fetch the equivalent Parse object from the local related managed object
-                         and add them all to the Parse relation
-                         */
+                        NSMutableDictionary* currentMembers = [NSMutableDictionary dictionaryWithCapacity:[relatedManagedObjects count]];
                         for (NSManagedObject* relatedManagedObject in relatedManagedObjects) {
+                            currentMembers[[relatedManagedObject valueForKey:APObjectUIDAttributeName]] = relatedManagedObject.entity.name;
+                        }
+                        
+                        // Removed members, looked up with one query per entity
+                        NSMutableDictionary* removedObjectUIDsByEntityName = [NSMutableDictionary dictionary];
+                        [lastSyncedMembers enumerateKeysAndObjectsUsingBlock:^(NSString* relatedObjectUID, NSString* relatedEntityName, BOOL *stop) {
+                            if (!currentMembers[relatedObjectUID]) {
+                                NSMutableArray* objectUIDs = removedObjectUIDsByEntityName[relatedEntityName];
+                                if (!objectUIDs) {
+                                    objectUIDs = [NSMutableArray array];
+                                    removedObjectUIDsByEntityName[relatedEntityName] = objectUIDs;
+                                }
+                                [objectUIDs addObject:relatedObjectUID];
+                            }
+                        }];
+                        
+                        for (NSString* relatedEntityName in removedObjectUIDsByEntityName) {
+                            NSEntityDescription* relatedEntity = self.psc.managedObjectModel.entitiesByName[relatedEntityName];
                             NSError* localError = nil;
-                            PFObject* relatedParseObject = [self parseObjectFromManagedObject:relatedManagedObject error:&localError];
+                            NSArray* removedParseObjects = [self parseObjectsFromEntity:relatedEntity objectUIDs:removedObjectUIDsByEntityName[relatedEntityName] error:&localError];
+                            if (localError) {
+                                if (error) *error = localError;
+                                *stop = YES;
+                                return;
+                            }
+                            for (PFObject* removedParseObject in removedParseObjects) {
+                                [relation removeObject:removedParseObject];
+                            }
+                        }
+                        
+                        // Added members
+                        for (NSManagedObject* relatedManagedObject in relatedManagedObjects) {
+                            if (lastSyncedMembers[[relatedManagedObject valueForKey:APObjectUIDAttributeName]]) {
+                                continue;
+                            }
+                            NSError* localError = nil;
+                            PFObject* relatedParseObject = [self savedParseObjectFromManagedObject:relatedManagedObject error:&localError];
                             if (localError) {
                                 if (error) *error = localError;
                                 *stop = YES;
+                                return;
                             }
                             [relation addObject:relatedParseObject];
                         }
                         
+                        [self setPendingMembers:currentMembers ofRelationship:propertyName objectUID:objectUID];
+                        
                     } else {
                         NSAssert(NO, @"Wasn't supposed to be here");
                     }
@@ -1047,36 +1782,6 @@ static NSUInteger const APParseQueryFetchLimit = 100;
 }
 
 
-- (BOOL) insertOnParseManagedObject:(NSManagedObject*) managedObject
-                              error:(NSError *__autoreleasing*)error {
-    
-    BOOL success = YES;
-    
-    NSEntityDescription* rootEntity = [self rootEntityFromEntity:managedObject.entity];
-    PFObject* parseObject = [[PFObject alloc]initWithClassName:rootEntity.name];
-    
-    NSError __autoreleasing * populateObjectError = nil;
-    if (![self populateParseObject:parseObject withManagedObject:managedObject error:&populateObjectError]) {
-        if (error) *error = populateObjectError;
-        success = NO;
-        
-    } else {
-        NSError __autoreleasing * saveError = nil;
-        if (![parseObject save:&saveError]) {
-            if (error) *error = saveError;
-            success = NO;
-            
-        } else {
-            /* Parse sets the objectId and updatedAt for a new object only after we save it. */
-            [managedObject setValue:parseObject.updatedAt forKey:APObjectLastModifiedAttributeName];
-            [managedObject setValue:@YES forKey:APObjectIsCreatedRemotelyAttributeName];
-        }
-        
-    }
-    return success;
-}
-
-
 #pragma mark - Getting Parse Objects
 
 - (PFObject*) parseObjectFromManagedObject:(NSManagedObject*) managedObject
@@ -1086,29 +1791,85 @@ static NSUInteger const APParseQueryFetchLimit = 100;
     NSError* localError = nil;
     
     NSString* relatedObjectUID = [managedObject valueForKey:APObjectUIDAttributeName];
-    NSEntityDescription* rootEntity = [self rootEntityFromEntity:managedObject.entity];
+    
+    // Objects being pushed in the current batch
+    parseObject = self.pendingParseObjectsByObjectUID[relatedObjectUID];
+    if (parseObject) {
+        return parseObject;
+    }
+    
+    // Synced before, a pointer is all that is needed
+    NSString* remoteID = [managedObject valueForKey:APObjectRemoteIDAttributeName];
+    if (remoteID) {
+        return [PFObject objectWithoutDataWithClassName:[self rootEntityFromEntity:managedObject.entity].name objectId:remoteID];
+    }
     
     if ([[managedObject valueForKey:APObjectIsCreatedRemotelyAttributeName]isEqualToNumber:@NO]) {
-        parseObject = [PFObject objectWithClassName:rootEntity.name];
-        [parseObject setValue:relatedObjectUID forKey:APObjectUIDAttributeName];
-        [parseObject setValue:managedObject.entity.name forKey:APObjectEntityNameAttributeName];
-        [parseObject setValue:@(APObjectStatusCreated) forKey:APObjectStatusAttributeName];
+        parseObject = [self placeholderParseObjectForManagedObject:managedObject];
         
-        [parseObject save:&localError];
-        if (localError) {
+        if (![self.backend saveObjects:@[parseObject] error:&localError]) {
             if (error) *error = localError;
             return nil;
         }
         [managedObject setValue:parseObject.updatedAt forKey:APObjectLastModifiedAttributeName];
+        [managedObject setValue:parseObject.objectId forKey:APObjectRemoteIDAttributeName];
         [managedObject setValue:@YES forKey:APObjectIsCreatedRemotelyAttributeName];
         
     } else {
+        // Synced by an earlier version or its remote ID hasn't been pulled yet
         parseObject = [self parseObjectFromEntity:managedObject.entity objectUID:relatedObjectUID error:&localError];
         if (localError) {
             if (error) *error = localError;
             return nil;
         }
+        if (parseObject.objectId) {
+            [managedObject setValue:parseObject.objectId forKey:APObjectRemoteIDAttributeName];
+        }
+    }
+    
+    return parseObject;
+}
+
+
+/*
+ PFRelation only accepts objects that exist at Parse already, objects from the current
+ batch that haven't been saved yet are saved beforehand.
+ */
+- (PFObject*) savedParseObjectFromManagedObject:(NSManagedObject*) managedObject
+                                          error:(NSError *__autoreleasing*)error {
+    
+    NSError* localError = nil;
+    PFObject* parseObject = [self parseObjectFromManagedObject:managedObject error:&localError];
+    
+    if (parseObject && !parseObject.objectId) {
+        if (![self.backend saveObjects:@[parseObject] error:&localError]) {
+            if (error) *error = localError;
+            return nil;
+        }
+        [managedObject setValue:parseObject.updatedAt forKey:APObjectLastModifiedAttributeName];
+        [managedObject setValue:parseObject.objectId forKey:APObjectRemoteIDAttributeName];
+        [managedObject setValue:@YES forKey:APObjectIsCreatedRemotelyAttributeName];
+    }
+    
+    if (localError) {
+        if (error) *error = localError;
+        return nil;
     }
+    return parseObject;
+}
+
+
+/*
+ Minimum Parse object representing a local object that hasn't been created remotely yet.
+ It gets populated once the related managed object itself is pushed.
+ */
+- (PFObject*) placeholderParseObjectForManagedObject:(NSManagedObject*) managedObject {
+    
+    NSEntityDescription* rootEntity = [self rootEntityFromEntity:managedObject.entity];
+    PFObject* parseObject = [PFObject objectWithClassName:rootEntity.name];
+    [parseObject setValue:[managedObject valueForKey:APObjectUIDAttributeName] forKey:APObjectUIDAttributeName];
+    [parseObject setValue:managedObject.entity.name forKey:APObjectEntityNameAttributeName];
+    [parseObject setValue:@(APObjectStatusCreated) forKey:APObjectStatusAttributeName];
     
     return parseObject;
 }
@@ -1120,28 +1881,10 @@ static NSUInteger const APParseQueryFetchLimit = 100;
     
     if (AP_DEBUG_METHODS) {MLog(@"Class:%@ - ObjectUID: %@",entity.name,objectUID)}
     
-    PFObject* parseObject;
-    NSEntityDescription* rootEntity = [self rootEntityFromEntity:entity];
-    PFQuery* query = [PFQuery queryWithClassName:rootEntity.name];
-    [query setCachePolicy:kPFCachePolicyNetworkOnly];
-    [query whereKey:APObjectUIDAttributeName equalTo:objectUID];
-    [query whereKey:APObjectEntityNameAttributeName equalTo:entity.name];
-    
-    /* Fetch related objects when the relation is flagged as a Array via core data model metadata. */
-    [entity.relationshipsByName enumerateKeysAndObjectsUsingBlock:^(NSString* relationName, NSRelationshipDescription* relationDescription, BOOL *stop) {
-        NSString* relationshipType = relationDescription.userInfo[APParseRelationshipTypeUserInfoKey];
-        if ((relationshipType && [relationshipType integerValue] == APParseRelationshipTypeArray) || [relationDescription isToMany] == NO) {
-            [query includeKey:relationName];
-        }
-    }];
-    
-    if ([query hasCachedResult]) {[query clearCachedResult];}
-    
     NSError* localError = nil;
-    NSArray* results = [query findObjects:&localError];
+    NSArray* results = [self parseObjectsFromEntity:entity objectUIDs:@[objectUID] error:&localError];
     
     if (localError) {
-        if (AP_DEBUG_ERRORS) {ELog(@"Error finding objects at Parse: %@",localError)}
         if (error) *error = localError;
         return nil;
         
@@ -1156,14 +1899,183 @@ static NSUInteger const APParseQueryFetchLimit = 100;
         return nil;
         
     } else {
-        parseObject = [results lastObject];
+        return [results lastObject];
+    }
+}
+
+
+/*
+ Fetches all Parse objects matching the objectUIDs, querying at most APParseQueryMaxFetchLimit
+ objectUIDs at a time.
+ */
+- (NSArray*) parseObjectsFromEntity:(NSEntityDescription*) entity
+                         objectUIDs:(NSArray*) objectUIDs
+                              error:(NSError *__autoreleasing*)error {
+    
+    if (AP_DEBUG_METHODS) {MLog(@"Class:%@ - Number of objectUIDs: %lu",entity.name,(unsigned long)[objectUIDs count])}
+    
+    NSMutableArray* parseObjects = [NSMutableArray arrayWithCapacity:[objectUIDs count]];
+    NSEntityDescription* rootEntity = [self rootEntityFromEntity:entity];
+    
+    for (NSUInteger location = 0; location < [objectUIDs count]; location += APParseQueryMaxFetchLimit) {
+        
+        NSArray* objectUIDsToQuery = [objectUIDs subarrayWithRange:NSMakeRange(location, MIN(APParseQueryMaxFetchLimit, [objectUIDs count] - location))];
+        
+        PFQuery* query = [PFQuery queryWithClassName:rootEntity.name];
+        [query setCachePolicy:kPFCachePolicyNetworkOnly];
+        
+        if ([objectUIDsToQuery count] == 1) {
+            [query whereKey:APObjectUIDAttributeName equalTo:[objectUIDsToQuery lastObject]];
+        } else {
+            [query whereKey:APObjectUIDAttributeName containedIn:objectUIDsToQuery];
+        }
+        [query whereKey:APObjectEntityNameAttributeName equalTo:entity.name];
+        
+        // Leave room for eventual duplicated objectUIDs to be detected.
+        query.limit = MIN([objectUIDsToQuery count] + 1, APParseQueryMaxFetchLimit);
+        
+        /* Fetch related objects when the relation is flagged as a Array via core data model metadata. */
+        [entity.relationshipsByName enumerateKeysAndObjectsUsingBlock:^(NSString* relationName, NSRelationshipDescription* relationDescription, BOOL *stop) {
+            NSString* relationshipType = relationDescription.userInfo[APParseRelationshipTypeUserInfoKey];
+            if ((relationshipType && [relationshipType integerValue] == APParseRelationshipTypeArray) || [relationDescription isToMany] == NO) {
+                [query includeKey:relationName];
+            }
+        }];
+        
+        if ([query hasCachedResult]) {[query clearCachedResult];}
+        
+        NSError* localError = nil;
+        NSArray* results = [self.backend findObjectsForQuery:query error:&localError];
+        
+        if (localError) {
+            if (AP_DEBUG_ERRORS) {ELog(@"Error finding objects at Parse: %@",localError)}
+            if (error) *error = localError;
+            return nil;
+        }
+        [parseObjects addObjectsFromArray:results];
+    }
+    
+    return parseObjects;
+}
+
+
+#pragma mark - Getting Managed Objects
+
+- (NSArray*) outboxEntriesAfterSequence:(int64_t) sequence
+                                  limit:(NSUInteger) limit
+                                  error:(NSError *__autoreleasing*) error {
+    
+    NSFetchRequest* request = [NSFetchRequest fetchRequestWithEntityName:APOutboxEntityName];
+    request.predicate = [NSPredicate predicateWithFormat:@"%K > %lld",APOutboxSequenceAttributeName,sequence];
+    request.sortDescriptors = @[[NSSortDescriptor sortDescriptorWithKey:APOutboxSequenceAttributeName ascending:YES]];
+    request.fetchLimit = limit;
+    
+    NSError* fetchingError = nil;
+    NSArray* outboxEntries = [self.context executeFetchRequest:request error:&fetchingError];
+    if (!outboxEntries) {
+        if (AP_DEBUG_ERRORS) {ELog(@"Error reading the outbox: %@",fetchingError)}
+        if (error) *error = fetchingError;
+    }
+    return outboxEntries;
+}
+
+
+/*
+ Objects of the entries that are still dirty, once each, in the order they were changed first.
+ One fetch per entity.
+ */
+- (NSArray*) dirtyManagedObjectsForOutboxEntries:(NSArray*) outboxEntries
+                                           error:(NSError *__autoreleasing*) error {
+    
+    NSMutableDictionary* objectUIDsByEntityName = [NSMutableDictionary dictionary];
+    for (NSManagedObject* outboxEntry in outboxEntries) {
+        NSString* entityName = [outboxEntry valueForKey:APObjectEntityNameAttributeName];
+        NSMutableArray* objectUIDs = objectUIDsByEntityName[entityName];
+        if (!objectUIDs) {
+            objectUIDs = [NSMutableArray array];
+            objectUIDsByEntityName[entityName] = objectUIDs;
+        }
+        [objectUIDs addObject:[outboxEntry valueForKey:APObjectUIDAttributeName]];
+    }
+    
+    NSMutableDictionary* managedObjectsByObjectUID = [NSMutableDictionary dictionaryWithCapacity:[outboxEntries count]];
+    for (NSString* entityName in objectUIDsByEntityName) {
+        if (!self.psc.managedObjectModel.entitiesByName[entityName]) {
+            continue;
+        }
+        
+        NSFetchRequest* request = [NSFetchRequest fetchRequestWithEntityName:entityName];
+        request.predicate = [NSPredicate predicateWithFormat:@"%K IN %@ AND %K == YES",APObjectUIDAttributeName,objectUIDsByEntityName[entityName],APObjectIsDirtyAttributeName];
+        request.includesSubentities = NO;
+        request.returnsObjectsAsFaults = NO;
+        
+        NSError* fetchingError = nil;
+        NSArray* managedObjects = [self.context executeFetchRequest:request error:&fetchingError];
+        if (!managedObjects) {
+            if (AP_DEBUG_ERRORS) {ELog(@"Error fetching dirty objects of %@: %@",entityName,fetchingError)}
+            if (error) *error = fetchingError;
+            return nil;
+        }
+        for (NSManagedObject* managedObject in managedObjects) {
+            managedObjectsByObjectUID[[managedObject valueForKey:APObjectUIDAttributeName]] = managedObject;
+        }
+    }
+    
+    NSMutableArray* dirtyManagedObjects = [NSMutableArray arrayWithCapacity:[managedObjectsByObjectUID count]];
+    NSMutableSet* addedObjectUIDs = [NSMutableSet set];
+    for (NSManagedObject* outboxEntry in outboxEntries) {
+        NSString* objectUID = [outboxEntry valueForKey:APObjectUIDAttributeName];
+        if (managedObjectsByObjectUID[objectUID] && ![addedObjectUIDs containsObject:objectUID]) {
+            [dirtyManagedObjects addObject:managedObjectsByObjectUID[objectUID]];
+            [addedObjectUIDs addObject:objectUID];
+        }
+    }
+    return dirtyManagedObjects;
+}
+
+
+// Outbox and sync state, never synced with Parse
+- (BOOL) isCacheOnlyEntity:(NSEntityDescription*) entity {
+    
+    return [entity.name isEqualToString:APOutboxEntityName] || [entity.name isEqualToString:APSyncStateEntityName];
+}
+
+
+/*
+ The store has been scanned for dirty objects since it has an outbox, see -mergeLocalContextError:
+ Must be called from within self.context queue.
+ */
+- (BOOL) isOutboxSeeded {
+    
+    if (!self.psc.managedObjectModel.entitiesByName[APSyncStateEntityName]) {
+        return NO;
+    }
+    
+    NSError* fetchingError = nil;
+    NSManagedObject* syncState = [self syncStateObjectForKey:self.latestObjectSyncedKey create:NO error:&fetchingError];
+    if (fetchingError) {
+        if (AP_DEBUG_ERRORS) {ELog(@"Error reading the sync state: %@",fetchingError)}
+    }
+    return [[syncState valueForKey:APSyncStateOutboxSeededAttributeName] boolValue];
+}
+
+
+// Written with the next save of self.context, must be called from within its queue.
+- (void) setOutboxSeeded {
+    
+    if (!self.psc.managedObjectModel.entitiesByName[APSyncStateEntityName]) {
+        return;
+    }
+    
+    NSError* fetchingError = nil;
+    NSManagedObject* syncState = [self syncStateObjectForKey:self.latestObjectSyncedKey create:YES error:&fetchingError];
+    if (!syncState) {
+        if (AP_DEBUG_ERRORS) {ELog(@"Error reading the sync state: %@",fetchingError)}
+        return;
     }
-    return parseObject;
+    [syncState setValue:@YES forKey:APSyncStateOutboxSeededAttributeName];
 }
 
-
-#pragma mark - Getting Managed Objects
-
 - (NSArray*) managedObjectsMarkedAsDirtyInContext: (NSManagedObjectContext *)context {
     
     if (AP_DEBUG_METHODS) { MLog()}
@@ -1174,6 +2086,9 @@ static NSUInteger const APParseQueryFetchLimit = 100;
     NSArray* allEntities = context.persistentStoreCoordinator.managedObjectModel.entities;
     
     [allEntities enumerateObjectsUsingBlock:^(NSEntityDescription* entity, NSUInteger idx, BOOL *stop) {
+        if ([self isCacheOnlyEntity:entity]) {
+            return;
+        }
         NSFetchRequest* request = [NSFetchRequest fetchRequestWithEntityName:entity.name];
         request.predicate = [NSPredicate predicateWithFormat:@"%K == YES",APObjectIsDirtyAttributeName];
         
@@ -1236,7 +2151,28 @@ static NSUInteger const APParseQueryFetchLimit = 100;
         
     } else if ([fetchResults count] == 0) {
         
-        if (createIfNecessary) {
+        if (createIfNecessary && context.parentContext) {
+            
+            /*
+             Objects are only ever created in self.context, whose queue serializes the workers,
+             so that two entities pulled at the same time can't create the same object (or
+             placeholder for a related object) twice.
+             */
+            __block NSManagedObjectID* objectID = nil;
+            __block NSError* parentError = nil;
+            NSManagedObjectContext* parentContext = context.parentContext;
+            [parentContext performBlockAndWait:^{
+                NSManagedObject* parentManagedObject = [self managedObjectForObjectUID:objectUID entity:entity inContext:parentContext createIfNecessary:YES error:&parentError];
+                objectID = parentManagedObject.objectID;
+            }];
+            
+            if (parentError) {
+                if (error) *error = parentError;
+                return nil;
+            }
+            managedObject = [context objectWithID:objectID];
+            
+        } else if (createIfNecessary) {
             managedObject = [NSEntityDescription insertNewObjectForEntityForName:entity.name inManagedObjectContext:context];
             [managedObject setValue:objectUID forKey:APObjectUIDAttributeName];
             
@@ -1259,8 +2195,384 @@ static NSUInteger const APParseQueryFetchLimit = 100;
 }
 
 
+/*
+ Resolves all objects a page of serialized Parse objects refers to - the objects themselves and their related
+ objects - with one fetch per root entity instead of one (or two) per object.
+ Objects that don't exist locally are created in one go and marked as created remotely, except for objects
+ deleted at Parse, whose objectUIDs are returned via insertedObjectUIDs.
+ @returns {RootEntityName: {objectUID: NSManagedObject}} registered in context, or nil if an error occurs.
+ */
+- (NSDictionary*) managedObjectsForSerializedParseObjects:(NSArray*) serializedParseObjects
+                                                inContext:(NSManagedObjectContext*) context
+                                       insertedObjectUIDs:(NSSet*__autoreleasing*) insertedObjectUIDs
+                                                    error:(NSError*__autoreleasing*) error {
+    
+    if (AP_DEBUG_METHODS) {MLog(@" - Number of objects: %lu",(unsigned long)[serializedParseObjects count])}
+    
+    NSDictionary* entitiesByName = context.persistentStoreCoordinator.managedObjectModel.entitiesByName;
+    
+    // {EntityName: objectUIDs}
+    NSMutableDictionary* objectUIDsByEntityName = [NSMutableDictionary dictionary];
+    
+    void (^addObjectUID)(NSString*, NSString*) = ^(NSString* objectUID, NSString* entityName) {
+        if (!objectUID || !entityName) return;
+        if (!entitiesByName[entityName]) {
+            [NSException raise:APIncrementalStoreExceptionInconsistency format:@"Entity %@ (Parse) isn't present in the Managed Object Model",entityName];
+        }
+        NSMutableSet* objectUIDs = objectUIDsByEntityName[entityName];
+        if (!objectUIDs) {
+            objectUIDs = [NSMutableSet set];
+            objectUIDsByEntityName[entityName] = objectUIDs;
+        }
+        [objectUIDs addObject:objectUID];
+    };
+    
+    // Objects deleted at Parse that don't exist locally must not be created.
+    NSMutableSet* deletedObjectUIDs = [NSMutableSet set];
+    
+    for (NSDictionary* serializedParseObject in serializedParseObjects) {
+        NSString* entityName = serializedParseObject[APObjectEntityNameAttributeName];
+        addObjectUID(serializedParseObject[APObjectUIDAttributeName],entityName);
+        
+        // Objects deleted at Parse won't be populated, no need for their related objects.
+        if ([serializedParseObject[APObjectStatusAttributeName] isEqualToNumber:@(APObjectStatusDeleted)]) {
+            [deletedObjectUIDs addObject:serializedParseObject[APObjectUIDAttributeName]];
+            continue;
+        }
+        
+        [[entitiesByName[entityName] relationshipsByName] enumerateKeysAndObjectsUsingBlock:^(NSString* relationshipName, NSRelationshipDescription* relationshipDescription, BOOL *stop) {
+            id value = serializedParseObject[relationshipName];
+            
+            if ([value isKindOfClass:[NSArray class]]) {
+                for (NSDictionary* relatedObject in value) {
+                    addObjectUID(relatedObject[APObjectUIDAttributeName],relatedObject[APObjectEntityNameAttributeName]);
+                }
+            } else if ([value isKindOfClass:[NSDictionary class]]) {
+                addObjectUID(value[APObjectUIDAttributeName],value[APObjectEntityNameAttributeName]);
+            }
+        }];
+    }
+    
+    NSError* localError = nil;
+    NSMutableDictionary* managedObjects = [self fetchManagedObjectsForObjectUIDsByEntityName:objectUIDsByEntityName inContext:context error:&localError];
+    if (!managedObjects) {
+        if (error) *error = localError;
+        return nil;
+    }
+    
+    NSMutableDictionary* missingObjectUIDsByEntityName = [NSMutableDictionary dictionary];
+    [objectUIDsByEntityName enumerateKeysAndObjectsUsingBlock:^(NSString* entityName, NSSet* objectUIDs, BOOL *stop) {
+        NSEntityDescription* entity = entitiesByName[entityName];
+        NSMutableSet* missingObjectUIDs = [NSMutableSet set];
+        
+        for (NSString* objectUID in objectUIDs) {
+            if (![self managedObjectForObjectUID:objectUID entity:entity inResolvedManagedObjects:managedObjects] &&
+                ![deletedObjectUIDs containsObject:objectUID]) {
+                [missingObjectUIDs addObject:objectUID];
+            }
+        }
+        if ([missingObjectUIDs count] > 0) {
+            missingObjectUIDsByEntityName[entityName] = missingObjectUIDs;
+        }
+    }];
+    
+    NSMutableSet* localInsertedObjectUIDs = [NSMutableSet set];
+    
+    if ([missingObjectUIDsByEntityName count] > 0) {
+        
+        NSDictionary* insertedManagedObjects;
+        
+        if (context.parentContext) {
+            
+            /*
+             Same as -managedObjectForObjectUID:entity:inContext:createIfNecessary:error:, objects are
+             only ever created in self.context, whose queue serializes the workers.
+             */
+            __block NSDictionary* insertedObjectIDs = nil;
+            __block NSError* parentError = nil;
+            NSManagedObjectContext* parentContext = context.parentContext;
+            [parentContext performBlockAndWait:^{
+                NSDictionary* parentManagedObjects = [self insertManagedObjectsForObjectUIDsByEntityName:missingObjectUIDsByEntityName inContext:parentContext error:&parentError];
+                NSMutableDictionary* objectIDs = [NSMutableDictionary dictionaryWithCapacity:[parentManagedObjects count]];
+                [parentManagedObjects enumerateKeysAndObjectsUsingBlock:^(NSString* objectUID, NSManagedObject* parentManagedObject, BOOL *stop) {
+                    objectIDs[objectUID] = parentManagedObject.objectID;
+                }];
+                insertedObjectIDs = parentManagedObjects ? objectIDs : nil;
+            }];
+            
+            if (!insertedObjectIDs) {
+                if (error) *error = parentError;
+                return nil;
+            }
+            
+            NSMutableDictionary* childManagedObjects = [NSMutableDictionary dictionaryWithCapacity:[insertedObjectIDs count]];
+            [insertedObjectIDs enumerateKeysAndObjectsUsingBlock:^(NSString* objectUID, NSManagedObjectID* objectID, BOOL *stop) {
+                childManagedObjects[objectUID] = [context objectWithID:objectID];
+            }];
+            insertedManagedObjects = childManagedObjects;
+            
+        } else {
+            insertedManagedObjects = [self insertManagedObjectsForObjectUIDsByEntityName:missingObjectUIDsByEntityName inContext:context error:&localError];
+            if (!insertedManagedObjects) {
+                if (error) *error = localError;
+                return nil;
+            }
+        }
+        
+        [insertedManagedObjects enumerateKeysAndObjectsUsingBlock:^(NSString* objectUID, NSManagedObject* insertedManagedObject, BOOL *stop) {
+            NSString* rootEntityName = [self rootEntityFromEntity:insertedManagedObject.entity].name;
+            managedObjects[rootEntityName][objectUID] = insertedManagedObject;
+            [localInsertedObjectUIDs addObject:objectUID];
+        }];
+    }
+    
+    if (insertedObjectUIDs) *insertedObjectUIDs = localInsertedObjectUIDs;
+    return managedObjects;
+}
+
+
+/*
+ One fetch per root entity.
+ @returns {RootEntityName: {objectUID: NSManagedObject}} with an entry for every root entity requested.
+ */
+- (NSMutableDictionary*) fetchManagedObjectsForObjectUIDsByEntityName:(NSDictionary*) objectUIDsByEntityName
+                                                            inContext:(NSManagedObjectContext*) context
+                                                                error:(NSError*__autoreleasing*) error {
+    
+    NSDictionary* entitiesByName = context.persistentStoreCoordinator.managedObjectModel.entitiesByName;
+    
+    NSMutableDictionary* objectUIDsByRootEntityName = [NSMutableDictionary dictionary];
+    [objectUIDsByEntityName enumerateKeysAndObjectsUsingBlock:^(NSString* entityName, NSSet* objectUIDs, BOOL *stop) {
+        NSString* rootEntityName = [self rootEntityFromEntity:entitiesByName[entityName]].name;
+        NSMutableSet* rootEntityObjectUIDs = objectUIDsByRootEntityName[rootEntityName] ?: [NSMutableSet set];
+        [rootEntityObjectUIDs unionSet:objectUIDs];
+        objectUIDsByRootEntityName[rootEntityName] = rootEntityObjectUIDs;
+    }];
+    
+    NSMutableDictionary* managedObjects = [NSMutableDictionary dictionaryWithCapacity:[objectUIDsByRootEntityName count]];
+    
+    for (NSString* rootEntityName in objectUIDsByRootEntityName) {
+        NSSet* objectUIDs = objectUIDsByRootEntityName[rootEntityName];
+        NSMutableDictionary* managedObjectsByObjectUID = [NSMutableDictionary dictionaryWithCapacity:[objectUIDs count]];
+        managedObjects[rootEntityName] = managedObjectsByObjectUID;
+        
+        NSFetchRequest* fr = [NSFetchRequest fetchRequestWithEntityName:rootEntityName];
+        fr.predicate = [NSPredicate predicateWithFormat:@"%K IN %@",APObjectUIDAttributeName,objectUIDs];
+        
+        NSError* localError = nil;
+        NSArray* fetchResults = [context executeFetchRequest:fr error:&localError];
+        if (localError) {
+            if (error) *error = localError;
+            return nil;
+        }
+        
+        for (NSManagedObject* managedObject in fetchResults) {
+            NSString* objectUID = [managedObject valueForKey:APObjectUIDAttributeName];
+            if (managedObjectsByObjectUID[objectUID]) {
+                [NSException raise:APIncrementalStoreExceptionInconsistency format:@"More than one cached result for parse object"];
+            }
+            managedObjectsByObjectUID[objectUID] = managedObject;
+        }
+    }
+    
+    return managedObjects;
+}
+
+
+/*
+ Inserts the objects that (still) don't exist in context, all of them obtaining permanent IDs at once.
+ @returns {objectUID: NSManagedObject} for the objects inserted.
+ */
+- (NSDictionary*) insertManagedObjectsForObjectUIDsByEntityName:(NSDictionary*) objectUIDsByEntityName
+                                                      inContext:(NSManagedObjectContext*) context
+                                                          error:(NSError*__autoreleasing*) error {
+    
+    NSDictionary* entitiesByName = context.persistentStoreCoordinator.managedObjectModel.entitiesByName;
+    
+    // Another worker may have created some of them in the meantime.
+    NSError* localError = nil;
+    NSDictionary* existingManagedObjects = [self fetchManagedObjectsForObjectUIDsByEntityName:objectUIDsByEntityName inContext:context error:&localError];
+    if (!existingManagedObjects) {
+        if (error) *error = localError;
+        return nil;
+    }
+    
+    NSMutableDictionary* insertedManagedObjects = [NSMutableDictionary dictionary];
+    
+    [objectUIDsByEntityName enumerateKeysAndObjectsUsingBlock:^(NSString* entityName, NSSet* objectUIDs, BOOL *stop) {
+        NSEntityDescription* entity = entitiesByName[entityName];
+        
+        for (NSString* objectUID in objectUIDs) {
+            NSManagedObject* managedObject = [self managedObjectForObjectUID:objectUID entity:entity inResolvedManagedObjects:existingManagedObjects];
+            if (!managedObject) {
+                managedObject = [NSEntityDescription insertNewObjectForEntityForName:entityName inManagedObjectContext:context];
+                [managedObject setValue:objectUID forKey:APObjectUIDAttributeName];
+                [managedObject setValue:@YES forKey:APObjectIsCreatedRemotelyAttributeName];
+            }
+            insertedManagedObjects[objectUID] = managedObject;
+        }
+    }];
+    
+    NSError* permanentIdError = nil;
+    [context obtainPermanentIDsForObjects:[insertedManagedObjects allValues] error:&permanentIdError];
+    // Sanity check
+    if (permanentIdError) {
+        [NSException raise:APIncrementalStoreExceptionInconsistency format:@"Could not obtain permanent IDs for objects %@ with error %@", insertedManagedObjects, permanentIdError];
+    }
+    
+    return insertedManagedObjects;
+}
+
+
+- (NSManagedObject*) managedObjectForObjectUID:(NSString*) objectUID
+                                        entity:(NSEntityDescription*) entity
+                      inResolvedManagedObjects:(NSDictionary*) resolvedManagedObjects {
+    
+    if (!objectUID || !resolvedManagedObjects) {
+        return nil;
+    }
+    
+    NSManagedObject* managedObject = resolvedManagedObjects[[self rootEntityFromEntity:entity].name][objectUID];
+    return [managedObject.entity isKindOfEntity:entity] ? managedObject : nil;
+}
+
+
+/*
+ Members of the PFRelations of a whole page, queried APParseRelationQueryConcurrency at a time instead of one after the other.
+ Parse can only query the members of one object's relation at a time ($relatedTo).
+ @returns {key: relatedObjects} for each object, in the same order (see -serializeParseObject:forEntity:relatedObjectsByKey:error:).
+ */
+- (NSArray*) relatedObjectsOfParseObjects:(NSArray*) parseObjects
+                                forEntity:(NSEntityDescription*) entity
+                                    error:(NSError* __autoreleasing*) error {
+    
+    NSMutableArray* relatedObjectsByKeyOfObjects = [NSMutableArray arrayWithCapacity:[parseObjects count]];
+    NSOperationQueue* queue = [[NSOperationQueue alloc]init];
+    queue.maxConcurrentOperationCount = APParseRelationQueryConcurrency;
+    __block NSError* localError = nil;
+    
+    for (PFObject* parseObject in parseObjects) {
+        NSMutableDictionary* relatedObjectsByKey = [NSMutableDictionary dictionary];
+        [relatedObjectsByKeyOfObjects addObject:relatedObjectsByKey];
+        
+        for (NSString* key in [parseObject allKeys]) {
+            id value = parseObject[key];
+            if (![value isKindOfClass:[PFRelation class]] || ![self needToPopulateRelationForKey:key entity:entity]) {
+                continue;
+            }
+            
+            [queue addOperationWithBlock:^{
+                NSError* queryError = nil;
+                NSArray* relatedObjects = [self relatedObjectsOfRelation:value forKey:key parseObject:parseObject error:&queryError];
+                
+                @synchronized(relatedObjectsByKeyOfObjects) {
+                    if (relatedObjects) {
+                        relatedObjectsByKey[key] = relatedObjects;
+                    } else if (!localError) {
+                        localError = queryError;
+                        [queue cancelAllOperations];
+                    }
+                }
+            }];
+        }
+    }
+    
+    [queue waitUntilAllOperationsAreFinished];
+    
+    if (localError) {
+        if (AP_DEBUG_ERRORS) {ELog(@"Error getting objects from To-Many relationships of %@ from Parse: %@",entity.name,localError)}
+        if (error) *error = localError;
+        return nil;
+    }
+    return relatedObjectsByKeyOfObjects;
+}
+
+
+/*
+ In order to optimize the sync process there are three scenarios where we don't need
+ to populate this relation:
+ 
+ 1) The PFRelation is part of the root entity so that doesn't belong to this entity.
+ This happens because Parse doesn't send not populated properties along with the
+ fetched objects, which works great for inheritance and allows us to use only the
+ root class to store all subclasses at Parse. The exception is for PFRelations, even
+ being NULL Parse put it in the object. So we have to discaard it.
+ 
+ 2) The inverse relation is To-One
+ 
+ 3) The inverse is an Array. Here we can't differentiate solely evaluating our Core
+ Data model and tell if the inverse relation is an Array or a PFRelation.
+ For that reason if the Core Data model has a key APParseRelationshipTypeUserInfoKey
+ set with APParseRelationshipTypeArray we assume that Parse has a relation as the inverse
+ relationship, therefore we can skip populating this relation.
+ */
+- (BOOL) needToPopulateRelationForKey:(NSString*) key
+                               entity:(NSEntityDescription*) entity {
+    
+    NSRelationshipDescription* relationshipDescription = entity.propertiesByName[key];
+    
+    if (![relationshipDescription isKindOfClass:[NSRelationshipDescription class]]) {
+        // 1
+        return NO;
+        
+    } else if (![relationshipDescription.inverseRelationship isToMany]) {
+        // 2
+        return NO;
+        
+    } else if ([relationshipDescription.inverseRelationship isArrayAtParse]) {
+        // 3
+        return NO;
+    }
+    return YES;
+}
+
+
+// To-Many relationship (need to create an Array of Dictionaries including only the ObjectUID)
+- (NSArray*) relatedObjectsOfRelation:(PFRelation*) relation
+                               forKey:(NSString*) key
+                          parseObject:(PFObject*) parseObject
+                                error:(NSError* __autoreleasing*) error {
+    
+    PFQuery* queryForRelatedObjects = [relation query];
+    [queryForRelatedObjects selectKeys:@[APObjectUIDAttributeName,APObjectEntityNameAttributeName]];
+    
+    NSError* localError = nil;
+    NSArray* results = [queryForRelatedObjects findObjects:&localError];
+    if (localError) {
+        if (error) *error = localError;
+        return nil;
+    }
+    
+    NSMutableArray* relatedObjects = [[NSMutableArray alloc]initWithCapacity:[results count]];
+    for (PFObject* relatedParseObject in results) {
+        if (!relatedParseObject[APObjectUIDAttributeName]) {
+            [NSException raise:APIncrementalStoreExceptionInconsistency format:@"%@ is missing APObjectUIDAttributeName", parseObject];
+        }
+        if (!relatedParseObject[APObjectEntityNameAttributeName]) {
+            [NSException raise:APIncrementalStoreExceptionInconsistency format:@"%@ is missing APObjectEntityNameAttributeName",parseObject];
+        }
+        [relatedObjects addObject:@{APObjectUIDAttributeName: relatedParseObject[APObjectUIDAttributeName],
+                                    APObjectEntityNameAttributeName: relatedParseObject[APObjectEntityNameAttributeName]}];
+    }
+    return relatedObjects;
+}
+
+
+- (NSDictionary*) serializeParseObject:(PFObject*) parseObject
+                             forEntity:(NSEntityDescription*) entity
+                                 error:(NSError* __autoreleasing*) error {
+    
+    return [self serializeParseObject:parseObject forEntity:entity relatedObjectsByKey:nil error:error];
+}
+
+
+/*
+ PFRelations found in relatedObjectsByKey ({key: [{APObjectUIDAttributeName: objectUID, APObjectEntityNameAttributeName: entityName}]})
+ aren't queried again.
+ */
 - (NSDictionary*) serializeParseObject:(PFObject*) parseObject
                              forEntity:(NSEntityDescription*) entity
+                   relatedObjectsByKey:(NSDictionary*) relatedObjectsByKey
                                  error:(NSError* __autoreleasing*) error {
     
     if (AP_DEBUG_METHODS) { MLog()};
@@ -1274,68 +2586,19 @@ static NSUInteger const APParseQueryFetchLimit = 100;
         
         if ([value isKindOfClass:[PFRelation class]]) {
             
-            /*
-             In order to optimize the sync process there are three scenarios where we don't need
-             to populate this relation:
-             
-             1) The PFRelation is part of the root entity so that doesn't belong to this entity.
-             This happens because Parse doesn't send not populated properties along with the
-             fetched objects, which works great for inheritance and allows us to use only the
-             root class to store all subclasses at Parse. The exception is for PFRelations, even
-             being NULL Parse put it in the object. So we have to discaard it.
-             
-             2) The inverse relation is To-One
-             
-             3) The inverse is an Array. Here we can't differentiate solely evaluating our Core
-             Data model and tell if the inverse relation is an Array or a PFRelation.
-             For that reason if the Core Data model has a key APParseRelationshipTypeUserInfoKey
-             set with APParseRelationshipTypeArray we assume that Parse has a relation as the inverse
-             relationship, therefore we can skip populating this relation.
-             
-             */
-            BOOL needToPopulateRelation = YES;
-            NSRelationshipDescription* relationshipDescription = entity.propertiesByName[key];
-            
-            if (![relationshipDescription isKindOfClass:[NSRelationshipDescription class]]) {
-                // 1
-                needToPopulateRelation = NO;
-                
-            } else if (![relationshipDescription.inverseRelationship isToMany]) {
-                // 2
-                needToPopulateRelation = NO;
-                
-            } else if ([relationshipDescription.inverseRelationship isArrayAtParse]) {
-                // 3
-                needToPopulateRelation = NO;
-            }
-            
-            if (needToPopulateRelation) {
-                // To-Many relationship (need to create an Array of Dictionaries including only the ObjectId
-                
-                PFRelation* relation = (PFRelation*) value;
-                PFQuery* queryForRelatedObjects = [relation query];
-                [queryForRelatedObjects selectKeys:@[APObjectUIDAttributeName,APObjectEntityNameAttributeName]];
+            if ([self needToPopulateRelationForKey:key entity:entity]) {
                 
-                NSArray* results = [queryForRelatedObjects findObjects:&localError];
+                // Resolved for the whole page beforehand, see -relatedObjectsOfParseObjects:forEntity:error:
+                NSArray* relatedObjects = relatedObjectsByKey[key];
+                if (!relatedObjects) {
+                    relatedObjects = [self relatedObjectsOfRelation:(PFRelation*) value forKey:key parseObject:parseObject error:&localError];
+                }
                 
                 if (localError) {
                     *stop = YES;
                     ELog(@"Error getting objects from To-Many relationship %@from Parse: %@",key,localError);
                     
                 } else {
-                    NSMutableArray* relatedObjects = [[NSMutableArray alloc]initWithCapacity:[results count]];
-                    
-                    for (PFObject* relatedParseObject in results) {
-                        if (!relatedParseObject[APObjectUIDAttributeName]) {
-                            [NSException raise:APIncrementalStoreExceptionInconsistency format:@"%@ is missing APObjectUIDAttributeName", parseObject];
-                        }
-                        if (!relatedParseObject[APObjectEntityNameAttributeName]) {
-                            [NSException raise:APIncrementalStoreExceptionInconsistency format:@"%@ is missing APObjectEntityNameAttributeName",parseObject];
-                        }
-                        [relatedObjects addObject:@{APObjectUIDAttributeName: relatedParseObject[APObjectUIDAttributeName],
-                                                    APObjectEntityNameAttributeName: relatedParseObject[APObjectEntityNameAttributeName]}];
-                    }
-                    
                     dictionaryRepresentation[key] = relatedObjects;
                 }
             }
@@ -1364,6 +2627,16 @@ static NSUInteger const APParseQueryFetchLimit = 100;
             
             dictionaryRepresentation[key] = relatedObjects;
             
+        } else if ([value isKindOfClass:[PFFile class]] && self.deferFileDownloads && self.blobStore && [(PFFile*) value url]) {
+            
+            // Downloaded when first read or prefetched after the sync
+            
+            NSData* reference = [self.blobStore referenceForRemoteFileURL:[(PFFile*) value url]];
+            dictionaryRepresentation[key] = reference;
+            @synchronized(self.deferredFileReferences) {
+                [self.deferredFileReferences addObject:reference];
+            }
+            
         } else if ([value isKindOfClass:[PFFile class]]) {
             PFFile* file = (PFFile*) value;
             NSData* fileData = [file getData:&localError];
@@ -1372,6 +2645,7 @@ static NSUInteger const APParseQueryFetchLimit = 100;
                 ELog(@"Error getting file from Parse: %@",localError);
             } else {
                 dictionaryRepresentation[key] = fileData;
+                [self.blobStore setRemoteFileName:file.name forDigest:[APBlobStore digestForData:fileData]];
             }
             
         } else if ([value isKindOfClass:[PFObject class]]) {
@@ -1427,6 +2701,7 @@ static NSUInteger const APParseQueryFetchLimit = 100;
     }];
     
     dictionaryRepresentation[APObjectLastModifiedAttributeName] = parseObject.updatedAt;
+    dictionaryRepresentation[APObjectRemoteIDAttributeName] = parseObject.objectId;
     
     if (dictionaryRepresentation[APObjectUIDAttributeName] == nil ||
         dictionaryRepresentation[APObjectEntityNameAttributeName] == nil ||
@@ -1446,42 +2721,88 @@ static NSUInteger const APParseQueryFetchLimit = 100;
 
 #pragma mark - Save Context
 
+/*
+ Every save of self.context (a pulled page or a pushed batch) is added to mergedObjectsUIDsNestedByEntityName,
+ once per object, and sent as it is to mergedChangesBlock. Called within self.context queue.
+ */
 - (void) configSaveContextObserver {
     
     [[NSNotificationCenter defaultCenter]addObserverForName: NSManagedObjectContextDidSaveNotification object:self.context queue:nil usingBlock:^(NSNotification *note) {
         
-        [note.userInfo enumerateKeysAndObjectsUsingBlock:^(id key, NSArray* managedObjects, BOOL *stop) {
+        NSMutableDictionary* savedObjectsUIDsNestedByEntityName = [NSMutableDictionary dictionary];
+        
+        for (NSString* key in @[NSInsertedObjectsKey,NSUpdatedObjectsKey,NSDeletedObjectsKey]) {
             
-            [managedObjects enumerateObjectsUsingBlock:^(NSManagedObject* managedObject, NSUInteger idx, BOOL *stop) {
+            for (NSManagedObject* managedObject in note.userInfo[key]) {
+                if ([self isCacheOnlyEntity:managedObject.entity]) {
+                    continue;
+                }
+                NSString* entityName = managedObject.entity.name;
                 NSString* objectUID = [managedObject valueForKey:APObjectUIDAttributeName];
-                if (![self isObjectUID:objectUID includedForEntityName:managedObject.entity.name]){
-                    
-                    NSMutableDictionary* relatedEntityEntry = self.mergedObjectsUIDsNestedByEntityName[managedObject.entity.name] ?: [NSMutableDictionary dictionary];
-                    NSArray* mergedObjectUIDs = relatedEntityEntry[key] ?: [NSArray new];
+                
+                NSMutableDictionary* savedEntityEntry = savedObjectsUIDsNestedByEntityName[entityName] ?: [NSMutableDictionary dictionary];
+                NSMutableArray* savedObjectUIDs = savedEntityEntry[key] ?: [NSMutableArray array];
+                [savedObjectUIDs addObject:objectUID];
+                savedEntityEntry[key] = savedObjectUIDs;
+                savedObjectsUIDsNestedByEntityName[entityName] = savedEntityEntry;
+                
+                if (![self isObjectUID:objectUID includedForEntityName:entityName]){
+                    NSMutableSet* entityObjectUIDs = self.mergedObjectUIDsByEntityName[entityName] ?: [NSMutableSet set];
+                    [entityObjectUIDs addObject:objectUID];
+                    self.mergedObjectUIDsByEntityName[entityName] = entityObjectUIDs;
                     
-                    relatedEntityEntry[key] = [mergedObjectUIDs arrayByAddingObject:objectUID];
-                    self.mergedObjectsUIDsNestedByEntityName[managedObject.entity.name] = relatedEntityEntry;
+                    NSMutableDictionary* relatedEntityEntry = self.mergedObjectsUIDsNestedByEntityName[entityName] ?: [NSMutableDictionary dictionary];
+                    NSMutableArray* mergedObjectUIDs = relatedEntityEntry[key] ?: [NSMutableArray array];
+                    [mergedObjectUIDs addObject:objectUID];
+                    relatedEntityEntry[key] = mergedObjectUIDs;
+                    self.mergedObjectsUIDsNestedByEntityName[entityName] = relatedEntityEntry;
                 }
+            }
+        }
+        
+        if (self.mergedChangesBlock && [savedObjectsUIDsNestedByEntityName count] > 0) {
+            [[NSOperationQueue mainQueue]addOperationWithBlock:^{
+                self.mergedChangesBlock(savedObjectsUIDsNestedByEntityName);
             }];
-        }];
+        }
     }];
 }
 
 
 - (BOOL) isObjectUID:(NSString*) objectUID includedForEntityName:(NSString*) entityName {
     
-    NSMutableDictionary* relatedEntityEntry = self.mergedObjectsUIDsNestedByEntityName[entityName];
-    if ([relatedEntityEntry[NSInsertedObjectsKey] containsObject:objectUID]) {
-        return YES;
-    
-    } else if ([relatedEntityEntry[NSUpdatedObjectsKey] containsObject:objectUID]) {
-        return YES;
+    return [self.mergedObjectUIDsByEntityName[entityName] containsObject:objectUID];
+}
+
+
+/*
+ Pushes the worker context changes to self.context and saves it along with the entities sync dates.
+ Must be called from within the worker context queue.
+ */
+- (BOOL) saveWorkerContext:(NSManagedObjectContext*) workerContext
+                     error:(NSError *__autoreleasing*) error {
     
-    } else if ([relatedEntityEntry[NSDeletedObjectsKey] containsObject:objectUID]) {
-        return YES;
+    __block BOOL success = YES;
+    __block NSError* localError = nil;
     
+    if ([workerContext hasChanges] && ![workerContext save:&localError]) {
+        if (AP_DEBUG_ERRORS) {ELog(@"Error saving worker context changes: %@",localError)}
+        if (error) *error = localError;
+        return NO;
     }
-    return NO;
+    
+    [self.context performBlockAndWait:^{
+        if ([self.context hasChanges]) {
+            [self stageSyncState];
+            if (![self.context save:&localError]) {
+                if (AP_DEBUG_ERRORS) {ELog(@"Error saving sync context changes: %@",localError)}
+                success = NO;
+            }
+        }
+    }];
+    
+    if (!success && error) *error = localError;
+    return success;
 }
 
 
@@ -1523,33 +2844,6 @@ static NSUInteger const APParseQueryFetchLimit = 100;
 }
 
 
-- (NSDate*) getParseServerTime: (NSError*__autoreleasing*) error {
-    
-    NSError* localError = nil;
-    NSDate* parseServerTime = [PFCloud callFunction:@"getTime" withParameters:@{} error:&localError];
-    
-    if (localError) {
-        if ([localError.domain isEqualToString:@"Parse"] && localError.code == kPFScriptError) {
-            
-            if ([localError.userInfo[@"error"] isEqualToString:@"function not found"]) {
-                NSString* msg = @"You likely don't have Parse Cloud Code configured properly, add a method named \"getTime\" in order to enable APIncrementalStore to retrieve Parse time. Check https://github.com/flavionegrao/APIncrementalStore to see how to set it up correctly.";
-                [NSException raise:APIncrementalStoreExceptionInconsistency format:@"%@",msg];
-                
-            } else {
-                if (error) *error = localError;
-                return nil;
-            }
-            
-        } else {
-            if (error) *error = localError;
-            return nil;
-        }
-    }
-    
-    return parseServerTime;
-}
-
-
 - (BOOL) isUserAuthenticated:(NSError*__autoreleasing*) error {
     
     if (AP_DEBUG_METHODS) {MLog()}
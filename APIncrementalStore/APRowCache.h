@@ -0,0 +1,78 @@
+/*
+ *
+ * Copyright 2014 Flavio Negrão Torres
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#import <Foundation/Foundation.h>
+
+typedef NS_ENUM(NSUInteger, APRowCacheEvictionPolicy) {
+
+    /// Rows least recently read are evicted first (DEFAULT)
+    APRowCacheEvictionPolicyLeastRecentlyUsed = 0,
+
+    /// Rows are evicted in the same order they were cached
+    APRowCacheEvictionPolicyFirstInFirstOut = 1
+};
+
+
+/**
+ In-memory cache of the values APIncrementalStore hands to Core Data when an object is faulted in, keyed by objectUID.
+
+ Every objectUID has a version which is bumped each time its row is invalidated. Values read from the disk cache
+ are only kept if the version hasn't changed while they were being read, that way a fault racing with a save
+ or a sync merge can't put stale values back in the cache.
+ */
+@interface APRowCache : NSObject
+
+/**
+ Designated Initializer
+ @param costLimit approximate maximum number of bytes kept in memory, 0 disables the cache.
+ @param evictionPolicy which rows are evicted when costLimit is reached.
+ */
+- (instancetype) initWithCostLimit:(NSUInteger) costLimit
+                    evictionPolicy:(APRowCacheEvictionPolicy) evictionPolicy;
+
+@property (nonatomic, readonly) NSUInteger costLimit;
+@property (nonatomic, readonly) APRowCacheEvictionPolicy evictionPolicy;
+
+/// @returns the cached values or nil if they have to be read from the disk cache.
+- (NSDictionary*) valuesForObjectUID:(NSString*) objectUID;
+
+/// Current version of the row, to be passed back to -setValues:forObjectUID:version: once its values have been read.
+- (NSUInteger) versionForObjectUID:(NSString*) objectUID;
+
+/**
+ Caches the values read for objectUID, unless its row has been invalidated since version was obtained.
+ @param values dictionary of property names and values as handed to NSIncrementalStoreNode.
+ */
+- (void) setValues:(NSDictionary*) values
+      forObjectUID:(NSString*) objectUID
+           version:(NSUInteger) version;
+
+/// The objects have changed (saved or merged from the webservice), their rows are discarded and versions bumped.
+- (void) invalidateObjectUIDs:(id<NSFastEnumeration>) objectUIDs;
+
+/// Same as invalidateObjectUIDs: for every object, used when we can't tell which objects have changed.
+- (void) invalidateAllObjects;
+
+/// The objects are no longer registered by any context, there's no point keeping their rows.
+- (void) removeObjectUIDs:(id<NSFastEnumeration>) objectUIDs;
+
+@property (nonatomic, readonly) NSUInteger totalCost;
+@property (nonatomic, readonly) NSUInteger numberOfRows;
+@property (nonatomic, readonly) NSUInteger hits;
+@property (nonatomic, readonly) NSUInteger misses;
+
+@end
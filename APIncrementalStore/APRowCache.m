@@ -0,0 +1,232 @@
+/*
+ *
+ * Copyright 2014 Flavio Negrão Torres
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#import "APRowCache.h"
+
+#import "APBlobData.h"
+
+// Rough per row and per value overhead, we only need the order of magnitude.
+static NSUInteger const APRowCacheRowCost = 64;
+static NSUInteger const APRowCacheValueCost = 16;
+
+// Versions of invalidated objects kept before they are compacted, see -removeObjectUIDs:
+static NSUInteger const APRowCacheMaxNumberOfVersions = 10000;
+
+// Row keys
+static NSString* const APRowCacheValuesKey = @"APRowCacheValuesKey";
+static NSString* const APRowCacheCostKey = @"APRowCacheCostKey";
+
+
+@interface APRowCache ()
+
+@property (nonatomic, assign) NSUInteger costLimit;
+@property (nonatomic, assign) APRowCacheEvictionPolicy evictionPolicy;
+
+/*
+ {objectUID: {APRowCacheValuesKey: values, APRowCacheCostKey: cost}}
+ rowsOrder has the objectUIDs in eviction order, first is evicted first.
+ */
+@property (nonatomic, strong) NSMutableDictionary* rowsByObjectUID;
+@property (nonatomic, strong) NSMutableOrderedSet* rowsOrder;
+
+/*
+ Versions are taken from a single clock, an invalidated objectUID gets the next tick.
+ Invalidating all objects moves minimumVersion instead of touching every entry.
+ */
+@property (nonatomic, strong) NSMutableDictionary* versionsByObjectUID;
+@property (nonatomic, assign) NSUInteger clock;
+@property (nonatomic, assign) NSUInteger minimumVersion;
+
+@property (nonatomic, assign) NSUInteger totalCost;
+@property (nonatomic, assign) NSUInteger hits;
+@property (nonatomic, assign) NSUInteger misses;
+
+@end
+
+
+@implementation APRowCache
+
+- (instancetype) initWithCostLimit:(NSUInteger) costLimit
+                    evictionPolicy:(APRowCacheEvictionPolicy) evictionPolicy {
+
+    self = [super init];
+    if (self) {
+        _costLimit = costLimit;
+        _evictionPolicy = evictionPolicy;
+        _rowsByObjectUID = [NSMutableDictionary dictionary];
+        _rowsOrder = [NSMutableOrderedSet orderedSet];
+        _versionsByObjectUID = [NSMutableDictionary dictionary];
+    }
+    return self;
+}
+
+
+- (NSUInteger) numberOfRows {
+
+    @synchronized(self) {
+        return [self.rowsByObjectUID count];
+    }
+}
+
+
+#pragma mark - Reading
+
+- (NSDictionary*) valuesForObjectUID:(NSString*) objectUID {
+
+    if (!objectUID || self.costLimit == 0) {
+        return nil;
+    }
+
+    @synchronized(self) {
+        NSDictionary* row = self.rowsByObjectUID[objectUID];
+
+        if (!row) {
+            self.misses++;
+            return nil;
+        }
+
+        self.hits++;
+        if (self.evictionPolicy == APRowCacheEvictionPolicyLeastRecentlyUsed) {
+            [self.rowsOrder removeObject:objectUID];
+            [self.rowsOrder addObject:objectUID];
+        }
+        return row[APRowCacheValuesKey];
+    }
+}
+
+
+- (NSUInteger) versionForObjectUID:(NSString*) objectUID {
+
+    @synchronized(self) {
+        return MAX([self.versionsByObjectUID[objectUID] unsignedIntegerValue], self.minimumVersion);
+    }
+}
+
+
+#pragma mark - Writing
+
+- (void) setValues:(NSDictionary*) values
+      forObjectUID:(NSString*) objectUID
+           version:(NSUInteger) version {
+
+    if (!objectUID || !values || self.costLimit == 0) {
+        return;
+    }
+
+    NSUInteger cost = [self costForValues:values];
+    if (cost > self.costLimit) {
+        return;
+    }
+
+    @synchronized(self) {
+        if ([self versionForObjectUID:objectUID] != version) {
+            // Changed while being read
+            return;
+        }
+
+        [self removeRowForObjectUID:objectUID];
+        self.rowsByObjectUID[objectUID] = @{APRowCacheValuesKey: [values copy], APRowCacheCostKey: @(cost)};
+        [self.rowsOrder addObject:objectUID];
+        self.totalCost += cost;
+
+        while (self.totalCost > self.costLimit && [self.rowsOrder count] > 0) {
+            [self removeRowForObjectUID:[self.rowsOrder firstObject]];
+        }
+    }
+}
+
+
+- (void) invalidateObjectUIDs:(id<NSFastEnumeration>) objectUIDs {
+
+    @synchronized(self) {
+        for (NSString* objectUID in objectUIDs) {
+            [self removeRowForObjectUID:objectUID];
+            self.versionsByObjectUID[objectUID] = @(++self.clock);
+        }
+    }
+}
+
+
+- (void) invalidateAllObjects {
+
+    @synchronized(self) {
+        [self.rowsByObjectUID removeAllObjects];
+        [self.rowsOrder removeAllObjects];
+        [self.versionsByObjectUID removeAllObjects];
+        self.totalCost = 0;
+        self.minimumVersion = ++self.clock;
+    }
+}
+
+
+- (void) removeObjectUIDs:(id<NSFastEnumeration>) objectUIDs {
+
+    @synchronized(self) {
+        for (NSString* objectUID in objectUIDs) {
+            [self removeRowForObjectUID:objectUID];
+        }
+
+        /*
+         Versions have to survive their rows as a fault may be reading them right now. Instead of tracking
+         them one by one they are all forgotten at once by moving minimumVersion past them, which only
+         makes the reads in progress be discarded.
+         */
+        if ([self.versionsByObjectUID count] > APRowCacheMaxNumberOfVersions) {
+            [self.versionsByObjectUID removeAllObjects];
+            self.minimumVersion = ++self.clock;
+        }
+    }
+}
+
+
+#pragma mark - Support Methods
+
+// Must be called while synchronized
+- (void) removeRowForObjectUID:(NSString*) objectUID {
+
+    NSDictionary* row = self.rowsByObjectUID[objectUID];
+    if (row) {
+        self.totalCost -= [row[APRowCacheCostKey] unsignedIntegerValue];
+        [self.rowsByObjectUID removeObjectForKey:objectUID];
+        [self.rowsOrder removeObject:objectUID];
+    }
+}
+
+
+- (NSUInteger) costForValues:(NSDictionary*) values {
+
+    __block NSUInteger cost = APRowCacheRowCost;
+
+    [values enumerateKeysAndObjectsUsingBlock:^(id key, id value, BOOL *stop) {
+        cost += APRowCacheValueCost;
+
+        // Only its reference until read, asking for the length would download it.
+        if ([value isKindOfClass:[APBlobData class]]) {
+            cost += [[(APBlobData*) value reference] length];
+
+        } else if ([value isKindOfClass:[NSData class]]) {
+            cost += [(NSData*) value length];
+
+        } else if ([value isKindOfClass:[NSString class]]) {
+            cost += [(NSString*) value length] * sizeof(unichar);
+        }
+    }];
+
+    return cost;
+}
+
+@end
@@ -29,9 +29,51 @@ typedef NS_ENUM(NSInteger, APMergePolicy) {
 /// Default is APMergePolicyServerWins
 @property (nonatomic, assign) APMergePolicy mergePolicy;
 
+/// Number of local objects sent to the webservice per request when pushing local changes. Default is 50, 1 sends one object at a time.
+@property (nonatomic, assign) NSUInteger pushBatchSize;
+
+/// Maximum number of entities pulled from the webservice at the same time. Default is 4, 1 pulls one entity after the other.
+@property (nonatomic, assign) NSUInteger pullConcurrency;
+
+/// Number of remote objects requested per page when pulling remote changes. Default is 1000, limited to what the webservice allows.
+@property (nonatomic, assign) NSUInteger pullPageSize;
+
+/// Number of remote pages fetched ahead while the current page is being merged. Default is 2, minimum is 1.
+@property (nonatomic, assign) NSUInteger pullPrefetchDepth;
+
+/**
+ Objects synced are reported in aggregated events, at most one every progressInterval or every progressObjectCount
+ objects, whichever comes first, plus a last one before syncCompletionBlock. Each event has the number of objects
+ synced since the previous one nested by entity name (ie: {"Book": 120}). Called in the main thread.
+ */
+@property (nonatomic, copy) void (^progressBlock) (NSDictionary* remoteObjectsSyncedByEntityName, NSDictionary* localObjectsSyncedByEntityName);
+
+/// Seconds between progress events. Default is 0.5.
+@property (nonatomic, assign) NSTimeInterval progressInterval;
+
+/// Number of objects synced that triggers a progress event before progressInterval. Default is 500.
+@property (nonatomic, assign) NSUInteger progressObjectCount;
+
+/// Called once per object synced, in the same main thread turn as progressBlock. Kept for compatibility, prefer progressBlock.
 @property (nonatomic, copy) void (^perObjectCompletionBlock) (BOOL isRemote, NSString* entityName);
 
+/**
+ Called in the main thread after each page of remote objects or batch of local objects is saved to the cache,
+ with the objectUIDs saved using the same format as syncCompletionBlock mergedObjectsUIDsNestedByEntityName.
+ An object changed by more than one page is included in each of them.
+ */
+@property (nonatomic, copy) void (^mergedChangesBlock) (NSDictionary* objectUIDsNestedByEntityName);
+
 @property (nonatomic, copy) void (^syncCompletionBlock) (
                                     NSDictionary* mergedObjectsUIDsNestedByEntityName,
                                     NSError* error);
+
+/// Subclasses report the objects synced through this method, from any thread. See progressBlock.
+- (void) reportSyncedObjects:(NSUInteger) numberOfObjects
+                  entityName:(NSString*) entityName
+                    isRemote:(BOOL) isRemote;
+
+/// Delivers the objects reported since the last progress event, subclasses call it before syncCompletionBlock.
+- (void) flushProgress;
+
 @end
@@ -8,6 +8,26 @@
 
 #import "APWebServiceSyncOperation.h"
 
+static NSUInteger const APDefaultPushBatchSize = 50;
+static NSUInteger const APDefaultPullConcurrency = 4;
+static NSUInteger const APDefaultPullPageSize = 1000;
+static NSUInteger const APDefaultPullPrefetchDepth = 2;
+static NSTimeInterval const APDefaultProgressInterval = 0.5;
+static NSUInteger const APDefaultProgressObjectCount = 500;
+
+
+@interface APWebServiceSyncOperation ()
+
+// Objects reported since the last progress event, entity name -> NSNumber. Guarded by progressLock.
+@property (nonatomic, strong) NSMutableDictionary* pendingRemoteObjectsSynced;
+@property (nonatomic, strong) NSMutableDictionary* pendingLocalObjectsSynced;
+@property (nonatomic, assign) NSUInteger pendingNumberOfObjectsSynced;
+@property (nonatomic, assign) CFAbsoluteTime lastProgressTime;
+@property (nonatomic, strong) NSObject* progressLock;
+
+@end
+
+
 @implementation APWebServiceSyncOperation
 
 - (instancetype)initWithMergePolicy:(APMergePolicy) policy {
@@ -15,18 +35,92 @@
     self = [super init];
     if (self) {
         _mergePolicy = policy;
+        _pushBatchSize = APDefaultPushBatchSize;
+        _pullConcurrency = APDefaultPullConcurrency;
+        _pullPageSize = APDefaultPullPageSize;
+        _pullPrefetchDepth = APDefaultPullPrefetchDepth;
+        _progressInterval = APDefaultProgressInterval;
+        _progressObjectCount = APDefaultProgressObjectCount;
+        _pendingRemoteObjectsSynced = [NSMutableDictionary dictionary];
+        _pendingLocalObjectsSynced = [NSMutableDictionary dictionary];
+        _lastProgressTime = CFAbsoluteTimeGetCurrent();
+        _progressLock = [[NSObject alloc]init];
     }
     return self;
 }
 
+
+#pragma mark - Progress
+
+- (void) reportSyncedObjects:(NSUInteger) numberOfObjects
+                  entityName:(NSString*) entityName
+                    isRemote:(BOOL) isRemote {
+    
+    if (numberOfObjects == 0 || !entityName) {
+        return;
+    }
+    
+    BOOL shouldFlush;
+    @synchronized(self.progressLock) {
+        NSMutableDictionary* pending = (isRemote) ? self.pendingRemoteObjectsSynced : self.pendingLocalObjectsSynced;
+        pending[entityName] = @([pending[entityName] unsignedIntegerValue] + numberOfObjects);
+        self.pendingNumberOfObjectsSynced += numberOfObjects;
+        
+        shouldFlush = (self.pendingNumberOfObjectsSynced >= MAX(self.progressObjectCount, 1) ||
+                       CFAbsoluteTimeGetCurrent() - self.lastProgressTime >= self.progressInterval);
+    }
+    
+    if (shouldFlush) {
+        [self flushProgress];
+    }
+}
+
+
+// One main queue block per event no matter how many objects it carries.
+- (void) flushProgress {
+    
+    NSDictionary* remoteObjectsSynced;
+    NSDictionary* localObjectsSynced;
+    
+    @synchronized(self.progressLock) {
+        self.lastProgressTime = CFAbsoluteTimeGetCurrent();
+        if (self.pendingNumberOfObjectsSynced == 0) {
+            return;
+        }
+        remoteObjectsSynced = [self.pendingRemoteObjectsSynced copy];
+        localObjectsSynced = [self.pendingLocalObjectsSynced copy];
+        [self.pendingRemoteObjectsSynced removeAllObjects];
+        [self.pendingLocalObjectsSynced removeAllObjects];
+        self.pendingNumberOfObjectsSynced = 0;
+    }
+    
+    [[NSOperationQueue mainQueue]addOperationWithBlock:^{
+        if (self.progressBlock) self.progressBlock(remoteObjectsSynced,localObjectsSynced);
+        
+        if (self.perObjectCompletionBlock) {
+            [remoteObjectsSynced enumerateKeysAndObjectsUsingBlock:^(NSString* entityName, NSNumber* numberOfObjects, BOOL *stop) {
+                for (NSUInteger idx = 0; idx < [numberOfObjects unsignedIntegerValue]; idx++) self.perObjectCompletionBlock(YES,entityName);
+            }];
+            [localObjectsSynced enumerateKeysAndObjectsUsingBlock:^(NSString* entityName, NSNumber* numberOfObjects, BOOL *stop) {
+                for (NSUInteger idx = 0; idx < [numberOfObjects unsignedIntegerValue]; idx++) self.perObjectCompletionBlock(NO,entityName);
+            }];
+        }
+    }];
+}
+
+
 - (NSString*) debugDescription {
-    NSString* customDescription =  [NSString stringWithFormat:@"%@\n    • isExecuting: %@\n    • isCancelled: %@\n    • isFinished: %@\n    • isReady:%@\n    • Merge Policy: %@\n",
+    NSString* customDescription =  [NSString stringWithFormat:@"%@\n    • isExecuting: %@\n    • isCancelled: %@\n    • isFinished: %@\n    • isReady:%@\n    • Merge Policy: %@\n    • Push Batch Size: %lu\n    • Pull Concurrency: %lu\n    • Pull Page Size: %lu\n    • Pull Prefetch Depth: %lu\n",
                                     self,
                                     [self isExecuting] ? @"👍" : @"👎",
                                     [self isCancelled] ? @"👍" : @"👎",
                                     [self isFinished]  ? @"👍" : @"👎",
                                     [self isReady] ? @"👍" : @"👎",
-                                    (self.mergePolicy == APMergePolicyClientWins) ? @"Client Wins" : @"Server Wins"];
+                                    (self.mergePolicy == APMergePolicyClientWins) ? @"Client Wins" : @"Server Wins",
+                                    (unsigned long)self.pushBatchSize,
+                                    (unsigned long)self.pullConcurrency,
+                                    (unsigned long)self.pullPageSize,
+                                    (unsigned long)self.pullPrefetchDepth];
     return customDescription;
 }
 @end
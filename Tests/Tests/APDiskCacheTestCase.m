@@ -18,6 +18,10 @@
 @import XCTest;
 
 #import "APDiskCache.h"
+#import "APDiskCacheWriter.h"
+#import "APBlobData.h"
+#import "APBlobStore.h"
+#import "APRowCache.h"
 #import "APParseSyncOperation.h"
 
 #import "APCommon.h"
@@ -312,6 +316,605 @@ static NSString* const APTestSqliteFile = @"APTestStore.sqlite";
 }
 
 
+- (void) testFetchObjectIdentitiesHonorsLimitAndOffset {
+    
+    NSError* error;
+    NSArray* representations = @[[self representationFromManagedObject:[self managedObjectBook1]],[self representationFromManagedObject:[self managedObjectBook2]]];
+    [self.localCache insertObjectRepresentations:representations error:&error];
+    XCTAssertNil(error);
+    
+    NSFetchRequest* fr = [NSFetchRequest fetchRequestWithEntityName:@"Book"];
+    fr.sortDescriptors = @[[NSSortDescriptor sortDescriptorWithKey:@"name" ascending:YES]];
+    fr.fetchLimit = 1;
+    fr.fetchOffset = 1;
+    
+    NSArray* identities = [self.localCache fetchObjectIdentities:fr requestContext:self.testContext error:&error];
+    XCTAssertNil(error);
+    XCTAssertTrue([identities count] == 1);
+    XCTAssertEqualObjects([identities lastObject], (@{APObjectUIDAttributeName: kBookObjectUIDLocal2, APObjectEntityNameAttributeName: @"Book"}));
+}
+
+
+- (void) testFetchRepresentationsWithRelationshipsForResultSet {
+    
+    NSError* error;
+    Book* book1 = [self managedObjectBook1];
+    Book* book2 = [self managedObjectBook2];
+    Author* author = [self managedObjectAuthor];
+    [author addBooksObject:book1];
+    [author addBooksObject:book2];
+    
+    NSArray* representations = @[[self representationFromManagedObject:book1],[self representationFromManagedObject:book2],[self representationFromManagedObject:author]];
+    [self.localCache insertObjectRepresentations:representations error:&error];
+    XCTAssertNil(error);
+    
+    NSArray* fetchedBooks = [self.localCache fetchObjectRepresentations:[NSFetchRequest fetchRequestWithEntityName:@"Book"] requestContext:self.testContext error:&error];
+    XCTAssertNil(error);
+    XCTAssertTrue([fetchedBooks count] == 2);
+    for (NSDictionary* fetchedBook in fetchedBooks) {
+        XCTAssertEqualObjects(fetchedBook[@"author"], @{@"Author": kAuthorObjectUIDLocal});
+    }
+    
+    NSDictionary* fetchedAuthor = [[self.localCache fetchObjectRepresentations:[NSFetchRequest fetchRequestWithEntityName:@"Author"] requestContext:self.testContext error:&error] lastObject];
+    XCTAssertEqualObjects([NSSet setWithArray:fetchedAuthor[@"books"][@"Book"]], ([NSSet setWithObjects:kBookObjectUIDLocal1,kBookObjectUIDLocal2,nil]));
+}
+
+
+- (void) testFetchDictionaryGroupedByRelationship {
+    
+    NSError* error;
+    Book* book1 = [self managedObjectBook1];
+    Book* book2 = [self managedObjectBook2];
+    Author* author = [self managedObjectAuthor];
+    [author addBooksObject:book1];
+    [author addBooksObject:book2];
+    
+    NSArray* representations = @[[self representationFromManagedObject:book1],[self representationFromManagedObject:book2],[self representationFromManagedObject:author]];
+    [self.localCache insertObjectRepresentations:representations error:&error];
+    XCTAssertNil(error);
+    
+    NSExpressionDescription* countDescription = [[NSExpressionDescription alloc]init];
+    countDescription.name = @"numberOfBooks";
+    countDescription.expression = [NSExpression expressionForFunction:@"count:" arguments:@[[NSExpression expressionForKeyPath:@"name"]]];
+    countDescription.expressionResultType = NSInteger64AttributeType;
+    
+    NSFetchRequest* fr = [NSFetchRequest fetchRequestWithEntityName:@"Book"];
+    fr.resultType = NSDictionaryResultType;
+    fr.propertiesToFetch = @[@"author",countDescription];
+    fr.propertiesToGroupBy = @[@"author"];
+    fr.havingPredicate = [NSPredicate predicateWithFormat:@"$numberOfBooks > 1"];
+    
+    NSArray* results = [self.localCache fetchDictionaryRepresentations:fr requestContext:self.testContext error:&error];
+    XCTAssertNil(error);
+    XCTAssertTrue([results count] == 1);
+    XCTAssertEqualObjects([results lastObject][@"author"], @{@"Author": kAuthorObjectUIDLocal});
+    XCTAssertEqualObjects([results lastObject][@"numberOfBooks"], @2);
+}
+
+
+- (void) testFetchRelatedObjectUIDsForRelationship {
+    
+    NSError* error;
+    Book* book1 = [self managedObjectBook1];
+    Book* book2 = [self managedObjectBook2];
+    Author* author = [self managedObjectAuthor];
+    [author addBooksObject:book1];
+    [author addBooksObject:book2];
+    
+    NSArray* representations = @[[self representationFromManagedObject:book1],[self representationFromManagedObject:book2],[self representationFromManagedObject:author]];
+    [self.localCache insertObjectRepresentations:representations error:&error];
+    XCTAssertNil(error);
+    
+    NSRelationshipDescription* booksRelationship = [[self testModel].entitiesByName[@"Author"] relationshipsByName][@"books"];
+    NSDictionary* relatedBooks = [self.localCache fetchRelatedObjectUIDsForRelationship:booksRelationship objectUID:kAuthorObjectUIDLocal entityName:@"Author" requestContext:self.testContext error:&error];
+    XCTAssertNil(error);
+    XCTAssertEqualObjects([NSSet setWithArray:relatedBooks[@"Book"]], ([NSSet setWithObjects:kBookObjectUIDLocal1,kBookObjectUIDLocal2,nil]));
+    
+    NSRelationshipDescription* authorRelationship = [[self testModel].entitiesByName[@"Book"] relationshipsByName][@"author"];
+    NSDictionary* relatedAuthor = [self.localCache fetchRelatedObjectUIDsForRelationship:authorRelationship objectUID:kBookObjectUIDLocal1 entityName:@"Book" requestContext:self.testContext error:&error];
+    XCTAssertNil(error);
+    XCTAssertEqualObjects(relatedAuthor, @{@"Author": @[kAuthorObjectUIDLocal]});
+    
+    // Unknown object
+    XCTAssertNil([self.localCache fetchRelatedObjectUIDsForRelationship:authorRelationship objectUID:kBookObjectUIDLocal3 entityName:@"Book" requestContext:self.testContext error:&error]);
+}
+
+
+- (void) testSaveInsertsUpdatesAndDeletesAtOnce {
+    
+    NSError* error;
+    Book* book1 = [self managedObjectBook1];
+    Book* book2 = [self managedObjectBook2];
+    [self.localCache insertObjectRepresentations:@[[self representationFromManagedObject:book1],[self representationFromManagedObject:book2]] error:&error];
+    XCTAssertNil(error);
+    
+    Author* author = [self managedObjectAuthor];
+    [author addBooksObject:book1];
+    book1.name = kBookNameLocal3;
+    
+    BOOL success = [self.localCache saveInsertedObjectRepresentations:@[[self representationFromManagedObject:author]]
+                                         updatedObjectRepresentations:@[[self representationFromManagedObject:book1]]
+                                         deletedObjectRepresentations:@[[self representationFromManagedObject:book2]]
+                                                                error:&error];
+    XCTAssertTrue(success);
+    XCTAssertNil(error);
+    
+    NSDictionary* fetchedBook1 = [self.localCache fetchObjectRepresentationForObjectUID:kBookObjectUIDLocal1 requestContext:self.testContext entityName:@"Book"];
+    XCTAssertEqualObjects(fetchedBook1[@"name"], kBookNameLocal3);
+    XCTAssertEqualObjects(fetchedBook1[@"author"], @{@"Author": kAuthorObjectUIDLocal});
+    XCTAssertNil([self.localCache fetchObjectRepresentationForObjectUID:kBookObjectUIDLocal2 requestContext:self.testContext entityName:@"Book"]);
+}
+
+
+- (void) testSaveAppendsOneOutboxEntryPerChangedObject {
+    
+    NSError* error;
+    Book* book1 = [self managedObjectBook1];
+    Book* book2 = [self managedObjectBook2];
+    [self.localCache insertObjectRepresentations:@[[self representationFromManagedObject:book1],[self representationFromManagedObject:book2]] error:&error];
+    XCTAssertNil(error);
+    
+    book1.name = kBookNameLocal3;
+    [self.localCache saveInsertedObjectRepresentations:@[[self representationFromManagedObject:[self managedObjectAuthor]]]
+                          updatedObjectRepresentations:@[[self representationFromManagedObject:book1]]
+                          deletedObjectRepresentations:@[[self representationFromManagedObject:book2]]
+                                                 error:&error];
+    XCTAssertNil(error);
+    XCTAssertTrue([self.localCache flush:&error]);
+    
+    // Reading the cache store the same way the sync operation does
+    NSPersistentStoreCoordinator* psc = [[NSPersistentStoreCoordinator alloc]initWithManagedObjectModel:[self testModel]];
+    [psc addPersistentStoreWithType:NSSQLiteStoreType configuration:nil URL:[NSURL fileURLWithPath:[self.localCache pathToLocalStore]] options:nil error:&error];
+    XCTAssertNil(error);
+    NSManagedObjectContext* context = [[NSManagedObjectContext alloc]initWithConcurrencyType:NSPrivateQueueConcurrencyType];
+    context.persistentStoreCoordinator = psc;
+    
+    __block NSArray* outboxEntries;
+    [context performBlockAndWait:^{
+        NSFetchRequest* fr = [NSFetchRequest fetchRequestWithEntityName:APOutboxEntityName];
+        fr.sortDescriptors = @[[NSSortDescriptor sortDescriptorWithKey:APOutboxSequenceAttributeName ascending:YES]];
+        outboxEntries = [context executeFetchRequest:fr error:nil];
+    }];
+    
+    // Inserted, updated and deleted, in the order they were saved
+    NSArray* expectedObjectUIDs = @[kBookObjectUIDLocal1,kBookObjectUIDLocal2,kAuthorObjectUIDLocal,kBookObjectUIDLocal1,kBookObjectUIDLocal2];
+    XCTAssertEqualObjects([outboxEntries valueForKey:APObjectUIDAttributeName], expectedObjectUIDs);
+    
+    int64_t previousSequence = 0;
+    for (NSManagedObject* entry in outboxEntries) {
+        XCTAssertTrue([[entry valueForKey:APOutboxSequenceAttributeName] longLongValue] > previousSequence);
+        previousSequence = [[entry valueForKey:APOutboxSequenceAttributeName] longLongValue];
+    }
+}
+
+
+- (void) testWriterCoalescesSavesUntilFlushed {
+    
+    NSError* error;
+    self.localCache.writeCoalescingInterval = 60;
+    NSUInteger transactionsBefore = self.localCache.writer.numberOfTransactions;
+    
+    [self.localCache insertObjectRepresentations:@[[self representationFromManagedObject:[self managedObjectBook1]]] error:&error];
+    [self.localCache insertObjectRepresentations:@[[self representationFromManagedObject:[self managedObjectBook2]]] error:&error];
+    [self.localCache insertObjectRepresentations:@[[self representationFromManagedObject:[self managedObjectAuthor]]] error:&error];
+    XCTAssertNil(error);
+    XCTAssertTrue(self.localCache.writer.queueDepth == 3);
+    XCTAssertTrue(self.localCache.writer.numberOfTransactions == transactionsBefore);
+    
+    // Pending writes are readable before being durable
+    NSFetchRequest* fr = [NSFetchRequest fetchRequestWithEntityName:@"Book"];
+    XCTAssertTrue([self.localCache countObjectRepresentations:fr requestContext:self.testContext error:&error] == 2);
+    
+    XCTAssertTrue([self.localCache flush:&error]);
+    XCTAssertNil(error);
+    XCTAssertTrue(self.localCache.writer.queueDepth == 0);
+    XCTAssertTrue(self.localCache.writer.numberOfTransactions == transactionsBefore + 1);
+    XCTAssertTrue(self.localCache.writer.lastDurabilityLatency >= 0);
+}
+
+
+- (void) testWriterRetriesFailedWrites {
+    
+    NSError* error;
+    
+    // A required attribute left empty makes the save fail validation
+    NSEntityDescription* entity = [[NSEntityDescription alloc]init];
+    entity.name = @"Note";
+    NSAttributeDescription* text = [[NSAttributeDescription alloc]init];
+    text.name = @"text";
+    text.attributeType = NSStringAttributeType;
+    text.optional = NO;
+    entity.properties = @[text];
+    NSManagedObjectModel* model = [[NSManagedObjectModel alloc]init];
+    model.entities = @[entity];
+    
+    NSPersistentStoreCoordinator* psc = [[NSPersistentStoreCoordinator alloc]initWithManagedObjectModel:model];
+    XCTAssertNotNil([psc addPersistentStoreWithType:NSInMemoryStoreType configuration:nil URL:nil options:nil error:&error]);
+    NSManagedObjectContext* context = [[NSManagedObjectContext alloc]initWithConcurrencyType:NSPrivateQueueConcurrencyType];
+    context.persistentStoreCoordinator = psc;
+    APDiskCacheWriter* writer = [[APDiskCacheWriter alloc]initWithContext:context coalescingInterval:60];
+    
+    __block NSManagedObject* note;
+    [context performBlockAndWait:^{
+        note = [NSEntityDescription insertNewObjectForEntityForName:@"Note" inManagedObjectContext:context];
+    }];
+    [writer scheduleWrite];
+    XCTAssertFalse([writer flush:&error]);
+    XCTAssertNotNil(error);
+    XCTAssertTrue(writer.queueDepth == 1);
+    XCTAssertTrue(writer.numberOfTransactions == 0);
+    
+    // Still pending, the next flush writes it
+    [context performBlockAndWait:^{
+        [note setValue:@"Fixed" forKey:@"text"];
+    }];
+    error = nil;
+    XCTAssertTrue([writer flush:&error]);
+    XCTAssertNil(error);
+    XCTAssertTrue(writer.queueDepth == 0);
+    XCTAssertTrue(writer.numberOfTransactions == 1);
+    
+    // Nothing left from the failed write
+    XCTAssertTrue([writer flush:&error]);
+    XCTAssertNil(error);
+}
+
+
+- (void) testBinaryAttributesAreStoredOnceInTheBlobStore {
+    
+    NSError* error;
+    NSData* picture = [@"A picture shared by both books" dataUsingEncoding:NSUTF8StringEncoding];
+    Book* book1 = [self managedObjectBook1];
+    Book* book2 = [self managedObjectBook2];
+    book1.picture = picture;
+    book2.picture = picture;
+    
+    [self.localCache insertObjectRepresentations:@[[self representationFromManagedObject:book1],[self representationFromManagedObject:book2]] error:&error];
+    XCTAssertNil(error);
+    
+    NSDictionary* fetchedBook1Representation = [self.localCache fetchObjectRepresentationForObjectUID:kBookObjectUIDLocal1 requestContext:self.testContext entityName:@"Book"];
+    NSDictionary* fetchedBook2Representation = [self.localCache fetchObjectRepresentationForObjectUID:kBookObjectUIDLocal2 requestContext:self.testContext entityName:@"Book"];
+    XCTAssertEqualObjects(fetchedBook1Representation[@"picture"], picture);
+    XCTAssertEqualObjects(fetchedBook2Representation[@"picture"], picture);
+    
+    NSUInteger numberOfBlobs = 0;
+    NSDirectoryEnumerator* enumerator = [[NSFileManager defaultManager] enumeratorAtPath:self.localCache.blobStore.directoryPath];
+    for (NSString* path in enumerator) {
+        if ([[enumerator fileAttributes][NSFileType] isEqualToString:NSFileTypeRegular] && [[path lastPathComponent] isEqualToString:[APBlobStore digestForData:picture]]) {
+            numberOfBlobs++;
+        }
+    }
+    XCTAssertTrue(numberOfBlobs == 1);
+    
+    NSData* reference = [self.localCache.blobStore referenceForData:picture error:&error];
+    XCTAssertTrue([APBlobStore isReference:reference]);
+    XCTAssertFalse([APBlobStore isReference:picture]);
+    XCTAssertEqualObjects([self.localCache.blobStore dataForReference:reference error:&error], picture);
+}
+
+
+- (void) testUnreferencedBlobsAreRemoved {
+    
+    NSError* error;
+    NSData* picture1 = [@"A picture kept" dataUsingEncoding:NSUTF8StringEncoding];
+    NSData* picture2 = [@"A picture deleted along with its book" dataUsingEncoding:NSUTF8StringEncoding];
+    Book* book1 = [self managedObjectBook1];
+    Book* book2 = [self managedObjectBook2];
+    book1.picture = picture1;
+    book2.picture = picture2;
+    
+    [self.localCache insertObjectRepresentations:@[[self representationFromManagedObject:book1],[self representationFromManagedObject:book2]] error:&error];
+    XCTAssertNil(error);
+    NSData* reference1 = [self.localCache.blobStore referenceForData:picture1 error:&error];
+    NSData* reference2 = [self.localCache.blobStore referenceForData:picture2 error:&error];
+    
+    NSDictionary* fetchedBook2Representation = [self.localCache fetchObjectRepresentationForObjectUID:kBookObjectUIDLocal2 requestContext:self.testContext entityName:@"Book"];
+    [self.localCache deleteObjectRepresentations:@[fetchedBook2Representation] error:&error];
+    XCTAssertNil(error);
+    
+    // Blobs handed out just now may not have been saved yet, they are kept until the next collection
+    XCTAssertTrue([self.localCache removeUnreferencedBlobs:&error]);
+    XCTAssertNil(error);
+    XCTAssertTrue([self.localCache.blobStore hasDataForReference:reference2]);
+    
+    XCTAssertTrue([self.localCache removeUnreferencedBlobs:&error]);
+    XCTAssertNil(error);
+    XCTAssertTrue([self.localCache.blobStore hasDataForReference:reference1]);
+    XCTAssertFalse([self.localCache.blobStore hasDataForReference:reference2]);
+    
+    NSDictionary* fetchedBook1Representation = [self.localCache fetchObjectRepresentationForObjectUID:kBookObjectUIDLocal1 requestContext:self.testContext entityName:@"Book"];
+    XCTAssertEqualObjects(fetchedBook1Representation[@"picture"], picture1);
+}
+
+
+/*
+ Scenario:
+ - A save writes a blob while a collection is marking, its reference isn't in the store yet.
+ 
+ Expected Results:
+ - The sweep keeps it and so does the next one, the save may still be in flight.
+ - It is removed by the collection after that, nothing has saved it.
+ */
+- (void) testBlobsOfSavesInFlightAreKept {
+    
+    NSError* error;
+    APBlobStore* blobStore = self.localCache.blobStore;
+    [blobStore beginCollection];
+    NSData* reference = [blobStore referenceForData:[@"A picture being saved" dataUsingEncoding:NSUTF8StringEncoding] error:&error];
+    XCTAssertTrue([blobStore removeBlobsNotInReferences:[NSSet set] error:&error]);
+    XCTAssertNil(error);
+    XCTAssertTrue([blobStore hasDataForReference:reference]);
+    
+    [blobStore beginCollection];
+    XCTAssertTrue([blobStore removeBlobsNotInReferences:[NSSet set] error:&error]);
+    XCTAssertTrue([blobStore hasDataForReference:reference]);
+    
+    [blobStore beginCollection];
+    XCTAssertTrue([blobStore removeBlobsNotInReferences:[NSSet set] error:&error]);
+    XCTAssertFalse([blobStore hasDataForReference:reference]);
+}
+
+
+- (void) testRemoteFilesAreDownloadedWhenRead {
+    
+    NSError* error;
+    NSData* picture = [@"A picture not downloaded yet" dataUsingEncoding:NSUTF8StringEncoding];
+    NSString* path = [NSTemporaryDirectory() stringByAppendingPathComponent:@"APBlobStoreRemotePicture"];
+    [picture writeToFile:path atomically:YES];
+    NSData* reference = [self.localCache.blobStore referenceForRemoteFileURL:[[NSURL fileURLWithPath:path] absoluteString]];
+    XCTAssertTrue([APBlobStore isRemoteReference:reference]);
+    XCTAssertFalse([self.localCache.blobStore hasDataForReference:reference]);
+    unsigned long long downloadedSizeBefore = self.localCache.blobStore.downloadedSize;
+    
+    NSMutableDictionary* representation = [[self representationFromManagedObject:[self managedObjectBook1]] mutableCopy];
+    representation[@"picture"] = reference;
+    [self.localCache insertObjectRepresentations:@[representation] error:&error];
+    XCTAssertNil(error);
+    XCTAssertFalse([self.localCache.blobStore hasDataForReference:reference]);
+    
+    // Fetching doesn't download it, reading does
+    NSDictionary* fetchedBook1Representation = [self.localCache fetchObjectRepresentationForObjectUID:kBookObjectUIDLocal1 requestContext:self.testContext entityName:@"Book"];
+    XCTAssertTrue([fetchedBook1Representation[@"picture"] isKindOfClass:[APBlobData class]]);
+    XCTAssertFalse([self.localCache.blobStore hasDataForReference:reference]);
+    XCTAssertEqualObjects(fetchedBook1Representation[@"picture"], picture);
+    XCTAssertTrue([fetchedBook1Representation[@"picture"] isLoaded]);
+    XCTAssertTrue([self.localCache.blobStore hasDataForReference:reference]);
+    XCTAssertTrue(self.localCache.blobStore.downloadedSize == downloadedSizeBefore + [picture length]);
+    XCTAssertEqualObjects([self.localCache.blobStore remoteFileNameForDigest:[APBlobStore digestForData:picture]], @"APBlobStoreRemotePicture");
+    
+    [[NSFileManager defaultManager] removeItemAtPath:path error:nil];
+}
+
+
+- (void) testSavingObjectWhoseDownloadFailedKeepsItsFile {
+    
+    NSError* error;
+    NSString* path = [NSTemporaryDirectory() stringByAppendingPathComponent:@"APBlobStoreMissingPicture"];
+    [[NSFileManager defaultManager] removeItemAtPath:path error:nil];
+    NSData* reference = [self.localCache.blobStore referenceForRemoteFileURL:[[NSURL fileURLWithPath:path] absoluteString]];
+    
+    NSMutableDictionary* representation = [[self representationFromManagedObject:[self managedObjectBook1]] mutableCopy];
+    representation[@"picture"] = reference;
+    [self.localCache insertObjectRepresentations:@[representation] error:&error];
+    XCTAssertNil(error);
+    
+    NSMutableDictionary* fetchedBook1Representation = [[self.localCache fetchObjectRepresentationForObjectUID:kBookObjectUIDLocal1 requestContext:self.testContext entityName:@"Book"] mutableCopy];
+    APBlobData* picture = fetchedBook1Representation[@"picture"];
+    XCTAssertTrue([picture isKindOfClass:[APBlobData class]]);
+    XCTAssertFalse([picture load:&error]);
+    XCTAssertNotNil(error);
+    XCTAssertEqualObjects(picture.loadingError, error);
+    XCTAssertTrue([picture length] == 0);
+    
+    // Saved along with another change, the cache still points to the remote file
+    error = nil;
+    fetchedBook1Representation[@"name"] = @"Renamed";
+    [self.localCache updateObjectRepresentations:@[fetchedBook1Representation] error:&error];
+    XCTAssertNil(error);
+    
+    NSDictionary* refetchedBook1Representation = [self.localCache fetchObjectRepresentationForObjectUID:kBookObjectUIDLocal1 requestContext:self.testContext entityName:@"Book"];
+    XCTAssertEqualObjects(refetchedBook1Representation[@"name"], @"Renamed");
+    XCTAssertTrue([refetchedBook1Representation[@"picture"] isKindOfClass:[APBlobData class]]);
+    XCTAssertEqualObjects([refetchedBook1Representation[@"picture"] reference], reference);
+}
+
+
+#pragma mark - Tests - Predicate Translation
+
+- (void) testPredicateTemplatesAreReusedWithTheirOwnConstants {
+    
+    NSError* error;
+    NSArray* representations = @[[self representationFromManagedObject:[self managedObjectBook1]],[self representationFromManagedObject:[self managedObjectBook2]]];
+    [self.localCache insertObjectRepresentations:representations error:&error];
+    XCTAssertNil(error);
+    
+    NSFetchRequest* fr = [NSFetchRequest fetchRequestWithEntityName:@"Book"];
+    fr.predicate = [NSPredicate predicateWithFormat:@"name == %@",kBookNameLocal1];
+    NSArray* books = [self.localCache fetchObjectRepresentations:fr requestContext:self.testContext error:&error];
+    XCTAssertNil(error);
+    XCTAssertEqualObjects([books lastObject][APObjectUIDAttributeName], kBookObjectUIDLocal1);
+    
+    NSUInteger missesBefore = self.localCache.predicateTemplateMisses;
+    NSUInteger hitsBefore = self.localCache.predicateTemplateHits;
+    
+    fr.predicate = [NSPredicate predicateWithFormat:@"name == %@",kBookNameLocal2];
+    books = [self.localCache fetchObjectRepresentations:fr requestContext:self.testContext error:&error];
+    XCTAssertNil(error);
+    XCTAssertTrue([books count] == 1);
+    XCTAssertEqualObjects([books lastObject][APObjectUIDAttributeName], kBookObjectUIDLocal2);
+    XCTAssertTrue(self.localCache.predicateTemplateMisses == missesBefore);
+    XCTAssertTrue(self.localCache.predicateTemplateHits > hitsBefore);
+    
+    // nil is part of the structure
+    fr.predicate = [NSPredicate predicateWithFormat:@"name == nil"];
+    XCTAssertTrue([self.localCache countObjectRepresentations:fr requestContext:self.testContext error:&error] == 0);
+    XCTAssertNil(error);
+}
+
+
+- (void) testPredicateTranslationPerformance {
+    
+    NSFetchRequest* fr = [NSFetchRequest fetchRequestWithEntityName:@"Book"];
+    
+    [self measureBlock:^{
+        for (NSUInteger i = 0; i < 1000; i++) {
+            NSError* error;
+            fr.predicate = [NSPredicate predicateWithFormat:@"name == %@ OR (name BEGINSWITH %@ AND name != nil)",kBookNameLocal1,[@(i) stringValue]];
+            [self.localCache countObjectRepresentations:fr requestContext:self.testContext error:&error];
+        }
+    }];
+}
+
+
+#pragma mark - Tests - ObjectID Index
+
+- (void) testObjectIDIndexServesRepeatedLookups {
+
+    NSError* error;
+    Book* book1 = [self managedObjectBook1];
+    Book* book2 = [self managedObjectBook2];
+    Author* author = [self managedObjectAuthor];
+    [author addBooksObject:book1];
+    [author addBooksObject:book2];
+
+    NSArray* booksRepresentations = @[[self representationFromManagedObject:book1],[self representationFromManagedObject:book2]];
+    [self.localCache insertObjectRepresentations:booksRepresentations error:&error];
+    XCTAssertNil(error);
+
+    // Related books were inserted before and must be found without going to the store
+    NSUInteger hitsBeforeAuthor = self.localCache.objectIDIndexHits;
+    [self.localCache insertObjectRepresentations:@[[self representationFromManagedObject:author]] error:&error];
+    XCTAssertNil(error);
+    XCTAssertTrue(self.localCache.objectIDIndexHits >= hitsBeforeAuthor + 2);
+
+    NSMutableDictionary* fetchedBook1Representation = [[self.localCache fetchObjectRepresentationForObjectUID:kBookObjectUIDLocal1 requestContext:self.testContext entityName:@"Book"]mutableCopy];
+    XCTAssertNotNil(fetchedBook1Representation);
+
+    // Deleted objects must be evicted from the index
+    [self.localCache deleteObjectRepresentations:@[fetchedBook1Representation] error:&error];
+    XCTAssertNil(error);
+
+    NSUInteger missesBeforeInsert = self.localCache.objectIDIndexMisses;
+    [self.localCache insertObjectRepresentations:@[[self representationFromManagedObject:book1]] error:&error];
+    XCTAssertNil(error);
+    XCTAssertTrue(self.localCache.objectIDIndexMisses > missesBeforeInsert);
+    XCTAssertNotNil([self.localCache fetchObjectRepresentationForObjectUID:kBookObjectUIDLocal1 requestContext:self.testContext entityName:@"Book"]);
+}
+
+
+#pragma mark - Tests - Row Cache
+
+- (void) testRowCacheEvictsLeastRecentlyUsedRows {
+
+    // Each row costs a bit more than 100 bytes, there's room for two of them.
+    NSDictionary* values = @{@"name": kBookNameLocal1};
+    APRowCache* rowCache = [[APRowCache alloc]initWithCostLimit:300 evictionPolicy:APRowCacheEvictionPolicyLeastRecentlyUsed];
+    XCTAssertNil([rowCache valuesForObjectUID:kBookObjectUIDLocal1]);
+
+    [rowCache setValues:values forObjectUID:kBookObjectUIDLocal1 version:[rowCache versionForObjectUID:kBookObjectUIDLocal1]];
+    [rowCache setValues:values forObjectUID:kBookObjectUIDLocal2 version:[rowCache versionForObjectUID:kBookObjectUIDLocal2]];
+    XCTAssertEqualObjects([rowCache valuesForObjectUID:kBookObjectUIDLocal1], values);
+
+    [rowCache setValues:values forObjectUID:kBookObjectUIDLocal3 version:[rowCache versionForObjectUID:kBookObjectUIDLocal3]];
+    XCTAssertNotNil([rowCache valuesForObjectUID:kBookObjectUIDLocal1]);
+    XCTAssertNil([rowCache valuesForObjectUID:kBookObjectUIDLocal2]);
+    XCTAssertNotNil([rowCache valuesForObjectUID:kBookObjectUIDLocal3]);
+    XCTAssertTrue(rowCache.totalCost <= rowCache.costLimit);
+}
+
+
+- (void) testRowCacheDiscardsValuesReadBeforeInvalidation {
+
+    APRowCache* rowCache = [[APRowCache alloc]initWithCostLimit:1024 evictionPolicy:APRowCacheEvictionPolicyFirstInFirstOut];
+
+    // A fault starts reading, meanwhile the object is saved.
+    NSUInteger version = [rowCache versionForObjectUID:kBookObjectUIDLocal1];
+    [rowCache invalidateObjectUIDs:@[kBookObjectUIDLocal1]];
+    [rowCache setValues:@{@"name": kBookNameLocal1} forObjectUID:kBookObjectUIDLocal1 version:version];
+    XCTAssertNil([rowCache valuesForObjectUID:kBookObjectUIDLocal1]);
+
+    version = [rowCache versionForObjectUID:kBookObjectUIDLocal1];
+    [rowCache setValues:@{@"name": kBookNameLocal2} forObjectUID:kBookObjectUIDLocal1 version:version];
+    XCTAssertEqualObjects([rowCache valuesForObjectUID:kBookObjectUIDLocal1][@"name"], kBookNameLocal2);
+
+    // Same after a sync we can't tell which objects it has changed
+    version = [rowCache versionForObjectUID:kBookObjectUIDLocal2];
+    [rowCache invalidateAllObjects];
+    XCTAssertNil([rowCache valuesForObjectUID:kBookObjectUIDLocal1]);
+    [rowCache setValues:@{@"name": kBookNameLocal1} forObjectUID:kBookObjectUIDLocal2 version:version];
+    XCTAssertNil([rowCache valuesForObjectUID:kBookObjectUIDLocal2]);
+
+    // Objects no longer registered
+    version = [rowCache versionForObjectUID:kBookObjectUIDLocal1];
+    [rowCache setValues:@{@"name": kBookNameLocal1} forObjectUID:kBookObjectUIDLocal1 version:version];
+    [rowCache removeObjectUIDs:@[kBookObjectUIDLocal1]];
+    XCTAssertTrue(rowCache.numberOfRows == 0);
+    XCTAssertTrue(rowCache.totalCost == 0);
+}
+
+
+#pragma mark - Tests - Migration
+
+- (void) testCacheStoreOfPreviousVersionIsMigrated {
+    
+    NSError* error = nil;
+    NSString* localSQLiteFileName = [NSString stringWithFormat:@"%@%@",APCacheSqliteFile,[@(arc4random()) stringValue]];
+    NSString* documentsDirectory = [[self.localCache pathToLocalStore] stringByDeletingLastPathComponent];
+    NSURL* storeURL = [NSURL fileURLWithPath:[documentsDirectory stringByAppendingPathComponent:localSQLiteFileName]];
+    
+    // A book saved and not yet synced by 0.4.2
+    NSManagedObjectModel* previousModel = [self previousTestModel];
+    NSPersistentStoreCoordinator* previousPSC = [[NSPersistentStoreCoordinator alloc]initWithManagedObjectModel:previousModel];
+    [previousPSC addPersistentStoreWithType:NSSQLiteStoreType configuration:nil URL:storeURL options:nil error:&error];
+    XCTAssertNil(error);
+    NSManagedObjectContext* previousContext = [[NSManagedObjectContext alloc]initWithConcurrencyType:NSPrivateQueueConcurrencyType];
+    previousContext.persistentStoreCoordinator = previousPSC;
+    [previousContext performBlockAndWait:^{
+        NSManagedObject* book = [NSEntityDescription insertNewObjectForEntityForName:@"Book" inManagedObjectContext:previousContext];
+        [book setValue:kBookObjectUIDLocal1 forKey:APObjectUIDAttributeName];
+        [book setValue:kBookNameLocal1 forKey:@"name"];
+        [book setValue:@YES forKey:APObjectIsDirtyAttributeName];
+        NSError* savingError = nil;
+        XCTAssertTrue([previousContext save:&savingError]);
+        XCTAssertNil(savingError);
+    }];
+    XCTAssertTrue([previousPSC removePersistentStore:[previousPSC.persistentStores firstObject] error:&error]);
+    
+    // Automatic migration can't find the model it was created with
+    NSDictionary* automaticMigrationOptions = @{NSMigratePersistentStoresAutomaticallyOption: @YES,
+                                                NSInferMappingModelAutomaticallyOption: @YES};
+    NSPersistentStoreCoordinator* automaticMigrationPSC = [[NSPersistentStoreCoordinator alloc]initWithManagedObjectModel:[self testModel]];
+    XCTAssertNil([automaticMigrationPSC addPersistentStoreWithType:NSSQLiteStoreType configuration:nil URL:storeURL options:automaticMigrationOptions error:nil]);
+    
+    APDiskCache* cache = [[APDiskCache alloc]initWithManagedModel:[self testModel]
+                                            previousManagedModels:@[previousModel]
+                                        translateToObjectUIDBlock:^NSString* (NSManagedObjectID* objectID) {return nil;}
+                                               localStoreFileName:localSQLiteFileName];
+    XCTAssertNotNil(cache);
+    
+    NSDictionary* bookRepresentation = [cache fetchObjectRepresentationForObjectUID:kBookObjectUIDLocal1 requestContext:self.testContext entityName:@"Book"];
+    XCTAssertEqualObjects(bookRepresentation[@"name"], kBookNameLocal1);
+    
+    // Opened as a store of the current version, with the book still to be synced
+    NSPersistentStoreCoordinator* psc = [[NSPersistentStoreCoordinator alloc]initWithManagedObjectModel:[self testModel]];
+    [psc addPersistentStoreWithType:NSSQLiteStoreType configuration:nil URL:storeURL options:nil error:&error];
+    XCTAssertNil(error);
+    NSManagedObjectContext* context = [[NSManagedObjectContext alloc]initWithConcurrencyType:NSPrivateQueueConcurrencyType];
+    context.persistentStoreCoordinator = psc;
+    
+    [context performBlockAndWait:^{
+        NSFetchRequest* fr = [NSFetchRequest fetchRequestWithEntityName:@"Book"];
+        fr.predicate = [NSPredicate predicateWithFormat:@"%K == %@",APObjectUIDAttributeName,kBookObjectUIDLocal1];
+        NSManagedObject* book = [[context executeFetchRequest:fr error:nil] lastObject];
+        XCTAssertTrue([[book valueForKey:APObjectIsDirtyAttributeName] boolValue]);
+        XCTAssertNil([book valueForKey:APObjectRemoteIDAttributeName]);
+        XCTAssertTrue([context countForFetchRequest:[NSFetchRequest fetchRequestWithEntityName:APOutboxEntityName] error:nil] == 0);
+    }];
+    
+    [cache resetCache];
+}
+
+
 #pragma mark - Support Methods
 
 - (NSMutableDictionary*) mapManagedObjectIDToObjectUID {
@@ -510,6 +1113,31 @@ static NSString* const APTestSqliteFile = @"APTestStore.sqlite";
 }
 
 
+// The cache model of the stores created up to 0.4.2, see -[APIncrementalStore cacheModelFromUserModel:previousVersion:]
+- (NSManagedObjectModel*) previousTestModel {
+    
+    NSManagedObjectModel* model = [self testModel];
+    NSArray* newPropertyNames = @[APObjectRemoteIDAttributeName,APObjectRelationMembersAttributeName];
+    NSMutableArray* entities = [NSMutableArray array];
+    
+    for (NSEntityDescription* entity in model.entities) {
+        
+        if ([entity.name isEqualToString:APOutboxEntityName]) {
+            continue;
+        }
+        
+        if (![entity superentity]) {
+            NSPredicate* previousProperties = [NSPredicate predicateWithFormat:@"NOT name IN %@",newPropertyNames];
+            [entity setProperties:[entity.properties filteredArrayUsingPredicate:previousProperties]];
+        }
+        [entities addObject:entity];
+    }
+    
+    [model setEntities:entities];
+    return model;
+}
+
+
 - (NSManagedObjectModel*) testModel {
     
     NSBundle *bundle = [NSBundle bundleForClass:[self class]];
@@ -563,6 +1191,13 @@ static NSString* const APTestSqliteFile = @"APTestStore.sqlite";
         [lastModifiedProperty setUserInfo:@{APIncrementalStorePrivateAttributeKey:@YES}];
         [additionalProperties addObject:lastModifiedProperty];
         
+        NSAttributeDescription *remoteIDProperty = [[NSAttributeDescription alloc] init];
+        [remoteIDProperty setName:APObjectRemoteIDAttributeName];
+        [remoteIDProperty setAttributeType:NSStringAttributeType];
+        [remoteIDProperty setIndexed:NO];
+        [remoteIDProperty setUserInfo:@{APIncrementalStorePrivateAttributeKey:@YES}];
+        [additionalProperties addObject:remoteIDProperty];
+        
         NSAttributeDescription *statusProperty = [[NSAttributeDescription alloc] init];
         [statusProperty setName:APObjectStatusAttributeName];
         [statusProperty setAttributeType:NSInteger16AttributeType];
@@ -590,8 +1225,38 @@ static NSString* const APTestSqliteFile = @"APTestStore.sqlite";
         [createdRemotelyProperty setUserInfo:@{APIncrementalStorePrivateAttributeKey:@YES}];
         [additionalProperties addObject:createdRemotelyProperty];
         
+        NSAttributeDescription *relationMembersProperty = [[NSAttributeDescription alloc] init];
+        [relationMembersProperty setName:APObjectRelationMembersAttributeName];
+        [relationMembersProperty setAttributeType:NSTransformableAttributeType];
+        [relationMembersProperty setIndexed:NO];
+        [relationMembersProperty setUserInfo:@{APIncrementalStorePrivateAttributeKey:@YES}];
+        [additionalProperties addObject:relationMembersProperty];
+        
         [entity setProperties:[entity.properties arrayByAddingObjectsFromArray:additionalProperties]];
     }
+    
+    NSEntityDescription* outboxEntity = [[NSEntityDescription alloc]init];
+    [outboxEntity setName:APOutboxEntityName];
+    
+    NSAttributeDescription *sequenceProperty = [[NSAttributeDescription alloc] init];
+    [sequenceProperty setName:APOutboxSequenceAttributeName];
+    [sequenceProperty setAttributeType:NSInteger64AttributeType];
+    [sequenceProperty setIndexed:YES];
+    [sequenceProperty setOptional:NO];
+    
+    NSAttributeDescription *outboxUIDProperty = [[NSAttributeDescription alloc] init];
+    [outboxUIDProperty setName:APObjectUIDAttributeName];
+    [outboxUIDProperty setAttributeType:NSStringAttributeType];
+    [outboxUIDProperty setOptional:NO];
+    
+    NSAttributeDescription *outboxEntityNameProperty = [[NSAttributeDescription alloc] init];
+    [outboxEntityNameProperty setName:APObjectEntityNameAttributeName];
+    [outboxEntityNameProperty setAttributeType:NSStringAttributeType];
+    [outboxEntityNameProperty setOptional:NO];
+    
+    [outboxEntity setProperties:@[sequenceProperty,outboxUIDProperty,outboxEntityNameProperty]];
+    [cacheModel setEntities:[cacheModel.entities arrayByAddingObject:outboxEntity]];
+    
     return cacheModel;
 }
 
@@ -20,6 +20,8 @@
 @import CoreData;
 
 #import "APParseSyncOperation.h"
+#import "APPagePrefetcher.h"
+#import "APDiskCache.h"
 
 #import "NSLogEmoji.h"
 #import "APCommon.h"
@@ -54,6 +56,26 @@ static NSString* const kMagazineNameLocal1 = @"Playboy";
 static NSString* const testSqliteFile = @"APParseConnectorTestFile.sqlite";
 
 
+@interface APParseSyncOperation (Testing)
+
+- (NSDictionary*) managedObjectsForSerializedParseObjects:(NSArray*) serializedParseObjects
+                                                inContext:(NSManagedObjectContext*) context
+                                       insertedObjectUIDs:(NSSet*__autoreleasing*) insertedObjectUIDs
+                                                    error:(NSError*__autoreleasing*) error;
+
+- (BOOL) populateParseObject:(PFObject*) parseObject
+           withManagedObject:(NSManagedObject*) managedObject
+                       error:(NSError *__autoreleasing*)error;
+
+- (void) acknowledgeRelationMembersOfManagedObject:(NSManagedObject*) managedObject;
+
+- (NSArray*) relatedObjectsOfParseObjects:(NSArray*) parseObjects
+                                forEntity:(NSEntityDescription*) entity
+                                    error:(NSError* __autoreleasing*) error;
+
+@end
+
+
 @interface APParseConnectorTestCase : XCTestCase
 
 @property (strong, nonatomic) NSManagedObjectModel* testModel;
@@ -254,6 +276,85 @@ static NSString* const testSqliteFile = @"APParseConnectorTestFile.sqlite";
 }
 
 
+/*
+ Scenario:
+ - 25 books are created at Parse in a single request, most of them will share the same updatedAt.
+ - Remote objects are pulled 4 at a time.
+
+ Expected Results:
+ - Every book is merged exactly once.
+ */
+- (void) testMergeRemoteObjectsInPages {
+
+    NSUInteger const numberOfBooks = 25;
+
+    __block BOOL done = NO;
+    dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+        NSMutableArray* books = [NSMutableArray arrayWithCapacity:numberOfBooks];
+        for (NSUInteger i = 0; i < numberOfBooks; i++) {
+            PFObject* book = [PFObject objectWithClassName:@"Book"];
+            [book setValue:[NSString stringWithFormat:@"book#%lu",(unsigned long) i] forKey:@"name"];
+            [book setValue:@(APObjectStatusCreated) forKey:APObjectStatusAttributeName];
+            [book setValue:[self createObjectUID] forKey:APObjectUIDAttributeName];
+            [book setValue:@"Book" forKeyPath:APObjectEntityNameAttributeName];
+            [books addObject:book];
+        }
+        [PFObject saveAll:books];
+        done = YES;
+    });
+    while (done == NO && WAIT_PATIENTLY);
+
+    APParseSyncOperation* parseSyncOperation = [self newParseSyncOperation];
+    parseSyncOperation.pullPageSize = 4;
+
+    done = NO;
+    [parseSyncOperation setSyncCompletionBlock:^(NSDictionary *mergedObjectsUIDsNestedByEntityName, NSError *operationError) {
+        XCTAssertNil(operationError, @"Sync error:%@",operationError);
+        done = YES;
+    }];
+    [self.syncQueue addOperation:parseSyncOperation];
+    while (done == NO && WAIT_PATIENTLY);
+
+    NSFetchRequest* booksFr = [NSFetchRequest fetchRequestWithEntityName:@"Book"];
+    NSArray* books = [self.testContext executeFetchRequest:booksFr error:nil];
+    XCTAssertEqual([books count], numberOfBooks + 2);
+    XCTAssertEqual([[NSSet setWithArray:[books valueForKey:APObjectUIDAttributeName]] count], numberOfBooks + 2);
+}
+
+
+/*
+ Expected Results:
+ - Each merged page is saved along with its entity sync date in the sync state.
+ */
+- (void) testMergeRemoteObjectsCommitsSyncDatesWithObjects {
+
+    APParseSyncOperation* parseSyncOperation = [self newParseSyncOperation];
+
+    __block BOOL done = NO;
+    [parseSyncOperation setSyncCompletionBlock:^(NSDictionary *mergedObjectsUIDsNestedByEntityName, NSError *operationError) {
+        XCTAssertNil(operationError, @"Sync error:%@",operationError);
+        done = YES;
+    }];
+    [self.syncQueue addOperation:parseSyncOperation];
+    while (done == NO && WAIT_PATIENTLY);
+
+    NSError* error;
+    NSFetchRequest* fr = [NSFetchRequest fetchRequestWithEntityName:APSyncStateEntityName];
+    NSManagedObject* syncState = [[self.testContext executeFetchRequest:fr error:&error] lastObject];
+    XCTAssertNil(error);
+    XCTAssertNotNil(syncState);
+
+    NSDictionary* syncDates = [syncState valueForKey:APSyncStateCursorsAttributeName];
+    XCTAssertNotNil(syncDates[@"Book"]);
+    XCTAssertNotNil(syncDates[@"Author"]);
+    
+    // Objects sharing the date of the last one synced are resumed after its objectUID
+    NSDictionary* syncObjectUIDs = [syncState valueForKey:APSyncStateCursorObjectUIDsAttributeName];
+    XCTAssertNotNil(syncObjectUIDs[@"Book"]);
+    XCTAssertNotNil(syncObjectUIDs[@"Author"]);
+}
+
+
 - (void) testMergeRemoteCreatedRelationship {
     
     __block NSError* error;
@@ -459,6 +560,441 @@ static NSString* const testSqliteFile = @"APParseConnectorTestFile.sqlite";
 }
 
 
+/*
+ Scenario:
+ - A book is created and left dirty by 0.4.2, whose cache store has neither an outbox nor a sync state.
+ - The store is opened (migrated) by the disk cache and synced using a local stand-in backend.
+
+ Expected Results:
+ - The book is found by the one-time scan for dirty objects and pushed, though it has no outbox entry.
+ - The outbox is recorded as seeded in the sync state.
+ */
+- (void) testMergeLocalSeedsOutboxOfMigratedStore {
+
+    NSError* error = nil;
+    NSURL* storeURL = [NSURL fileURLWithPath:[self pathToLocalStore]];
+    NSString* bookObjectUID = [self createObjectUID];
+    
+    NSManagedObjectModel* previousModel = [self previousTestModel];
+    NSPersistentStoreCoordinator* previousPSC = [[NSPersistentStoreCoordinator alloc]initWithManagedObjectModel:previousModel];
+    [previousPSC addPersistentStoreWithType:NSSQLiteStoreType configuration:nil URL:storeURL options:nil error:&error];
+    XCTAssertNil(error);
+    NSManagedObjectContext* previousContext = [[NSManagedObjectContext alloc]initWithConcurrencyType:NSMainQueueConcurrencyType];
+    previousContext.persistentStoreCoordinator = previousPSC;
+    
+    NSManagedObject* book = [NSEntityDescription insertNewObjectForEntityForName:@"Book" inManagedObjectContext:previousContext];
+    [book setValue:@YES forKey:APObjectIsDirtyAttributeName];
+    [book setValue:bookObjectUID forKey:APObjectUIDAttributeName];
+    [book setValue:kBookNameLocal1 forKey:@"name"];
+    XCTAssertTrue([previousContext save:&error]);
+    XCTAssertTrue([previousPSC removePersistentStore:[previousPSC.persistentStores firstObject] error:&error]);
+    
+    // Migrated by the disk cache before syncing, as APIncrementalStore does
+    NSManagedObjectModel* model = [self testModelWithOutbox];
+    APDiskCache* diskCache = [[APDiskCache alloc]initWithManagedModel:model
+                                                previousManagedModels:@[previousModel]
+                                            translateToObjectUIDBlock:^NSString* (NSManagedObjectID* objectID) {return nil;}
+                                                   localStoreFileName:testSqliteFile];
+    XCTAssertNotNil(diskCache);
+    [diskCache ap_willRemoveFromPersistentStoreCoordinator];
+    
+    NSPersistentStoreCoordinator* psc = [[NSPersistentStoreCoordinator alloc]initWithManagedObjectModel:model];
+    [psc addPersistentStoreWithType:NSSQLiteStoreType configuration:nil URL:storeURL options:@{NSSQLitePragmasOption:@{@"journal_mode":@"DELETE"}} error:&error];
+    XCTAssertNil(error);
+    
+    APLocalSyncBackend* backend = [[APLocalSyncBackend alloc]init];
+    APParseSyncOperation* parseSyncOperation = [[APParseSyncOperation alloc]initWithMergePolicy:APMergePolicyServerWins
+                                                                         authenticatedParseUser:[PFUser currentUser]
+                                                                     persistentStoreCoordinator:psc
+                                                                          sendPushNotifications:NO];
+    parseSyncOperation.backend = backend;
+
+    __block NSError* syncError;
+    __block BOOL done = NO;
+    [parseSyncOperation setSyncCompletionBlock:^(NSDictionary *mergedObjectsUIDsNestedByEntityName, NSError *operationError) {
+        syncError = operationError;
+        done = YES;
+    }];
+    [self.syncQueue addOperation:parseSyncOperation];
+    while (done == NO && WAIT_PATIENTLY);
+
+    XCTAssertNil(syncError);
+    XCTAssertTrue(backend.numberOfSavedObjects == 1);
+    
+    NSManagedObjectContext* checkContext = [[NSManagedObjectContext alloc]initWithConcurrencyType:NSMainQueueConcurrencyType];
+    checkContext.persistentStoreCoordinator = psc;
+    
+    NSFetchRequest* booksFetchRequest = [NSFetchRequest fetchRequestWithEntityName:@"Book"];
+    booksFetchRequest.predicate = [NSPredicate predicateWithFormat:@"%K == %@",APObjectUIDAttributeName,bookObjectUID];
+    NSManagedObject* syncedBook = [[checkContext executeFetchRequest:booksFetchRequest error:&error] lastObject];
+    XCTAssertNil(error);
+    XCTAssertFalse([[syncedBook valueForKey:APObjectIsDirtyAttributeName] boolValue]);
+    XCTAssertNotNil([syncedBook valueForKey:APObjectRemoteIDAttributeName]);
+    
+    NSFetchRequest* syncStateFetchRequest = [NSFetchRequest fetchRequestWithEntityName:APSyncStateEntityName];
+    NSArray* syncStates = [checkContext executeFetchRequest:syncStateFetchRequest error:&error];
+    XCTAssertNil(error);
+    XCTAssertTrue([[syncStates valueForKey:APSyncStateOutboxSeededAttributeName] containsObject:@YES]);
+}
+
+
+/*
+ Scenario:
+ - 500 books are created locally and pushed using a local stand-in backend that takes 10ms per round trip.
+ - One of the books is rejected by the backend.
+
+ Expected Results:
+ - Objects are sent 50 at a time, the failing batch is retried one by one.
+ - The error points to the rejected book, which remains dirty, while books acknowledged before it are not.
+ */
+- (void) testMergeLocalCreatedObjectsInBatches {
+
+    NSUInteger const numberOfBooks = 500;
+    NSString* failingObjectUID;
+
+    for (NSUInteger i = 0; i < numberOfBooks; i++) {
+        Book* book = [NSEntityDescription insertNewObjectForEntityForName:@"Book" inManagedObjectContext:self.testContext];
+        [book setValue:@YES forKey:APObjectIsDirtyAttributeName];
+        [book setValue:[self createObjectUID] forKey:APObjectUIDAttributeName];
+        book.name = [NSString stringWithFormat:@"book#%lu",(unsigned long) i];
+    }
+
+    NSError* error;
+    [self.testContext save:&error];
+    XCTAssertNil(error);
+
+    NSFetchRequest* booksFetchRequest = [NSFetchRequest fetchRequestWithEntityName:@"Book"];
+    booksFetchRequest.sortDescriptors = @[[NSSortDescriptor sortDescriptorWithKey:APObjectUIDAttributeName ascending:YES]];
+    NSArray* books = [self.testContext executeFetchRequest:booksFetchRequest error:&error];
+    failingObjectUID = [books[numberOfBooks - 10] valueForKey:APObjectUIDAttributeName];
+
+    APLocalSyncBackend* backend = [[APLocalSyncBackend alloc]init];
+    backend.simulatedLatency = 0.01;
+    backend.failingObjectUIDs = [NSSet setWithObject:failingObjectUID];
+
+    APParseSyncOperation* parseSyncOperation = [self newParseSyncOperation];
+    parseSyncOperation.backend = backend;
+    parseSyncOperation.pushBatchSize = 50;
+
+    __block NSError* syncError;
+    __block BOOL done = NO;
+    [parseSyncOperation setSyncCompletionBlock:^(NSDictionary *mergedObjectsUIDsNestedByEntityName, NSError *operationError) {
+        syncError = operationError;
+        done = YES;
+    }];
+    [self.syncQueue addOperation:parseSyncOperation];
+    while (done == NO && WAIT_PATIENTLY);
+
+    XCTAssertNotNil(syncError);
+    XCTAssertEqualObjects(syncError.userInfo[APObjectUIDAttributeName], failingObjectUID);
+    XCTAssertEqualObjects(syncError.userInfo[APObjectEntityNameAttributeName], @"Book");
+
+    // At most 10 batches plus the failing batch retried one by one until the culprit.
+    XCTAssertTrue(backend.numberOfRequests <= numberOfBooks / 50 + 50);
+    XCTAssertTrue(backend.numberOfSavedObjects < numberOfBooks);
+
+    // Whatever was acknowledged before the failure has been saved.
+    NSManagedObjectContext* checkContext = [[NSManagedObjectContext alloc]initWithConcurrencyType:NSMainQueueConcurrencyType];
+    checkContext.persistentStoreCoordinator = self.syncPSC;
+    booksFetchRequest.predicate = [NSPredicate predicateWithFormat:@"%K == YES",APObjectIsDirtyAttributeName];
+    NSArray* dirtyBooks = [checkContext executeFetchRequest:booksFetchRequest error:&error];
+    XCTAssertNil(error);
+    XCTAssertTrue([dirtyBooks count] > 0 && [dirtyBooks count] < numberOfBooks);
+    XCTAssertTrue([[dirtyBooks valueForKey:APObjectUIDAttributeName] containsObject:failingObjectUID]);
+}
+
+
+/*
+ Scenario:
+ - Nothing to push, every entity is pulled from a local stand-in backend that takes 200ms per round trip.
+
+ Expected Results:
+ - One query per entity plus the server time.
+ - Entities are pulled at the same time, the sync takes less than pulling them one after the other.
+ */
+- (void) testMergeRemoteObjectsPullsEntitiesConcurrently {
+
+    NSTimeInterval const latency = 0.2;
+    NSUInteger numberOfEntities = [self.testModel.entities count];
+
+    APLocalSyncBackend* backend = [[APLocalSyncBackend alloc]init];
+    backend.simulatedLatency = latency;
+
+    APParseSyncOperation* parseSyncOperation = [self newParseSyncOperation];
+    parseSyncOperation.backend = backend;
+    parseSyncOperation.pullConcurrency = numberOfEntities;
+
+    __block BOOL done = NO;
+    [parseSyncOperation setSyncCompletionBlock:^(NSDictionary *mergedObjectsUIDsNestedByEntityName, NSError *operationError) {
+        XCTAssertNil(operationError);
+        done = YES;
+    }];
+
+    NSDate* start = [NSDate date];
+    [self.syncQueue addOperation:parseSyncOperation];
+    while (done == NO && WAIT_PATIENTLY);
+    NSTimeInterval elapsed = [[NSDate date] timeIntervalSinceDate:start];
+
+    XCTAssertEqual(backend.numberOfRequests, numberOfEntities + 1);
+    XCTAssertTrue(elapsed < latency * (numberOfEntities + 1));
+}
+
+
+/*
+ Scenario:
+ - An author and a book are pushed to a local stand-in backend (its queries never return anything).
+ - A second book related to the same author is pushed afterwards.
+
+ Expected Results:
+ - Pushed objects keep their remote object id.
+ - The pointer to the author is built from its remote id, no query for it is needed.
+ */
+- (void) testMergeLocalCreatedRelationshipToOneUsesRemoteIDs {
+
+    Author* author = [NSEntityDescription insertNewObjectForEntityForName:@"Author" inManagedObjectContext:self.testContext];
+    [author setValue:@YES forKey:APObjectIsDirtyAttributeName];
+    [author setValue:[self createObjectUID] forKey:APObjectUIDAttributeName];
+    author.name = kAuthorNameLocal;
+
+    Book* book1 = [NSEntityDescription insertNewObjectForEntityForName:@"Book" inManagedObjectContext:self.testContext];
+    [book1 setValue:@YES forKey:APObjectIsDirtyAttributeName];
+    [book1 setValue:[self createObjectUID] forKey:APObjectUIDAttributeName];
+    book1.name = kBookNameLocal1;
+    book1.author = author;
+
+    NSError* error;
+    [self.testContext save:&error];
+    XCTAssertNil(error);
+
+    APLocalSyncBackend* backend = [[APLocalSyncBackend alloc]init];
+    __block NSError* syncError;
+    __block BOOL done = NO;
+    void (^syncCompletionBlock) (NSDictionary*, NSError*) = ^(NSDictionary *mergedObjectsUIDsNestedByEntityName, NSError *operationError) {
+        syncError = operationError;
+        done = YES;
+    };
+
+    APParseSyncOperation* parseSyncOperation = [self newParseSyncOperation];
+    parseSyncOperation.backend = backend;
+    [parseSyncOperation setSyncCompletionBlock:syncCompletionBlock];
+    [self.syncQueue addOperation:parseSyncOperation];
+    while (done == NO && WAIT_PATIENTLY);
+    XCTAssertNil(syncError);
+
+    [self.testContext refreshObject:author mergeChanges:NO];
+    XCTAssertNotNil([author valueForKey:APObjectRemoteIDAttributeName]);
+
+    Book* book2 = [NSEntityDescription insertNewObjectForEntityForName:@"Book" inManagedObjectContext:self.testContext];
+    [book2 setValue:@YES forKey:APObjectIsDirtyAttributeName];
+    [book2 setValue:[self createObjectUID] forKey:APObjectUIDAttributeName];
+    book2.name = kBookNameLocal2;
+    book2.author = author;
+    [self.testContext save:&error];
+    XCTAssertNil(error);
+
+    done = NO;
+    parseSyncOperation = [self newParseSyncOperation];
+    parseSyncOperation.backend = backend;
+    [parseSyncOperation setSyncCompletionBlock:syncCompletionBlock];
+    [self.syncQueue addOperation:parseSyncOperation];
+    while (done == NO && WAIT_PATIENTLY);
+    XCTAssertNil(syncError);
+
+    [self.testContext refreshObject:book2 mergeChanges:NO];
+    XCTAssertNotNil([book2 valueForKey:APObjectRemoteIDAttributeName]);
+    XCTAssertTrue([[book2 valueForKey:APObjectIsDirtyAttributeName] isEqualToNumber:@NO]);
+}
+
+
+/*
+ Scenario:
+ - Magazine authors are a PFRelation in this test (an Array in the test model).
+ - A magazine synced with authors 1 and 3 now has authors 1 and 2, author 2 hasn't been pushed yet.
+ 
+ Expected Results:
+ - Author 2 is the only one saved, author 3 the only one looked up to be removed, author 1 isn't sent at all.
+ - Once the magazine is acknowledged its members are authors 1 and 2, saved in the cache store along with it.
+ */
+- (void) testMergeLocalUpdatedRelationPushesOnlyChangedMembers {
+    
+    NSError* error;
+    NSPersistentStoreCoordinator* relationPSC = [self newInMemoryPSCWithMagazineAuthorsAsPFRelation];
+    NSManagedObjectContext* context = [[NSManagedObjectContext alloc]initWithConcurrencyType:NSMainQueueConcurrencyType];
+    context.persistentStoreCoordinator = relationPSC;
+    
+    NSManagedObject* author1 = [NSEntityDescription insertNewObjectForEntityForName:@"Author" inManagedObjectContext:context];
+    [author1 setValue:[self createObjectUID] forKey:APObjectUIDAttributeName];
+    [author1 setValue:@"author1" forKey:APObjectRemoteIDAttributeName];
+    [author1 setValue:@YES forKey:APObjectIsCreatedRemotelyAttributeName];
+    [author1 setValue:kAuthorNameLocal forKey:@"name"];
+    
+    NSManagedObject* author2 = [NSEntityDescription insertNewObjectForEntityForName:@"Author" inManagedObjectContext:context];
+    [author2 setValue:[self createObjectUID] forKey:APObjectUIDAttributeName];
+    [author2 setValue:kAuthorNameLocal2 forKey:@"name"];
+    
+    NSString* author3ObjectUID = [self createObjectUID];
+    
+    NSManagedObject* magazine = [NSEntityDescription insertNewObjectForEntityForName:@"Magazine" inManagedObjectContext:context];
+    [magazine setValue:[self createObjectUID] forKey:APObjectUIDAttributeName];
+    [magazine setValue:@"magazine" forKey:APObjectRemoteIDAttributeName];
+    [magazine setValue:@YES forKey:APObjectIsCreatedRemotelyAttributeName];
+    [magazine setValue:@YES forKey:APObjectIsDirtyAttributeName];
+    [magazine setValue:@{@"authors": @{[author1 valueForKey:APObjectUIDAttributeName]: @"Author", author3ObjectUID: @"Author"}} forKey:APObjectRelationMembersAttributeName];
+    [magazine setValue:kMagazineNameLocal1 forKey:@"name"];
+    [[magazine mutableSetValueForKey:@"authors"] addObjectsFromArray:@[author1,author2]];
+    
+    [context save:&error];
+    XCTAssertNil(error);
+    
+    APLocalSyncBackend* backend = [[APLocalSyncBackend alloc]init];
+    APParseSyncOperation* parseSyncOperation = [[APParseSyncOperation alloc]initWithMergePolicy:APMergePolicyServerWins
+                                                                         authenticatedParseUser:[PFUser currentUser]
+                                                                     persistentStoreCoordinator:relationPSC
+                                                                          sendPushNotifications:NO];
+    parseSyncOperation.backend = backend;
+    
+    PFObject* parseMagazine = [PFObject objectWithoutDataWithClassName:@"Magazine" objectId:@"magazine"];
+    XCTAssertTrue([parseSyncOperation populateParseObject:parseMagazine withManagedObject:magazine error:&error]);
+    XCTAssertNil(error);
+    XCTAssertTrue(backend.numberOfSavedObjects == 1);
+    XCTAssertTrue(backend.numberOfRequests == 2);
+    XCTAssertNotNil([author2 valueForKey:APObjectRemoteIDAttributeName]);
+    
+    // Not acknowledged yet, a failed push sends the same changes again
+    XCTAssertNotNil([magazine valueForKey:APObjectRelationMembersAttributeName][@"authors"][author3ObjectUID]);
+    
+    [parseSyncOperation acknowledgeRelationMembersOfManagedObject:magazine];
+    NSDictionary* expectedMembers = @{[author1 valueForKey:APObjectUIDAttributeName]: @"Author", [author2 valueForKey:APObjectUIDAttributeName]: @"Author"};
+    XCTAssertEqualObjects([magazine valueForKey:APObjectRelationMembersAttributeName][@"authors"], expectedMembers);
+    
+    // Saved along with the object
+    [context save:&error];
+    XCTAssertNil(error);
+    [context refreshObject:magazine mergeChanges:NO];
+    XCTAssertEqualObjects([magazine valueForKey:APObjectRelationMembersAttributeName][@"authors"], expectedMembers);
+}
+
+
+- (void) testSyncStateIsSavedInTheCacheStore {
+    
+    NSString* envID = [self createObjectUID];
+    __block NSError* syncError;
+    __block BOOL done = NO;
+    
+    APParseSyncOperation* parseSyncOperation = [self newParseSyncOperation];
+    parseSyncOperation.backend = [[APLocalSyncBackend alloc]init];
+    parseSyncOperation.envID = envID;
+    [parseSyncOperation setSyncCompletionBlock:^(NSDictionary *mergedObjectsUIDsNestedByEntityName, NSError *operationError) {
+        syncError = operationError;
+        done = YES;
+    }];
+    [self.syncQueue addOperation:parseSyncOperation];
+    while (done == NO && WAIT_PATIENTLY);
+    XCTAssertNil(syncError);
+    
+    NSFetchRequest* fr = [NSFetchRequest fetchRequestWithEntityName:APSyncStateEntityName];
+    fr.predicate = [NSPredicate predicateWithFormat:@"%K == %@",APSyncStateEnvIDAttributeName,envID];
+    NSError* error;
+    NSArray* syncStates = [self.testContext executeFetchRequest:fr error:&error];
+    XCTAssertNil(error);
+    XCTAssertTrue([syncStates count] == 1);
+    XCTAssertNotNil([[syncStates lastObject] valueForKey:APSyncStateServerTimeAttributeName]);
+    
+    // Nothing is written to NSUserDefaults anymore
+    NSString* userDefaultsKey = [NSString stringWithFormat:@"com.apetis.apincrementalstore.parseconnector.request.latestobjectsynced.key.%@",envID];
+    XCTAssertNil([[NSUserDefaults standardUserDefaults] objectForKey:userDefaultsKey]);
+}
+
+
+- (void) testSyncProgressIsReportedInAggregatedEvents {
+    
+    NSUInteger const numberOfBooks = 120;
+    for (NSUInteger idx = 0; idx < numberOfBooks; idx++) {
+        Book* book = [NSEntityDescription insertNewObjectForEntityForName:@"Book" inManagedObjectContext:self.testContext];
+        [book setValue:@YES forKey:APObjectIsDirtyAttributeName];
+        [book setValue:[self createObjectUID] forKey:APObjectUIDAttributeName];
+        book.name = kBookNameLocal1;
+    }
+    NSError* error;
+    [self.testContext save:&error];
+    XCTAssertNil(error);
+    
+    __block NSUInteger numberOfEvents = 0;
+    __block NSUInteger numberOfBooksSynced = 0;
+    __block NSUInteger numberOfPerObjectCalls = 0;
+    __block NSError* syncError;
+    __block BOOL done = NO;
+    
+    APParseSyncOperation* parseSyncOperation = [self newParseSyncOperation];
+    parseSyncOperation.backend = [[APLocalSyncBackend alloc]init];
+    parseSyncOperation.progressInterval = 60;
+    parseSyncOperation.progressObjectCount = 50;
+    [parseSyncOperation setProgressBlock:^(NSDictionary *remoteObjectsSyncedByEntityName, NSDictionary *localObjectsSyncedByEntityName) {
+        XCTAssertTrue([NSThread isMainThread]);
+        numberOfEvents++;
+        numberOfBooksSynced += [localObjectsSyncedByEntityName[@"Book"] unsignedIntegerValue];
+    }];
+    [parseSyncOperation setPerObjectCompletionBlock:^(BOOL isRemote, NSString *entityName) {
+        numberOfPerObjectCalls++;
+    }];
+    [parseSyncOperation setSyncCompletionBlock:^(NSDictionary *mergedObjectsUIDsNestedByEntityName, NSError *operationError) {
+        syncError = operationError;
+        done = YES;
+    }];
+    [self.syncQueue addOperation:parseSyncOperation];
+    while (done == NO && WAIT_PATIENTLY);
+    XCTAssertNil(syncError);
+    
+    // 50 + 50 by count, the remaining 20 before the completion block
+    XCTAssertTrue(numberOfEvents == 3);
+    XCTAssertTrue(numberOfBooksSynced == numberOfBooks);
+    XCTAssertTrue(numberOfPerObjectCalls == numberOfBooks);
+}
+
+
+- (void) testMergedChangesAreSentPageByPage {
+    
+    NSUInteger const numberOfBooks = 120;
+    for (NSUInteger idx = 0; idx < numberOfBooks; idx++) {
+        Book* book = [NSEntityDescription insertNewObjectForEntityForName:@"Book" inManagedObjectContext:self.testContext];
+        [book setValue:@YES forKey:APObjectIsDirtyAttributeName];
+        [book setValue:[self createObjectUID] forKey:APObjectUIDAttributeName];
+        book.name = kBookNameLocal1;
+    }
+    NSError* error;
+    [self.testContext save:&error];
+    XCTAssertNil(error);
+    
+    __block NSUInteger numberOfPages = 0;
+    NSMutableSet* bookUIDsFromPages = [NSMutableSet set];
+    __block NSDictionary* mergedObjects;
+    __block NSError* syncError;
+    __block BOOL done = NO;
+    
+    APParseSyncOperation* parseSyncOperation = [self newParseSyncOperation];
+    parseSyncOperation.backend = [[APLocalSyncBackend alloc]init];
+    parseSyncOperation.pushBatchSize = 50;
+    [parseSyncOperation setMergedChangesBlock:^(NSDictionary *objectUIDsNestedByEntityName) {
+        XCTAssertTrue([NSThread isMainThread]);
+        numberOfPages++;
+        [bookUIDsFromPages addObjectsFromArray:objectUIDsNestedByEntityName[@"Book"][NSUpdatedObjectsKey]];
+    }];
+    [parseSyncOperation setSyncCompletionBlock:^(NSDictionary *mergedObjectsUIDsNestedByEntityName, NSError *operationError) {
+        mergedObjects = mergedObjectsUIDsNestedByEntityName;
+        syncError = operationError;
+        done = YES;
+    }];
+    [self.syncQueue addOperation:parseSyncOperation];
+    while (done == NO && WAIT_PATIENTLY);
+    XCTAssertNil(syncError);
+    
+    // One per pushed batch, each object once in the accumulated result
+    XCTAssertTrue(numberOfPages == 3);
+    XCTAssertTrue([bookUIDsFromPages count] == numberOfBooks);
+    XCTAssertEqualObjects([NSSet setWithArray:mergedObjects[@"Book"][NSUpdatedObjectsKey]], bookUIDsFromPages);
+}
+
+
 - (void) testMergeLocalCreatedRelationshipToOne {
     
     // Create a local Book, mark is as "dirty" and set the objectUID with the predefined prefix
@@ -1302,6 +1838,165 @@ static NSString* const testSqliteFile = @"APParseConnectorTestFile.sqlite";
 }
 
 
+#pragma mark - Tests - Pull Pipeline
+
+/*
+ Scenario:
+ - 5 pages take 100ms each to be fetched and 100ms each to be consumed.
+
+ Expected Results:
+ - Pages are delivered in order.
+ - Fetching and consuming overlap, it takes clearly less than doing one after the other.
+ */
+- (void) testPagePrefetcherOverlapsFetchingAndConsuming {
+
+    NSUInteger const numberOfPages = 5;
+    NSTimeInterval const stageTime = 0.1;
+
+    __block NSUInteger fetchedPages = 0;
+    APPagePrefetcher* prefetcher = [[APPagePrefetcher alloc]initWithDepth:2 fetchBlock:^id(BOOL *isLastPage, NSError *__autoreleasing *error) {
+        [NSThread sleepForTimeInterval:stageTime];
+        fetchedPages++;
+        *isLastPage = (fetchedPages == numberOfPages);
+        return @(fetchedPages);
+    }];
+
+    NSDate* start = [NSDate date];
+    [prefetcher start];
+
+    NSMutableArray* consumedPages = [NSMutableArray array];
+    NSError* error = nil;
+    id page;
+    while ((page = [prefetcher nextPage:&error])) {
+        [consumedPages addObject:page];
+        [NSThread sleepForTimeInterval:stageTime];
+    }
+    NSTimeInterval elapsed = [[NSDate date] timeIntervalSinceDate:start];
+
+    XCTAssertNil(error);
+    XCTAssertEqualObjects(consumedPages, (@[@1,@2,@3,@4,@5]));
+    XCTAssertTrue(elapsed < stageTime * numberOfPages * 2 * 0.75);
+    XCTAssertTrue(prefetcher.consumerStallTime < stageTime * 2);
+}
+
+
+/*
+ Scenario:
+ - A page has a new Author related to an existing Book and a new EBook, and a Book deleted at Parse that doesn't exist locally.
+
+ Expected Results:
+ - All objects are resolved by root entity, the missing ones are created as created remotely.
+ - The deleted Book isn't created.
+ */
+- (void) testResolveManagedObjectsForPage {
+
+    NSString* authorObjectUID = [self createObjectUID];
+    NSString* existingBookObjectUID = [self createObjectUID];
+    NSString* newEBookObjectUID = [self createObjectUID];
+    NSString* deletedBookObjectUID = [self createObjectUID];
+
+    Book* existingBook = [NSEntityDescription insertNewObjectForEntityForName:@"Book" inManagedObjectContext:self.testContext];
+    [existingBook setValue:existingBookObjectUID forKey:APObjectUIDAttributeName];
+    XCTAssertTrue([self.testContext save:nil]);
+
+    NSArray* serializedParseObjects = @[@{APObjectUIDAttributeName: authorObjectUID,
+                                          APObjectEntityNameAttributeName: @"Author",
+                                          APObjectStatusAttributeName: @(APObjectStatusCreated),
+                                          @"books": @[@{APObjectUIDAttributeName: existingBookObjectUID, APObjectEntityNameAttributeName: @"Book"},
+                                                      @{APObjectUIDAttributeName: newEBookObjectUID, APObjectEntityNameAttributeName: @"EBook"}]},
+                                        @{APObjectUIDAttributeName: deletedBookObjectUID,
+                                          APObjectEntityNameAttributeName: @"Book",
+                                          APObjectStatusAttributeName: @(APObjectStatusDeleted)}];
+
+    APParseSyncOperation* parseSyncOperation = [self newParseSyncOperation];
+    NSSet* insertedObjectUIDs = nil;
+    NSError* error = nil;
+    NSDictionary* resolvedManagedObjects = [parseSyncOperation managedObjectsForSerializedParseObjects:serializedParseObjects
+                                                                                              inContext:self.testContext
+                                                                                     insertedObjectUIDs:&insertedObjectUIDs
+                                                                                                  error:&error];
+    XCTAssertNil(error);
+    XCTAssertEqualObjects(insertedObjectUIDs, ([NSSet setWithObjects:authorObjectUID,newEBookObjectUID,nil]));
+
+    XCTAssertEqualObjects(resolvedManagedObjects[@"Book"][existingBookObjectUID], existingBook);
+    XCTAssertEqualObjects([resolvedManagedObjects[@"Book"][newEBookObjectUID] entity].name, @"EBook");
+    XCTAssertEqualObjects([resolvedManagedObjects[@"Author"][authorObjectUID] valueForKey:APObjectIsCreatedRemotelyAttributeName], @YES);
+    XCTAssertNil(resolvedManagedObjects[@"Book"][deletedBookObjectUID]);
+}
+
+
+/*
+ Scenario:
+ - Magazine authors are a PFRelation in this test (an Array in the test model).
+ - A page with two magazines, the first related to authors 1 and 2 and the second to author 3.
+ - A page with two authors, author 1 with a PFRelation to magazine 1 (Array inverse) and the
+   author created at setUp with a PFRelation to its books (To-One inverse).
+ 
+ Expected Results:
+ - Each magazine gets its own authors, in the same order as the page.
+ - The authors' relations aren't queried, as before.
+ */
+- (void) testRelatedObjectsOfParseObjectsArePerObject {
+    
+    NSError* error;
+    NSMutableArray* parseAuthors = [NSMutableArray array];
+    for (NSUInteger i = 0; i < 3; i++) {
+        PFObject* parseAuthor = [PFObject objectWithClassName:@"Author"];
+        parseAuthor[@"name"] = [NSString stringWithFormat:@"author#%lu",(unsigned long) i];
+        parseAuthor[APObjectStatusAttributeName] = @(APObjectStatusCreated);
+        parseAuthor[APObjectUIDAttributeName] = [self createObjectUID];
+        parseAuthor[APObjectEntityNameAttributeName] = @"Author";
+        [parseAuthors addObject:parseAuthor];
+    }
+    XCTAssertTrue([PFObject saveAll:parseAuthors error:&error]);
+    
+    PFObject* parseMagazine1 = [PFObject objectWithClassName:@"Magazine"];
+    parseMagazine1[@"name"] = kMagazineNameLocal1;
+    parseMagazine1[APObjectUIDAttributeName] = [self createObjectUID];
+    parseMagazine1[APObjectEntityNameAttributeName] = @"Magazine";
+    [[parseMagazine1 relationForKey:@"authors"] addObject:parseAuthors[0]];
+    [[parseMagazine1 relationForKey:@"authors"] addObject:parseAuthors[1]];
+    
+    PFObject* parseMagazine2 = [PFObject objectWithClassName:@"Magazine"];
+    parseMagazine2[@"name"] = kMagazineNameLocal1;
+    parseMagazine2[APObjectUIDAttributeName] = [self createObjectUID];
+    parseMagazine2[APObjectEntityNameAttributeName] = @"Magazine";
+    [[parseMagazine2 relationForKey:@"authors"] addObject:parseAuthors[2]];
+    XCTAssertTrue([PFObject saveAll:@[parseMagazine1,parseMagazine2] error:&error]);
+    
+    [[parseAuthors[0] relationForKey:@"magazines"] addObject:parseMagazine1];
+    XCTAssertTrue([parseAuthors[0] save:&error]);
+    
+    PFQuery* authorQuery = [PFQuery queryWithClassName:@"Author"];
+    [authorQuery whereKey:@"name" equalTo:kAuthorNameParse];
+    PFObject* parseAuthorWithBooks = [authorQuery getFirstObject:&error];
+    XCTAssertNotNil(parseAuthorWithBooks);
+    
+    NSPersistentStoreCoordinator* relationPSC = [self newInMemoryPSCWithMagazineAuthorsAsPFRelation];
+    APParseSyncOperation* relationSyncOperation = [[APParseSyncOperation alloc]initWithMergePolicy:APMergePolicyServerWins
+                                                                            authenticatedParseUser:[PFUser currentUser]
+                                                                        persistentStoreCoordinator:relationPSC
+                                                                             sendPushNotifications:NO];
+    NSEntityDescription* magazineEntity = relationPSC.managedObjectModel.entitiesByName[@"Magazine"];
+    NSArray* relatedObjects = [relationSyncOperation relatedObjectsOfParseObjects:@[parseMagazine1,parseMagazine2] forEntity:magazineEntity error:&error];
+    XCTAssertNil(error);
+    XCTAssertTrue([relatedObjects count] == 2);
+    
+    NSSet* (^objectUIDs)(NSArray*) = ^NSSet* (NSArray* objects) {
+        return [NSSet setWithArray:[objects valueForKey:APObjectUIDAttributeName]];
+    };
+    XCTAssertEqualObjects(objectUIDs(relatedObjects[0][@"authors"]), objectUIDs(@[parseAuthors[0],parseAuthors[1]]));
+    XCTAssertEqualObjects(objectUIDs(relatedObjects[1][@"authors"]), objectUIDs(@[parseAuthors[2]]));
+    XCTAssertEqualObjects([relatedObjects[0][@"authors"] valueForKey:APObjectEntityNameAttributeName], (@[@"Author",@"Author"]));
+    
+    APParseSyncOperation* parseSyncOperation = [self newParseSyncOperation];
+    NSEntityDescription* authorEntity = self.testModel.entitiesByName[@"Author"];
+    relatedObjects = [parseSyncOperation relatedObjectsOfParseObjects:@[parseAuthors[0],parseAuthorWithBooks] forEntity:authorEntity error:&error];
+    XCTAssertNil(error);
+    XCTAssertEqualObjects(relatedObjects, (@[@{},@{}]));
+}
+
+
 #pragma mark - Support Methods
 
 - (NSString*) createObjectUID {
@@ -1411,6 +2106,12 @@ static NSString* const testSqliteFile = @"APParseConnectorTestFile.sqlite";
             [lastModifiedProperty setIndexed:NO];
             [additionalProperties addObject:lastModifiedProperty];
             
+            NSAttributeDescription *remoteIDProperty = [[NSAttributeDescription alloc] init];
+            [remoteIDProperty setName:APObjectRemoteIDAttributeName];
+            [remoteIDProperty setAttributeType:NSStringAttributeType];
+            [remoteIDProperty setIndexed:NO];
+            [additionalProperties addObject:remoteIDProperty];
+            
             NSAttributeDescription *statusProperty = [[NSAttributeDescription alloc] init];
             [statusProperty setName:APObjectStatusAttributeName];
             [statusProperty setAttributeType:NSInteger16AttributeType];
@@ -1435,9 +2136,48 @@ static NSString* const testSqliteFile = @"APParseConnectorTestFile.sqlite";
             [isDirtyProperty setDefaultValue:@NO];
             [additionalProperties addObject:isDirtyProperty];
             
+            NSAttributeDescription *relationMembersProperty = [[NSAttributeDescription alloc] init];
+            [relationMembersProperty setName:APObjectRelationMembersAttributeName];
+            [relationMembersProperty setAttributeType:NSTransformableAttributeType];
+            [relationMembersProperty setIndexed:NO];
+            [additionalProperties addObject:relationMembersProperty];
+            
             [entity setProperties:[entity.properties arrayByAddingObjectsFromArray:additionalProperties]];
         }
         
+        NSEntityDescription* syncStateEntity = [[NSEntityDescription alloc]init];
+        [syncStateEntity setName:APSyncStateEntityName];
+        
+        NSAttributeDescription *keyProperty = [[NSAttributeDescription alloc] init];
+        [keyProperty setName:APSyncStateKeyAttributeName];
+        [keyProperty setAttributeType:NSStringAttributeType];
+        [keyProperty setIndexed:YES];
+        [keyProperty setOptional:NO];
+        
+        NSAttributeDescription *cursorsProperty = [[NSAttributeDescription alloc] init];
+        [cursorsProperty setName:APSyncStateCursorsAttributeName];
+        [cursorsProperty setAttributeType:NSTransformableAttributeType];
+        
+        NSAttributeDescription *cursorObjectUIDsProperty = [[NSAttributeDescription alloc] init];
+        [cursorObjectUIDsProperty setName:APSyncStateCursorObjectUIDsAttributeName];
+        [cursorObjectUIDsProperty setAttributeType:NSTransformableAttributeType];
+        
+        NSAttributeDescription *serverTimeProperty = [[NSAttributeDescription alloc] init];
+        [serverTimeProperty setName:APSyncStateServerTimeAttributeName];
+        [serverTimeProperty setAttributeType:NSDateAttributeType];
+        
+        NSAttributeDescription *envIDProperty = [[NSAttributeDescription alloc] init];
+        [envIDProperty setName:APSyncStateEnvIDAttributeName];
+        [envIDProperty setAttributeType:NSStringAttributeType];
+        
+        NSAttributeDescription *outboxSeededProperty = [[NSAttributeDescription alloc] init];
+        [outboxSeededProperty setName:APSyncStateOutboxSeededAttributeName];
+        [outboxSeededProperty setAttributeType:NSBooleanAttributeType];
+        [outboxSeededProperty setDefaultValue:@NO];
+        
+        [syncStateEntity setProperties:@[keyProperty,cursorsProperty,cursorObjectUIDsProperty,serverTimeProperty,envIDProperty,outboxSeededProperty]];
+        [model setEntities:[model.entities arrayByAddingObject:syncStateEntity]];
+        
          _testModel = model;
     }
     
@@ -1445,6 +2185,62 @@ static NSString* const testSqliteFile = @"APParseConnectorTestFile.sqlite";
 }
 
 
+// The test model as APIncrementalStore builds it, with the outbox entity.
+- (NSManagedObjectModel*) testModelWithOutbox {
+    
+    NSManagedObjectModel* model = [self.testModel copy];
+    
+    NSEntityDescription* outboxEntity = [[NSEntityDescription alloc]init];
+    [outboxEntity setName:APOutboxEntityName];
+    
+    NSAttributeDescription *sequenceProperty = [[NSAttributeDescription alloc] init];
+    [sequenceProperty setName:APOutboxSequenceAttributeName];
+    [sequenceProperty setAttributeType:NSInteger64AttributeType];
+    [sequenceProperty setIndexed:YES];
+    [sequenceProperty setOptional:NO];
+    
+    NSAttributeDescription *outboxUIDProperty = [[NSAttributeDescription alloc] init];
+    [outboxUIDProperty setName:APObjectUIDAttributeName];
+    [outboxUIDProperty setAttributeType:NSStringAttributeType];
+    [outboxUIDProperty setOptional:NO];
+    
+    NSAttributeDescription *outboxEntityNameProperty = [[NSAttributeDescription alloc] init];
+    [outboxEntityNameProperty setName:APObjectEntityNameAttributeName];
+    [outboxEntityNameProperty setAttributeType:NSStringAttributeType];
+    [outboxEntityNameProperty setOptional:NO];
+    
+    [outboxEntity setProperties:@[sequenceProperty,outboxUIDProperty,outboxEntityNameProperty]];
+    [model setEntities:[model.entities arrayByAddingObject:outboxEntity]];
+    
+    return model;
+}
+
+
+// The test model as 0.4.2 built it: no remote ID and relation members attributes, no sync state.
+- (NSManagedObjectModel*) previousTestModel {
+    
+    NSManagedObjectModel* model = [self.testModel copy];
+    NSArray* newPropertyNames = @[APObjectRemoteIDAttributeName,APObjectRelationMembersAttributeName];
+    NSMutableArray* entities = [NSMutableArray array];
+    
+    for (NSEntityDescription* entity in model.entities) {
+        
+        if ([entity.name isEqualToString:APSyncStateEntityName]) {
+            continue;
+        }
+        
+        if (![entity superentity]) {
+            NSPredicate* previousProperties = [NSPredicate predicateWithFormat:@"NOT name IN %@",newPropertyNames];
+            [entity setProperties:[entity.properties filteredArrayUsingPredicate:previousProperties]];
+        }
+        [entities addObject:entity];
+    }
+    
+    [model setEntities:entities];
+    return model;
+}
+
+
 - (NSManagedObjectContext*) testContext {
     
     if (!_testContext) {
@@ -1496,6 +2292,26 @@ static NSString* const testSqliteFile = @"APParseConnectorTestFile.sqlite";
 }
 
 
+/*
+ The test model with Magazine authors as a PFRelation (an Array in the test model),
+ on an in-memory store.
+ */
+- (NSPersistentStoreCoordinator*) newInMemoryPSCWithMagazineAuthorsAsPFRelation {
+    
+    NSManagedObjectModel* relationModel = [self.testModel copy];
+    NSRelationshipDescription* authorsRelationship = [relationModel.entitiesByName[@"Magazine"] relationshipsByName][@"authors"];
+    authorsRelationship.userInfo = @{APParseRelationshipTypeUserInfoKey: [@(APParseRelationshipTypePFRelation) stringValue]};
+    
+    NSPersistentStoreCoordinator* psc = [[NSPersistentStoreCoordinator alloc]initWithManagedObjectModel:relationModel];
+    NSError* error = nil;
+    [psc addPersistentStoreWithType:NSInMemoryStoreType configuration:nil URL:nil options:nil error:&error];
+    if (error) {
+        NSLog(@"Error adding store to PSC:%@",error);
+    }
+    return psc;
+}
+
+
 - (NSString *)documentsDirectory {
     
     NSString *documentsDirectory = nil;
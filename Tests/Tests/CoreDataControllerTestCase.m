@@ -857,6 +857,38 @@ Expected Results:
 }
 
 
+- (void) testFetchObjectIDsMatchFetchedObjects {
+    
+    NSError* fetchError;
+    NSFetchRequest* fr = [NSFetchRequest fetchRequestWithEntityName:@"Book"];
+    fr.sortDescriptors = @[[NSSortDescriptor sortDescriptorWithKey:@"name" ascending:YES]];
+    NSArray* books = [self.coreDataController.mainContext executeFetchRequest:fr error:&fetchError];
+    XCTAssertNil(fetchError);
+    XCTAssertTrue([books count] > 0);
+    
+    fr.resultType = NSManagedObjectIDResultType;
+    NSArray* bookIDs = [self.coreDataController.mainContext executeFetchRequest:fr error:&fetchError];
+    XCTAssertNil(fetchError);
+    XCTAssertEqualObjects(bookIDs, [books valueForKey:@"objectID"]);
+}
+
+
+- (void) testFetchDictionaryTranslatesOnlyRelationshipsToObjectIDs {
+    
+    NSError* fetchError;
+    Book* fetchedBook = [self fetchBook];
+    
+    NSFetchRequest* fr = [NSFetchRequest fetchRequestWithEntityName:@"Book"];
+    fr.resultType = NSDictionaryResultType;
+    fr.predicate = [NSPredicate predicateWithFormat:@"self == %@",fetchedBook];
+    fr.propertiesToFetch = @[@"name",@"author"];
+    NSDictionary* result = [[self.coreDataController.mainContext executeFetchRequest:fr error:&fetchError] lastObject];
+    XCTAssertNil(fetchError);
+    XCTAssertEqualObjects(result[@"name"], fetchedBook.name);
+    XCTAssertEqualObjects(result[@"author"], fetchedBook.author.objectID);
+}
+
+
 - (void) testFetchUsing_IN_inThePredicate {
  
     /* 